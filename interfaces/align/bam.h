@@ -549,6 +549,18 @@ ALIGN_EXTERN rc_t CC BAMFileVMakeWithDir ( const BAMFile **result,
 ALIGN_EXTERN rc_t CC BAMFileMakeWithKFile(const BAMFile **result,
     struct KFile const *file);
 
+/* MakeWithKFileAndThreads
+ *  open the BAM file specified by file and inflate it on background threads
+ *
+ *  "file" [ IN ] - an open KFile
+ *
+ *  "threads" [ IN ] - number of threads inflating BGZF blocks,
+ *  0 is the same as BAMFileMakeWithKFile. the file can only be
+ *  read front to back, BAMFileSetPosition and BAMFileRewind fail
+ */
+ALIGN_EXTERN rc_t CC BAMFileMakeWithKFileAndThreads(const BAMFile **result,
+    struct KFile const *file, unsigned threads);
+
 /* Make
  *  open the BAM file specified by file
  *
@@ -620,6 +632,65 @@ ALIGN_EXTERN rc_t CC BAMFileRead ( const BAMFile *self, const BAMAlignment **res
 ALIGN_EXTERN rc_t CC BAMFileRead2 ( const BAMFile *self, const BAMAlignment **result );
 
 
+/*--------------------------------------------------------------------------
+ * BAMAlignmentBatch
+ *  consecutive alignments decoded into parallel arrays
+ *
+ *  "record" [ i ] points to the raw BAM record of the i'th alignment,
+ *  just past its block_size, "recordSize" [ i ] is the size of the record.
+ *  the offsets are relative to "record" [ i ]; the read name starts at
+ *  32, the tags run from "tagOffset" [ i ] to the end of the record.
+ *  all values are in host byte order, the record itself is as in the file.
+ */
+typedef struct BAMAlignmentBatch BAMAlignmentBatch;
+struct BAMAlignmentBatch
+{
+    const uint8_t **record;
+    uint32_t *recordSize;
+    int32_t *refSeqId;
+    int32_t *position;
+    int32_t *mateRefSeqId;
+    int32_t *matePosition;
+    int32_t *insertSize;
+    uint32_t *readLen;
+    uint32_t *cigarOffset;
+    uint32_t *seqOffset;
+    uint32_t *qualOffset;
+    uint32_t *tagOffset;
+    uint16_t *cigarCount;
+    uint16_t *flags;
+    uint8_t *mapQual;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+/* Make
+ *  make a batch holding up to "capacity" alignments
+ */
+ALIGN_EXTERN rc_t CC BAMAlignmentBatchMake ( BAMAlignmentBatch **result, uint32_t capacity );
+
+/* Release
+ */
+ALIGN_EXTERN rc_t CC BAMAlignmentBatchRelease ( BAMAlignmentBatch *self );
+
+/* ReadBatch
+ *  read up to batch->capacity alignments
+ *
+ *  the records are not copied but point into the decompressed data and
+ *  are valid until the next read from the file. a batch stops at the end
+ *  of a BGZF block, so fewer records than asked for are normal; only a
+ *  record that spans blocks is copied and then starts the batch.
+ *
+ *  returns:
+ *    RC(..., ..., ..., rcRow, rcNotFound) at end
+ *    RC(..., ..., ..., rcData, rcInvalid) if a record's size is not
+ *      positive, as BAMFileRead2 does
+ *    RC(..., ..., ..., rcRow, rcInvalid) if a record is malformed
+ *  in both error cases the records before the bad one are in the batch
+ */
+ALIGN_EXTERN rc_t CC BAMFileReadBatch ( const BAMFile *self, BAMAlignmentBatch *batch );
+
+
 /* Rewind
  *  reset the position back to the first aligment in the file
  */
@@ -690,6 +761,9 @@ ALIGN_EXTERN rc_t CC BAMFileGetReadGroupByName ( const BAMFile *self,
 
 /* OpenIndex
  *  takes a simple path...
+ *  reads BAI and CSI indices, CSI plain or BGZF compressed;
+ *  BAMFileSeek needs a BAI index,
+ *  region queries work with either
  */
 ALIGN_EXTERN rc_t CC BAMFileOpenIndex ( const BAMFile *self, const char *path );
 
@@ -711,6 +785,54 @@ ALIGN_EXTERN bool CC BAMFileIndexHasRefSeqId ( const BAMFile *self, uint32_t ref
  */
 ALIGN_EXTERN rc_t CC BAMFileSeek ( const BAMFile *self, uint32_t refSeqId, uint64_t alignStart, uint64_t alignEnd );
 
+
+/*--------------------------------------------------------------------------
+ * BAMRegionQuery
+ *  the alignments overlapping a list of regions, found through the index
+ */
+typedef struct BAMRegion BAMRegion;
+struct BAMRegion
+{
+    uint32_t refSeqId;
+    uint64_t start; /* zero-based */
+    uint64_t end;   /* exclusive */
+};
+
+typedef struct BAMRegionQuery BAMRegionQuery;
+
+/* MakeRegionQuery
+ *  resolve the regions to the chunks of the file holding their alignments
+ *
+ *  "regions" [ IN ] and "count" [ IN ] - the regions, copied
+ *
+ *  "threads" [ IN ] - number of threads reading and inflating chunks
+ *  ahead of the reader; 0 reads each chunk when it is needed.
+ *  read-ahead is limited to 4MB of fetched data per thread.
+ *  the file is read concurrently through its KFile.
+ */
+ALIGN_EXTERN rc_t CC BAMFileMakeRegionQuery ( const BAMFile *self, BAMRegionQuery **result,
+    const BAMRegion regions [], uint32_t count, uint32_t threads );
+
+/* Read
+ *  read the next alignment
+ *  the regions are done in the order given, the alignments of a region
+ *  in file order; an alignment overlapping several regions is read once
+ *  for each of them.
+ *
+ *  "region" [ OUT ] - index of the region the alignment overlaps
+ *
+ *  "result" [ OUT ] - return param for BAMAlignment object
+ *   must be released with BAMAlignmentRelease
+ *
+ *  returns RC(..., ..., ..., rcRow, rcNotFound) at end
+ */
+ALIGN_EXTERN rc_t CC BAMRegionQueryRead ( BAMRegionQuery *self, uint32_t *region,
+    const BAMAlignment **result );
+
+/* Release
+ */
+ALIGN_EXTERN rc_t CC BAMRegionQueryRelease ( BAMRegionQuery *self );
+
 typedef uint32_t BAMValidateOption;
 enum BAMValidateOptions {
     /* this is the minimum level of BAM file validation; just walks the compressed block headers */
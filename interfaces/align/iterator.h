@@ -483,6 +483,43 @@ ALIGN_EXTERN rc_t CC PlacementSetIteratorNextIdAt ( PlacementSetIterator *self,
     INSDC_coord_zero pos, int64_t *row_id, INSDC_coord_len *len );
 
 
+/* WalkShards
+ *  sharded alternative to NextReference / NextWindow / NextAvailPos / NextRecordAt:
+ *  cuts every window not yet handed out by NextReference into shards
+ *  and walks them on several threads. the set is consumed.
+ *
+ *  "shard_len" [ IN ] - length of a shard on the reference, 0 for one shard per window
+ *
+ *  "num_threads" [ IN ] - number of workers
+ *
+ *  "ordered" [ IN ] - if true "visit" is called on the calling thread,
+ *  in the order the unsharded iteration produces placements.
+ *  if false "visit" is called from the workers as they go, and must be thread-safe.
+ *
+ *  "make" [ IN ] - called on a worker to create a placement-iterator over
+ *  [ first_pos, first_pos + len ) that replaces "origin", one of the iterators
+ *  added to the set. cursors can not be shared between threads, so it has to
+ *  use resources private to "worker" ( 0 .. num_threads - 1 ).
+ *
+ *  "visit" [ IN ] - receives every placement exactly once and owns it
+ *  ( PlacementRecordWhack ). a placement spanning shards is reported by
+ *  the shard containing its position. "worker" is the one whose
+ *  iterator produced it.
+ *
+ *  returns the first failure in reference order
+ */
+typedef rc_t ( CC * PlacementSetShardMakeFunc ) ( PlacementIterator **pi,
+    const PlacementIterator *origin, INSDC_coord_zero first_pos, INSDC_coord_len len,
+    uint32_t worker, void *data );
+
+typedef rc_t ( CC * PlacementSetShardVisitFunc ) ( const PlacementRecord *rec,
+    uint32_t worker, void *data );
+
+ALIGN_EXTERN rc_t CC PlacementSetIteratorWalkShards ( PlacementSetIterator *self,
+    INSDC_coord_len shard_len, uint32_t num_threads, bool ordered,
+    PlacementSetShardMakeFunc make, PlacementSetShardVisitFunc visit, void *data );
+
+
 /*--------------------------------------------------------------------------
  * ReferenceIterator
  *  walk across placements from an alignment db within a reference window
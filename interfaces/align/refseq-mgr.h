@@ -52,6 +52,38 @@ ALIGN_EXTERN rc_t CC RefSeqMgr_Release(const RefSeqMgr* cself);
 
 ALIGN_EXTERN rc_t CC RefSeqMgr_SetCache(RefSeqMgr const *const cself, size_t cache, uint32_t keep_open_num);
 
+/* Chunk cache of decoded reference bases, keyed by (accession, chunk),
+   shared by any number of managers (e.g. one per thread)
+    memory [IN] - budget for cached chunks; least recently used chunks are evicted
+ */
+typedef struct RefSeqChunkCache RefSeqChunkCache;
+
+typedef struct RefSeqChunkCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t waits;     /* hits on a chunk still being read ahead */
+    uint64_t readahead; /* chunks queued for reading ahead */
+    uint64_t failed;    /* chunks queued but not read ahead, left to the readers */
+    uint64_t evicted;
+    size_t used;
+    rc_t failure;       /* why the last of the failed was not read ahead */
+} RefSeqChunkCacheStats;
+
+ALIGN_EXTERN rc_t CC RefSeqChunkCache_Make(RefSeqChunkCache **cache, size_t memory);
+
+ALIGN_EXTERN rc_t CC RefSeqChunkCache_AddRef(RefSeqChunkCache const *cself);
+
+ALIGN_EXTERN rc_t CC RefSeqChunkCache_Release(RefSeqChunkCache const *cself);
+
+ALIGN_EXTERN rc_t CC RefSeqChunkCache_GetStats(RefSeqChunkCache const *cself, RefSeqChunkCacheStats *stats);
+
+/* Serve reads through a chunk cache, NULL to detach
+    readahead [IN] - number of chunks past each read to decode in the background, 0 - none;
+                     uses a private reader on the caller's VFS manager, so it costs one more
+                     open reference; chunks it fails to read are counted in the cache's stats
+ */
+ALIGN_EXTERN rc_t CC RefSeqMgr_SetChunkCache(RefSeqMgr const *cself, RefSeqChunkCache *cache, uint32_t readahead);
+
 /* return value if 0 means object was found, path is optional */
 ALIGN_EXTERN rc_t RefSeqMgr_Exists(const RefSeqMgr* cself, const char* accession, uint32_t accession_sz, char** path);
 
@@ -74,6 +74,10 @@ ALIGN_EXTERN rc_t CC ReferenceMgr_Release(const ReferenceMgr *cself,
 
 ALIGN_EXTERN rc_t CC ReferenceMgr_SetCache(ReferenceMgr const *const self, size_t cache, uint32_t num_open);
 
+/* see RefSeqMgr_SetChunkCache */
+struct RefSeqChunkCache;
+ALIGN_EXTERN rc_t CC ReferenceMgr_SetChunkCache(ReferenceMgr const *const self, struct RefSeqChunkCache *cache, uint32_t readahead);
+
 typedef struct ReferenceSeq ReferenceSeq;
 
 /* id: chr12 or NC_000001.3 */
@@ -143,6 +147,46 @@ ALIGN_EXTERN rc_t CC ReferenceSeq_Compress(const ReferenceSeq* cself,
                                            uint32_t allele_cigar_len,
                                            uint8_t rna_orient,
                                            TableWriterAlgnData* data);
+
+/* one alignment of a ReferenceSeq_CompressBatch call; the arguments are those
+   of ReferenceSeq_Compress. Reads of the same alignment record (ploidy > 1)
+   share 'data' and must be next to each other, they are compressed in order.
+   rc [OUT] - result for this alignment
+ */
+typedef struct ReferenceSeqCompressItem {
+    INSDC_coord_zero offset;
+    const char* seq;
+    INSDC_coord_len seq_len;
+    const void* cigar;
+    uint32_t cigar_len;
+    INSDC_coord_zero allele_offset;
+    const char* allele;
+    INSDC_coord_len allele_len;
+    INSDC_coord_zero offset_in_allele;
+    const void* allele_cigar;
+    uint32_t allele_cigar_len;
+    uint8_t rna_orient;
+    TableWriterAlgnData* data;
+    rc_t rc;
+} ReferenceSeqCompressItem;
+
+/* Compress a block of alignments to the same reference on 'threads' threads;
+   the part of the reference they cover is read once up front.
+   Each item fills its own 'data', so the caller writes the rows out in order.
+   Returns the first failure in item order.
+ */
+ALIGN_EXTERN rc_t CC ReferenceSeq_CompressBatch(const ReferenceSeq* cself,
+                                                uint32_t options,
+                                                uint32_t count,
+                                                ReferenceSeqCompressItem items[],
+                                                uint32_t threads);
+
+ALIGN_EXTERN rc_t CC ReferenceMgr_CompressBatch(const ReferenceMgr* cself,
+                                                uint32_t options,
+                                                const char* id,
+                                                uint32_t count,
+                                                ReferenceSeqCompressItem items[],
+                                                uint32_t threads);
                                            
 ALIGN_EXTERN rc_t CC ReferenceSeq_TranslateOffset_int(ReferenceSeq const *const cself,
                                                       INSDC_coord_zero const offset,
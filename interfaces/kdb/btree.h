@@ -121,6 +121,17 @@ KDB_EXTERN rc_t CC KBTreeRelease ( const KBTree *self );
 KDB_EXTERN rc_t CC KBTreeDropBacking ( KBTree *self );
 
 
+/* SetWriteBack
+ *  write evicted dirty pages on a background thread
+ *  instead of stalling the insert that caused the eviction.
+ *  also enables read-ahead of sibling pages around node splits.
+ *
+ *  "dirty_limit" [ IN ] - bytes of evicted pages allowed to
+ *  wait for the writer
+ */
+KDB_EXTERN rc_t CC KBTreeSetWriteBack ( KBTree *self, size_t dirty_limit );
+
+
 /* Size
  *  returns size in bytes of file and cache
  *
@@ -92,6 +92,20 @@ KFS_EXTERN rc_t CC KMMapReposition ( const KMMap *self, uint64_t pos, size_t *si
 KFS_EXTERN rc_t CC KMMapAddrRead ( const KMMap *self, const void **addr );
 KFS_EXTERN rc_t CC KMMapAddrUpdate ( KMMap *self, void **addr );
 
+/* Advise
+ *  tell the os how the region is going to be used
+ *  advice the os or the region can't act on is ignored
+ *
+ *  "advice" [ IN ] - a combination of KMMapAdvice flags
+ */
+enum
+{
+    kmmapAdviseReserve   = 1,   /* allocate file storage for the region now   */
+    kmmapAdviseHugePages = 2,   /* back the region with huge pages if allowed */
+    kmmapAdvisePrefault  = 4    /* fault in the pages of the region now       */
+};
+KFS_EXTERN rc_t CC KMMapAdvise ( const KMMap *self, uint32_t advice );
+
 /* Make
  *  maps entire file
  *
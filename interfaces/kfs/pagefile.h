@@ -176,6 +176,28 @@ KFS_EXTERN rc_t CC KPageFileGet ( KPageFile *self, KPage **page, uint32_t page_i
 KFS_EXTERN rc_t CC KPageFilePosGet ( KPageFile *self, KPage **page, uint64_t offset );
 
 
+/* SetWriteBack
+ *  moves writing of evicted dirty pages to a background thread
+ *  so that cache replacement does not stall on the backing file.
+ *  pages still queued are flushed when the page file is released,
+ *  or discarded by DropBacking. may be called again to change limit.
+ *
+ *  "dirty_limit" [ IN ] - bytes of evicted dirty pages allowed
+ *  to wait for the writer before eviction blocks
+ */
+KFS_EXTERN rc_t CC KPageFileSetWriteBack ( KPageFile *self, size_t dirty_limit );
+
+
+/* Prefetch
+ *  hint that a page will be needed soon
+ *  when write-back is enabled, the page is read on the background
+ *  thread and handed to the next Get. otherwise does nothing.
+ *
+ *  "page_id" [ IN ] - id of page to read ahead
+ */
+KFS_EXTERN rc_t CC KPageFilePrefetch ( KPageFile *self, uint32_t page_id );
+
+
 /* DropBacking
  *  used immediately prior to releasing
  *  prevents modified pages from being flushed to disk
@@ -0,0 +1,121 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_kfs_readahead_
+#define _h_kfs_readahead_
+
+#ifndef _h_kfs_extern_
+#include <kfs/extern.h>
+#endif
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*--------------------------------------------------------------------------
+ * forwards
+ */
+struct KFile;
+
+
+/*--------------------------------------------------------------------------
+ * KReadAheadPattern
+ *  access pattern detected from the recent history of reads
+ */
+enum KReadAheadPattern
+{
+    kraUnknown,
+    kraSequential,   /* each read starts where the previous one ended */
+    kraStrided,      /* reads advance by a constant step larger than themselves */
+    kraRandom        /* no usable relationship between reads */
+};
+
+
+/*--------------------------------------------------------------------------
+ * KReadAheadStats
+ *  counters accumulated over the life of an adaptive read-ahead file
+ */
+typedef struct KReadAheadStats KReadAheadStats;
+struct KReadAheadStats
+{
+    uint64_t reads;             /* calls to KFileRead                         */
+    uint64_t hits;              /* reads satisfied from read-ahead pages      */
+    uint64_t misses;            /* reads that went to the original file       */
+    uint64_t stalls;            /* reads that waited on an in-flight prefetch */
+    uint64_t bytes_prefetched;  /* bytes brought in ahead of demand           */
+    uint64_t bytes_wasted;      /* prefetched bytes dropped without being read*/
+    size_t window;              /* current read-ahead window in bytes         */
+    uint32_t depth;             /* current number of pages kept in flight     */
+    uint32_t pattern;           /* enum KReadAheadPattern                     */
+};
+
+
+/* MakeAdaptiveReadAhead
+ *  make a read-only file that watches the offsets it is asked for,
+ *  classifies them as sequential, strided or random, and sizes its
+ *  read-ahead accordingly.
+ *
+ *  sequential access grows the window geometrically up to "max_window"
+ *  and keeps up to "max_depth" windows in flight on a background thread.
+ *  strided access prefetches the predicted next strides. random access
+ *  shrinks the window to "min_window" and stops prefetching, passing
+ *  large reads straight through to "original".
+ *
+ *  "ra" [ OUT ] - return parameter for new file
+ *
+ *  "original" [ IN ] - source file. must have read access
+ *
+ *  "min_window" [ IN, 0 = DEFAULT ] - smallest read issued to "original"
+ *
+ *  "max_window" [ IN, 0 = DEFAULT ] - largest read-ahead window
+ *
+ *  "max_depth" [ IN ] - maximum number of windows prefetched
+ *  asynchronously. 0 disables the background thread and reads
+ *  ahead synchronously within a single window.
+ */
+KFS_EXTERN rc_t CC KFileMakeAdaptiveReadAhead ( struct KFile const ** ra,
+    struct KFile const * original, size_t min_window, size_t max_window,
+    uint32_t max_depth );
+
+
+/* GetReadAheadStats
+ *  retrieve a snapshot of the counters
+ *  fails with rcType/rcIncorrect if "self" was not made by
+ *  KFileMakeAdaptiveReadAhead
+ */
+KFS_EXTERN rc_t CC KFileGetReadAheadStats ( struct KFile const * self,
+    KReadAheadStats * stats );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_kfs_readahead_ */
@@ -106,6 +106,18 @@ struct Pager_vt {
     void        (*unuse )(Pager *self, void const *page);
 };
 
+/* Pager_hint_vt
+ *  optional hints, kept out of Pager_vt so that pagers built
+ *  against it need not change; given to BTreeEntryWithHints
+ */
+typedef struct Pager_hint_vt Pager_hint_vt;
+struct Pager_hint_vt {
+    /* "pageid" is about to be used
+     * may be NULL
+     */
+    void        (*prefetch)(Pager *self, uint32_t pageid);
+};
+
 /* Find
  *  searches for a match
  *
@@ -129,6 +141,14 @@ KLIB_EXTERN rc_t CC BTreeFind ( uint32_t root, Pager *pager, Pager_vt const *vt,
 KLIB_EXTERN rc_t CC BTreeEntry ( uint32_t *root, Pager *pager, Pager_vt const *vt, uint32_t *id,
     bool *was_inserted, const void *key, size_t key_size );
 
+/* EntryWithHints
+ *  same as Entry, also passing hints to the pager
+ *
+ *  "hints" [ IN, NULL OKAY ]
+ */
+KLIB_EXTERN rc_t CC BTreeEntryWithHints ( uint32_t *root, Pager *pager, Pager_vt const *vt,
+    Pager_hint_vt const *hints, uint32_t *id, bool *was_inserted, const void *key, size_t key_size );
+
 /* ForEach
  *  executes a function on each tree element
  *
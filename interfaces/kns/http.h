@@ -113,6 +113,29 @@ KNS_EXTERN rc_t CC KNSManagerVMakeHttpFile ( struct KNSManager const *self,
     struct KFile const **file, struct KStream *conn, ver_t vers, const char *url, va_list args );
 
 
+/* DownloadHttpFile
+ *  fetch an entire object into "dst", splitting it into ranges
+ *  that are read concurrently over up to "num_streams" connections
+ *
+ *  "dst" [ IN ] - writable destination, resized to the object size
+ *
+ *  "size" [ OUT, NULL OKAY ] - number of bytes written on success
+ *
+ *  "conn" [ IN, NULL OKAY ] - connection for the first stream,
+ *  the others always open their own
+ *
+ *  "num_streams" [ IN ] - maximum number of concurrent connections
+ *
+ *  "range_size" [ IN ] - bytes per range request, 0 for default
+ */
+KNS_EXTERN rc_t CC KNSManagerDownloadHttpFile ( struct KNSManager const *self,
+    struct KFile *dst, uint64_t *size, struct KStream *conn, ver_t vers,
+    uint32_t num_streams, size_t range_size, const char *url, ... );
+KNS_EXTERN rc_t CC KNSManagerVDownloadHttpFile ( struct KNSManager const *self,
+    struct KFile *dst, uint64_t *size, struct KStream *conn, ver_t vers,
+    uint32_t num_streams, size_t range_size, const char *url, va_list args );
+
+
 /*--------------------------------------------------------------------------
  * KClientHttp
  *  hyper text transfer protocol
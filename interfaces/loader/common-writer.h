@@ -57,6 +57,8 @@ struct CommonWriter;
 struct SequenceWriter;
 struct AlignmentWriter;
 struct Reference;
+struct SpotNameHash;
+struct ExtSort;
 
 /*--------------------------------------------------------------------------
  * CommonWriterSettings
@@ -66,6 +68,9 @@ enum LoaderModes {
     mode_Analysis
 };
 
+/* the smallest nameHashMemory accepted */
+#define NAME_HASH_MIN_MEMORY (64 * 1024)
+
 typedef struct CommonWriterSettings
 {
     uint64_t numfiles;
@@ -122,6 +127,9 @@ typedef struct CommonWriterSettings
     INSDC_SRA_platform_id platform;
     bool parseSpotName;
     bool compressQuality;
+    bool prefaultIdMap; /* reserve, huge-page and pre-fault the spot id map in the background */
+    size_t nameHashMemory; /* bytes for the in-memory spot name table, 0: B-trees only, else at least NAME_HASH_MIN_MEMORY */
+    size_t mateSortMemory; /* bytes for sorting mates together after loading, 0: pair them as they come */
     uint64_t maxMateDistance;
 } CommonWriterSettings;
 
@@ -135,9 +143,11 @@ typedef struct SpotAssembler {
     const struct KLoadProgressbar *progress[4];
     struct KBTree *key2id[NUM_ID_SPACES];
     char *key2id_names;
+    struct SpotNameHash *nameHash; /* in front of key2id */
     struct MMArray *id2value;
     struct KMemBank *fragsBoth; /*** mate will be there soon ***/
     struct KMemBank *fragsOne;  /*** mate may not be found soon or even show up ***/
+    struct ExtSort *mates;      /*** mateSortMemory: fragments sorted by spot, paired at the end ***/
     int64_t spotId;
     int64_t primaryId;
     int64_t secondId;
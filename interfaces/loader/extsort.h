@@ -0,0 +1,66 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#ifndef _h_extsort_
+#define _h_extsort_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+/*--------------------------------------------------------------------------
+ * forwards
+ */
+
+struct KFile;
+
+/*--------------------------------------------------------------------------
+ * ExtSort
+ *  sorts variable size records by a 64-bit key within a memory budget,
+ *  spilling sorted runs to fp and merging them; records with equal keys
+ *  come back in the order they were added
+ */
+struct ExtSort;
+
+rc_t ExtSortMake(struct ExtSort **rslt, struct KFile *fp, size_t memory);
+
+rc_t ExtSortAdd(struct ExtSort *self, uint64_t key, void const *data, size_t size);
+
+/* ends input on the first call; *data is NULL after the last record.
+ * data stays valid until the next call */
+rc_t ExtSortNext(struct ExtSort *self, uint64_t *key, void const **data, size_t *size);
+
+typedef struct ExtSortStats {
+    uint64_t records;
+    uint64_t runs;          /* sorted runs written to the file */
+    uint64_t spilled;       /* bytes written to the file */
+} ExtSortStats;
+
+void ExtSortGetStats(struct ExtSort const *self, ExtSortStats *stats);
+
+void ExtSortWhack(struct ExtSort *self);
+
+#endif
@@ -43,6 +43,25 @@ struct MMArray;
 
 rc_t MMArrayMake(struct MMArray **rslt, struct KFile *fp, uint32_t elemSize);
 
+/* options for MMArrayMakeWithOptions */
+enum MMArrayOptions {
+    mma_Reserve = 1,    /* grow the file in large steps and allocate its storage */
+    mma_HugePages = 2,  /* ask for transparent huge pages */
+    mma_Prefetch = 4    /* map and pre-fault the next subchunk in the background */
+};
+
+rc_t MMArrayMakeWithOptions(struct MMArray **rslt, struct KFile *fp, uint32_t elemSize, uint32_t options);
+
+typedef struct MMArrayStats {
+    uint64_t maps;          /* subchunks mapped */
+    uint64_t prefetched;    /* ... of which by the background thread */
+    uint64_t waits;         /* times MMArrayGet waited on the background thread */
+    uint64_t prefaulted;    /* bytes faulted in before first use */
+    uint64_t reserved;      /* bytes the file was grown by */
+} MMArrayStats;
+
+void MMArrayGetStats(struct MMArray const *self, MMArrayStats *stats);
+
 rc_t MMArrayGet(struct MMArray *const self, void **const value, uint64_t const element);
 
 void MMArrayWhack(struct MMArray *self);
@@ -83,6 +83,7 @@ static  int64_t  LE2HI64(void const *X) {  int64_t y; memcpy(&y, X, sizeof(y));
 #endif
 
 typedef struct BAMIndex BAMIndex;
+typedef struct BAMChunkIndex BAMChunkIndex;
 typedef struct BGZFile BGZFile;
 
 /* MARK: BGZFile *** Start *** */
@@ -105,7 +106,7 @@ typedef uint8_t zlib_block_t[ZLIB_BLOCK_SIZE];
 #define CG_NUM_SEGS 4
 
 typedef struct BGZFile_vt_s {
-    rc_t (*FileRead)(void *, zlib_block_t, unsigned *);
+    rc_t (*FileRead)(void *, zlib_block_t, uint8_t const **, unsigned *);
     uint64_t (*FileGetPos)(void const *);
     float (*FileProPos)(void const *);
     uint64_t (*FileGetSize)(void const *);
@@ -253,6 +254,13 @@ rc_t BGZFileRead(BGZFile *self, zlib_block_t dst, unsigned *pNumRead)
     return RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
 }
 
+/* inflates into the caller's scratch block */
+static rc_t BGZFileReadBlock(BGZFile *self, zlib_block_t scratch, uint8_t const **data, unsigned *pNumRead)
+{
+    *data = scratch;
+    return BGZFileRead(self, scratch, pNumRead);
+}
+
 static uint64_t BGZFileGetPos(const BGZFile *self)
 {
     return self->fpos + self->bpos;
@@ -447,7 +455,7 @@ static rc_t BGZFileInit(BGZFile *self, const KFile *kfp, BGZFile_vt *vt)
     int i;
     rc_t rc;
     static BGZFile_vt const my_vt = {
-        (rc_t (*)(void *, zlib_block_t, unsigned *))BGZFileRead,
+        (rc_t (*)(void *, zlib_block_t, uint8_t const **, unsigned *))BGZFileReadBlock,
         (uint64_t (*)(void const *))BGZFileGetPos,
         (float (*)(void const *))BGZFileProPos,
         (uint64_t (*)(void const *))BGZFileGetSize,
@@ -486,6 +494,84 @@ static rc_t BGZFileInit(BGZFile *self, const KFile *kfp, BGZFile_vt *vt)
     return 0;
 }
 
+/* MARK: BGZF blocks */
+
+/* checks the fixed part of the gzip header of a BGZF block
+ * and returns the size of the whole header
+ */
+static rc_t BGZFHeaderSize(uint8_t const hdr[12], unsigned *hsize)
+{
+    unsigned xlen;
+
+    /* BGZF is gzip with only FEXTRA set */
+    if (hdr[0] != 31 || hdr[1] != 139 || hdr[2] != 8 || hdr[3] != 4)
+        return RC(rcAlign, rcFile, rcReading, rcFormat, rcInvalid);
+
+    xlen = LE2HUI16(&hdr[10]);
+    if (xlen > ZLIB_BLOCK_SIZE - 12 - 8)
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+
+    *hsize = 12 + xlen;
+    return 0;
+}
+
+/* finds the block size in the BC extra field of the header */
+static rc_t BGZFBlockSize(uint8_t const hdr[], unsigned const hsize, unsigned *bsize)
+{
+    unsigned const xlen = hsize - 12;
+    unsigned i;
+
+    *bsize = 0;
+    for (i = 0; i + 4 <= xlen; ) {
+        uint8_t const *const sub = &hdr[12 + i];
+        unsigned const slen = LE2HUI16(&sub[2]);
+
+        if (sub[0] == 'B' && sub[1] == 'C' && slen == 2 && i + 6 <= xlen) {
+            *bsize = 1 + LE2HUI16(&sub[4]);
+            break;
+        }
+        i += slen + 4;
+    }
+    if (*bsize == 0) {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("BGZF Header extra field BC not found\n"));
+        return RC(rcAlign, rcFile, rcReading, rcFormat, rcInvalid); /* not BGZF */
+    }
+    if (*bsize < hsize + 8)
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    return 0;
+}
+
+/* inflates a whole BGZF block with a raw inflate stream and checks its trailer */
+static rc_t BGZFInflateBlock(z_stream *const zs,
+                             uint8_t const block[], unsigned const hsize, unsigned const bsize,
+                             zlib_block_t dst, unsigned *dsize)
+{
+    uint8_t const *const trailer = &block[bsize - 8];
+    unsigned const isize = LE2HUI32(&trailer[4]);
+    int zr;
+
+    *dsize = 0;
+    if (isize > sizeof(zlib_block_t))
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+
+    zr = inflateReset(zs);
+    assert(zr == Z_OK);
+    zs->next_in = (Bytef *)&block[hsize];
+    zs->avail_in = bsize - hsize - 8;
+    zs->next_out = dst;
+    zs->avail_out = sizeof(zlib_block_t);
+
+    zr = inflate(zs, Z_FINISH);
+    if (zr != Z_STREAM_END || zs->total_out != isize ||
+        crc32(crc32(0, Z_NULL, 0), dst, isize) != LE2HUI32(&trailer[0]))
+    {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("Unexpected Zlib result %i\n", zr));
+        return RC(rcAlign, rcFile, rcReading, rcFile, rcCorrupt);
+    }
+    *dsize = isize;
+    return 0;
+}
+
 #ifndef WINDOWS
 
 /* MARK: BGZThreadFile *** Start *** */
@@ -496,88 +582,210 @@ static rc_t BGZFileInit(BGZFile *self, const KFile *kfp, BGZFile_vt *vt)
 
 typedef struct BGZThreadFile_s BGZThreadFile;
 
-#define BUFFER_COUNT (3)
+/* One thread cuts the file into BGZF blocks, a pool of threads inflates
+ * them, and the reader is handed the inflated blocks in file order straight
+ * out of the ring.
+ */
+#define BGZF_THREADS_MAX (32)
+#define BGZF_QUEUE_DEPTH (4) /* blocks in the ring per inflating thread */
+
+enum BGZThreadFileBlockState {
+    bgzfEmpty,
+    bgzfCompressed,
+    bgzfInflating,
+    bgzfReady
+};
 
-typedef struct BGZThreadFileWorkQElem_s BGZThreadFileWorkQElem;
+typedef struct BGZThreadFileBlock_s BGZThreadFileBlock;
 
-struct BGZThreadFileWorkQElem_s {
-    uint8_t *buf;
-    uint64_t pos;
-    unsigned bsz;
+struct BGZThreadFileBlock_s {
+    uint64_t pos;       /* position in file of the block */
+    unsigned csize;     /* size of the whole BGZF block */
+    unsigned hsize;     /* size of its gzip header */
+    unsigned dsize;     /* size of the inflated data */
+    rc_t rc;
+    int state;
+    uint8_t cdata[ZLIB_BLOCK_SIZE];
+    zlib_block_t data;
 };
 
 struct BGZThreadFile_s {
     BGZFile file;
     KLock *lock;
-    KCondition *have_data;
-    KCondition *need_data;
-    KThread *th;
-    uint64_t pos;
-    BGZThreadFileWorkQElem que[BUFFER_COUNT];
-    rc_t volatile rc;
-    unsigned volatile nque;
-    bool eof;
-    uint8_t buffer[sizeof(zlib_block_t) * BUFFER_COUNT];
+    KCondition *have_data;  /* a block was inflated or the reader stopped */
+    KCondition *need_data;  /* a block of the ring was freed */
+    KCondition *have_work;  /* a block was queued for inflating */
+    KThread *reader;
+    KThread *inflater[BGZF_THREADS_MAX];
+    BGZThreadFileBlock *ring;
+    uint64_t pos;           /* position in file following the held block */
+    uint64_t head;          /* next block to hand out */
+    uint64_t next;          /* next block to inflate */
+    uint64_t tail;          /* next block to fill */
+    unsigned nring;
+    unsigned nthreads;
+    rc_t rc;                /* why the reader stopped */
+    bool held;              /* the block at head is in use by the caller */
+    bool stopped;
+    bool quit;
 };
 
-static rc_t BGZThreadFileRead(BGZThreadFile *self, zlib_block_t dst, unsigned *pNumRead)
+/* copies the next len bytes of the file */
+static rc_t BGZFileCopyRaw(BGZFile *const self, uint8_t *dst, unsigned len)
 {
-    rc_t rc;
-    
-    *pNumRead = 0;
-    
-    KLockAcquire(self->lock);
-    if ((rc = self->rc) == 0) {
-        while (self->nque == 0 && (rc = self->rc) == 0)
-            KConditionWait(self->have_data, self->lock);
-        if (rc == 0) {
-            BGZThreadFileWorkQElem const work = self->que[0];
-            
-            self->pos = work.pos;
-            if (work.buf) {
-                memcpy(dst, work.buf, *pNumRead = work.bsz);
-                memmove(&self->que[0], &self->que[1], --self->nque * sizeof(self->que[0]));
-                KConditionSignal(self->need_data);
-            }
-            else {
-                self->eof = true;
-                self->rc = rc = RC(rcAlign, rcFile, rcReading, rcData, rcInsufficient);
-            }
+    while (len > 0) {
+        if (self->bpos >= self->bcount) {
+            rc_t const rc = BGZFileGetMoreBytes(self);
+            if (rc)
+                return rc;
+        }
+        {
+            unsigned const avail = (unsigned)(self->bcount - self->bpos);
+            unsigned const n = avail < len ? avail : len;
+
+            memcpy(dst, &self->buf[self->bpos], n);
+            self->bpos += n;
+            dst += n;
+            len -= n;
         }
     }
-    KLockUnlock(self->lock);
+    return 0;
+}
+
+/* copies the next BGZF block of the file without inflating it
+ * returns (rcData, rcInsufficient) at eof
+ */
+static rc_t BGZThreadFileReadBlock(BGZThreadFile *const self, BGZThreadFileBlock *const blk)
+{
+    uint8_t *const hdr = blk->cdata;
+    rc_t rc;
+
+    blk->pos = BGZFileGetPos(&self->file);
+    rc = BGZFileCopyRaw(&self->file, hdr, 12);
+    if (rc == 0)
+        rc = BGZFHeaderSize(hdr, &blk->hsize);
+    if (rc == 0)
+        rc = BGZFileCopyRaw(&self->file, &hdr[12], blk->hsize - 12);
+    if (rc == 0)
+        rc = BGZFBlockSize(hdr, blk->hsize, &blk->csize);
+    if (rc == 0)
+        rc = BGZFileCopyRaw(&self->file, &hdr[blk->hsize], blk->csize - blk->hsize);
+    if (rc != 0 && GetRCObject(rc) == (enum RCObject)rcData && GetRCState(rc) == rcInsufficient
+        && BGZFileGetPos(&self->file) != blk->pos)
+    {
+        DBGMSG(DBG_ALIGN, DBG_FLAG(DBG_ALIGN_BGZF), ("EOF in Zlib block after %lu bytes\n", BGZFileGetPos(&self->file)));
+        rc = RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+    }
     return rc;
 }
 
-static rc_t CC BGZThreadFileMain(KThread const *const th, void *const vp)
+static rc_t CC BGZThreadFileReaderMain(KThread const *const th, void *const vp)
 {
     BGZThreadFile *const self = (BGZThreadFile *)vp;
     rc_t rc = 0;
-    unsigned bufno;
-    
+
     KLockAcquire(self->lock);
-    for (bufno = 0; ; bufno = (bufno + 1) % BUFFER_COUNT) {
-        while (self->nque == BUFFER_COUNT)
+    while (!self->quit) {
+        if (self->tail - self->head == self->nring)
             KConditionWait(self->need_data, self->lock);
-        {
-            BGZThreadFileWorkQElem work;
-            
-            work.pos = BGZFileGetPos(&self->file);
-            work.buf = &self->buffer[bufno * sizeof(zlib_block_t)];
-            rc = BGZFileRead(&self->file, work.buf, &work.bsz);
-            if ( GetRCObject( rc ) == (enum RCObject)rcData && GetRCState( rc ) == rcInsufficient )
-                work.buf = NULL;
-            else if ( rc != 0 )
+        else {
+            BGZThreadFileBlock *const blk = &self->ring[self->tail % self->nring];
+
+            KLockUnlock(self->lock);
+            rc = BGZThreadFileReadBlock(self, blk);
+            KLockAcquire(self->lock);
+            if (rc)
                 break;
-            self->que[self->nque++] = work;
-            KConditionSignal(self->have_data);
+            blk->state = bgzfCompressed;
+            ++self->tail;
+            KConditionSignal(self->have_work);
         }
     }
     self->rc = rc;
+    self->stopped = true;
+    KConditionBroadcast(self->have_work);
+    KConditionSignal(self->have_data);
     KLockUnlock(self->lock);
     return 0;
 }
 
+static rc_t CC BGZThreadFileInflaterMain(KThread const *const th, void *const vp)
+{
+    BGZThreadFile *const self = (BGZThreadFile *)vp;
+    z_stream zs;
+    rc_t zrc = 0;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) /* raw deflate, the header was parsed already */
+        zrc = RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+
+    KLockAcquire(self->lock);
+    while (!self->quit) {
+        if (self->next == self->tail) {
+            if (self->stopped)
+                break;
+            KConditionWait(self->have_work, self->lock);
+        }
+        else {
+            BGZThreadFileBlock *const blk = &self->ring[self->next++ % self->nring];
+
+            blk->state = bgzfInflating;
+            KLockUnlock(self->lock);
+            blk->rc = zrc ? zrc : BGZFInflateBlock(&zs, blk->cdata, blk->hsize, blk->csize, blk->data, &blk->dsize);
+            KLockAcquire(self->lock);
+            blk->state = bgzfReady;
+            KConditionSignal(self->have_data);
+        }
+    }
+    KLockUnlock(self->lock);
+
+    if (zrc == 0)
+        inflateEnd(&zs);
+    return 0;
+}
+
+/* hands out the inflated data without copying it
+ * the data stays valid until the next call
+ */
+static rc_t BGZThreadFileRead(BGZThreadFile *self, zlib_block_t scratch, uint8_t const **data, unsigned *pNumRead)
+{
+    rc_t rc = 0;
+    
+    *data = NULL;
+    *pNumRead = 0;
+    
+    KLockAcquire(self->lock);
+    if (self->held) {
+        self->ring[self->head % self->nring].state = bgzfEmpty;
+        ++self->head;
+        self->held = false;
+        KConditionSignal(self->need_data);
+    }
+    for ( ; ; ) {
+        if (self->head != self->tail) {
+            BGZThreadFileBlock const *const blk = &self->ring[self->head % self->nring];
+
+            if (blk->state == bgzfReady) {
+                rc = blk->rc;
+                if (rc == 0) {
+                    self->held = true;
+                    self->pos = blk->pos + blk->csize;
+                    *data = blk->data;
+                    *pNumRead = blk->dsize;
+                }
+                break;
+            }
+        }
+        else if (self->stopped) {
+            rc = self->rc;
+            break;
+        }
+        KConditionWait(self->have_data, self->lock);
+    }
+    KLockUnlock(self->lock);
+    return rc;
+}
+
 static uint64_t BGZThreadFileGetPos(BGZThreadFile const *const self)
 {
     return self->pos;
@@ -601,20 +809,36 @@ static rc_t BGZThreadFileSetPos(BGZThreadFile *const self)
 
 static void BGZThreadFileWhack(BGZThreadFile *const self)
 {
-    KThreadCancel(self->th);
-    KThreadWait(self->th, NULL);
+    unsigned i;
+
+    if (self->lock) {
+        KLockAcquire(self->lock);
+        self->quit = true;
+        KConditionBroadcast(self->need_data);
+        KConditionBroadcast(self->have_work);
+        KLockUnlock(self->lock);
+    }
+    if (self->reader) {
+        KThreadWait(self->reader, NULL);
+        KThreadRelease(self->reader);
+    }
+    for (i = 0; i < self->nthreads; ++i) {
+        KThreadWait(self->inflater[i], NULL);
+        KThreadRelease(self->inflater[i]);
+    }
     BGZFileWhack(&self->file);
+    KConditionRelease(self->have_work);
     KConditionRelease(self->need_data);
     KConditionRelease(self->have_data);
     KLockRelease(self->lock);
-    KThreadRelease(self->th);
+    free(self->ring);
 }
 
-static rc_t BGZThreadFileInit(BGZThreadFile *self, const KFile *kfp, BGZFile_vt *vt)
+static rc_t BGZThreadFileInit(BGZThreadFile *self, const KFile *kfp, BGZFile_vt *vt, unsigned threads)
 {
     rc_t rc;
     static BGZFile_vt const my_vt = {
-        (rc_t (*)(void *, zlib_block_t, unsigned *))BGZThreadFileRead,
+        (rc_t (*)(void *, zlib_block_t, uint8_t const **, unsigned *))BGZThreadFileRead,
         (uint64_t (*)(void const *))BGZThreadFileGetPos,
         (float (*)(void const *))BGZThreadFileProPos,
         (uint64_t (*)(void const *))BGZThreadFileGetSize,
@@ -623,28 +847,42 @@ static rc_t BGZThreadFileInit(BGZThreadFile *self, const KFile *kfp, BGZFile_vt
     };
     
     memset(self, 0, sizeof(*self));
+    if (threads > BGZF_THREADS_MAX)
+        threads = BGZF_THREADS_MAX;
     
     rc = BGZFileInit(&self->file, kfp, vt);
-    if (rc == 0) {
+    if (rc)
+        return rc;
+
+    self->nring = threads * BGZF_QUEUE_DEPTH;
+    self->ring = calloc(self->nring, sizeof(self->ring[0]));
+    if (self->ring == NULL)
+        rc = RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    if (rc == 0)
         rc = KLockMake(&self->lock);
-        if (rc == 0) {
-            rc = KConditionMake(&self->have_data);
-            if (rc == 0) {
-                rc = KConditionMake(&self->need_data);
-                if (rc == 0) {
-                    rc = KThreadMake(&self->th, BGZThreadFileMain, self);
-                    if (rc == 0) {
-                        *vt = my_vt;
-                        return 0;
-                    }
-                    KConditionRelease(self->need_data);
-                }
-                KConditionRelease(self->have_data);
-            }
-            KLockRelease(self->lock);
+    if (rc == 0)
+        rc = KConditionMake(&self->have_data);
+    if (rc == 0)
+        rc = KConditionMake(&self->need_data);
+    if (rc == 0)
+        rc = KConditionMake(&self->have_work);
+    while (rc == 0 && self->nthreads < threads) {
+        rc = KThreadMake(&self->inflater[self->nthreads], BGZThreadFileInflaterMain, self);
+        if (rc == 0)
+            ++self->nthreads;
+        else if (self->nthreads > 0) {
+            /* make do with the threads we got */
+            rc = 0;
+            break;
         }
-        BGZFileWhack(&self->file);
     }
+    if (rc == 0)
+        rc = KThreadMake(&self->reader, BGZThreadFileReaderMain, self);
+    if (rc == 0) {
+        *vt = my_vt;
+        return 0;
+    }
+    BGZThreadFileWhack(self);
     memset(self, 0, sizeof(*self));
     memset(vt, 0, sizeof(*vt));
     return rc;
@@ -679,6 +917,7 @@ struct BAMFile {
     BAMAlignment *bufLocker;
     BAMAlignment *nocopy;       /* used to hold current record for BAMFileRead2 */
     BAMIndex const *ndx;
+    BAMChunkIndex const *cndx;  /* bins and chunks, BAI or CSI */
     
     size_t nocopy_size;
     
@@ -691,7 +930,8 @@ struct BAMFile {
     unsigned bufCurrent;        /* location in uncompressed buffer of read head */
     bool eof;
     bool threaded;
-    zlib_block_t buffer;        /* uncompressed buffer */
+    uint8_t const *buffer;      /* uncompressed buffer, either block or handed out by the file */
+    zlib_block_t block;
 };
 
 /* MARK: Alignment structures */
@@ -958,7 +1198,7 @@ static struct offset_size_s const *get_CG_GQ_info(BAMAlignment const *cself)
 /* returns (rcData, rcInsufficient) if eof */
 static rc_t BAMFileFillBuffer(BAMFile *self)
 {
-    rc_t const rc = self->vt.FileRead(&self->file, self->buffer, &self->bufSize);
+    rc_t const rc = self->vt.FileRead(&self->file, self->block, &self->buffer, &self->bufSize);
     if (rc)
         return rc;
     if (self->bufSize == 0 || self->bufSize <= self->bufCurrent)
@@ -1651,6 +1891,8 @@ static rc_t ProcessHeader(BAMFile *self, char const headerText[])
 /* MARK: BAM File destructor */
 
 static rc_t BAMIndexWhack(const BAMIndex *);
+static rc_t BAMChunkIndexWhack(const BAMChunkIndex *);
+static rc_t BAMChunkIndexMake(BAMChunkIndex **, uint8_t const [], size_t);
 
 static rc_t BAMFileWhack(BAMFile *self) {
     if (self->refSeq)
@@ -1665,6 +1907,8 @@ static rc_t BAMFileWhack(BAMFile *self) {
         free((void *)self->headerData2);
     if (self->ndx)
         BAMIndexWhack(self->ndx);
+    if (self->cndx)
+        BAMChunkIndexWhack(self->cndx);
     if (self->nocopy)
         free(self->nocopy);
     if (self->vt.FileWhack)
@@ -1679,7 +1923,7 @@ static rc_t BAMFileWhack(BAMFile *self) {
 static rc_t BAMFileMakeWithKFileAndHeader(BAMFile const **cself,
                                           KFile const *file,
                                           char const *headerText,
-                                          bool threaded)
+                                          unsigned threads)
 {
     BAMFile *self = calloc(1, sizeof(*self));
     rc_t rc;
@@ -1689,8 +1933,8 @@ static rc_t BAMFileMakeWithKFileAndHeader(BAMFile const **cself,
     
     KRefcountInit(&self->refcount, 1, "BAMFile", "new", "");
 #ifndef WINDOWS
-    if (threaded)
-        rc = BGZThreadFileInit(&self->file.thread, file, &self->vt);
+    if (threads > 0)
+        rc = BGZThreadFileInit(&self->file.thread, file, &self->vt, threads);
     else
 #endif
         rc = BGZFileInit(&self->file.plain, file, &self->vt);
@@ -1709,7 +1953,13 @@ static rc_t BAMFileMakeWithKFileAndHeader(BAMFile const **cself,
 /* file is retained */
 LIB_EXPORT rc_t CC BAMFileMakeWithKFile(const BAMFile **cself, const KFile *file)
 {
-    return BAMFileMakeWithKFileAndHeader(cself, file, NULL, false);
+    return BAMFileMakeWithKFileAndHeader(cself, file, NULL, 0);
+}
+
+/* file is retained */
+LIB_EXPORT rc_t CC BAMFileMakeWithKFileAndThreads(const BAMFile **cself, const KFile *file, unsigned threads)
+{
+    return BAMFileMakeWithKFileAndHeader(cself, file, NULL, threads);
 }
 
 LIB_EXPORT rc_t CC BAMFileVMakeWithDir(const BAMFile **result,
@@ -1783,7 +2033,7 @@ LIB_EXPORT rc_t CC BAMFileMakeWithHeader ( const BAMFile **cself,
     va_start(args, path);
     rc = KDirectoryVOpenFileRead(dir, &kf, path, args);
     if (rc == 0) {
-        rc = BAMFileMakeWithKFileAndHeader(cself, kf, headerText, false);
+        rc = BAMFileMakeWithKFileAndHeader(cself, kf, headerText, 0);
         KFileRelease(kf);
     }
     va_end(args);
@@ -2309,7 +2559,7 @@ rc_t BAMFileReadCopy(BAMFile *const self, BAMAlignment const *rslt[], bool const
     }
     else {
         storage = NULL;
-        data = (bam_alignment *)&self->buffer[self->bufCurrent];
+        data = (bam_alignment const *)&self->buffer[self->bufCurrent];
         
         BAMFileAdvance(self, datasize);
     }
@@ -2440,6 +2690,198 @@ LIB_EXPORT rc_t CC BAMFileRead(const BAMFile *cself, const BAMAlignment **rhs)
     return BAMFileReadCopy(self, rhs, false);
 }
 
+/* MARK: BAMAlignmentBatch */
+
+typedef struct BAMAlignmentBatchImpl BAMAlignmentBatchImpl;
+struct BAMAlignmentBatchImpl {
+    BAMAlignmentBatch dad;
+    uint8_t *spill;     /* holds a record that spans blocks */
+    size_t spill_size;
+};
+
+LIB_EXPORT rc_t CC BAMAlignmentBatchMake(BAMAlignmentBatch **rslt, uint32_t capacity)
+{
+    BAMAlignmentBatchImpl *self;
+    BAMAlignmentBatch *dad;
+    size_t const per_record = sizeof(dad->record[0])
+                            + 11 * sizeof(uint32_t)
+                            + 2 * sizeof(uint16_t)
+                            + sizeof(uint8_t);
+    uint8_t *arrays;
+    
+    if (rslt == NULL)
+        return RC(rcAlign, rcRow, rcConstructing, rcParam, rcNull);
+    *rslt = NULL;
+    if (capacity == 0)
+        return RC(rcAlign, rcRow, rcConstructing, rcParam, rcInvalid);
+
+    self = calloc(1, sizeof(*self) + capacity * per_record);
+    if (self == NULL)
+        return RC(rcAlign, rcRow, rcConstructing, rcMemory, rcExhausted);
+
+    /* the arrays follow in order of decreasing alignment */
+    dad = &self->dad;
+    arrays = (uint8_t *)(self + 1);
+    dad->record       = (uint8_t const **)arrays; arrays += capacity * sizeof(dad->record[0]);
+    dad->recordSize   = (uint32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->refSeqId     = ( int32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->position     = ( int32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->mateRefSeqId = ( int32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->matePosition = ( int32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->insertSize   = ( int32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->readLen      = (uint32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->cigarOffset  = (uint32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->seqOffset    = (uint32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->qualOffset   = (uint32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->tagOffset    = (uint32_t *)arrays; arrays += capacity * sizeof(uint32_t);
+    dad->cigarCount   = (uint16_t *)arrays; arrays += capacity * sizeof(uint16_t);
+    dad->flags        = (uint16_t *)arrays; arrays += capacity * sizeof(uint16_t);
+    dad->mapQual      = arrays;
+    dad->capacity = capacity;
+
+    *rslt = dad;
+    return 0;
+}
+
+LIB_EXPORT rc_t CC BAMAlignmentBatchRelease(BAMAlignmentBatch *batch)
+{
+    BAMAlignmentBatchImpl *const self = (BAMAlignmentBatchImpl *)batch;
+
+    if (self != NULL) {
+        free(self->spill);
+        free(self);
+    }
+    return 0;
+}
+
+/* decodes the fixed part of the record, false if the record is malformed */
+static bool BAMAlignmentBatchSet(BAMAlignmentBatch *const self, unsigned const i,
+                                 uint8_t const *const data, unsigned const datasize)
+{
+    struct bam_alignment_s const *const raw = (struct bam_alignment_s const *)data;
+    unsigned const name = (unsigned)(raw->read_name - (char const *)raw);
+    uint64_t cigar;
+    uint64_t seq;
+    uint64_t qual;
+    uint64_t xtra;
+    uint32_t readLen;
+    uint16_t cigCnt;
+
+    if (datasize < name)
+        return false;
+
+    readLen = LE2HUI32(raw->read_len);
+    cigCnt  = LE2HUI16(raw->n_cigars);
+    cigar   = name + raw->read_name_len;
+    seq     = cigar + 4 * (uint64_t)cigCnt;
+    qual    = seq + ((uint64_t)readLen + 1) / 2;
+    xtra    = qual + readLen;
+    if (xtra > datasize)
+        return false;
+
+    self->record[i]       = data;
+    self->recordSize[i]   = datasize;
+    self->refSeqId[i]     = LE2HI32(raw->rID);
+    self->position[i]     = LE2HI32(raw->pos);
+    self->mateRefSeqId[i] = LE2HI32(raw->mate_rID);
+    self->matePosition[i] = LE2HI32(raw->mate_pos);
+    self->insertSize[i]   = LE2HI32(raw->ins_size);
+    self->readLen[i]      = readLen;
+    self->cigarOffset[i]  = (uint32_t)cigar;
+    self->seqOffset[i]    = (uint32_t)seq;
+    self->qualOffset[i]   = (uint32_t)qual;
+    self->tagOffset[i]    = (uint32_t)xtra;
+    self->cigarCount[i]   = cigCnt;
+    self->flags[i]        = LE2HUI16(raw->flags);
+    self->mapQual[i]      = raw->mapQual;
+    return true;
+}
+
+LIB_EXPORT rc_t CC BAMFileReadBatch(const BAMFile *cself, BAMAlignmentBatch *batch)
+{
+    BAMFile *const self = (BAMFile *)cself;
+    BAMAlignmentBatchImpl *const impl = (BAMAlignmentBatchImpl *)batch;
+    rc_t rc;
+    
+    if (self == NULL || batch == NULL)
+        return RC(rcAlign, rcFile, rcReading, rcParam, rcNull);
+    
+    batch->count = 0;
+    
+    if (self->bufCurrent >= self->bufSize && self->eof)
+        return RC(rcAlign, rcFile, rcReading, rcRow, rcNotFound);
+
+    rc = BAMFileBreakLock(self);
+    if (rc)
+        return rc;
+
+    while (batch->count < batch->capacity) {
+        unsigned const maxPeek = BAMFileMaxPeek(self);
+        uint8_t const *data;
+        int32_t i32 = 0;
+
+        if (maxPeek == 0) {
+            /* refilling would overwrite the records already in the batch */
+            if (batch->count > 0)
+                break;
+
+            rc = BAMFileFillBuffer(self);
+            if (rc == 0)
+                continue;
+            if ( GetRCObject( rc ) == (enum RCObject)rcData && GetRCState( rc ) == rcInsufficient )
+            {
+                self->eof = true;
+                rc = SILENT_RC(rcAlign, rcFile, rcReading, rcRow, rcNotFound);
+            }
+            return rc;
+        }
+        if (maxPeek >= 4) {
+            i32 = BAMFilePeekI32(self);
+            if (i32 <= 0)
+                return RC(rcAlign, rcFile, rcReading, rcData, rcInvalid);
+        }
+        if (maxPeek >= 4 && maxPeek - 4 >= (uint32_t)i32) {
+            data = BAMFilePeek(self, 4);
+            BAMFileAdvance(self, 4 + i32);
+        }
+        else if (batch->count > 0) {
+            /* the record spans blocks; it starts the next batch */
+            break;
+        }
+        else {
+            rc = BAMFileReadI32(self, &i32);
+            if ( rc != 0 )
+            {
+                if ( GetRCObject( rc ) == (enum RCObject)rcData && GetRCState( rc ) == rcInsufficient )
+                {
+                    self->eof = true;
+                    rc = RC( rcAlign, rcFile, rcReading, rcRow, rcNotFound );
+                }
+                return rc;
+            }
+            if (i32 <= 0)
+                return RC(rcAlign, rcFile, rcReading, rcData, rcInvalid);
+            if (impl->spill_size < (uint32_t)i32) {
+                size_t const size = ((uint32_t)i32 + 4095u) & ~(size_t)4095u;
+                void *const temp = realloc(impl->spill, size);
+
+                if (temp == NULL)
+                    return RC(rcAlign, rcFile, rcReading, rcMemory, rcExhausted);
+                impl->spill = temp;
+                impl->spill_size = size;
+            }
+            rc = BAMFileReadn(self, i32, impl->spill);
+            if (rc)
+                return rc;
+            data = impl->spill;
+        }
+        if (!BAMAlignmentBatchSet(batch, batch->count, data, i32))
+            return RC(rcAlign, rcFile, rcReading, rcRow, rcInvalid);
+        ++batch->count;
+    }
+    return 0;
+}
+
 /* MARK: BAM File header info accessor */
 
 LIB_EXPORT rc_t CC BAMFileGetRefSeqById(const BAMFile *cself, int32_t id, const BAMRefSeq **rhs)
@@ -4179,6 +4621,65 @@ rc_t LoadIndex(BAMFile *self, const uint8_t buf[], size_t blen)
     return rc;
 }
 
+/* CSI files, unlike BAI, are written BGZF compressed */
+static rc_t BAMIndexInflate(uint8_t **const rslt, size_t *const rlen,
+                            uint8_t const cdata[], size_t const clen)
+{
+    uint8_t *data = NULL;
+    size_t dlen = 0;
+    size_t dmax = 0;
+    size_t cp = 0;
+    z_stream zs;
+    rc_t rc = 0;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+        return RC(rcAlign, rcIndex, rcReading, rcMemory, rcExhausted);
+
+    while (cp < clen) {
+        unsigned hsize;
+        unsigned bsize;
+        unsigned dsize;
+
+        if (cp + 12 > clen) {
+            rc = RC(rcAlign, rcIndex, rcReading, rcFile, rcTooShort);
+            break;
+        }
+        rc = BGZFHeaderSize(&cdata[cp], &hsize);
+        if (rc == 0 && cp + hsize > clen)
+            rc = RC(rcAlign, rcIndex, rcReading, rcFile, rcTooShort);
+        if (rc == 0)
+            rc = BGZFBlockSize(&cdata[cp], hsize, &bsize);
+        if (rc == 0 && cp + bsize > clen)
+            rc = RC(rcAlign, rcIndex, rcReading, rcFile, rcTooShort);
+        if (rc == 0 && dlen + ZLIB_BLOCK_SIZE > dmax) {
+            size_t const max = dmax ? dmax * 2 : 16 * ZLIB_BLOCK_SIZE;
+            void *const temp = realloc(data, max);
+
+            if (temp == NULL)
+                rc = RC(rcAlign, rcIndex, rcReading, rcMemory, rcExhausted);
+            else {
+                data = temp;
+                dmax = max;
+            }
+        }
+        if (rc == 0)
+            rc = BGZFInflateBlock(&zs, &cdata[cp], hsize, bsize, &data[dlen], &dsize);
+        if (rc)
+            break;
+        dlen += dsize;
+        cp += bsize;
+    }
+    inflateEnd(&zs);
+    if (rc) {
+        free(data);
+        return rc;
+    }
+    *rslt = data;
+    *rlen = dlen;
+    return 0;
+}
+
 static
 rc_t BAMFileOpenIndexKFile(const BAMFile *self, KFile const *kf)
 {
@@ -4201,8 +4702,29 @@ rc_t BAMFileOpenIndexKFile(const BAMFile *self, KFile const *kf)
             
             rc = KFileReadAll(kf, 0, buf, fsize, &nread);
             if (rc == 0) {
+                if (nread >= 4 && buf[0] == 31 && buf[1] == 139) {
+                    uint8_t *data;
+
+                    rc = BAMIndexInflate(&data, &nread, buf, nread);
+                    free(buf);
+                    if (rc)
+                        return rc;
+                    buf = data;
+                    fsize = nread;
+                }
                 if (nread == fsize) {
-                    rc = LoadIndex((BAMFile *)self, buf, nread);
+                    BAMChunkIndex *cndx;
+
+                    rc = BAMChunkIndexMake(&cndx, buf, nread);
+                    if (rc == 0 && memcmp(buf, "BAI\1", 4) == 0)
+                        rc = LoadIndex((BAMFile *)self, buf, nread);
+                    if (rc == 0) {
+                        if (self->cndx)
+                            BAMChunkIndexWhack(self->cndx);
+                        ((BAMFile *)self)->cndx = cndx;
+                    }
+                    else
+                        BAMChunkIndexWhack(cndx);
                     free(buf);
                     return rc;
                 }
@@ -4401,6 +4923,727 @@ static rc_t BAMIndexWhack(const BAMIndex *cself) {
     return 0;
 }
 
+/* MARK: BAM chunk index */
+
+/* The bins and chunks of a BAI or CSI index as they are in the file.
+ * BAI is CSI with min_shift 14 and depth 5 and a 16kbp linear index in
+ * place of the per-bin offsets.
+ */
+typedef struct BAMIndexChunk_s {
+    uint64_t beg;
+    uint64_t end;
+} BAMIndexChunk;
+
+typedef struct BAMIndexBin_s {
+    uint64_t loffset;
+    BAMIndexChunk const *chunk;
+    uint32_t bin;
+    uint32_t chunks;
+} BAMIndexBin;
+
+typedef struct BAMIndexRef_s {
+    BAMIndexBin const *bin;
+    uint64_t const *ioff;
+    uint32_t bins;
+    uint32_t ioffs;
+} BAMIndexRef;
+
+struct BAMChunkIndex {
+    BAMIndexRef *ref;
+    BAMIndexBin *bin;
+    BAMIndexChunk *chunk;
+    uint64_t *ioff;
+    uint32_t refs;
+    uint32_t bins;
+    uint32_t chunks;
+    uint32_t ioffs;
+    int min_shift;
+    int depth;
+};
+
+/* counts the index entries if self->ref is NULL, else fills them in */
+static rc_t BAMChunkIndexWalk(BAMChunkIndex *const self, uint8_t const buf[], size_t const blen)
+{
+    bool const fill = self->ref != NULL;
+    bool const csi = memcmp(buf, "CSI\1", 4) == 0;
+    uint32_t bins = 0;
+    uint32_t chunks = 0;
+    uint32_t ioffs = 0;
+    size_t cp = 4;
+    int32_t nrefs;
+    int32_t i;
+
+    if (csi) {
+        int32_t l_aux;
+
+        if (cp + 12 > blen)
+            return RC(rcAlign, rcIndex, rcReading, rcData, rcInsufficient);
+        self->min_shift = LE2HI32(buf + cp);
+        self->depth = LE2HI32(buf + cp + 4);
+        l_aux = LE2HI32(buf + cp + 8);
+        cp += 12;
+        /* bin numbers have to fit in 32 bits */
+        if (self->min_shift < 0 || self->depth < 0 || self->depth > 9 ||
+            self->min_shift + 3 * self->depth > 63 || l_aux < 0)
+        {
+            return RC(rcAlign, rcIndex, rcReading, rcData, rcInvalid);
+        }
+        cp += l_aux;
+    }
+    else {
+        self->min_shift = 14;
+        self->depth = 5;
+    }
+    if (cp + 4 > blen)
+        return RC(rcAlign, rcIndex, rcReading, rcData, rcInsufficient);
+    nrefs = LE2HI32(buf + cp); cp += 4;
+    if (nrefs < 0)
+        return RC(rcAlign, rcIndex, rcReading, rcData, rcInvalid);
+    self->refs = nrefs;
+
+    for (i = 0; i < nrefs; ++i) {
+        int32_t nbins;
+        int32_t j;
+
+        if (cp + 4 > blen)
+            return RC(rcAlign, rcIndex, rcReading, rcData, rcInsufficient);
+        nbins = LE2HI32(buf + cp); cp += 4;
+        if (nbins < 0)
+            return RC(rcAlign, rcIndex, rcReading, rcData, rcInvalid);
+        if (fill) {
+            self->ref[i].bin = &self->bin[bins];
+            self->ref[i].bins = nbins;
+        }
+        for (j = 0; j < nbins; ++j) {
+            uint32_t bin;
+            uint64_t loffset = 0;
+            int32_t nchunks;
+
+            if (cp + (csi ? 16 : 8) > blen)
+                return RC(rcAlign, rcIndex, rcReading, rcData, rcInsufficient);
+            bin = LE2HUI32(buf + cp); cp += 4;
+            if (csi) {
+                loffset = LE2HUI64(buf + cp); cp += 8;
+            }
+            nchunks = LE2HI32(buf + cp); cp += 4;
+            if (nchunks < 0)
+                return RC(rcAlign, rcIndex, rcReading, rcData, rcInvalid);
+            if ((blen - cp) / 16 < (size_t)nchunks)
+                return RC(rcAlign, rcIndex, rcReading, rcData, rcInsufficient);
+            if (fill) {
+                BAMIndexBin *const b = &self->bin[bins];
+                int32_t k;
+
+                b->bin = bin;
+                b->loffset = loffset;
+                b->chunk = &self->chunk[chunks];
+                b->chunks = nchunks;
+                for (k = 0; k < nchunks; ++k) {
+                    self->chunk[chunks + k].beg = LE2HUI64(buf + cp + 16 * k);
+                    self->chunk[chunks + k].end = LE2HUI64(buf + cp + 16 * k + 8);
+                }
+            }
+            cp += 16 * (size_t)nchunks;
+            chunks += nchunks;
+            ++bins;
+        }
+        if (!csi) {
+            int32_t nioffs;
+
+            if (cp + 4 > blen)
+                return RC(rcAlign, rcIndex, rcReading, rcData, rcInsufficient);
+            nioffs = LE2HI32(buf + cp); cp += 4;
+            if (nioffs < 0)
+                return RC(rcAlign, rcIndex, rcReading, rcData, rcInvalid);
+            if ((blen - cp) / 8 < (size_t)nioffs)
+                return RC(rcAlign, rcIndex, rcReading, rcData, rcInsufficient);
+            if (fill) {
+                int32_t k;
+
+                self->ref[i].ioff = &self->ioff[ioffs];
+                self->ref[i].ioffs = nioffs;
+                for (k = 0; k < nioffs; ++k)
+                    self->ioff[ioffs + k] = LE2HUI64(buf + cp + 8 * k);
+            }
+            cp += 8 * (size_t)nioffs;
+            ioffs += nioffs;
+        }
+    }
+    self->bins = bins;
+    self->chunks = chunks;
+    self->ioffs = ioffs;
+    return 0;
+}
+
+static rc_t BAMChunkIndexMake(BAMChunkIndex **rslt, uint8_t const buf[], size_t const blen)
+{
+    BAMChunkIndex count;
+    BAMChunkIndex *self;
+    rc_t rc;
+
+    *rslt = NULL;
+    if (blen < 4 || (memcmp(buf, "BAI\1", 4) != 0 && memcmp(buf, "CSI\1", 4) != 0))
+        return RC(rcAlign, rcIndex, rcReading, rcFormat, rcUnknown);
+
+    memset(&count, 0, sizeof(count));
+    rc = BAMChunkIndexWalk(&count, buf, blen);
+    if (rc)
+        return rc;
+
+    self = calloc(1, sizeof(*self)
+                   + count.refs * sizeof(self->ref[0])
+                   + count.bins * sizeof(self->bin[0])
+                   + count.chunks * sizeof(self->chunk[0])
+                   + count.ioffs * sizeof(self->ioff[0]));
+    if (self == NULL)
+        return RC(rcAlign, rcIndex, rcReading, rcMemory, rcExhausted);
+
+    self->ref = (BAMIndexRef *)(self + 1);
+    self->bin = (BAMIndexBin *)(self->ref + count.refs);
+    self->chunk = (BAMIndexChunk *)(self->bin + count.bins);
+    self->ioff = (uint64_t *)(self->chunk + count.chunks);
+
+    rc = BAMChunkIndexWalk(self, buf, blen);
+    if (rc) {
+        free(self);
+        return rc;
+    }
+    *rslt = self;
+    return 0;
+}
+
+/* the reference range covered by a bin, false for pseudo-bins */
+static bool BAMChunkIndexBinRange(BAMChunkIndex const *const self, uint32_t const bin,
+                                  uint64_t *const beg, uint64_t *const end)
+{
+    uint64_t first = 0;
+    int level;
+
+    for (level = 0; level <= self->depth; ++level) {
+        uint64_t const count = (uint64_t)1 << (3 * level);
+
+        if (bin < first + count) {
+            int const shift = self->min_shift + 3 * (self->depth - level);
+
+            *beg = (bin - first) << shift;
+            *end = *beg + ((uint64_t)1 << shift);
+            return true;
+        }
+        first += count;
+    }
+    return false;
+}
+
+/* a lower bound on the file offsets of the alignments overlapping pos */
+static uint64_t BAMChunkIndexMinOffset(BAMChunkIndex const *const self,
+                                       BAMIndexRef const *const ref,
+                                       uint64_t const pos)
+{
+    if (ref->ioffs > 0) {
+        uint64_t const i = pos >> self->min_shift;
+
+        return ref->ioff[i < ref->ioffs ? i : ref->ioffs - 1];
+    }
+    else {
+        /* use the smallest bin containing pos that is in the index */
+        uint64_t first = ((uint64_t)1 << (3 * self->depth + 3)) / 7;
+        int level;
+
+        for (level = self->depth; level >= 0; --level) {
+            int const shift = self->min_shift + 3 * (self->depth - level);
+            uint64_t const bin = (first -= (uint64_t)1 << (3 * level)) + (pos >> shift);
+            uint32_t i;
+
+            if ((pos >> shift) >= ((uint64_t)1 << (3 * level)))
+                continue;
+            for (i = 0; i < ref->bins; ++i) {
+                if (ref->bin[i].bin == bin)
+                    return ref->bin[i].loffset;
+            }
+        }
+        return 0;
+    }
+}
+
+static rc_t BAMChunkIndexWhack(BAMChunkIndex const *cself)
+{
+    free((void *)cself);
+    return 0;
+}
+
+/* MARK: BAM region queries */
+
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
+#define REGION_THREADS_MAX (32)
+#define REGION_QUEUE_BYTES (4u * 1024u * 1024u) /* bytes fetched ahead per thread */
+
+typedef struct BAMRegionChunk_s BAMRegionChunk;
+struct BAMRegionChunk_s {
+    uint64_t beg;       /* virtual offsets */
+    uint64_t end;
+    uint8_t *data;      /* the inflated blocks of the chunk */
+    size_t size;
+    size_t first;       /* offset in data of beg */
+    size_t last;        /* offset in data of end */
+    size_t held;        /* bytes charged against the read-ahead budget */
+    uint32_t region;
+    rc_t rc;
+    bool ready;
+};
+
+struct BAMRegionQuery {
+    BAMFile const *file;
+    KFile const *kfp;
+    BAMRegion *region;
+    bool *region_done;
+    BAMRegionChunk *chunk;
+    KLock *lock;
+    KCondition *have_data;
+    KCondition *need_data;
+    KThread *thread[REGION_THREADS_MAX];
+    size_t rpos;        /* read position in the current chunk */
+    size_t budget;      /* read-ahead limit in bytes */
+    size_t inflight;    /* bytes held by chunks fetched or being fetched */
+    uint32_t regions;
+    uint32_t chunks;
+    uint32_t max_chunks;
+    uint32_t next;      /* next chunk to fetch */
+    uint32_t cur;       /* chunk being read */
+    uint32_t nthreads;
+    bool reading;       /* the current chunk has been fetched */
+    bool quit;
+};
+
+static int64_t CC BAMRegionChunkCompare(void const *A, void const *B, void *ignored)
+{
+    BAMRegionChunk const *const a = A;
+    BAMRegionChunk const *const b = B;
+
+    return a->beg < b->beg ? -1 : a->beg > b->beg ? 1 : 0;
+}
+
+/* adds the chunks of a region in file order, merging those that
+ * overlap or share a BGZF block
+ */
+static rc_t BAMRegionQueryAddRegion(BAMRegionQuery *const self,
+                                    BAMChunkIndex const *const ndx,
+                                    uint32_t const r)
+{
+    BAMRegion const *const reg = &self->region[r];
+    BAMIndexRef const *ref;
+    uint32_t const first = self->chunks;
+    uint64_t minoff;
+    uint32_t i;
+    uint32_t n;
+
+    if (reg->refSeqId >= ndx->refs || reg->start >= reg->end)
+        return 0;
+    ref = &ndx->ref[reg->refSeqId];
+    minoff = BAMChunkIndexMinOffset(ndx, ref, reg->start);
+
+    for (i = 0; i < ref->bins; ++i) {
+        BAMIndexBin const *const bin = &ref->bin[i];
+        uint64_t beg;
+        uint64_t end;
+        uint32_t j;
+
+        if (!BAMChunkIndexBinRange(ndx, bin->bin, &beg, &end))
+            continue;
+        if (end <= reg->start || reg->end <= beg)
+            continue;
+        for (j = 0; j < bin->chunks; ++j) {
+            BAMRegionChunk *chunk;
+
+            if (bin->chunk[j].end <= minoff || bin->chunk[j].end <= bin->chunk[j].beg)
+                continue;
+            if (self->chunks == self->max_chunks) {
+                uint32_t const max = self->max_chunks ? self->max_chunks * 2 : 64;
+                void *const temp = realloc(self->chunk, max * sizeof(self->chunk[0]));
+
+                if (temp == NULL)
+                    return RC(rcAlign, rcIndex, rcSearching, rcMemory, rcExhausted);
+                self->chunk = temp;
+                self->max_chunks = max;
+            }
+            chunk = &self->chunk[self->chunks++];
+            memset(chunk, 0, sizeof(*chunk));
+            chunk->beg = bin->chunk[j].beg < minoff ? minoff : bin->chunk[j].beg;
+            chunk->end = bin->chunk[j].end;
+            chunk->region = r;
+        }
+    }
+    if (self->chunks - first < 2)
+        return 0;
+
+    ksort(&self->chunk[first], self->chunks - first, sizeof(self->chunk[0]), BAMRegionChunkCompare, NULL);
+    for (n = first, i = first + 1; i < self->chunks; ++i) {
+        BAMRegionChunk *const last = &self->chunk[n];
+        BAMRegionChunk const *const chunk = &self->chunk[i];
+
+        if ((chunk->beg >> 16) <= (last->end >> 16)) {
+            if (last->end < chunk->end)
+                last->end = chunk->end;
+        }
+        else
+            self->chunk[++n] = *chunk;
+    }
+    self->chunks = n + 1;
+    return 0;
+}
+
+/* the compressed bytes spanned by a chunk */
+static size_t BAMRegionChunkSpan(BAMRegionChunk const *const chunk)
+{
+    return (size_t)((chunk->end >> 16) - (chunk->beg >> 16)) + ((chunk->end & 0xFFFF) ? ZLIB_BLOCK_SIZE : 0);
+}
+
+/* reads and inflates the BGZF blocks of a chunk */
+static rc_t BAMRegionChunkFetch(KFile const *const kfp, BAMRegionChunk *const chunk)
+{
+    uint64_t const cbeg = chunk->beg >> 16;
+    uint64_t const cend = chunk->end >> 16;
+    unsigned const uend = (unsigned)(chunk->end & 0xFFFF);
+    size_t const clen = BAMRegionChunkSpan(chunk);
+    size_t dmax = 0;
+    size_t nread = 0;
+    size_t cp = 0;
+    uint8_t *cdata;
+    z_stream zs;
+    rc_t rc;
+
+    chunk->data = NULL;
+    chunk->size = 0;
+    chunk->first = (size_t)(chunk->beg & 0xFFFF);
+    chunk->last = 0;
+
+    cdata = malloc(clen);
+    if (cdata == NULL)
+        return RC(rcAlign, rcFile, rcReading, rcMemory, rcExhausted);
+    rc = KFileReadAll(kfp, cbeg, cdata, clen, &nread);
+
+    memset(&zs, 0, sizeof(zs));
+    if (rc == 0 && inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+        rc = RC(rcAlign, rcFile, rcReading, rcMemory, rcExhausted);
+    if (rc) {
+        free(cdata);
+        return rc;
+    }
+
+    while (cp < cend - cbeg || (cp == cend - cbeg && uend != 0)) {
+        unsigned hsize;
+        unsigned bsize;
+        unsigned dsize;
+
+        if (cp + 12 > nread) {
+            rc = RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+            break;
+        }
+        rc = BGZFHeaderSize(&cdata[cp], &hsize);
+        if (rc == 0 && cp + hsize > nread)
+            rc = RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+        if (rc == 0)
+            rc = BGZFBlockSize(&cdata[cp], hsize, &bsize);
+        if (rc == 0 && cp + bsize > nread)
+            rc = RC(rcAlign, rcFile, rcReading, rcFile, rcTooShort);
+        if (rc == 0 && chunk->size + ZLIB_BLOCK_SIZE > dmax) {
+            size_t const max = dmax ? dmax * 2 : 4 * ZLIB_BLOCK_SIZE;
+            void *const temp = realloc(chunk->data, max);
+
+            if (temp == NULL)
+                rc = RC(rcAlign, rcFile, rcReading, rcMemory, rcExhausted);
+            else {
+                chunk->data = temp;
+                dmax = max;
+            }
+        }
+        if (rc)
+            break;
+        if (cp == cend - cbeg)
+            chunk->last = chunk->size + uend;
+        rc = BGZFInflateBlock(&zs, &cdata[cp], hsize, bsize, &chunk->data[chunk->size], &dsize);
+        if (rc)
+            break;
+        chunk->size += dsize;
+        cp += bsize;
+    }
+    inflateEnd(&zs);
+    free(cdata);
+
+    if (rc == 0) {
+        if (uend == 0) {
+            if (cp != cend - cbeg)
+                rc = RC(rcAlign, rcIndex, rcReading, rcData, rcInvalid);
+            chunk->last = chunk->size;
+        }
+        if (chunk->last > chunk->size || chunk->first > chunk->last)
+            rc = RC(rcAlign, rcIndex, rcReading, rcData, rcInvalid);
+    }
+    if (rc) {
+        free(chunk->data);
+        chunk->data = NULL;
+    }
+    return rc;
+}
+
+static rc_t CC BAMRegionQueryFetcherMain(KThread const *const th, void *const vp)
+{
+    BAMRegionQuery *const self = (BAMRegionQuery *)vp;
+
+    KLockAcquire(self->lock);
+    while (!self->quit && self->next < self->chunks) {
+        BAMRegionChunk *const chunk = &self->chunk[self->next];
+
+        /* the chunk the reader waits on is always fetched, however large */
+        if (self->next > self->cur && self->inflight + BAMRegionChunkSpan(chunk) > self->budget)
+            KConditionWait(self->need_data, self->lock);
+        else {
+            rc_t rc;
+
+            ++self->next;
+            chunk->held = BAMRegionChunkSpan(chunk);
+            self->inflight += chunk->held;
+            KLockUnlock(self->lock);
+            rc = BAMRegionChunkFetch(self->kfp, chunk);
+            KLockAcquire(self->lock);
+            /* charge what the chunk actually holds now that it is inflated */
+            self->inflight -= chunk->held;
+            chunk->held = chunk->size;
+            self->inflight += chunk->held;
+            chunk->rc = rc;
+            chunk->ready = true;
+            KConditionSignal(self->have_data);
+        }
+    }
+    KLockUnlock(self->lock);
+    return 0;
+}
+
+LIB_EXPORT rc_t CC BAMRegionQueryRelease(BAMRegionQuery *self)
+{
+    uint32_t i;
+
+    if (self == NULL)
+        return 0;
+
+    if (self->lock) {
+        KLockAcquire(self->lock);
+        self->quit = true;
+        KConditionBroadcast(self->need_data);
+        KLockUnlock(self->lock);
+    }
+    for (i = 0; i < self->nthreads; ++i) {
+        KThreadWait(self->thread[i], NULL);
+        KThreadRelease(self->thread[i]);
+    }
+    for (i = 0; i < self->chunks; ++i)
+        free(self->chunk[i].data);
+    free(self->chunk);
+    free(self->region);
+    free(self->region_done);
+    KConditionRelease(self->need_data);
+    KConditionRelease(self->have_data);
+    KLockRelease(self->lock);
+    BAMFileRelease(self->file);
+    free(self);
+    return 0;
+}
+
+LIB_EXPORT rc_t CC BAMFileMakeRegionQuery(const BAMFile *file, BAMRegionQuery **rslt,
+                                          const BAMRegion regions[], uint32_t count,
+                                          uint32_t threads)
+{
+    BAMRegionQuery *self;
+    uint32_t i;
+    rc_t rc = 0;
+
+    if (rslt == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcParam, rcNull);
+    *rslt = NULL;
+    if (file == NULL || (regions == NULL && count > 0))
+        return RC(rcAlign, rcFile, rcConstructing, rcParam, rcNull);
+    if (file->cndx == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcIndex, rcNotFound);
+    for (i = 0; i < count; ++i) {
+        if (regions[i].refSeqId >= file->refSeqs)
+            return RC(rcAlign, rcFile, rcConstructing, rcParam, rcInvalid);
+    }
+    if (threads > REGION_THREADS_MAX)
+        threads = REGION_THREADS_MAX;
+
+    self = calloc(1, sizeof(*self));
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    BAMFileAddRef(file);
+    self->file = file;
+    /* the plain and threaded files both start with a BGZFile */
+    self->kfp = file->file.plain.kfp;
+    self->regions = count;
+
+    self->region = malloc((count ? count : 1) * sizeof(self->region[0]));
+    self->region_done = calloc(count ? count : 1, sizeof(self->region_done[0]));
+    if (self->region == NULL || self->region_done == NULL)
+        rc = RC(rcAlign, rcFile, rcConstructing, rcMemory, rcExhausted);
+    else {
+        memmove(self->region, regions, count * sizeof(self->region[0]));
+        for (i = 0; i < count && rc == 0; ++i)
+            rc = BAMRegionQueryAddRegion(self, file->cndx, i);
+    }
+
+    if (rc == 0 && threads > 0 && self->chunks > 0) {
+        self->budget = (size_t)threads * REGION_QUEUE_BYTES;
+        rc = KLockMake(&self->lock);
+        if (rc == 0)
+            rc = KConditionMake(&self->have_data);
+        if (rc == 0)
+            rc = KConditionMake(&self->need_data);
+        while (rc == 0 && self->nthreads < threads) {
+            rc = KThreadMake(&self->thread[self->nthreads], BAMRegionQueryFetcherMain, self);
+            if (rc == 0)
+                ++self->nthreads;
+            else if (self->nthreads > 0) {
+                /* make do with the threads we got */
+                rc = 0;
+                break;
+            }
+        }
+    }
+    if (rc == 0) {
+        *rslt = self;
+        return 0;
+    }
+    BAMRegionQueryRelease(self);
+    return rc;
+}
+
+/* waits for the current chunk to be fetched, or fetches it */
+static rc_t BAMRegionQueryGetChunk(BAMRegionQuery *const self, BAMRegionChunk *const chunk)
+{
+    if (self->nthreads == 0) {
+        if (!chunk->ready) {
+            chunk->rc = BAMRegionChunkFetch(self->kfp, chunk);
+            chunk->ready = true;
+        }
+    }
+    else {
+        KLockAcquire(self->lock);
+        while (!chunk->ready)
+            KConditionWait(self->have_data, self->lock);
+        KLockUnlock(self->lock);
+    }
+    return chunk->rc;
+}
+
+static void BAMRegionQueryNextChunk(BAMRegionQuery *const self)
+{
+    BAMRegionChunk *const chunk = &self->chunk[self->cur];
+
+    free(chunk->data);
+    chunk->data = NULL;
+    self->reading = false;
+    if (self->nthreads == 0)
+        ++self->cur;
+    else {
+        KLockAcquire(self->lock);
+        self->inflight -= chunk->held;
+        chunk->held = 0;
+        ++self->cur;
+        KConditionBroadcast(self->need_data);
+        KLockUnlock(self->lock);
+    }
+}
+
+LIB_EXPORT rc_t CC BAMRegionQueryRead(BAMRegionQuery *self, uint32_t *region, const BAMAlignment **rslt)
+{
+    if (self == NULL || region == NULL || rslt == NULL)
+        return RC(rcAlign, rcFile, rcReading, rcParam, rcNull);
+    *rslt = NULL;
+
+    for ( ; ; ) {
+        BAMRegionChunk *chunk;
+        BAMRegion const *reg;
+        uint8_t const *data;
+        BAMAlignment x;
+        int32_t refSeq;
+        int32_t alignPos;
+        int32_t alignEndPos;
+        int32_t datasize;
+
+        if (self->cur == self->chunks)
+            return RC(rcAlign, rcFile, rcReading, rcRow, rcNotFound);
+        chunk = &self->chunk[self->cur];
+        if (!self->reading) {
+            rc_t const rc = BAMRegionQueryGetChunk(self, chunk);
+            if (rc)
+                return rc;
+            self->rpos = chunk->first;
+            self->reading = true;
+        }
+        if (self->region_done[chunk->region] || self->rpos >= chunk->last) {
+            BAMRegionQueryNextChunk(self);
+            continue;
+        }
+
+        if (self->rpos + 4 > chunk->size)
+            return RC(rcAlign, rcFile, rcReading, rcData, rcInvalid);
+        data = &chunk->data[self->rpos];
+        datasize = LE2HI32(data);
+        if (datasize <= 0 || chunk->size - self->rpos - 4 < (uint32_t)datasize)
+            return RC(rcAlign, rcFile, rcReading, rcData, rcInvalid);
+        self->rpos += 4 + datasize;
+        data += 4;
+
+        memset(&x, 0, sizeof(x));
+        x.data = (bam_alignment const *)data;
+        x.datasize = datasize;
+        if (BAMAlignmentSetOffsets(&x) > x.datasize)
+            return RC(rcAlign, rcFile, rcReading, rcRow, rcInvalid);
+        BAMAlignmentAlignInfo(&x, &refSeq, &alignPos, &alignEndPos);
+
+        /* the file is sorted, so the region is done once past its end */
+        reg = &self->region[chunk->region];
+        if (refSeq < 0 || refSeq > (int64_t)reg->refSeqId ||
+            (refSeq == reg->refSeqId && alignPos >= 0 && (uint64_t)alignPos >= reg->end))
+        {
+            self->region_done[chunk->region] = true;
+            continue;
+        }
+        if (refSeq < reg->refSeqId)
+            continue;
+        if (alignEndPos == alignPos)
+            ++alignEndPos;
+        if (alignEndPos <= 0 || (uint64_t)alignEndPos <= reg->start)
+            continue;
+
+        {
+            unsigned const rsltsize = BAMAlignmentSizeFromData(datasize, data);
+            BAMAlignment *const y = malloc(rsltsize);
+            uint8_t *const storage = malloc(datasize);
+
+            if (y == NULL || storage == NULL) {
+                free(y);
+                free(storage);
+                return RC(rcAlign, rcFile, rcReading, rcMemory, rcExhausted);
+            }
+            memmove(storage, data, datasize);
+            if (!BAMAlignmentInitLog(y, rsltsize, datasize, storage)) {
+                free(y);
+                free(storage);
+                return RC(rcAlign, rcFile, rcReading, rcRow, rcInvalid);
+            }
+            y->storage = storage;
+            y->parent = (BAMFile *)self->file;
+            KRefcountInit(&y->refcount, 1, "BAMAlignment", "RegionQuery", "");
+            BAMFileAddRef(self->file);
+            *region = chunk->region;
+            *rslt = y;
+            return 0;
+        }
+    }
+}
+
 /* MARK: BAM Validation Stuff */
 
 static rc_t OpenVPathRead(const KFile **fp, struct VPath const *path)
@@ -31,6 +31,9 @@
 #include <klib/sort.h>
 #include <klib/text.h>
 #include <klib/out.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 #include <insdc/insdc.h>
 #include <align/manager.h>
 #include <align/iterator.h>
@@ -687,3 +690,360 @@ LIB_EXPORT rc_t CC PlacementSetIteratorNextIdAt ( PlacementSetIterator *self,
     }
     return rc;
 }
+
+
+/* =================================================================================================== */
+
+
+#define SHARD_THREADS_MAX ( 32 )
+
+/* in ordered mode: how many shards the workers may run ahead of delivery, per worker */
+#define SHARD_LOOKAHEAD ( 2 )
+
+
+typedef struct pi_shard
+{
+    pi_window * pw;                 /* the window it was cut from, its entries are the origins */
+    window w;                       /* the part of the window this shard covers */
+    bool first;                     /* first shard of the window: keeps placements starting before it */
+    bool last;                      /* last shard of the window: keeps placements starting after it */
+    DLList recs;                    /* ordered mode: the placements found, in order */
+    uint32_t worker;                /* which worker walked it */
+    rc_t rc;
+    bool done;
+} pi_shard;
+
+
+typedef struct pi_shard_walk
+{
+    pi_shard * shards;
+    uint32_t count;
+    uint32_t next;                  /* next shard to be claimed by a worker */
+    uint32_t delivered;             /* ordered mode: shards handed to visit so far */
+    uint32_t lookahead;
+    bool ordered;
+    bool abort;                     /* set on the first failure, stops claiming */
+    KLock * lock;
+    KCondition * cond;              /* shard done / shard delivered */
+    PlacementSetShardMakeFunc make;
+    PlacementSetShardVisitFunc visit;
+    void * data;
+} pi_shard_walk;
+
+
+typedef struct pi_shard_worker
+{
+    pi_shard_walk * walk;
+    uint32_t id;
+} pi_shard_worker;
+
+
+static void CC pi_shard_rec_whacker( DLNode *n, void *data )
+{
+    PlacementRecordWhack ( ( PlacementRecord * )n );
+}
+
+
+/* keeps a placement only in the shard containing its position */
+static rc_t pi_shard_emit( pi_shard_walk * walk, pi_shard * shard, const PlacementRecord * rec, uint32_t worker )
+{
+    if ( ( !shard->first && rec->pos < shard->w.first ) ||
+         ( !shard->last && rec->pos >= shard->w.first + ( INSDC_coord_zero )shard->w.len ) )
+    {
+        PlacementRecordWhack ( rec );
+        return 0;
+    }
+    if ( walk->ordered )
+    {
+        DLListPushTail ( &shard->recs, ( DLNode * )&rec->n );
+        return 0;
+    }
+    return walk->visit( rec, worker, walk->data );
+}
+
+
+/* the same merge PlacementSetIteratorNextAvailPos/NextRecordAt perform on a window,
+   over iterators made for the shard */
+static rc_t pi_shard_walk_one( pi_shard_walk * walk, pi_shard * shard, uint32_t worker )
+{
+    rc_t rc = 0;
+    uint32_t i, count = 0;
+    PlacementIterator ** pi = calloc( shard->pw->count, sizeof *pi );
+    pi_entry * pie;
+
+    if ( pi == NULL )
+        return RC( rcAlign, rcIterator, rcAccessing, rcMemory, rcExhausted );
+
+    for ( pie = ( pi_entry * )DLListHead( &shard->pw->pi_entries );
+          rc == 0 && pie != NULL;
+          pie = ( pi_entry * )DLNodeNext( ( DLNode * )pie ) )
+    {
+        rc = walk->make( &pi[ count ], pie->pi, shard->w.first, shard->w.len, worker, walk->data );
+        if ( rc == 0 && pi[ count ] != NULL )
+            ++count;
+    }
+
+    while ( rc == 0 )
+    {
+        INSDC_coord_zero min_pos = 0;
+        bool found = false;
+
+        for ( i = 0; rc == 0 && i < count; ++i )
+        {
+            INSDC_coord_zero pos;
+            rc_t rc1 = PlacementIteratorNextAvailPos ( pi[ i ], &pos, NULL );
+            if ( rc1 == 0 )
+            {
+                if ( !found || pos < min_pos )
+                    min_pos = pos;
+                found = true;
+            }
+            else if ( GetRCState( rc1 ) != rcDone )
+                rc = rc1;
+        }
+        if ( rc != 0 || !found )
+            break;
+
+        for ( i = 0; rc == 0 && i < count; ++i )
+        {
+            const PlacementRecord *rec;
+            rc_t rc1 = 0;
+            while ( rc == 0 && ( rc1 = PlacementIteratorNextRecordAt ( pi[ i ], min_pos, &rec ) ) == 0 )
+                rc = pi_shard_emit( walk, shard, rec, worker );
+            if ( rc == 0 && GetRCState( rc1 ) != rcDone )
+                rc = rc1;
+        }
+    }
+
+    for ( i = 0; i < count; ++i )
+        PlacementIteratorRelease ( pi[ i ] );
+    free( pi );
+    return rc;
+}
+
+
+/* claims the next shard, in ordered mode not too far ahead of delivery */
+static pi_shard * pi_shard_claim( pi_shard_walk * walk )
+{
+    pi_shard * shard = NULL;
+
+    KLockAcquire ( walk->lock );
+    while ( !walk->abort && walk->next < walk->count &&
+            walk->ordered && walk->next >= walk->delivered + walk->lookahead )
+    {
+        KConditionWait ( walk->cond, walk->lock );
+    }
+    if ( !walk->abort && walk->next < walk->count )
+        shard = &walk->shards[ walk->next++ ];
+    KLockUnlock ( walk->lock );
+
+    return shard;
+}
+
+
+static void pi_shard_finish( pi_shard_walk * walk, pi_shard * shard, uint32_t worker, rc_t rc )
+{
+    KLockAcquire ( walk->lock );
+    shard->worker = worker;
+    shard->rc = rc;
+    shard->done = true;
+    if ( rc != 0 )
+        walk->abort = true;
+    KConditionBroadcast ( walk->cond );
+    KLockUnlock ( walk->lock );
+}
+
+
+static rc_t CC pi_shard_thread( const KThread *th, void *data )
+{
+    pi_shard_worker * wrk = ( pi_shard_worker * )data;
+    pi_shard * shard;
+
+    while ( ( shard = pi_shard_claim( wrk->walk ) ) != NULL )
+        pi_shard_finish( wrk->walk, shard, wrk->id, pi_shard_walk_one( wrk->walk, shard, wrk->id ) );
+    return 0;
+}
+
+
+/* ordered mode: hands the shards to visit in order, as they become ready */
+static void pi_shard_deliver( pi_shard_walk * walk, bool inline_walk )
+{
+    uint32_t i;
+
+    for ( i = 0; i < walk->count && !walk->abort; ++i )
+    {
+        pi_shard * shard = &walk->shards[ i ];
+        rc_t rc = 0;
+
+        if ( inline_walk )
+        {
+            /* nobody to wait for */
+            walk->next = i + 1;
+            pi_shard_finish( walk, shard, 0, pi_shard_walk_one( walk, shard, 0 ) );
+        }
+        else
+        {
+            KLockAcquire ( walk->lock );
+            while ( !shard->done && !walk->abort )
+                KConditionWait ( walk->cond, walk->lock );
+            KLockUnlock ( walk->lock );
+        }
+        if ( !shard->done || shard->rc != 0 )
+            break;
+
+        while ( rc == 0 )
+        {
+            PlacementRecord * rec = ( PlacementRecord * )DLListPopHead ( &shard->recs );
+            if ( rec == NULL )
+                break;
+            rc = walk->visit( rec, shard->worker, walk->data );
+        }
+
+        KLockAcquire ( walk->lock );
+        if ( rc != 0 )
+        {
+            shard->rc = rc;
+            walk->abort = true;
+        }
+        walk->delivered = i + 1;
+        KConditionBroadcast ( walk->cond );
+        KLockUnlock ( walk->lock );
+    }
+}
+
+
+static rc_t pi_shard_cut( PlacementSetIterator *self, INSDC_coord_len shard_len, pi_shard_walk * walk )
+{
+    uint32_t count = 0;
+    pi_ref * pr;
+    pi_window * pw;
+
+    /* count first, then fill in, both in the order of the unsharded iteration */
+    for ( pr = ( pi_ref * )DLListHead( &self->pi_refs ); pr != NULL; pr = ( pi_ref * )DLNodeNext( ( DLNode * )pr ) )
+    {
+        for ( pw = ( pi_window * )DLListHead( &pr->pi_windows ); pw != NULL; pw = ( pi_window * )DLNodeNext( ( DLNode * )pw ) )
+            count += ( shard_len == 0 || pw->w.len <= shard_len ) ? 1 : ( pw->w.len + shard_len - 1 ) / shard_len;
+    }
+
+    walk->shards = calloc( count + 1, sizeof *walk->shards );
+    if ( walk->shards == NULL )
+        return RC( rcAlign, rcIterator, rcAccessing, rcMemory, rcExhausted );
+
+    for ( pr = ( pi_ref * )DLListHead( &self->pi_refs ); pr != NULL; pr = ( pi_ref * )DLNodeNext( ( DLNode * )pr ) )
+    {
+        for ( pw = ( pi_window * )DLListHead( &pr->pi_windows ); pw != NULL; pw = ( pi_window * )DLNodeNext( ( DLNode * )pw ) )
+        {
+            INSDC_coord_len done = 0;
+            do
+            {
+                pi_shard * shard = &walk->shards[ walk->count++ ];
+                INSDC_coord_len len = pw->w.len - done;
+
+                if ( shard_len != 0 && len > shard_len )
+                    len = shard_len;
+
+                shard->pw = pw;
+                shard->w.first = pw->w.first + ( INSDC_coord_zero )done;
+                shard->w.len = len;
+                shard->first = ( done == 0 );
+                done += len;
+                shard->last = ( done >= pw->w.len );
+                DLListInit( &shard->recs );
+            } while ( done < pw->w.len );
+        }
+    }
+    assert ( walk->count == count );
+    return 0;
+}
+
+
+LIB_EXPORT rc_t CC PlacementSetIteratorWalkShards ( PlacementSetIterator *self,
+    INSDC_coord_len shard_len, uint32_t num_threads, bool ordered,
+    PlacementSetShardMakeFunc make, PlacementSetShardVisitFunc visit, void *data )
+{
+    rc_t rc = 0;
+    pi_shard_walk walk;
+    pi_shard_worker wrk[ SHARD_THREADS_MAX ];
+    KThread *thread[ SHARD_THREADS_MAX ];
+    uint32_t i, nthreads = 0;
+
+    if ( self == NULL )
+        return RC( rcAlign, rcIterator, rcAccessing, rcSelf, rcNull );
+    if ( make == NULL || visit == NULL )
+        return RC( rcAlign, rcIterator, rcAccessing, rcParam, rcNull );
+
+    if ( num_threads > SHARD_THREADS_MAX )
+        num_threads = SHARD_THREADS_MAX;
+    if ( num_threads == 0 )
+        num_threads = 1;
+
+    memset( &walk, 0, sizeof walk );
+    walk.ordered = ordered;
+    walk.lookahead = SHARD_LOOKAHEAD * num_threads;
+    walk.make = make;
+    walk.visit = visit;
+    walk.data = data;
+
+    pl_set_iter_clear_curr_ref_window( self );
+    pl_set_iter_clear_curr_ref( self );
+    self->current_entry = NULL;
+
+    rc = pi_shard_cut( self, shard_len, &walk );
+    if ( rc == 0 )
+        rc = KLockMake ( &walk.lock );
+    if ( rc == 0 )
+        rc = KConditionMake ( &walk.cond );
+    if ( rc == 0 )
+    {
+        /* in unordered mode the calling thread is worker #0 */
+        uint32_t first_id = ordered ? 0 : 1;
+
+        while ( first_id + nthreads < num_threads )
+        {
+            wrk[ nthreads ].walk = &walk;
+            wrk[ nthreads ].id = first_id + nthreads;
+            if ( KThreadMake ( &thread[ nthreads ], pi_shard_thread, &wrk[ nthreads ] ) != 0 )
+                break;
+            ++nthreads;
+        }
+
+        if ( ordered )
+            pi_shard_deliver( &walk, nthreads == 0 );
+        else
+        {
+            pi_shard_worker self_wrk;
+            self_wrk.walk = &walk;
+            self_wrk.id = 0;
+            pi_shard_thread( NULL, &self_wrk );
+        }
+
+        if ( ordered )
+        {
+            /* wake up workers held back by the lookahead */
+            KLockAcquire ( walk.lock );
+            walk.abort = true;
+            KConditionBroadcast ( walk.cond );
+            KLockUnlock ( walk.lock );
+        }
+        for ( i = 0; i < nthreads; ++i )
+        {
+            KThreadWait ( thread[ i ], NULL );
+            KThreadRelease ( thread[ i ] );
+        }
+
+        /* report the first failure in reference order */
+        for ( i = 0; i < walk.count && rc == 0; ++i )
+            rc = walk.shards[ i ].rc;
+    }
+
+    for ( i = 0; i < walk.count; ++i )
+        DLListWhack ( &walk.shards[ i ].recs, pi_shard_rec_whacker, NULL );
+    free( walk.shards );
+    KConditionRelease ( walk.cond );
+    KLockRelease ( walk.lock );
+
+    /* the set is consumed */
+    DLListWhack ( &self->pi_refs, pi_ref_whacker, NULL );
+
+    return rc;
+}
@@ -31,7 +31,12 @@
 #include <klib/text.h>
 #include <klib/printf.h>
 #include <klib/log.h>
+#include <klib/refcount.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 #include <kdb/manager.h>
+#include <kdb/kdb-priv.h>
 #include <kdb/meta.h>
 #include <kfg/config.h>
 #include <insdc/insdc.h>
@@ -39,6 +44,7 @@
 #include <vdb/vdb-priv.h>
 #include <vdb/cursor.h>
 #include <vdb/vdb-priv.h>
+#include <vfs/manager.h>
 #include <align/refseq-mgr.h>
 #include <sysalloc.h>
 
@@ -47,6 +53,7 @@
 #include "debug.h"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -66,6 +73,8 @@ struct RefSeqMgr {
     unsigned num_open;
     unsigned nRefSeqs;
     unsigned maxRefSeqs;
+    RefSeqChunkCache *chunks;
+    struct RefSeqReadahead *readahead;
 };
 
 typedef struct RefSeq_VT RefSeq_VT;
@@ -641,6 +650,8 @@ static int AccessionType(VDBManager const *const mgr,
 }
 
 static void WhackAllReaders(RefSeqMgr *const mgr);
+static void StopReadahead(RefSeqMgr *const mgr);
+static rc_t StartReadahead(RefSeqMgr *const mgr, uint32_t depth);
 
 LIB_EXPORT rc_t CC RefSeqMgr_SetCache(RefSeqMgr const *const cself, size_t cache, uint32_t keep_open_num)
 {
@@ -655,6 +666,27 @@ LIB_EXPORT rc_t CC RefSeqMgr_SetCache(RefSeqMgr const *const cself, size_t cache
     return 0;
 }
 
+LIB_EXPORT rc_t CC RefSeqMgr_SetChunkCache(RefSeqMgr const *const cself, RefSeqChunkCache *const cache, uint32_t const readahead)
+{
+    RefSeqMgr *const self = (RefSeqMgr *)cself;
+    rc_t rc = 0;
+
+    if (self == NULL)
+        return RC(rcAlign, rcIndex, rcUpdating, rcSelf, rcNull);
+
+    StopReadahead(self);
+    if (cache) {
+        rc = RefSeqChunkCache_AddRef(cache);
+        if (rc)
+            return rc;
+    }
+    RefSeqChunkCache_Release(self->chunks);
+    self->chunks = cache;
+    if (cache && readahead > 0)
+        rc = StartReadahead(self, readahead);
+    return rc;
+}
+
 LIB_EXPORT rc_t CC RefSeqMgr_Make( const RefSeqMgr** cself, const VDBManager* vmgr,
                                    uint32_t reader_options, size_t cache, uint32_t keep_open_num )
 {
@@ -708,6 +740,8 @@ LIB_EXPORT rc_t CC RefSeqMgr_Release(const RefSeqMgr* cself)
         RefSeqMgr* self = (RefSeqMgr*)cself;
         unsigned i;
 
+        StopReadahead(self);
+        RefSeqChunkCache_Release(self->chunks);
         WhackAllReaders(self);
         for (i = 0; i < self->nRefSeqs; ++i)
             free(self->refSeq[i]);
@@ -864,6 +898,17 @@ LIB_EXPORT rc_t CC RefSeqMgr_Read(const RefSeqMgr* cself, const char* seq_id, ui
     RefSeq const *obj;
     rc_t rc = 0;
 
+    if (cself != NULL && cself->chunks != NULL && seq_id != NULL) {
+        /* hits must not have to reopen the reader; misses open it as needed */
+        RefSeq *fnd = NULL;
+
+        rc = GetSeq((RefSeqMgr *)cself, &fnd, seq_id_sz, seq_id);
+        if (rc == 0) {
+            fnd->vt->setRow(fnd, seq_id_sz, seq_id);
+            rc = RefSeq_Read(fnd, offset, len, buffer, written);
+        }
+        return rc;
+    }
     if( (rc = RefSeqMgr_GetSeq(cself, &obj, seq_id, seq_id_sz)) == 0 ) {
         rc = RefSeq_Read(obj, offset, len, buffer, written);
         RefSeq_Release(obj);
@@ -960,6 +1005,541 @@ LIB_EXPORT rc_t CC RefSeqMgr_GetSeq(RefSeqMgr const *const cmgr,
     return rc;
 }
 
+/* MARK: chunk cache
+ * decoded bases are cached a reference row (the usual MAX_SEQ_LEN) at a time;
+ * the cache is shared between managers and threads, and one lock guards the
+ * table, the LRU list and the readahead queues
+ */
+#define CHUNK_BASES (5000)
+
+typedef struct RefSeqChunk RefSeqChunk;
+struct RefSeqChunk {
+    DLNode lru;             /* linked only once ready */
+    RefSeqChunk *next;      /* hash chain */
+    RefSeqChunk *queued;    /* readahead queue */
+    int64_t row;
+    uint32_t hash;
+    uint32_t options;
+    uint32_t chunk;
+    INSDC_coord_len total;  /* length of the whole sequence */
+    INSDC_coord_len len;
+    bool ready;
+    uint8_t data[CHUNK_BASES];
+    char name[1];
+};
+
+typedef struct RefSeqChunkKey {
+    char const *name;
+    int64_t row;
+    uint32_t options;
+    uint32_t chunk;
+    uint32_t hash;
+} RefSeqChunkKey;
+
+struct RefSeqChunkCache {
+    KRefcount refcount;
+    KLock *lock;
+    KCondition *cond;
+    RefSeqChunk **bucket;
+    DLList lru;             /* head is the most recently used */
+    size_t memory;
+    RefSeqChunkCacheStats stats;
+    uint32_t mask;
+};
+
+struct RefSeqReadahead {
+    RefSeqChunkCache *cache;
+    RefSeqMgr *mgr;         /* private; only the thread uses it */
+    KThread *thread;
+    RefSeqChunk *head;
+    RefSeqChunk *tail;
+    uint32_t depth;
+    bool quit;
+};
+
+static uint32_t ChunkKeyHash(RefSeqChunkKey const *const key)
+{
+    uint32_t h = 2166136261u;
+    char const *cp;
+
+    for (cp = key->name; *cp; ++cp)
+        h = (h ^ (uint8_t)*cp) * 16777619u;
+    h = (h ^ (uint32_t)key->row) * 16777619u;
+    h = (h ^ (uint32_t)(key->row >> 32)) * 16777619u;
+    h = (h ^ key->options) * 16777619u;
+    h = (h ^ key->chunk) * 16777619u;
+    return h;
+}
+
+static size_t ChunkSize(RefSeqChunk const *const e)
+{
+    return sizeof(*e) + strlen(e->name);
+}
+
+/* returns the link that points, or would point, at the chunk */
+static RefSeqChunk **ChunkFind(RefSeqChunkCache *const self, RefSeqChunkKey const *const key)
+{
+    RefSeqChunk **pp = &self->bucket[key->hash & self->mask];
+
+    for ( ; *pp; pp = &(*pp)->next) {
+        RefSeqChunk const *const e = *pp;
+
+        if (   e->hash == key->hash && e->chunk == key->chunk
+            && e->row == key->row && e->options == key->options
+            && strcmp(e->name, key->name) == 0)
+        {
+            break;
+        }
+    }
+    return pp;
+}
+
+static RefSeqChunk **ChunkLink(RefSeqChunkCache *const self, RefSeqChunk const *const e)
+{
+    RefSeqChunk **pp = &self->bucket[e->hash & self->mask];
+
+    while (*pp != e)
+        pp = &(*pp)->next;
+    return pp;
+}
+
+static RefSeqChunk *ChunkAlloc(RefSeqChunkKey const *const key)
+{
+    size_t const namelen = strlen(key->name);
+    RefSeqChunk *const e = malloc(sizeof(*e) + namelen);
+
+    if (e) {
+        memset(e, 0, offsetof(RefSeqChunk, data));
+        e->row = key->row;
+        e->hash = key->hash;
+        e->options = key->options;
+        e->chunk = key->chunk;
+        memmove(e->name, key->name, namelen + 1);
+    }
+    return e;
+}
+
+/* all of these are called under the lock */
+static void ChunkRemove(RefSeqChunkCache *const self, RefSeqChunk **const pp)
+{
+    RefSeqChunk *const e = *pp;
+
+    *pp = e->next;
+    if (e->ready)
+        DLListUnlink(&self->lru, &e->lru);
+    self->stats.used -= ChunkSize(e);
+    free(e);
+}
+
+/* chunks still being read ahead are never evicted */
+static void ChunkEvict(RefSeqChunkCache *const self, size_t const reserve)
+{
+    while (self->stats.used + reserve > self->memory && self->lru.tail != NULL) {
+        RefSeqChunk const *const e = (RefSeqChunk const *)self->lru.tail;
+
+        ChunkRemove(self, ChunkLink(self, e));
+        ++self->stats.evicted;
+    }
+}
+
+static void ChunkInsert(RefSeqChunkCache *const self, RefSeqChunk **const pp, RefSeqChunk *const e)
+{
+    e->next = *pp;
+    *pp = e;
+    self->stats.used += ChunkSize(e);
+    if (e->ready)
+        DLListPushHead(&self->lru, &e->lru);
+}
+
+static void RefSeqChunkCacheWhack(RefSeqChunkCache *const self)
+{
+    if (self->bucket) {
+        uint32_t i;
+
+        for (i = 0; i <= self->mask; ++i) {
+            while (self->bucket[i])
+                ChunkRemove(self, &self->bucket[i]);
+        }
+        free(self->bucket);
+    }
+    KConditionRelease(self->cond);
+    KLockRelease(self->lock);
+    free(self);
+}
+
+LIB_EXPORT rc_t CC RefSeqChunkCache_Make(RefSeqChunkCache **const rslt, size_t const memory)
+{
+    RefSeqChunkCache *self;
+    uint32_t nbuckets = 64;
+    rc_t rc;
+
+    if (rslt == NULL)
+        return RC(rcAlign, rcIndex, rcConstructing, rcParam, rcNull);
+
+    while (nbuckets < memory / sizeof(RefSeqChunk) && nbuckets < (1u << 24))
+        nbuckets <<= 1;
+
+    self = calloc(1, sizeof(*self));
+    if (self == NULL)
+        return RC(rcAlign, rcIndex, rcConstructing, rcMemory, rcExhausted);
+
+    self->bucket = calloc(nbuckets, sizeof(self->bucket[0]));
+    if (self->bucket == NULL)
+        rc = RC(rcAlign, rcIndex, rcConstructing, rcMemory, rcExhausted);
+    else
+        rc = KLockMake(&self->lock);
+    if (rc == 0)
+        rc = KConditionMake(&self->cond);
+    if (rc == 0) {
+        KRefcountInit(&self->refcount, 1, "RefSeqChunkCache", "Make", "");
+        self->memory = memory;
+        self->mask = nbuckets - 1;
+        *rslt = self;
+        return 0;
+    }
+    RefSeqChunkCacheWhack(self);
+    return rc;
+}
+
+LIB_EXPORT rc_t CC RefSeqChunkCache_AddRef(RefSeqChunkCache const *const cself)
+{
+    if (cself != NULL && KRefcountAdd(&cself->refcount, "RefSeqChunkCache") != krefOkay)
+        return RC(rcAlign, rcIndex, rcAttaching, rcError, rcUnexpected);
+    return 0;
+}
+
+LIB_EXPORT rc_t CC RefSeqChunkCache_Release(RefSeqChunkCache const *const cself)
+{
+    if (cself != NULL && KRefcountDrop(&cself->refcount, "RefSeqChunkCache") == krefWhack)
+        RefSeqChunkCacheWhack((RefSeqChunkCache *)cself);
+    return 0;
+}
+
+LIB_EXPORT rc_t CC RefSeqChunkCache_GetStats(RefSeqChunkCache const *const cself, RefSeqChunkCacheStats *const stats)
+{
+    if (cself == NULL || stats == NULL)
+        return RC(rcAlign, rcIndex, rcAccessing, rcParam, rcNull);
+
+    KLockAcquire(cself->lock);
+    *stats = cself->stats;
+    KLockUnlock(cself->lock);
+    return 0;
+}
+
+/* copies bases [s, s + n) of a cached chunk, waiting for it if it is being
+ * read ahead; false if the chunk is not in the cache
+ */
+static bool RefSeqChunkCacheCopy(RefSeqChunkCache *const self,
+                                 RefSeqChunkKey const *const key,
+                                 INSDC_coord_len const s,
+                                 INSDC_coord_len const n,
+                                 uint8_t *const dst,
+                                 INSDC_coord_len *const total,
+                                 bool *const copied)
+{
+    RefSeqChunk *e;
+    bool waited = false;
+
+    KLockAcquire(self->lock);
+    while ((e = *ChunkFind(self, key)) != NULL && !e->ready) {
+        waited = true;
+        KConditionWait(self->cond, self->lock);
+    }
+    if (e) {
+        *total = e->total;
+        *copied = s + n <= e->len;
+        if (*copied)
+            memmove(dst, e->data + s, n);
+        DLListUnlink(&self->lru, &e->lru);
+        DLListPushHead(&self->lru, &e->lru);
+        ++self->stats.hits;
+        if (waited)
+            ++self->stats.waits;
+    }
+    else
+        ++self->stats.misses;
+    KLockUnlock(self->lock);
+    return e != NULL;
+}
+
+/* decodes a whole chunk through the manager's own reader for the sequence */
+static rc_t RefSeqChunkDecode(RefSeq *const obj, RefSeqMgr *const mgr, RefSeqChunk *const e)
+{
+    INSDC_coord_len const start = e->chunk * CHUNK_BASES;
+    rc_t rc = GetReader(mgr, obj);
+
+    if (rc == 0)
+        rc = obj->vt->length(obj, &e->total);
+    if (rc == 0 && start < e->total) {
+        INSDC_coord_len const n = e->total - start < CHUNK_BASES ? e->total - start : CHUNK_BASES;
+
+        rc = obj->vt->read(obj, start, n, e->data, &e->len);
+    }
+    return rc;
+}
+
+/* decodes a chunk that was not in the cache and offers it to the cache;
+ * if another reader got there first, theirs is kept
+ */
+static rc_t RefSeqChunkLoad(RefSeq *const obj,
+                            RefSeqMgr *const mgr,
+                            RefSeqChunkKey const *const key,
+                            INSDC_coord_len const s,
+                            INSDC_coord_len const n,
+                            uint8_t *const dst,
+                            INSDC_coord_len *const total,
+                            bool *const copied)
+{
+    RefSeqChunkCache *const self = mgr->chunks;
+    RefSeqChunk *e = ChunkAlloc(key);
+    rc_t rc;
+
+    if (e == NULL)
+        return RC(rcAlign, rcTable, rcReading, rcMemory, rcExhausted);
+
+    rc = RefSeqChunkDecode(obj, mgr, e);
+    if (rc == 0) {
+        *total = e->total;
+        *copied = s + n <= e->len;
+        if (*copied)
+            memmove(dst, e->data + s, n);
+        if (e->len > 0) {
+            KLockAcquire(self->lock);
+            {
+                RefSeqChunk **const pp = ChunkFind(self, key);
+
+                if (*pp == NULL) {
+                    e->ready = true;
+                    ChunkInsert(self, pp, e);
+                    ChunkEvict(self, 0);
+                    e = NULL;
+                }
+            }
+            KLockUnlock(self->lock);
+        }
+    }
+    free(e);
+    return rc;
+}
+
+/* queues the chunks following the last one read that are not cached yet */
+static void RefSeqChunkReadahead(RefSeqMgr *const mgr,
+                                 RefSeqChunkKey *const key,
+                                 INSDC_coord_len const total)
+{
+    struct RefSeqReadahead *const ra = mgr->readahead;
+    RefSeqChunkCache *const self = mgr->chunks;
+    uint32_t const last = key->chunk;
+    bool queued = false;
+    uint32_t i;
+
+    KLockAcquire(self->lock);
+    for (i = 1; i <= ra->depth; ++i) {
+        RefSeqChunk **pp;
+        RefSeqChunk *e;
+
+        key->chunk = last + i;
+        if ((uint64_t)key->chunk * CHUNK_BASES >= total)
+            break;
+        key->hash = ChunkKeyHash(key);
+        pp = ChunkFind(self, key);
+        if (*pp != NULL)
+            continue;
+
+        ChunkEvict(self, sizeof(*e) + strlen(key->name));
+        if (self->stats.used + sizeof(*e) + strlen(key->name) > self->memory)
+            break;
+        e = ChunkAlloc(key);
+        if (e == NULL)
+            break;
+        ChunkInsert(self, pp, e);
+        if (ra->tail)
+            ra->tail->queued = e;
+        else
+            ra->head = e;
+        ra->tail = e;
+        ++self->stats.readahead;
+        queued = true;
+    }
+    if (queued)
+        KConditionBroadcast(self->cond);
+    KLockUnlock(self->lock);
+}
+
+static rc_t CC RefSeqReadaheadMain(KThread const *const th, void *const vp)
+{
+    struct RefSeqReadahead *const ra = vp;
+    RefSeqChunkCache *const self = ra->cache;
+
+    KLockAcquire(self->lock);
+    while (!ra->quit) {
+        RefSeqChunk *const e = ra->head;
+
+        if (e == NULL) {
+            KConditionWait(self->cond, self->lock);
+            continue;
+        }
+        ra->head = e->queued;
+        if (ra->head == NULL)
+            ra->tail = NULL;
+        KLockUnlock(self->lock);
+        {
+            RefSeq *obj = NULL;
+            rc_t rc = GetSeq(ra->mgr, &obj, (unsigned)strlen(e->name), e->name);
+
+            if (rc == 0)
+                rc = RefSeqChunkDecode(obj, ra->mgr, e);
+
+            KLockAcquire(self->lock);
+            if (rc == 0 && e->len > 0) {
+                e->ready = true;
+                DLListPushHead(&self->lru, &e->lru);
+                ChunkEvict(self, 0);
+            }
+            else {
+                /* a reader waiting on the chunk reads it itself */
+                if (rc != 0) {
+                    ++self->stats.failed;
+                    self->stats.failure = rc;
+                }
+                ChunkRemove(self, ChunkLink(self, e));
+            }
+        }
+        KConditionBroadcast(self->cond);
+    }
+    KLockUnlock(self->lock);
+    return 0;
+}
+
+static rc_t StartReadahead(RefSeqMgr *const mgr, uint32_t const depth)
+{
+    struct RefSeqReadahead *const ra = calloc(1, sizeof(*ra));
+    rc_t rc;
+
+    if (ra == NULL)
+        return RC(rcAlign, rcIndex, rcConstructing, rcMemory, rcExhausted);
+
+    ra->cache = mgr->chunks;
+    ra->depth = depth;
+    {
+        /* opening and closing tables through one VDBManager from two
+         * threads is not safe, so the thread gets a manager of its own;
+         * it shares the caller's VFS manager, and with it the configuration
+         * and the resolver, so that it finds the same references */
+        KDBManager const *kmgr = NULL;
+        VFSManager *vfs = NULL;
+        VDBManager *vmgr = NULL;
+
+        rc = VDBManagerOpenKDBManagerRead(mgr->vmgr, &kmgr);
+        if (rc == 0) {
+            rc = KDBManagerGetVFSManager(kmgr, &vfs);
+            KDBManagerRelease(kmgr);
+        }
+        if (rc == 0) {
+            rc = VDBManagerMakeRsrc(&vmgr, vfs);
+            VFSManagerRelease(vfs);
+        }
+        if (rc == 0) {
+            rc = RefSeqMgr_Make((RefSeqMgr const **)&ra->mgr, vmgr, mgr->reader_options,
+                                mgr->cache, mgr->num_open_max);
+            VDBManagerRelease(vmgr);
+        }
+    }
+    if (rc == 0)
+        rc = KThreadMake(&ra->thread, RefSeqReadaheadMain, ra);
+    if (rc == 0) {
+        mgr->readahead = ra;
+        return 0;
+    }
+    RefSeqMgr_Release(ra->mgr);
+    free(ra);
+    return rc;
+}
+
+/* drops whatever is still queued and waits out the chunk in progress */
+static void StopReadahead(RefSeqMgr *const mgr)
+{
+    struct RefSeqReadahead *const ra = mgr->readahead;
+    RefSeqChunkCache *cache;
+
+    if (ra == NULL)
+        return;
+    mgr->readahead = NULL;
+    cache = ra->cache;
+
+    KLockAcquire(cache->lock);
+    ra->quit = true;
+    while (ra->head) {
+        RefSeqChunk *const e = ra->head;
+
+        ra->head = e->queued;
+        ChunkRemove(cache, ChunkLink(cache, e));
+    }
+    ra->tail = NULL;
+    KConditionBroadcast(cache->cond);
+    KLockUnlock(cache->lock);
+
+    KThreadWait(ra->thread, NULL);
+    KThreadRelease(ra->thread);
+    RefSeqMgr_Release(ra->mgr);
+    free(ra);
+}
+
+static rc_t RefSeq_ReadDirect(RefSeq *const self, INSDC_coord_zero const offset, INSDC_coord_len const len,
+                              uint8_t *const buffer, INSDC_coord_len *const written)
+{
+    rc_t const rc = GetReader((RefSeqMgr *)self->mgr, self);
+
+    if (rc)
+        return rc;
+    return self->vt->read(self, offset, len, buffer, written);
+}
+
+/* serves reads that lie within the sequence from the chunk cache; anything
+ * else (empty, wrapping around or running off the end) is read directly so
+ * the readers keep their own rules for it
+ */
+static rc_t RefSeq_ReadCached(RefSeq *const self, INSDC_coord_zero const offset, INSDC_coord_len const len,
+                              uint8_t *const buffer, INSDC_coord_len *const written)
+{
+    RefSeqMgr *const mgr = (RefSeqMgr *)self->mgr;
+    bool const wgs = self->vt == &RefSeq_WGS_VT;
+    RefSeqChunkKey key;
+    INSDC_coord_len total = 0;
+    INSDC_coord_len have = 0;
+
+    if (offset < 0 || len == 0)
+        return RefSeq_ReadDirect(self, offset, len, buffer, written);
+
+    key.name = self->vt->name(self);
+    key.row = wgs ? self->u.wgs.row : 0;
+    key.options = mgr->reader_options;
+    while (have < len) {
+        uint64_t const pos = (uint64_t)offset + have;
+        INSDC_coord_len const s = (INSDC_coord_len)(pos % CHUNK_BASES);
+        INSDC_coord_len const n = len - have < CHUNK_BASES - s ? len - have : CHUNK_BASES - s;
+        bool copied = false;
+
+        key.chunk = (uint32_t)(pos / CHUNK_BASES);
+        key.hash = ChunkKeyHash(&key);
+        if (!RefSeqChunkCacheCopy(mgr->chunks, &key, s, n, buffer + have, &total, &copied)) {
+            rc_t const rc = RefSeqChunkLoad(self, mgr, &key, s, n, buffer + have, &total, &copied);
+
+            if (rc)
+                return rc;
+        }
+        if (!copied || (uint64_t)offset + len > total)
+            return RefSeq_ReadDirect(self, offset, len, buffer, written);
+        have += n;
+    }
+    *written = have;
+
+    /* WGS contigs are a single row each, there is nothing next to read */
+    if (mgr->readahead != NULL && !wgs)
+        RefSeqChunkReadahead(mgr, &key, total);
+    return 0;
+}
+
 LIB_EXPORT rc_t CC RefSeq_Read(const RefSeq* cself, INSDC_coord_zero offset, INSDC_coord_len len,
                                uint8_t* buffer, INSDC_coord_len* written)
 {
@@ -969,11 +1549,11 @@ LIB_EXPORT rc_t CC RefSeq_Read(const RefSeq* cself, INSDC_coord_zero offset, INS
         rc = RC(rcAlign, rcFile, rcReading, rcParam, rcNull);
     else {
         RefSeq *const self = (RefSeq *)cself;
-        RefSeqMgr *const mgr = (RefSeqMgr *)self->mgr;
         
-        rc = GetReader(mgr, self);
-        if (rc == 0)
-            rc = self->vt->read(self, offset, len, buffer, written);
+        if (self->mgr->chunks != NULL)
+            rc = RefSeq_ReadCached(self, offset, len, buffer, written);
+        else
+            rc = RefSeq_ReadDirect(self, offset, len, buffer, written);
     }
     ALIGN_DBGERR(rc);
     return rc;
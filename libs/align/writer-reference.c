@@ -31,6 +31,8 @@
 #include <klib/container.h>
 #include <klib/checksum.h>
 #include <klib/text.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
 #include <kfs/mmap.h>
 #include <kfs/file.h>
 #include <kdb/manager.h>
@@ -1563,6 +1565,11 @@ LIB_EXPORT rc_t CC ReferenceMgr_SetCache(ReferenceMgr const *const self, size_t
     return RefSeqMgr_SetCache(self->rmgr, cache, num_open);
 }
 
+LIB_EXPORT rc_t CC ReferenceMgr_SetChunkCache(ReferenceMgr const *const self, struct RefSeqChunkCache *const cache, uint32_t const readahead)
+{
+    return RefSeqMgr_SetChunkCache(self->rmgr, cache, readahead);
+}
+
 static
 rc_t OpenDataDirectory(KDirectory const **rslt, char const path[])
 {
@@ -2814,20 +2821,57 @@ LIB_EXPORT rc_t CC ReferenceMgr_Compress(const ReferenceMgr* cself,
     return rc;
 }
 
-LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
-                                         uint32_t options,
-                                         INSDC_coord_zero offset,
-                                         const char* seq, INSDC_coord_len seq_len,
-                                         const void* cigar, uint32_t cigar_len,
-                                         INSDC_coord_zero allele_offset, const char* allele,
-                                         INSDC_coord_len allele_len,
-                                         INSDC_coord_zero offset_in_allele,
-                                         const void* allele_cigar, uint32_t allele_cigar_len,
-                                         uint8_t const rna_orient,
-                                         TableWriterAlgnData* data)
+/* a piece of the reference read ahead of a batch of alignments;
+ * reads outside of it go to the reference under the lock
+ */
+typedef struct ReferenceWindow {
+    uint8_t *data;
+    INSDC_coord_zero offset;
+    INSDC_coord_len length;
+    KLock *lock;
+} ReferenceWindow;
+
+static
+rc_t ReferenceSeq_ReadWindow(ReferenceSeq *self,
+                             ReferenceWindow const *window,
+                             int offset,
+                             unsigned const len,
+                             uint8_t buffer[],
+                             unsigned* written)
+{
+    rc_t rc;
+
+    if (window == NULL)
+        return ReferenceSeq_ReadDirect(self, offset, len, true, buffer, written, false);
+
+    if (offset >= window->offset && len <= window->length &&
+        offset - window->offset <= window->length - len)
+    {
+        memcpy(buffer, &window->data[offset - window->offset], len);
+        *written = len;
+        return 0;
+    }
+    KLockAcquire(window->lock);
+    rc = ReferenceSeq_ReadDirect(self, offset, len, true, buffer, written, false);
+    KLockUnlock(window->lock);
+    return rc;
+}
+
+static rc_t ReferenceSeq_Compress_int(ReferenceSeq *const self,
+                                      KDataBuffer *const compress,
+                                      ReferenceWindow const *const window,
+                                      uint32_t options,
+                                      INSDC_coord_zero offset,
+                                      const char* seq, INSDC_coord_len seq_len,
+                                      const void* cigar, uint32_t cigar_len,
+                                      INSDC_coord_zero allele_offset, const char* allele,
+                                      INSDC_coord_len allele_len,
+                                      INSDC_coord_zero offset_in_allele,
+                                      const void* allele_cigar, uint32_t allele_cigar_len,
+                                      uint8_t const rna_orient,
+                                      TableWriterAlgnData* data)
 {
     rc_t rc = 0;
-    ReferenceSeq *const self = (ReferenceSeq *)cself;
 
     if (self == NULL || seq == NULL || cigar == NULL || cigar_len == 0 || data == NULL ||
         (!(allele == NULL && allele_len == 0 && allele_cigar == NULL && allele_cigar_len == 0) &&
@@ -2836,8 +2880,8 @@ LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
         return RC(rcAlign, rcFile, rcProcessing, rcParam, rcInvalid);
     }
 
-    if (seq_len > self->mgr->compress.elem_count) {
-        rc = KDataBufferResize(&self->mgr->compress, seq_len);
+    if (seq_len > compress->elem_count) {
+        rc = KDataBufferResize(compress, seq_len);
         if (rc) return rc;
     }
     {
@@ -2879,7 +2923,7 @@ LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
         i_ref_offset_elements = data->ref_offset.elements;
         i_mismatch_elements = data->mismatch.elements;
         ALIGN_C_DBG("align%s '%.*s'[%u] to '%s:%s' at %i", (options & ewrefmgr_cmp_Exact) ? " EXACT" : "",
-                    seq_len, seq, seq_len, cself->id, cself->seqId, offset);
+                    seq_len, seq, seq_len, self->id, self->seqId, offset);
 #endif
         if(allele != NULL) {
             /* determine length of reference for subst by allele */
@@ -2903,10 +2947,10 @@ LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
             rc = cigar2offset(options,
                               cigar_len,
                               cigar,
-                              (unsigned)self->mgr->compress.elem_count,
+                              (unsigned)compress->elem_count,
                               seq_len,
                               rna_orient,
-                              self->mgr->compress.base,
+                              compress->base,
                               &seq_pos,
                               &rl,
                               &max_rl,
@@ -2935,7 +2979,7 @@ LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
                     max_rl = rl;
                 }
                 ALIGN_C_DBG("max_ref_len truncated to %u cause it goes beyond refseq length %lu at offset %i",
-                             max_rl, cself->seq_len, offset);
+                             max_rl, self->seq_len, offset);
             }
             ALIGN_C_DBG("chosen REF_LEN %u, ref len for match %u", ref_len, max_rl);
 
@@ -2963,7 +3007,7 @@ LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
                     } else {
                         /* fetch portion of reference which comes before allele */
                         rl = allele_offset - offset;
-                        rc = ReferenceSeq_ReadDirect(self, offset, rl, true, ref_buf, &i, false);
+                        rc = ReferenceSeq_ReadWindow(self, window, offset, rl, ref_buf, &i);
                         if(rc == 0 && rl != i) {
                             /* here we need to test it otherwise excessive portion of allele could be fetch in next if */
                             rc = RC(rcAlign, rcFile, rcProcessing, rcRange, rcExcessive);
@@ -2973,7 +3017,7 @@ LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
                         memcpy(&ref_buf[rl], allele, allele_len);
                         rl += allele_len;
                         /* append tail of actual reference */
-                        rc = ReferenceSeq_ReadDirect(self, allele_ref_end, max_rl - rl, true, &ref_buf[rl], &i, false);
+                        rc = ReferenceSeq_ReadWindow(self, window, allele_ref_end, max_rl - rl, &ref_buf[rl], &i);
                         rl += i;
                     } else if(rc == 0) {
                         /* allele is longer than needed */
@@ -2982,14 +3026,14 @@ LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
                     }
                 }
                 else {
-                    rc = ReferenceSeq_ReadDirect(self, offset, max_rl, true, ref_buf, &rl, false);
+                    rc = ReferenceSeq_ReadWindow(self, window, offset, max_rl, ref_buf, &rl);
                 }
                 if (rc != 0 || max_rl != rl) {
                     rc = rc ? rc : RC(rcAlign, rcFile, rcProcessing, rcRange, rcExcessive);
                     ALIGN_C_DBGERRP("refseq is shorter: at offset %i need %u bases", rc, offset, max_rl);
                 }
                 else {
-                    compress_buffer_t *const compress_buf = self->mgr->compress.base;
+                    compress_buffer_t *const compress_buf = compress->base;
                     unsigned ro = (unsigned)data->ref_offset.elements;
                     int ref_pos;
                     
@@ -3130,6 +3174,229 @@ LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
     return rc;
 }
 
+LIB_EXPORT rc_t CC ReferenceSeq_Compress(ReferenceSeq const *const cself,
+                                         uint32_t options,
+                                         INSDC_coord_zero offset,
+                                         const char* seq, INSDC_coord_len seq_len,
+                                         const void* cigar, uint32_t cigar_len,
+                                         INSDC_coord_zero allele_offset, const char* allele,
+                                         INSDC_coord_len allele_len,
+                                         INSDC_coord_zero offset_in_allele,
+                                         const void* allele_cigar, uint32_t allele_cigar_len,
+                                         uint8_t const rna_orient,
+                                         TableWriterAlgnData* data)
+{
+    ReferenceSeq *const self = (ReferenceSeq *)cself;
+
+    if (self == NULL)
+        return RC(rcAlign, rcFile, rcProcessing, rcParam, rcInvalid);
+    return ReferenceSeq_Compress_int(self, &self->mgr->compress, NULL, options, offset,
+                                     seq, seq_len, cigar, cigar_len,
+                                     allele_offset, allele, allele_len, offset_in_allele,
+                                     allele_cigar, allele_cigar_len, rna_orient, data);
+}
+
+/* longest piece of reference read ahead for a batch */
+#define COMPRESS_WINDOW_MAX (16u * 1024u * 1024u)
+#define COMPRESS_THREADS_MAX (32)
+
+typedef struct CompressBatch {
+    ReferenceSeq *self;
+    ReferenceSeqCompressItem *item;
+    ReferenceWindow window;
+    KLock *lock;
+    uint32_t options;
+    uint32_t count;
+    uint32_t next;
+} CompressBatch;
+
+static rc_t CompressBatchItem(CompressBatch *const batch,
+                              KDataBuffer *const compress,
+                              ReferenceSeqCompressItem *const item)
+{
+    return item->rc = ReferenceSeq_Compress_int(batch->self, compress,
+                                                batch->window.data ? &batch->window : NULL,
+                                                batch->options, item->offset,
+                                                item->seq, item->seq_len,
+                                                item->cigar, item->cigar_len,
+                                                item->allele_offset, item->allele,
+                                                item->allele_len, item->offset_in_allele,
+                                                item->allele_cigar, item->allele_cigar_len,
+                                                item->rna_orient, item->data);
+}
+
+/* claims the next run of items that share a TableWriterAlgnData */
+static bool CompressBatchClaim(CompressBatch *const batch, uint32_t *const first, uint32_t *const last)
+{
+    bool found = false;
+
+    KLockAcquire(batch->lock);
+    if (batch->next < batch->count) {
+        uint32_t i = batch->next;
+
+        while (++i < batch->count && batch->item[i].data == batch->item[i - 1].data)
+            ;
+        *first = batch->next;
+        *last = batch->next = i;
+        found = true;
+    }
+    KLockUnlock(batch->lock);
+    return found;
+}
+
+static rc_t CC CompressBatchThread(KThread const *th, void *vp)
+{
+    CompressBatch *const batch = vp;
+    KDataBuffer compress;
+    uint32_t first;
+    uint32_t last;
+    rc_t rc = KDataBufferMake(&compress, sizeof(compress_buffer_t) * 8, 0);
+
+    while (CompressBatchClaim(batch, &first, &last)) {
+        uint32_t i;
+
+        for (i = first; i < last; ++i) {
+            if (rc == 0)
+                CompressBatchItem(batch, &compress, &batch->item[i]);
+            else
+                batch->item[i].rc = rc;
+        }
+    }
+    KDataBufferWhack(&compress);
+    return 0;
+}
+
+/* reads ahead the part of the reference the batch is likely to touch */
+static void CompressBatchReadWindow(CompressBatch *const batch)
+{
+    ReferenceSeq *const self = batch->self;
+    int64_t beg = INT64_MAX;
+    int64_t end = 0;
+    uint32_t i;
+    unsigned written = 0;
+
+    if (self->circular)
+        return;
+    for (i = 0; i < batch->count; ++i) {
+        ReferenceSeqCompressItem const *const item = &batch->item[i];
+        /* room for deletions and clipping; anything beyond is read directly */
+        int64_t const item_end = (int64_t)item->offset + 2 * (int64_t)item->seq_len + 1024;
+
+        if (item->offset < 0)
+            continue;
+        if (beg > item->offset)
+            beg = item->offset;
+        if (end < item_end)
+            end = item_end;
+    }
+    if (beg >= self->seq_len)
+        return;
+    if (end > self->seq_len)
+        end = self->seq_len;
+    if (end - beg > COMPRESS_WINDOW_MAX)
+        end = beg + COMPRESS_WINDOW_MAX;
+
+    batch->window.data = malloc(end - beg);
+    if (batch->window.data == NULL)
+        return;
+    if (ReferenceSeq_ReadDirect(self, (int)beg, (unsigned)(end - beg), false,
+                                batch->window.data, &written, true) != 0)
+    {
+        free(batch->window.data);
+        batch->window.data = NULL;
+        return;
+    }
+    batch->window.offset = (INSDC_coord_zero)beg;
+    batch->window.length = written;
+}
+
+LIB_EXPORT rc_t CC ReferenceSeq_CompressBatch(ReferenceSeq const *const cself,
+                                              uint32_t options,
+                                              uint32_t count,
+                                              ReferenceSeqCompressItem items[],
+                                              uint32_t threads)
+{
+    CompressBatch batch;
+    KThread *thread[COMPRESS_THREADS_MAX];
+    uint32_t nthreads = 0;
+    uint32_t i;
+    rc_t rc;
+
+    if (cself == NULL || (items == NULL && count > 0))
+        return RC(rcAlign, rcFile, rcProcessing, rcParam, rcNull);
+    if (count == 0)
+        return 0;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.self = (ReferenceSeq *)cself;
+    batch.item = items;
+    batch.options = options;
+    batch.count = count;
+
+    if (threads > COMPRESS_THREADS_MAX)
+        threads = COMPRESS_THREADS_MAX;
+    if (threads < 2) {
+        /* no one to share with, the manager's buffer will do */
+        for (i = 0; i < count; ++i)
+            CompressBatchItem(&batch, &batch.self->mgr->compress, &items[i]);
+    }
+    else {
+        rc = KLockMake(&batch.lock);
+        if (rc == 0)
+            rc = KLockMake(&batch.window.lock);
+        if (rc == 0) {
+            CompressBatchReadWindow(&batch);
+            while (nthreads + 1 < threads) {
+                if (KThreadMake(&thread[nthreads], CompressBatchThread, &batch) != 0)
+                    break;
+                ++nthreads;
+            }
+            /* the calling thread does its share */
+            CompressBatchThread(NULL, &batch);
+            for (i = 0; i < nthreads; ++i) {
+                KThreadWait(thread[i], NULL);
+                KThreadRelease(thread[i]);
+            }
+            free(batch.window.data);
+        }
+        KLockRelease(batch.window.lock);
+        KLockRelease(batch.lock);
+        if (rc)
+            return rc;
+    }
+    /* report the first failure in batch order */
+    for (i = 0; i < count; ++i) {
+        if (items[i].rc)
+            return items[i].rc;
+    }
+    return 0;
+}
+
+LIB_EXPORT rc_t CC ReferenceMgr_CompressBatch(const ReferenceMgr* cself,
+                                              uint32_t options,
+                                              const char* id,
+                                              uint32_t count,
+                                              ReferenceSeqCompressItem items[],
+                                              uint32_t threads)
+{
+    rc_t rc = 0;
+    bool shouldUnmap = false;
+    bool wasRenamed = false;
+    const ReferenceSeq* refseq;
+
+    if(cself == NULL || id == NULL) {
+        rc = RC(rcAlign, rcFile, rcProcessing, rcParam, rcNull);
+    }
+    else if((rc = ReferenceMgr_GetSeq(cself, &refseq, id, &shouldUnmap, false, &wasRenamed)) == 0) {
+        assert(shouldUnmap == false);
+        assert(wasRenamed == false);
+        rc = ReferenceSeq_CompressBatch(refseq, options, count, items, threads);
+        ReferenceSeq_Release(refseq);
+    }
+    ALIGN_C_DBGERR(rc);
+    return rc;
+}
+
 LIB_EXPORT rc_t CC ReferenceSeq_Read(const ReferenceSeq* cself, INSDC_coord_zero offset, INSDC_coord_len len,
                                      uint8_t* buffer, INSDC_coord_len* ref_len)
 {
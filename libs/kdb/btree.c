@@ -112,6 +112,11 @@ static void PagerUnuse(Pager *self, void const *page)
     KPageRelease((KPage const *)page);
 }
 
+static void PagerPrefetch(Pager *self, uint32_t pageid)
+{
+    KPageFilePrefetch(self->pager, pageid);
+}
+
 static Pager_vt const KPageFile_vt = {
     PagerAlloc,
     PagerUse,
@@ -120,6 +125,10 @@ static Pager_vt const KPageFile_vt = {
     PagerUnuse
 };
 
+static Pager_hint_vt const KPageFile_hint_vt = {
+    PagerPrefetch
+};
+
 typedef struct KBTreeHdr_v3 KBTreeHdr;
 
 static
@@ -435,6 +444,20 @@ LIB_EXPORT rc_t CC KBTreeDropBacking ( KBTree *self )
 }
 
 
+/* SetWriteBack
+ *  write evicted dirty pages on a background thread
+ */
+LIB_EXPORT rc_t CC KBTreeSetWriteBack ( KBTree *self, size_t dirty_limit )
+{
+    if ( self == NULL )
+        return RC ( rcDB, rcTree, rcUpdating, rcSelf, rcNull );
+    if ( self -> read_only )
+        return RC ( rcDB, rcTree, rcUpdating, rcTree, rcReadonly );
+
+    return KPageFileSetWriteBack ( self -> pgfile.pager, dirty_limit );
+}
+
+
 /* Size
  *  returns size in bytes of file and cache
  *
@@ -550,7 +573,7 @@ LIB_EXPORT rc_t CC KBTreeEntry ( KBTree *self, uint64_t *id,
         else
         {
             uint32_t id32 = *id;
-            rc = BTreeEntry(&self->hdr.root, (Pager *)&self->pgfile, &KPageFile_vt, &id32, was_inserted, key, key_size);
+            rc = BTreeEntryWithHints(&self->hdr.root, (Pager *)&self->pgfile, &KPageFile_vt, &KPageFile_hint_vt, &id32, was_inserted, key, key_size);
             if (self->pgfile.rc)
                 rc = self->pgfile.rc;
             *id = id32;
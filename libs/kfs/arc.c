@@ -44,6 +44,7 @@
 
 #include <kfs/directory.h>
 #include <kfs/file.h>
+#include <kfs/mmap.h>
 #include <kfs/toc.h>
 #include <kfs/sra.h>
 #include <kfs/cacheteefile.h>
@@ -1849,7 +1850,18 @@ rc_t KArcFileReadContiguous (const KArcFile *self, uint64_t pos,
     rc = KTocEntryGetFileOffset (self->node, &offset);
     if (rc == 0)
     {
-	rc = KFileRead (self->archive, pos + offset, buffer, bsize, num_read);
+	/* -----
+	 * when the whole archive is mapped the member is a slice of it:
+	 * copy straight out of the map without a trip through the KFile
+	 */
+	if (self->toc->map_addr != NULL &&
+	    pos + offset + bsize <= self->toc->map_size)
+	{
+	    memcpy (buffer, self->toc->map_addr + pos + offset, bsize);
+	    *num_read = bsize;
+	}
+	else
+	    rc = KFileRead (self->archive, pos + offset, buffer, bsize, num_read);
     }
     return rc;
 }
@@ -2152,6 +2164,67 @@ static	KFile_vt_v1	vtKArcFile =
     KArcFileType
 };
 
+/*-----------------------------------------------------------------------
+ * KArcFileMapView
+ *
+ * Hands out a read-only view into the archive map shared through the TOC
+ * for a contiguous member, so that KMMap on a member costs neither an
+ * mmap of its own nor a malloc'd copy.
+ *
+ * [RET] rc_t					0 for success; rcUnsupported when "f" is not
+ *						a contiguous member of a mapped archive
+ * [IN]  const KFile *		f		file being mapped
+ * [IN]  uint64_t		pos		offset of the view within the member
+ * [INOUT] size_t *		size		requested size, 0 meaning to the end of
+ *						the member; cropped to the member on return
+ * [OUT] const char **		addr		start of the view
+ * [OUT] const KMMap **		owner		new reference to the map backing the view
+ */
+rc_t KArcFileMapView (const KFile * f, uint64_t pos, size_t * size,
+		      const char ** addr, const KMMap ** owner)
+{
+    const KArcFile * self = (const KArcFile *) f;
+    uint64_t offset, fsize;
+    rc_t rc;
+
+    assert (f != NULL);
+    assert (size != NULL);
+    assert (addr != NULL);
+    assert (owner != NULL);
+
+    if (&f->vt->v1 != &vtKArcFile ||
+        self->toc->map == NULL ||
+        self->node->type != ktocentrytype_file)
+        return SILENT_RC (rcFS, rcFile, rcAccessing, rcMemMap, rcUnsupported);
+
+    rc = KTocEntryGetFileOffset (self->node, &offset);
+    if (rc == 0)
+        rc = KTocEntryGetFileSize (self->node, &fsize);
+    if (rc == 0)
+    {
+        if (pos >= fsize)
+            return RC (rcFS, rcFile, rcAccessing, rcParam, rcInvalid);
+
+        if (*size == 0 || pos + *size > fsize)
+        {
+            if ((uint64_t)(size_t)(fsize - pos) != fsize - pos)
+                return RC (rcFS, rcFile, rcAccessing, rcParam, rcExcessive);
+            *size = (size_t)(fsize - pos);
+        }
+
+        if (offset + pos + *size > self->toc->map_size)
+            return SILENT_RC (rcFS, rcFile, rcAccessing, rcMemMap, rcUnsupported);
+
+        rc = KMMapAddRef (self->toc->map);
+        if (rc == 0)
+        {
+            *addr = self->toc->map_addr + offset + pos;
+            *owner = self->toc->map;
+        }
+    }
+    return rc;
+}
+
 /*-----------------------------------------------------------------------
  * KArcFileMake
  *
@@ -3739,6 +3812,7 @@ rc_t KDirectoryOpenArcDirRead_intern( const KDirectory * self,
                 }
                 else
                 {
+                    KTocMapArchive ( toc );
                     *pdir = &arcdir->dad;
                 }
             }
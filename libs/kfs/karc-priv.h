@@ -27,8 +27,26 @@
 #ifndef _h_kfs_arc_priv_h_
 #define _h_kfs_arc_priv_h_
 
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
 typedef struct KArcTOCNode KArcTOCNode;
 
+struct KFile;
+struct KMMap;
+
+/* MapView
+ *  if "f" is a contiguous member of an archive that has been mapped
+ *  as a whole, return a read-only view into that map and a new
+ *  reference to it. "size" of 0 means to the end of the member and
+ *  is cropped to the member on return.
+ *
+ *  returns rcUnsupported when "f" cannot be served this way.
+ */
+rc_t KArcFileMapView ( struct KFile const * f, uint64_t pos, size_t * size,
+    const char ** addr, struct KMMap const ** owner );
+
 #ifdef _DEBUGGING
 #define FUNC_ENTRY() DBGMSG (DBG_KFS, DBG_FLAG(DBG_KFS_ARCENTRY), ("Enter: %s\n", __func__))
 #define ARC_DEBUG(msg) DBGMSG (DBG_KFS, DBG_FLAG(DBG_KFS_ARC), msg)
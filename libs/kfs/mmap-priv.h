@@ -59,6 +59,8 @@ struct KMMap
     KFile *f;
     size_t pg_size;
 
+    const KMMap *view;
+
     uint32_t addr_adj;
     uint32_t size_adj;
 
@@ -104,6 +106,20 @@ rc_t KMMapROSys ( KMMap *self, uint64_t pos, size_t size );
 rc_t KMMapUnmap ( KMMap *self );
 
 
+/* AdviseSys
+ *  pass usage hints for a system mapped region on to the os
+ */
+rc_t KMMapAdviseSys ( const KMMap *self, uint32_t advice );
+
+
+/* MakeSysRead
+ *  map an entire file read-only with the system memory mapping
+ *  function, failing rather than falling back to a malloc'd copy.
+ *  the file must be a system file mapped from offset 0.
+ */
+rc_t KMMapMakeSysRead ( const KMMap **mm, const KFile *f );
+
+
 #ifdef __cplusplus
 }
 #endif
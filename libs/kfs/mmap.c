@@ -28,10 +28,12 @@
 #include "mmap-priv.h"
 #include "sysmmap-priv.h"
 #include "sysfile-priv.h"
+#include "karc-priv.h"
 #include <klib/refcount.h>
 #include <klib/rc.h>
 #include <sysalloc.h>
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -60,7 +62,13 @@ rc_t KMMapUnmapRgn ( KMMap *self )
 {
     rc_t rc;
 
-    if ( self -> sys_mmap )
+    if ( self -> view != NULL )
+    {
+        rc = KMMapRelease ( self -> view );
+        if ( rc == 0 )
+            self -> view = NULL;
+    }
+    else if ( self -> sys_mmap )
         rc = KMMapUnmap ( self );
     else
     {
@@ -237,6 +245,25 @@ LIB_EXPORT rc_t CC KMMapAddrUpdate ( KMMap *self, void **addr )
 }
 
 
+/* Advise
+ *  tell the os how the region is going to be used
+ */
+LIB_EXPORT rc_t CC KMMapAdvise ( const KMMap *self, uint32_t advice )
+{
+    if ( self == NULL )
+        return RC ( rcFS, rcMemMap, rcAccessing, rcSelf, rcNull );
+
+    if (  self -> addr == NULL )
+        return RC ( rcFS, rcMemMap, rcAccessing, rcMemMap, rcInvalid );
+
+    /* nothing to tell about a malloc'd copy */
+    if ( ! self -> sys_mmap || self -> size == 0 )
+        return 0;
+
+    return KMMapAdviseSys ( self, advice );
+}
+
+
 /* MallocRgn
  */
 #if USE_MALLOC_MMAP
@@ -426,7 +453,25 @@ rc_t KMMapRORgn ( KMMap *self, uint64_t pos, size_t size )
         /* pos is relative to a virtual file; s_pos is relative to a system file */
         uint64_t s_pos = pos;
 
-        KSysFile *sf = KFileGetSysFile ( self -> f, & self -> off );
+        KSysFile *sf;
+
+        /* members of an archive that is already mapped share its map */
+        size_t view_size = size;
+        const char *view_addr;
+        if ( KArcFileMapView ( self -> f, pos, & view_size, & view_addr, & self -> view ) == 0 )
+        {
+            self -> off = 0;
+            self -> addr = ( char* ) view_addr;
+            self -> addr_adj = self -> size_adj = 0;
+            self -> pos = pos;
+            self -> size = view_size;
+            self -> read_only = true;
+            self -> sys_mmap = self -> dirty = false;
+            return 0;
+        }
+        self -> view = NULL;
+
+        sf = KFileGetSysFile ( self -> f, & self -> off );
         if ( sf == NULL )
         {
 #if USE_MALLOC_MMAP
@@ -544,6 +589,7 @@ rc_t KMMapMakeRgn ( KMMap **mmp, const KFile *f )
             mm -> size = 0;
             mm -> addr = NULL;
             mm -> addr_adj = mm -> size_adj = 0;
+            mm -> view = NULL;
             KRefcountInit ( & mm -> refcount, 1, "KMMap", "make", "mmap" );
             mm -> sys_mmap = false;
             mm -> read_only = false;
@@ -639,6 +685,59 @@ LIB_EXPORT rc_t CC KMMapMakeRead ( const KMMap **mm, const KFile *f )
     return KMMapMakeRgnRead ( mm, f, 0, 0 );
 }
 
+/* MakeSysRead
+ */
+rc_t KMMapMakeSysRead ( const KMMap **mmp, const KFile *f )
+{
+    rc_t rc;
+    KMMap *mm;
+    uint64_t off, eof;
+
+    assert ( mmp != NULL );
+    * mmp = NULL;
+
+#if FORCE_MALLOC_MMAP
+    return RC ( rcFS, rcMemMap, rcConstructing, rcFunction, rcUnsupported );
+#endif
+
+    if ( f == NULL )
+        return RC ( rcFS, rcMemMap, rcConstructing, rcFile, rcNull );
+
+    if ( ! f -> read_enabled )
+        return RC ( rcFS, rcMemMap, rcConstructing, rcFile, rcNoPerm );
+
+    if ( KFileGetSysFile ( f, & off ) == NULL || off != 0 )
+        return RC ( rcFS, rcMemMap, rcConstructing, rcFile, rcIncorrect );
+
+    rc = KFileSize ( f, & eof );
+    if ( rc != 0 )
+        return ResetRCContext ( rc, rcFS, rcMemMap, rcConstructing );
+
+    if ( eof == 0 || ( uint64_t ) ( size_t ) eof != eof )
+        return RC ( rcFS, rcMemMap, rcConstructing, rcFile, rcInvalid );
+
+    rc = KMMapMakeRgn ( & mm, f );
+    if ( rc == 0 )
+    {
+        rc = KMMapROSys ( mm, 0, ( size_t ) eof );
+        if ( rc == 0 )
+        {
+            mm -> pos = 0;
+            mm -> size = ( size_t ) eof;
+            mm -> read_only = true;
+            mm -> sys_mmap = true;
+
+            * mmp = mm;
+            return 0;
+        }
+
+        mm -> addr = NULL;
+        KMMapWhack ( mm );
+    }
+
+    return rc;
+}
+
 LIB_EXPORT rc_t CC KMMapMakeUpdate ( KMMap **mm, KFile *f )
 {
     return KMMapMakeRgnUpdate ( mm, f, 0, 0 );
@@ -724,7 +823,7 @@ LIB_EXPORT rc_t CC KMMapReposition ( const KMMap *cself, uint64_t pos, size_t *s
 
         /* we're modifiable, so see if position
            is within first page of current map */
-        if ( ( pos & ~ pg_mask ) == left )
+        if ( self -> view == NULL && ( pos & ~ pg_mask ) == left )
         {
             self -> addr -= self -> addr_adj;
             self -> addr_adj = self -> size_adj = ( uint32_t ) ( pos - left );
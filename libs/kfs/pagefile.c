@@ -30,6 +30,9 @@
 #include <klib/container.h>
 #include <klib/rc.h>
 #include <klib/debug.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
 #include <atomic.h>
 #include <sysalloc.h>
 
@@ -85,25 +88,85 @@ void KPageMemWhack ( void *page )
 }
 
 
+/*--------------------------------------------------------------------------
+ * KPageQueued
+ *  raw page memory parked on one of the write-back queues
+ */
+typedef struct KPageQueued KPageQueued;
+struct KPageQueued
+{
+    DLNode ln;
+    void *page;
+    uint32_t page_id;
+};
+
+static
+void CC KPageQueuedWhack ( DLNode *n, void *ignore )
+{
+    KPageQueued *q = ( KPageQueued* ) n;
+    KPageMemWhack ( q -> page );
+    free ( q );
+}
+
+static
+KPageQueued *KPageQueuedFind ( const DLList *list, uint32_t page_id )
+{
+    DLNode *n;
+    for ( n = DLListHead ( list ); n != NULL; n = DLNodeNext ( n ) )
+    {
+        if ( ( ( KPageQueued* ) n ) -> page_id == page_id )
+            return ( KPageQueued* ) n;
+    }
+    return NULL;
+}
+
+
 /*--------------------------------------------------------------------------
  * KPageBacking
  *  a reference KFile wrapper
+ *
+ *  when write-back is enabled, a background thread owns writing
+ *  evicted dirty pages and servicing read prefetch requests.
+ *  "io" serializes every access to "backing" and "eof";
+ *  "qlock" guards the queues below.
  */
+#define PREFETCH_LIMIT 16
+
 typedef struct KPageBacking KPageBacking;
 struct KPageBacking
 {
     uint64_t eof;
     KFile *backing;
     KRefcount refcount;
+
+    KLock *io;
+    KLock *qlock;
+    KCondition *work;
+    KCondition *done;
+    KThread *th;
+
+    DLList dirty;           /* evicted pages waiting to be written */
+    DLList requests;        /* page ids to read ahead */
+    DLList prefetched;      /* pages read ahead, not yet claimed */
+    uint32_t dirty_count;
+    uint32_t dirty_limit;
+    uint32_t prefetch_count;
+    uint32_t in_flight;     /* id of page being written, or 0 */
+    rc_t wb_rc;             /* first write-back failure */
+
     bool write_through;
     bool have_eof;
+    bool quitting;
 };
 
+static void KPageBackingStopWriteBack ( KPageBacking *self );
+
 /* Whack
  */
 static
 void KPageBackingWhack ( KPageBacking *self )
 {
+    KPageBackingStopWriteBack ( self );
     if(self -> backing) KFileRelease ( self -> backing );
     free ( self );
 }
@@ -159,6 +222,18 @@ rc_t KPageBackingDrop ( KPageBacking *self )
     if ( self == NULL )
         return RC ( rcFS, rcFile, rcDetaching, rcSelf, rcNull );
 
+    if ( self -> th != NULL )
+    {
+        /* discard anything not yet written */
+        KLockAcquire ( self -> qlock );
+        DLListWhack ( & self -> dirty, KPageQueuedWhack, NULL );
+        self -> dirty_count = 0;
+        DLListWhack ( & self -> requests, KPageQueuedWhack, NULL );
+        while ( self -> in_flight != 0 )
+            KConditionWait ( self -> done, self -> qlock );
+        KLockUnlock ( self -> qlock );
+    }
+
     backing = self -> backing;
     if ( backing != NULL && atomic_test_and_set_ptr ( ( atomic_ptr_t* ) & self -> backing, NULL, backing ) == backing )
         KFileRelease ( backing );
@@ -185,6 +260,16 @@ rc_t KPageBackingSetSize ( KPageBacking *self, uint32_t pg_count )
     if ( new_eof == self -> eof )
         return 0;
 
+    if ( self -> io != NULL )
+    {
+        rc_t rc;
+        KLockAcquire ( self -> io );
+        self -> eof = new_eof;
+        rc = KFileSetSize ( self -> backing, self -> eof );
+        KLockUnlock ( self -> io );
+        return rc;
+    }
+
     self -> eof = new_eof;
     return KFileSetSize ( self -> backing, self -> eof );
 }
@@ -244,15 +329,21 @@ rc_t KPageBackingRead ( const KPageBacking *self, void **ppage, uint32_t pg_id )
 
         /* read page from file */
         size_t num_read;
+        if ( self -> io != NULL )
+            KLockAcquire ( self -> io );
         rc = KFileReadAll ( self -> backing, pos -= PGSIZE, page, PGSIZE, & num_read );
+        if ( rc == 0 && num_read != 0 )
+        {
+            /* keep track of eof */
+            if ( self -> eof < pos + num_read )
+                ( ( KPageBacking* ) self ) -> eof = pos + num_read;
+        }
+        if ( self -> io != NULL )
+            KLockUnlock ( self -> io );
         if ( rc == 0 )
         {
             if ( num_read != 0 )
             {
-                /* keep track of eof */
-                pos += num_read;
-                if ( self -> eof < pos )
-                    ( ( KPageBacking* ) self ) -> eof = pos;
 
                 /* detect a partial page */
                 if ( num_read < PGSIZE )
@@ -325,13 +416,19 @@ rc_t KPageBackingWrite ( KPageBacking *self, const void *page, uint32_t pg_id )
     pos = ( uint64_t ) pg_id << PGBITS;
 
     /* write the page */
+    if ( self -> io != NULL )
+        KLockAcquire ( self -> io );
     rc = KFileWriteAll ( self -> backing, pos -= PGSIZE, page, PGSIZE, & num_writ );
     if ( rc == 0 )
     {
         pos += num_writ;
         if ( self -> eof < pos )
             self -> eof = pos;
-
+    }
+    if ( self -> io != NULL )
+        KLockUnlock ( self -> io );
+    if ( rc == 0 )
+    {
         if ( num_writ == PGSIZE )
             return 0;
 
@@ -345,6 +442,288 @@ rc_t KPageBackingWrite ( KPageBacking *self, const void *page, uint32_t pg_id )
 }
 
 
+/* WriteBackMain
+ *  writes evicted dirty pages in eviction order,
+ *  then services read-ahead requests while idle
+ */
+static
+rc_t CC KPageBackingWriteBackMain ( const KThread *th, void *data )
+{
+    KPageBacking *self = data;
+
+    KLockAcquire ( self -> qlock );
+    while ( ! self -> quitting )
+    {
+        KPageQueued *q = ( KPageQueued* ) DLListPopHead ( & self -> dirty );
+        if ( q != NULL )
+        {
+            rc_t rc;
+
+            -- self -> dirty_count;
+            self -> in_flight = q -> page_id;
+            KLockUnlock ( self -> qlock );
+
+            rc = KPageBackingWrite ( self, q -> page, q -> page_id );
+            KPageQueuedWhack ( & q -> ln, NULL );
+
+            KLockAcquire ( self -> qlock );
+            if ( rc != 0 && self -> wb_rc == 0 )
+                self -> wb_rc = rc;
+            self -> in_flight = 0;
+            KConditionBroadcast ( self -> done );
+            continue;
+        }
+
+        q = ( KPageQueued* ) DLListPopHead ( & self -> requests );
+        if ( q != NULL )
+        {
+            rc_t rc;
+            uint32_t page_id = q -> page_id;
+
+            KLockUnlock ( self -> qlock );
+            rc = KPageBackingRead ( self, & q -> page, page_id );
+            KLockAcquire ( self -> qlock );
+
+            /* a dirty copy may have been parked while reading */
+            if ( rc != 0 || KPageQueuedFind ( & self -> dirty, page_id ) != NULL )
+                KPageQueuedWhack ( & q -> ln, NULL );
+            else
+            {
+                DLListPushTail ( & self -> prefetched, & q -> ln );
+                if ( ++ self -> prefetch_count > PREFETCH_LIMIT )
+                {
+                    KPageQueuedWhack ( DLListPopHead ( & self -> prefetched ), NULL );
+                    -- self -> prefetch_count;
+                }
+            }
+            continue;
+        }
+
+        KConditionWait ( self -> work, self -> qlock );
+    }
+    KLockUnlock ( self -> qlock );
+
+    return 0;
+}
+
+/* StartWriteBack
+ */
+static
+rc_t KPageBackingStartWriteBack ( KPageBacking *self, uint32_t dirty_limit )
+{
+    rc_t rc;
+
+    if ( self -> th != NULL )
+    {
+        KLockAcquire ( self -> qlock );
+        self -> dirty_limit = dirty_limit;
+        KConditionBroadcast ( self -> done );
+        KLockUnlock ( self -> qlock );
+        return 0;
+    }
+
+    DLListInit ( & self -> dirty );
+    DLListInit ( & self -> requests );
+    DLListInit ( & self -> prefetched );
+    self -> dirty_count = self -> prefetch_count = self -> in_flight = 0;
+    self -> dirty_limit = dirty_limit;
+    self -> wb_rc = 0;
+    self -> quitting = false;
+
+    rc = KLockMake ( & self -> qlock );
+    if ( rc == 0 )
+    {
+        rc = KConditionMake ( & self -> work );
+        if ( rc == 0 )
+        {
+            rc = KConditionMake ( & self -> done );
+            if ( rc == 0 )
+            {
+                /* io lock must exist before the thread can touch the file */
+                rc = KLockMake ( & self -> io );
+                if ( rc == 0 )
+                {
+                    rc = KThreadMake ( & self -> th, KPageBackingWriteBackMain, self );
+                    if ( rc == 0 )
+                        return 0;
+
+                    KLockRelease ( self -> io );
+                    self -> io = NULL;
+                }
+                KConditionRelease ( self -> done );
+            }
+            KConditionRelease ( self -> work );
+        }
+        KLockRelease ( self -> qlock );
+    }
+
+    self -> qlock = NULL;
+    self -> work = self -> done = NULL;
+    return rc;
+}
+
+/* StopWriteBack
+ *  flushes all parked pages before joining the thread
+ */
+static
+void KPageBackingStopWriteBack ( KPageBacking *self )
+{
+    if ( self -> th == NULL )
+        return;
+
+    KLockAcquire ( self -> qlock );
+    while ( self -> dirty_count != 0 || self -> in_flight != 0 )
+        KConditionWait ( self -> done, self -> qlock );
+    self -> quitting = true;
+    KConditionSignal ( self -> work );
+    KLockUnlock ( self -> qlock );
+
+    KThreadWait ( self -> th, NULL );
+    KThreadRelease ( self -> th );
+    self -> th = NULL;
+
+    DLListWhack ( & self -> requests, KPageQueuedWhack, NULL );
+    DLListWhack ( & self -> prefetched, KPageQueuedWhack, NULL );
+
+    KConditionRelease ( self -> done );
+    KConditionRelease ( self -> work );
+    KLockRelease ( self -> qlock );
+    KLockRelease ( self -> io );
+    self -> io = NULL;
+}
+
+/* WriteBackRC
+ *  the first write-back failure
+ *  the write-back thread sets it under "qlock"
+ */
+static
+rc_t KPageBackingWriteBackRC ( KPageBacking *self )
+{
+    rc_t rc;
+
+    if ( self -> th == NULL )
+        return self -> wb_rc;
+
+    KLockAcquire ( self -> qlock );
+    rc = self -> wb_rc;
+    KLockUnlock ( self -> qlock );
+
+    return rc;
+}
+
+/* Park
+ *  hand a dirty page to the write-back thread
+ *  takes ownership of "page" memory in all cases
+ *  blocks while the dirty queue is at its limit
+ */
+static
+rc_t KPageBackingPark ( KPageBacking *self, void *page, uint32_t page_id )
+{
+    KPageQueued *q = malloc ( sizeof * q );
+    if ( q == NULL )
+    {
+        /* fall back to writing synchronously */
+        rc_t rc = KPageBackingWrite ( self, page, page_id );
+        KPageMemWhack ( page );
+        return rc;
+    }
+
+    q -> page = page;
+    q -> page_id = page_id;
+
+    KLockAcquire ( self -> qlock );
+    while ( self -> dirty_count >= self -> dirty_limit && ! self -> quitting )
+        KConditionWait ( self -> done, self -> qlock );
+    {
+        /* any read-ahead copy is now stale */
+        KPageQueued *stale = KPageQueuedFind ( & self -> prefetched, page_id );
+        if ( stale != NULL )
+        {
+            DLListUnlink ( & self -> prefetched, & stale -> ln );
+            -- self -> prefetch_count;
+            KPageQueuedWhack ( & stale -> ln, NULL );
+        }
+    }
+    DLListPushTail ( & self -> dirty, & q -> ln );
+    ++ self -> dirty_count;
+    KConditionSignal ( self -> work );
+    KLockUnlock ( self -> qlock );
+
+    return 0;
+}
+
+/* Claim
+ *  reclaim a parked or prefetched copy of a page
+ *  returns NULL if the page must come from the file
+ */
+static
+void *KPageBackingClaim ( KPageBacking *self, uint32_t page_id, bool *dirty )
+{
+    KPageQueued *q;
+    void *page = NULL;
+
+    KLockAcquire ( self -> qlock );
+
+    /* a write in progress will leave the file current */
+    while ( self -> in_flight == page_id )
+        KConditionWait ( self -> done, self -> qlock );
+
+    q = KPageQueuedFind ( & self -> dirty, page_id );
+    if ( q != NULL )
+    {
+        DLListUnlink ( & self -> dirty, & q -> ln );
+        -- self -> dirty_count;
+        KConditionBroadcast ( self -> done );
+        * dirty = true;
+    }
+    else
+    {
+        q = KPageQueuedFind ( & self -> prefetched, page_id );
+        if ( q != NULL )
+        {
+            DLListUnlink ( & self -> prefetched, & q -> ln );
+            -- self -> prefetch_count;
+            * dirty = false;
+        }
+    }
+
+    KLockUnlock ( self -> qlock );
+
+    if ( q != NULL )
+    {
+        page = q -> page;
+        free ( q );
+    }
+
+    return page;
+}
+
+/* Request
+ *  queue a page for read-ahead
+ */
+static
+void KPageBackingRequest ( KPageBacking *self, uint32_t page_id )
+{
+    KLockAcquire ( self -> qlock );
+    if ( self -> prefetch_count < PREFETCH_LIMIT &&
+         KPageQueuedFind ( & self -> requests, page_id ) == NULL &&
+         KPageQueuedFind ( & self -> prefetched, page_id ) == NULL &&
+         KPageQueuedFind ( & self -> dirty, page_id ) == NULL &&
+         self -> in_flight != page_id )
+    {
+        KPageQueued *q = malloc ( sizeof * q );
+        if ( q != NULL )
+        {
+            q -> page = NULL;
+            q -> page_id = page_id;
+            DLListPushTail ( & self -> requests, & q -> ln );
+            KConditionSignal ( self -> work );
+        }
+    }
+    KLockUnlock ( self -> qlock );
+}
+
+
 /*--------------------------------------------------------------------------
  * KPage
  *  a reference counted page
@@ -366,6 +745,7 @@ struct KPage
     uint32_t page_id;
     bool read_only;
     bool dirty;
+    bool referenced;    /* CLOCK reference bit */
 };
 
 
@@ -377,7 +757,13 @@ rc_t KPageWhack ( KPage *self )
 {
     if ( self -> backing )
     {
-        if ( self -> dirty )
+        if ( self -> dirty && self -> backing -> th != NULL && self -> backing -> backing != NULL )
+        {
+            /* write-back thread takes the memory */
+            KPageBackingPark ( self -> backing, self -> page, self -> page_id );
+            self -> page = NULL;
+        }
+        else if ( self -> dirty )
             KPageBackingWrite ( self -> backing, self -> page, self -> page_id );
         KPageBackingSever ( self -> backing );
     }
@@ -410,6 +796,7 @@ rc_t KPageNew ( KPage **ppage, KPageBacking * backing, uint32_t page_id )
             page -> page_id = page_id;
             page -> read_only = false;
             page -> dirty = false;
+            page -> referenced = false;
 
             * ppage = page;
             return 0;
@@ -435,14 +822,22 @@ rc_t KPageMake ( KPage **ppage, KPageBacking *backing, uint32_t page_id )
         rc = RC ( rcFS, rcBlob, rcConstructing, rcMemory, rcExhausted );
     else
     {
-        rc = KPageBackingRead ( backing, & page -> page, page_id );
+        bool dirty = false;
+
+        rc = 0;
+        page -> page = NULL;
+        if ( backing != NULL && backing -> th != NULL )
+            page -> page = KPageBackingClaim ( backing, page_id, & dirty );
+        if ( page -> page == NULL )
+            rc = KPageBackingRead ( backing, & page -> page, page_id );
         if ( rc == 0 )
         {
             page -> backing = KPageBackingAttach ( backing );
             KRefcountInit ( & page -> refcount, 1, "KPage", "make", "page" );
             page -> page_id = page_id;
             page -> read_only = false;
-            page -> dirty = false;
+            page -> dirty = dirty;
+            page -> referenced = false;
 
             * ppage = page;
             return 0;
@@ -1202,18 +1597,28 @@ static rc_t KPageFileCachePage ( KPageFile *self, KPage *page )
     if ( ++ self -> ccount <= self -> climit )
         return 0;
 
+    /* CLOCK replacement: the list is the clock face with the hand
+       at the tail. referenced pages get a second chance at the head */
     do
     {
         DLNode *last = DLListPopTail ( & self -> by_access );
         KPage *doomed = ( KPage* ) last;
 
+        if ( doomed -> referenced )
+        {
+            doomed -> referenced = false;
+            DLListPushHead ( & self -> by_access, last );
+            continue;
+        }
+
         PAGE_DEBUG( ( "PAGE: {%p}.[%s] delete #%u\n", self, KDbgGetColName(), doomed->page_id ) );
 
         rc = KPageFileIndexDelete( self, doomed->page_id );
         if ( rc == 0 )
             rc = KPageSever ( doomed );
+        -- self -> ccount;
     }
-    while ( -- self -> ccount > self -> climit && rc == 0 );
+    while ( self -> ccount > self -> climit && rc == 0 );
 
     return rc;
 }
@@ -1245,8 +1650,12 @@ LIB_EXPORT rc_t CC KPageFileAlloc ( KPageFile *self, KPage **ppage, uint32_t *pa
             rc = RC ( rcFS, rcBlob, rcAllocating, rcFile, rcReadonly );
         else
         {
+            /* refuse new pages once write-back has failed */
+            rc = self -> backing == NULL ? 0 : KPageBackingWriteBackRC ( self -> backing );
+
             /* create new page */
-            rc = KPageNew ( ppage, self -> backing, self -> count + 1 );
+            if ( rc == 0 )
+                rc = KPageNew ( ppage, self -> backing, self -> count + 1 );
             if ( rc == 0 )
             {
                 /* insert into cache */
@@ -1299,19 +1708,17 @@ LIB_EXPORT rc_t CC KPageFileGet ( KPageFile *self, KPage **ppage, uint32_t page_
                 {
                     PAGE_DEBUG( ( "PAGE: {%p}.[%s] found #%u\n", self, KDbgGetColName(), page_id ) );
 
-                    /* put page at head of list if not already there */
-                    if ( DLListHead ( & self -> by_access ) != & page -> ln )
-                    {
-                        DLListUnlink ( & self -> by_access, & page -> ln );
-                        DLListPushHead ( & self -> by_access, & page -> ln );
-                    }
+                    /* give it a second chance at eviction time */
+                    page -> referenced = true;
                     return 0;
                 }
                 * ppage = NULL;
                 return rc;
             }
 
-            rc = KPageMake ( ppage, self -> backing, page_id );
+            rc = self -> backing == NULL ? 0 : KPageBackingWriteBackRC ( self -> backing );
+            if ( rc == 0 )
+                rc = KPageMake ( ppage, self -> backing, page_id );
             if ( rc == 0 )
             {
                 /* insert into cache */
@@ -1386,3 +1793,48 @@ LIB_EXPORT rc_t CC KPageFileDropBacking ( KPageFile *self )
 
     return self -> backing ? KPageBackingDrop ( self -> backing ) : 0;
 }
+
+
+/* SetWriteBack
+ *  hand eviction of dirty pages to a background writer
+ */
+LIB_EXPORT rc_t CC KPageFileSetWriteBack ( KPageFile *self, size_t dirty_limit )
+{
+    uint32_t dlimit;
+
+    if ( self == NULL )
+        return RC ( rcFS, rcFile, rcUpdating, rcSelf, rcNull );
+    if ( self -> read_only )
+        return RC ( rcFS, rcFile, rcUpdating, rcFile, rcReadonly );
+    if ( self -> backing == NULL || self -> backing -> backing == NULL )
+        return RC ( rcFS, rcFile, rcUpdating, rcFile, rcNull );
+
+    dlimit = ( uint32_t ) ( dirty_limit >> PGBITS );
+    if ( dlimit < MIN_CACHE_PAGE )
+        dlimit = MIN_CACHE_PAGE;
+
+    PAGE_DEBUG( ( "PAGE: KPageFileSetWriteBack {%p} limit = %u\n", self, dlimit ) );
+
+    return KPageBackingStartWriteBack ( self -> backing, dlimit );
+}
+
+
+/* Prefetch
+ *  hint that a page will be needed soon
+ */
+LIB_EXPORT rc_t CC KPageFilePrefetch ( KPageFile *self, uint32_t page_id )
+{
+    if ( self == NULL )
+        return RC ( rcFS, rcFile, rcReading, rcSelf, rcNull );
+    if ( page_id == 0 )
+        return RC ( rcFS, rcFile, rcReading, rcId, rcNull );
+
+    if ( page_id <= self -> count &&
+         self -> backing != NULL && self -> backing -> th != NULL &&
+         KPageFileIndexFind ( self, page_id ) == NULL )
+    {
+        KPageBackingRequest ( self -> backing, page_id );
+    }
+
+    return 0;
+}
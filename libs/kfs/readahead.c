@@ -0,0 +1,652 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ */
+
+
+#include <kfs/extern.h>
+
+struct KReadAheadFile;
+#define KFILE_IMPL struct KReadAheadFile
+#include <kfs/impl.h>
+
+#include <kfs/readahead.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+#include <klib/rc.h>
+#include <sysalloc.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RA_DFLT_MIN_WINDOW ( 64 * 1024 )
+#define RA_DFLT_MAX_WINDOW ( 1024 * 1024 )
+#define RA_MAX_DEPTH 8
+
+/* number of consecutive observations needed to change the pattern */
+#define RA_CONFIRM 2
+
+
+/*--------------------------------------------------------------------------
+ * KReadAheadPage
+ *  one window of the original file
+ */
+enum
+{
+    rapEmpty,
+    rapQueued,      /* waiting for the background thread */
+    rapLoading,     /* being read, buffer owned by the reader */
+    rapReady
+};
+
+typedef struct KReadAheadPage KReadAheadPage;
+struct KReadAheadPage
+{
+    uint8_t * data;
+    uint64_t pos;
+    uint64_t stamp;
+    size_t size;        /* bytes requested */
+    size_t valid;       /* bytes actually read */
+    rc_t rc;
+    uint32_t state;
+    bool touched;       /* delivered at least one byte */
+};
+
+
+/*--------------------------------------------------------------------------
+ * KReadAheadFile
+ */
+typedef struct KReadAheadFile KReadAheadFile;
+struct KReadAheadFile
+{
+    KFile dad;
+
+    const KFile * original;
+    uint64_t eof;
+
+    KLock * lock;
+    KCondition * queued;
+    KCondition * loaded;
+    KThread * th;
+
+    KReadAheadStats stats;
+
+    /* access history */
+    uint64_t last_pos;
+    uint64_t last_end;
+    int64_t stride;
+    uint32_t seq_run;
+    uint32_t stride_run;
+    uint32_t random_run;
+    bool have_history;
+
+    size_t min_window;
+    size_t max_window;
+    uint32_t max_depth;
+
+    uint64_t clock;
+    uint32_t npages;
+    bool quitting;
+
+    KReadAheadPage page [ RA_MAX_DEPTH + 1 ];
+};
+
+
+/* Observe
+ *  classify the new request against the previous one and
+ *  adjust the pattern with a little hysteresis
+ */
+static
+void KReadAheadFileObserve ( KReadAheadFile * self, uint64_t pos, size_t bsize )
+{
+    if ( self -> have_history )
+    {
+        int64_t delta = ( int64_t ) ( pos - self -> last_pos );
+
+        if ( pos == self -> last_end )
+        {
+            ++ self -> seq_run;
+            self -> stride_run = self -> random_run = 0;
+        }
+        else if ( delta > 0 && delta == self -> stride )
+        {
+            ++ self -> stride_run;
+            self -> seq_run = self -> random_run = 0;
+        }
+        else
+        {
+            ++ self -> random_run;
+            self -> seq_run = self -> stride_run = 0;
+        }
+
+        self -> stride = delta;
+
+        if ( self -> seq_run >= RA_CONFIRM )
+            self -> stats . pattern = kraSequential;
+        else if ( self -> stride_run >= RA_CONFIRM )
+            self -> stats . pattern = kraStrided;
+        else if ( self -> random_run >= RA_CONFIRM )
+        {
+            self -> stats . pattern = kraRandom;
+            self -> stats . window = self -> min_window;
+            self -> stats . depth = self -> max_depth == 0 ? 0 : 1;
+        }
+    }
+
+    self -> last_pos = pos;
+    self -> last_end = pos + bsize;
+    self -> have_history = true;
+}
+
+/* Grow
+ *  called when a read found nothing ready ahead of it
+ */
+static
+void KReadAheadFileGrow ( KReadAheadFile * self, bool stalled )
+{
+    if ( self -> stats . pattern == kraSequential )
+    {
+        size_t window = self -> stats . window * 2;
+        self -> stats . window = window > self -> max_window ? self -> max_window : window;
+    }
+    if ( stalled && self -> stats . depth < self -> max_depth )
+        ++ self -> stats . depth;
+}
+
+static
+KReadAheadPage * KReadAheadFileFind ( KReadAheadFile * self, uint64_t pos )
+{
+    uint32_t i;
+    for ( i = 0; i < self -> npages; ++ i )
+    {
+        KReadAheadPage * p = & self -> page [ i ];
+        if ( p -> state != rapEmpty && pos >= p -> pos && pos < p -> pos + p -> size )
+            return p;
+    }
+    return NULL;
+}
+
+/* Victim
+ *  prefer empty pages, then pages already consumed, then the oldest
+ *  unconsumed page - which is accounted as waste. pages in flight are
+ *  never taken.
+ */
+static
+KReadAheadPage * KReadAheadFileVictim ( KReadAheadFile * self, bool allow_waste )
+{
+    uint32_t i;
+    KReadAheadPage * used = NULL, * unused = NULL;
+
+    for ( i = 0; i < self -> npages; ++ i )
+    {
+        KReadAheadPage * p = & self -> page [ i ];
+        if ( p -> state == rapEmpty )
+            return p;
+        if ( p -> state == rapReady )
+        {
+            if ( p -> touched )
+            {
+                if ( used == NULL || p -> stamp < used -> stamp )
+                    used = p;
+            }
+            else if ( unused == NULL || p -> stamp < unused -> stamp )
+            {
+                unused = p;
+            }
+        }
+    }
+
+    if ( used != NULL )
+        return used;
+    if ( unused != NULL && allow_waste )
+    {
+        self -> stats . bytes_wasted += unused -> valid;
+        if ( self -> stats . depth > 1 )
+            -- self -> stats . depth;
+        return unused;
+    }
+    return NULL;
+}
+
+/* Schedule
+ *  queue the windows predicted to follow "next"
+ */
+static
+void KReadAheadFileSchedule ( KReadAheadFile * self, uint64_t pos, uint64_t next, size_t bsize )
+{
+    uint32_t k;
+    bool signal = false;
+
+    if ( self -> th == NULL )
+        return;
+
+    for ( k = 0; k < self -> stats . depth; ++ k )
+    {
+        uint64_t start;
+        size_t size;
+        KReadAheadPage * p;
+
+        switch ( self -> stats . pattern )
+        {
+        case kraSequential:
+            start = next + k * ( uint64_t ) self -> stats . window;
+            size = self -> stats . window;
+            break;
+        case kraStrided:
+            start = pos + ( k + 1 ) * ( uint64_t ) self -> stride;
+            size = bsize > self -> max_window ? self -> max_window : bsize;
+            break;
+        default:
+            return;
+        }
+
+        if ( start >= self -> eof )
+            break;
+        if ( KReadAheadFileFind ( self, start ) != NULL )
+            continue;
+
+        p = KReadAheadFileVictim ( self, false );
+        if ( p == NULL )
+            break;
+
+        p -> pos = start;
+        p -> size = size;
+        p -> valid = 0;
+        p -> rc = 0;
+        p -> stamp = ++ self -> clock;
+        p -> touched = false;
+        p -> state = rapQueued;
+        signal = true;
+    }
+
+    if ( signal )
+        KConditionSignal ( self -> queued );
+}
+
+static
+rc_t CC KReadAheadFileMain ( const KThread * th, void * data )
+{
+    KReadAheadFile * self = data;
+
+    KLockAcquire ( self -> lock );
+    while ( ! self -> quitting )
+    {
+        uint32_t i;
+        KReadAheadPage * p = NULL;
+
+        for ( i = 0; i < self -> npages; ++ i )
+        {
+            KReadAheadPage * q = & self -> page [ i ];
+            if ( q -> state == rapQueued && ( p == NULL || q -> stamp < p -> stamp ) )
+                p = q;
+        }
+
+        if ( p == NULL )
+            KConditionWait ( self -> queued, self -> lock );
+        else
+        {
+            size_t num_read = 0;
+            rc_t rc;
+
+            p -> state = rapLoading;
+            KLockUnlock ( self -> lock );
+
+            rc = KFileReadAll ( self -> original, p -> pos, p -> data, p -> size, & num_read );
+
+            KLockAcquire ( self -> lock );
+            p -> rc = rc;
+            p -> valid = rc == 0 ? num_read : 0;
+            p -> state = rapReady;
+            self -> stats . bytes_prefetched += p -> valid;
+            KConditionBroadcast ( self -> loaded );
+        }
+    }
+    KLockUnlock ( self -> lock );
+
+    return 0;
+}
+
+static
+rc_t CC KReadAheadFileDestroy ( KReadAheadFile * self )
+{
+    rc_t rc;
+    uint32_t i;
+
+    if ( self -> th != NULL )
+    {
+        KLockAcquire ( self -> lock );
+        self -> quitting = true;
+        KConditionBroadcast ( self -> queued );
+        KLockUnlock ( self -> lock );
+
+        KThreadWait ( self -> th, NULL );
+        KThreadRelease ( self -> th );
+    }
+
+    KConditionRelease ( self -> loaded );
+    KConditionRelease ( self -> queued );
+    KLockRelease ( self -> lock );
+
+    for ( i = 0; i < self -> npages; ++ i )
+    {
+        /* loaded but never read */
+        KReadAheadPage * p = & self -> page [ i ];
+        if ( p -> state == rapReady && ! p -> touched )
+            self -> stats . bytes_wasted += p -> valid;
+        free ( p -> data );
+    }
+
+    rc = KFileRelease ( self -> original );
+    free ( self );
+    return rc;
+}
+
+static
+struct KSysFile * CC KReadAheadFileGetSysFile ( const KReadAheadFile * self, uint64_t * offset )
+{
+    * offset = 0;
+    return NULL;
+}
+
+static
+rc_t CC KReadAheadFileRandomAccess ( const KReadAheadFile * self )
+{
+    return KFileRandomAccess ( self -> original );
+}
+
+static
+uint32_t CC KReadAheadFileType ( const KReadAheadFile * self )
+{
+    return KFileType ( self -> original );
+}
+
+static
+rc_t CC KReadAheadFileSize ( const KReadAheadFile * self, uint64_t * size )
+{
+    return KFileSize ( self -> original, size );
+}
+
+static
+rc_t CC KReadAheadFileSetSize ( KReadAheadFile * self, uint64_t size )
+{
+    return RC ( rcFS, rcFile, rcUpdating, rcFunction, rcUnsupported );
+}
+
+static
+rc_t CC KReadAheadFileRead ( const KReadAheadFile * cself, uint64_t pos,
+    void * buffer, size_t bsize, size_t * num_read )
+{
+    rc_t rc = 0;
+    KReadAheadFile * self = ( KReadAheadFile * ) cself;
+    KReadAheadPage * p;
+    uint64_t next;
+    bool stalled = false;
+
+    assert ( num_read != NULL );
+    * num_read = 0;
+
+    if ( bsize == 0 )
+        return 0;
+
+    KLockAcquire ( self -> lock );
+
+    ++ self -> stats . reads;
+    KReadAheadFileObserve ( self, pos, bsize );
+
+    /* the lock is dropped while waiting, and the page may be given
+       to another position meanwhile - look it up again on every wake */
+    while ( ( p = KReadAheadFileFind ( self, pos ) ) != NULL && p -> state != rapReady )
+    {
+        if ( ! stalled )
+        {
+            stalled = true;
+            ++ self -> stats . stalls;
+        }
+        KConditionWait ( self -> loaded, self -> lock );
+    }
+
+    if ( p != NULL && p -> rc != 0 )
+    {
+        /* retry the failed prefetch on demand */
+        p -> state = rapEmpty;
+        p = NULL;
+    }
+
+    if ( p != NULL )
+    {
+        size_t off = ( size_t ) ( pos - p -> pos );
+        size_t to_copy = off < p -> valid ? p -> valid - off : 0;
+        if ( to_copy > bsize )
+            to_copy = bsize;
+
+        memmove ( buffer, p -> data + off, to_copy );
+        * num_read = to_copy;
+
+        if ( ! stalled )
+            ++ self -> stats . hits;
+        p -> touched = true;
+        p -> stamp = ++ self -> clock;
+        next = p -> pos + p -> size;
+
+        if ( stalled )
+            KReadAheadFileGrow ( self, true );
+    }
+    else
+    {
+        ++ self -> stats . misses;
+        KReadAheadFileGrow ( self, false );
+
+        p = NULL;
+        if ( bsize < self -> stats . window )
+            p = KReadAheadFileVictim ( self, true );
+
+        if ( p == NULL )
+        {
+            /* large or random read: go straight to the source */
+            KLockUnlock ( self -> lock );
+            rc = KFileRead ( self -> original, pos, buffer, bsize, num_read );
+            KLockAcquire ( self -> lock );
+            next = pos + * num_read;
+        }
+        else
+        {
+            size_t valid = 0;
+
+            p -> pos = pos;
+            p -> size = self -> stats . window;
+            p -> valid = 0;
+            p -> stamp = ++ self -> clock;
+            p -> touched = true;
+            p -> state = rapLoading;
+            KLockUnlock ( self -> lock );
+
+            rc = KFileReadAll ( self -> original, pos, p -> data, p -> size, & valid );
+
+            KLockAcquire ( self -> lock );
+            if ( rc != 0 )
+                p -> state = rapEmpty;
+            else
+            {
+                p -> valid = valid;
+                p -> state = rapReady;
+                if ( valid > bsize )
+                    valid = bsize;
+                memmove ( buffer, p -> data, valid );
+                * num_read = valid;
+            }
+            KConditionBroadcast ( self -> loaded );
+            next = p -> pos + p -> size;
+        }
+    }
+
+    if ( rc == 0 )
+        KReadAheadFileSchedule ( self, pos, next, bsize );
+
+    KLockUnlock ( self -> lock );
+
+    return rc;
+}
+
+static
+rc_t CC KReadAheadFileWrite ( KReadAheadFile * self, uint64_t pos,
+    const void * buffer, size_t size, size_t * num_writ )
+{
+    return RC ( rcFS, rcFile, rcWriting, rcFunction, rcUnsupported );
+}
+
+static const KFile_vt_v1 vtKReadAheadFile =
+{
+    /* version */
+    1, 1,
+
+    /* 1.0 */
+    KReadAheadFileDestroy,
+    KReadAheadFileGetSysFile,
+    KReadAheadFileRandomAccess,
+    KReadAheadFileSize,
+    KReadAheadFileSetSize,
+    KReadAheadFileRead,
+    KReadAheadFileWrite,
+
+    /* 1.1 */
+    KReadAheadFileType
+};
+
+
+/* MakeAdaptiveReadAhead
+ */
+LIB_EXPORT rc_t CC KFileMakeAdaptiveReadAhead ( const KFile ** ra,
+    const KFile * original, size_t min_window, size_t max_window,
+    uint32_t max_depth )
+{
+    rc_t rc;
+    uint32_t i;
+    KReadAheadFile * self;
+
+    if ( ra == NULL )
+        return RC ( rcFS, rcFile, rcConstructing, rcParam, rcNull );
+
+    * ra = NULL;
+
+    if ( original == NULL )
+        return RC ( rcFS, rcFile, rcConstructing, rcFile, rcNull );
+    if ( ! original -> read_enabled )
+        return RC ( rcFS, rcFile, rcConstructing, rcFile, rcNoPerm );
+
+    if ( min_window == 0 )
+        min_window = RA_DFLT_MIN_WINDOW;
+    if ( max_window == 0 )
+        max_window = min_window > RA_DFLT_MAX_WINDOW ? min_window : RA_DFLT_MAX_WINDOW;
+    if ( min_window > max_window )
+        return RC ( rcFS, rcFile, rcConstructing, rcParam, rcInvalid );
+    if ( max_depth > RA_MAX_DEPTH )
+        max_depth = RA_MAX_DEPTH;
+
+    self = calloc ( 1, sizeof * self );
+    if ( self == NULL )
+        return RC ( rcFS, rcFile, rcConstructing, rcMemory, rcExhausted );
+
+    self -> min_window = min_window;
+    self -> max_window = max_window;
+    self -> max_depth = max_depth;
+    self -> stats . window = min_window;
+    self -> stats . depth = max_depth == 0 ? 0 : 1;
+    self -> stats . pattern = kraUnknown;
+    self -> npages = max_depth + 1;
+
+    if ( KFileSize ( original, & self -> eof ) != 0 )
+        self -> eof = ~ ( uint64_t ) 0;
+
+    rc = 0;
+    for ( i = 0; i < self -> npages; ++ i )
+    {
+        self -> page [ i ] . data = malloc ( max_window );
+        if ( self -> page [ i ] . data == NULL )
+        {
+            rc = RC ( rcFS, rcFile, rcConstructing, rcMemory, rcExhausted );
+            break;
+        }
+    }
+
+    if ( rc == 0 )
+        rc = KLockMake ( & self -> lock );
+    if ( rc == 0 )
+        rc = KConditionMake ( & self -> queued );
+    if ( rc == 0 )
+        rc = KConditionMake ( & self -> loaded );
+    if ( rc == 0 )
+    {
+        rc = KFileInit ( & self -> dad, ( const KFile_vt * ) & vtKReadAheadFile,
+            "KReadAheadFile", "no-name", true, false );
+    }
+    if ( rc == 0 )
+    {
+        rc = KFileAddRef ( original );
+        if ( rc == 0 )
+        {
+            self -> original = original;
+            if ( max_depth != 0 )
+                rc = KThreadMake ( & self -> th, KReadAheadFileMain, self );
+            if ( rc == 0 )
+            {
+                * ra = & self -> dad;
+                return 0;
+            }
+            KFileRelease ( original );
+        }
+    }
+
+    KConditionRelease ( self -> loaded );
+    KConditionRelease ( self -> queued );
+    KLockRelease ( self -> lock );
+    for ( i = 0; i < self -> npages; ++ i )
+        free ( self -> page [ i ] . data );
+    free ( self );
+
+    return rc;
+}
+
+
+/* GetReadAheadStats
+ */
+LIB_EXPORT rc_t CC KFileGetReadAheadStats ( const KFile * self, KReadAheadStats * stats )
+{
+    KReadAheadFile * ra;
+
+    if ( stats == NULL )
+        return RC ( rcFS, rcFile, rcAccessing, rcParam, rcNull );
+    if ( self == NULL )
+        return RC ( rcFS, rcFile, rcAccessing, rcSelf, rcNull );
+    if ( & self -> vt -> v1 != & vtKReadAheadFile )
+        return RC ( rcFS, rcFile, rcAccessing, rcType, rcIncorrect );
+
+    ra = ( KReadAheadFile * ) self;
+
+    KLockAcquire ( ra -> lock );
+    * stats = ra -> stats;
+    KLockUnlock ( ra -> lock );
+
+    return 0;
+}
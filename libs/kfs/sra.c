@@ -302,10 +302,16 @@ rc_t CC KArcParseSRAInt ( struct KToc * self,
         {
             uint64_t offset;
             offset = SraHeaderGetFileOffset (&header);
-            rc = KTocInflatePBSTree ( self, arcsize, pbstreeBuffer, 
-                                     (uint32_t)(offset - sizeof (header)),
-                                     offset,
-                                     reverse, "" );
+            rc = KTocPathIndexLoad ( self, pbstreeBuffer,
+                                     (size_t)(offset - sizeof (header)), reverse );
+            if ( rc == 0 )
+            {
+                rc = KTocInflatePBSTree ( self, arcsize, pbstreeBuffer, 
+                                         (uint32_t)(offset - sizeof (header)),
+                                         offset,
+                                         reverse, "" );
+                KTocPathIndexSeal ( self );
+            }
             free ( pbstreeBuffer );
             if ( rc != 0 && !silent )
             {
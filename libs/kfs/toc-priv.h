@@ -302,10 +302,33 @@ rc_t KTocEntryPersistNodeDir (void *param, const KTocEntry * n,
 			      size_t * num_writ, 
 			      PTWriteFunc write, void * write_param);
 
+/* ======================================================================
+ * KTocPathIndex
+ *  hash index of full paths within a TOC, loaded from the persisted
+ *  section that newer SRA archives carry at the end of their TOC region.
+ *  entries are numbered in the order in which the PBSTree inflates them
+ *  and "by_ordinal" is filled in as they are created.
+ */
+typedef struct KTocPathIndex KTocPathIndex;
+struct KTocPathIndex
+{
+    void *		block;		/* owns slots, entries and paths */
+    const uint32_t *	slots;		/* 0 for empty, else ordinal + 1 */
+    const uint32_t *	entries;	/* { hash, path offset, path size } per ordinal */
+    const char *	paths;
+    const KTocEntry **	by_ordinal;
+    uint32_t		num_slots;
+    uint32_t		num_entries;
+    uint32_t		num_recorded;
+    bool		recording;
+    bool		broken;
+};
+
 /* ======================================================================
  * KToc struct
  */
 struct KArcDir;
+struct KMMap;
 
 struct KToc
 {
@@ -362,6 +385,21 @@ struct KToc
     KSraHeader *	header;
 
 
+    /* -----
+     * Read-only map of the whole archive file, made once when the archive
+     * is a KFile with an underlying system file.  Contiguous members are
+     * read from and mapped as views into this region instead of issuing
+     * a read or mmap of their own.  NULL when not available.
+     */
+    const struct KMMap *map;
+    const char *	map_addr;
+    uint64_t		map_size;
+
+    /* -----
+     * Persisted path index used by KTocResolvePathTocEntry when present.
+     */
+    KTocPathIndex	pix;
+
     /* -----
      * This is the full path of the archive file as used to open it as a KFile.
      */
@@ -601,6 +639,26 @@ rc_t KTocInit( KToc**self, struct String const * path, KArcFSType arctype,
 rc_t KTocAddRef( const KToc *self );
 rc_t KTocRelease( const KToc *self );
 
+/* MapArchive
+ *  map the archive file once, read-only, so that contiguous members
+ *  can be served from memory. failure to map is not an error: members
+ *  fall back to reading through the archive KFile.
+ */
+void KTocMapArchive ( KToc *self );
+
+/* PathIndexLoad
+ *  look for a persisted path index at the end of the TOC region
+ *  "region" of "size" bytes, i.e. the bytes between the SRA header
+ *  and the file offset. an archive without one is not an error.
+ *  must be called before inflating the TOC, which records entries.
+ *
+ * PathIndexSeal
+ *  end recording after the TOC has been inflated; drops the index
+ *  if the inflated entries do not line up with it.
+ */
+rc_t KTocPathIndexLoad ( KToc *self, const void *region, size_t size, bool rev );
+void KTocPathIndexSeal ( KToc *self );
+
 
 /* AddRef
  * Release
@@ -34,12 +34,15 @@
 #include <kfs/toc.h>
 #include <kfs/directory.h>
 #include <kfs/file.h>
+#include <kfs/mmap.h>
+#include <byteswap.h>
 #include <klib/log.h>
 #include <klib/debug.h>
 #include <klib/rc.h>
 #include <sysalloc.h>
 
 #include "toc-priv.h"
+#include "mmap-priv.h"
 
 #include <assert.h>
 #include <limits.h>
@@ -484,6 +487,11 @@ rc_t KTocInit ( KToc ** self,
      */
     atomic32_set (&(*self)->refcount, 1);
 
+    (*self)->map = NULL;
+    (*self)->map_addr = NULL;
+    (*self)->map_size = 0;
+    memset (&(*self)->pix, 0, sizeof (*self)->pix);
+
     /* -----
      * a tad clunky
      */
@@ -511,6 +519,37 @@ rc_t KTocInit ( KToc ** self,
     return rc;
 }
 
+/* ----------------------------------------------------------------------
+ * KTocMapArchive
+ *
+ * Only attempted on 64-bit builds where the address space can hold the
+ * whole archive, and only with a true system mapping: a malloc'd copy of
+ * the archive would be far worse than reading members on demand.
+ */
+void KTocMapArchive ( KToc *self )
+{
+    const KMMap * mm;
+    const void * addr;
+    size_t size;
+
+    assert (self != NULL);
+
+    if (sizeof (size_t) < 8 || self->map != NULL || self->arctype != tocKFile)
+        return;
+
+    if (KMMapMakeSysRead (&mm, self->archive.f) != 0)
+        return;
+
+    if (KMMapAddrRead (mm, &addr) == 0 && KMMapSize (mm, &size) == 0)
+    {
+        self->map = mm;
+        self->map_addr = addr;
+        self->map_size = size;
+    }
+    else
+        KMMapRelease (mm);
+}
+
 /* ----------------------------------------------------------------------
  * AddRef
  *  ignores NULL references
@@ -541,6 +580,9 @@ rc_t KTocRelease ( const KToc *self )
 
     if (atomic32_dec_and_test (&mutable_self->refcount))
     {
+        KMMapRelease (self->map);
+        free (mutable_self->pix.block);
+        free ((void*)mutable_self->pix.by_ordinal);
         switch (self->arctype)
         {
         case tocUnknown:
@@ -892,6 +934,8 @@ static rc_t KTocCreate (KToc *self,
         case kcmInit:
             BSTreeUnlink (ptree, &pexistingentry->node); /*?*/
             KTocEntryDelete (pexistingentry);
+            /* an ordinal recorded for the old entry would now dangle */
+            self->pix.broken = self->pix.recording;
             goto insert;
             break;
 
@@ -905,6 +949,12 @@ static rc_t KTocCreate (KToc *self,
     {
     insert:
         rc = BSTreeInsert (ptree, &pnewentry->node, KTocEntryCmp2);
+        if (rc == 0 && self->pix.recording)
+        {
+            if (self->pix.num_recorded < self->pix.num_entries)
+                self->pix.by_ordinal [self->pix.num_recorded] = pnewentry;
+            ++ self->pix.num_recorded;
+        }
         TOC_DEBUG (("%s: inserted new %s into TOC %s\n", __func__,
                     KTocEntryTypeGetString(pparams->type),
                     pnewentry->name.addr));
@@ -1387,6 +1437,357 @@ rc_t KTocAlignmentSet( KToc * self,KSRAFileAlignment align )
 /*     *len = self->path.len; */
 /*     return &self->path.addr;; */
 /* } */
+/* ======================================================================
+ * Persisted path index
+ *
+ * An SRA archive may carry a hash index of the full paths in its TOC.
+ * It is written at the end of the TOC region so that it ends exactly at
+ * the header's file offset; readers that do not know about it stop at
+ * the end of the persisted PBSTree and never see it.
+ *
+ *   uint32_t slot [ num_slots ]	0 for empty, else ordinal + 1
+ *   uint32_t entry [ num_entries ] [ 3 ]	hash, path offset, path size
+ *   char path [ paths_size ]		full paths, not NUL terminated
+ *   zero filler to a multiple of 4
+ *   KTocPathIndexTrailer
+ *
+ * Ordinals number the entries in the order KTocEntryPersist writes them
+ * and KTocInflatePBSTree creates them again: forward through a directory
+ * with the contents of a subdirectory following the subdirectory itself.
+ * All integers are in the byte order of the archive.
+ */
+#define KTOC_PIX_MAGIC "KTocPIx1"
+
+typedef struct KTocPathIndexTrailer KTocPathIndexTrailer;
+struct KTocPathIndexTrailer
+{
+    uint32_t num_entries;
+    uint32_t num_slots;
+    uint32_t paths_size;
+    uint32_t index_size;	/* whole section including this trailer */
+    char magic [ 8 ];
+};
+
+static
+uint32_t KTocPathHash (const char * path, size_t size)
+{
+    /* 32-bit FNV-1a: part of the persisted format, must not change */
+    uint32_t h = 2166136261U;
+    size_t ix;
+
+    for (ix = 0; ix < size; ++ ix)
+    {
+        h ^= (uint8_t)path [ix];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static
+size_t KTocPathIndexSize (uint32_t num_entries, uint32_t num_slots, uint32_t paths_size)
+{
+    return sizeof (uint32_t) * ((size_t)num_slots + 3 * (size_t)num_entries)
+        + (((size_t)paths_size + 3) & ~ (size_t)3)
+        + sizeof (KTocPathIndexTrailer);
+}
+
+rc_t KTocPathIndexLoad ( KToc *self, const void *region, size_t size, bool rev )
+{
+    KTocPathIndexTrailer tr;
+    uint32_t * block;
+    size_t index_size;
+    uint32_t ix, count;
+    bool ok;
+
+    assert (self != NULL);
+
+    if (region == NULL || size < sizeof tr)
+        return 0;
+
+    memcpy (&tr, (const uint8_t*)region + size - sizeof tr, sizeof tr);
+    if (memcmp (tr.magic, KTOC_PIX_MAGIC, sizeof tr.magic) != 0)
+        return 0;
+
+    if (rev)
+    {
+        tr.num_entries = bswap_32 (tr.num_entries);
+        tr.num_slots = bswap_32 (tr.num_slots);
+        tr.paths_size = bswap_32 (tr.paths_size);
+        tr.index_size = bswap_32 (tr.index_size);
+    }
+
+    /* anything inconsistent is treated as an archive without an index */
+    if (tr.num_entries == 0 || tr.num_slots <= tr.num_entries ||
+        (tr.num_slots & (tr.num_slots - 1)) != 0 ||
+        tr.num_slots > (UINT32_MAX / 16) || tr.num_entries > (UINT32_MAX / 16))
+        return 0;
+
+    index_size = KTocPathIndexSize (tr.num_entries, tr.num_slots, tr.paths_size);
+    if (index_size != tr.index_size || index_size > size)
+        return 0;
+
+    block = malloc (index_size - sizeof tr);
+    if (block == NULL)
+        return RC (rcFS, rcToc, rcParsing, rcMemory, rcExhausted);
+
+    memcpy (block, (const uint8_t*)region + size - index_size, index_size - sizeof tr);
+
+    /* swap the integer part once so that lookups run native */
+    count = tr.num_slots + 3 * tr.num_entries;
+    if (rev)
+    {
+        for (ix = 0; ix < count; ++ ix)
+            block [ix] = bswap_32 (block [ix]);
+    }
+
+    /* validate slots and path extents up front */
+    for (ix = 0; ix < tr.num_slots; ++ ix)
+    {
+        if (block [ix] > tr.num_entries)
+            break;
+    }
+    ok = (ix == tr.num_slots);
+    for (ix = 0; ok && ix < tr.num_entries; ++ ix)
+    {
+        const uint32_t * e = block + tr.num_slots + 3 * ix;
+        ok = (e [1] <= tr.paths_size && e [2] <= tr.paths_size - e [1]);
+    }
+    if (! ok)
+    {
+        free (block);
+        return 0;
+    }
+
+    self->pix.by_ordinal = calloc (tr.num_entries, sizeof * self->pix.by_ordinal);
+    if (self->pix.by_ordinal == NULL)
+    {
+        free (block);
+        return RC (rcFS, rcToc, rcParsing, rcMemory, rcExhausted);
+    }
+
+    self->pix.block = block;
+    self->pix.slots = block;
+    self->pix.entries = block + tr.num_slots;
+    self->pix.paths = (const char*)(block + count);
+    self->pix.num_slots = tr.num_slots;
+    self->pix.num_entries = tr.num_entries;
+    self->pix.num_recorded = 0;
+    self->pix.recording = true;
+    self->pix.broken = false;
+
+    TOC_DEBUG (("%s: path index with %u entries\n", __func__, tr.num_entries));
+
+    return 0;
+}
+
+void KTocPathIndexSeal ( KToc *self )
+{
+    assert (self != NULL);
+
+    if (! self->pix.recording)
+        return;
+
+    self->pix.recording = false;
+    if (self->pix.broken || self->pix.num_recorded != self->pix.num_entries)
+    {
+        TOC_DEBUG (("%s: dropping path index: %u entries, %u inflated\n", __func__,
+                    self->pix.num_entries, self->pix.num_recorded));
+        free (self->pix.block);
+        free ((void*)self->pix.by_ordinal);
+        memset (&self->pix, 0, sizeof self->pix);
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * KTocPathIndexFind
+ *  probe the index for an exact full path
+ */
+static
+const KTocEntry * KTocPathIndexFind (const KToc * self, const char * path, size_t size)
+{
+    uint32_t hash, mask, slot;
+
+    if (self->pix.by_ordinal == NULL || self->pix.recording)
+        return NULL;
+
+    hash = KTocPathHash (path, size);
+    mask = self->pix.num_slots - 1;
+
+    for (slot = hash & mask; self->pix.slots [slot] != 0; slot = (slot + 1) & mask)
+    {
+        const uint32_t * e = self->pix.entries + 3 * (self->pix.slots [slot] - 1);
+        if (e [0] == hash && e [2] == size &&
+            memcmp (self->pix.paths + e [1], path, size) == 0)
+        {
+            const KTocEntry * entry = self->pix.by_ordinal [self->pix.slots [slot] - 1];
+            const char * leaf = string_rchr (path, size, '/');
+
+            leaf = (leaf == NULL) ? path : leaf + 1;
+
+            /* the entry must at least carry the leaf name of the path */
+            if (entry->name.size != (size_t)(path + size - leaf) ||
+                memcmp (entry->name.addr, leaf, entry->name.size) != 0)
+                return NULL;
+
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------
+ * KTocPathIndexBuild
+ *  gather full paths in persisted order when writing an archive
+ */
+typedef struct KTocPathIndexBuild KTocPathIndexBuild;
+struct KTocPathIndexBuild
+{
+    uint32_t * entries;
+    char * paths;
+    size_t num_entries;
+    size_t max_entries;
+    size_t paths_size;
+    size_t max_paths;
+    size_t prefix_off;
+    size_t prefix_size;
+    rc_t rc;
+};
+
+static
+void CC KTocPathIndexGather (BSTNode * n, void * data)
+{
+    KTocPathIndexBuild * b = data;
+    const KTocEntry * entry = (const KTocEntry*)n;
+    size_t off, need;
+
+    if (b->rc != 0)
+        return;
+
+    need = b->prefix_size + (b->prefix_size != 0) + entry->name.size;
+
+    if (b->num_entries == b->max_entries)
+    {
+        size_t max = b->max_entries ? b->max_entries * 2 : 256;
+        void * p = realloc (b->entries, max * 3 * sizeof * b->entries);
+        if (p == NULL)
+        {
+            b->rc = RC (rcFS, rcToc, rcPersisting, rcMemory, rcExhausted);
+            return;
+        }
+        b->entries = p;
+        b->max_entries = max;
+    }
+    if (b->paths_size + need > b->max_paths)
+    {
+        size_t max = b->max_paths ? b->max_paths * 2 : 16 * 1024;
+        void * p;
+        while (b->paths_size + need > max)
+            max *= 2;
+        p = realloc (b->paths, max);
+        if (p == NULL)
+        {
+            b->rc = RC (rcFS, rcToc, rcPersisting, rcMemory, rcExhausted);
+            return;
+        }
+        b->paths = p;
+        b->max_paths = max;
+    }
+
+    off = b->paths_size;
+    if (b->prefix_size != 0)
+    {
+        memmove (b->paths + off, b->paths + b->prefix_off, b->prefix_size);
+        b->paths [off + b->prefix_size] = '/';
+    }
+    memmove (b->paths + off + need - entry->name.size, entry->name.addr, entry->name.size);
+    b->paths_size += need;
+
+    b->entries [3 * b->num_entries + 0] = KTocPathHash (b->paths + off, need);
+    b->entries [3 * b->num_entries + 1] = (uint32_t)off;
+    b->entries [3 * b->num_entries + 2] = (uint32_t)need;
+    ++ b->num_entries;
+
+    /* a directory's contents follow it, exactly as KTocEntryPersistNodeDir writes them */
+    if (entry->type == ktocentrytype_dir)
+    {
+        size_t save_off = b->prefix_off;
+        size_t save_size = b->prefix_size;
+
+        b->prefix_off = off;
+        b->prefix_size = need;
+        BSTreeForEach (&entry->u.dir.tree, false, KTocPathIndexGather, b);
+        b->prefix_off = save_off;
+        b->prefix_size = save_size;
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * KTocPathIndexMake
+ *  build the persisted form of the index for "self"
+ *
+ *  returns an allocated section in "index" of "index_size" bytes, or
+ *  NULL and 0 when the TOC is empty or too large to be indexed
+ */
+static
+rc_t KTocPathIndexMake (const KToc * self, void ** index, size_t * index_size)
+{
+    KTocPathIndexBuild b;
+    rc_t rc;
+
+    *index = NULL;
+    *index_size = 0;
+
+    memset (&b, 0, sizeof b);
+    BSTreeForEach (&self->entry.u.dir.tree, false, KTocPathIndexGather, &b);
+    rc = b.rc;
+
+    if (rc == 0 && b.num_entries != 0 &&
+        b.num_entries < (UINT32_MAX / 16) && b.paths_size < UINT32_MAX)
+    {
+        uint32_t num_slots, ix;
+        size_t size;
+        uint32_t * block;
+
+        /* keep the load factor at or below one half */
+        for (num_slots = 16; num_slots < 2 * b.num_entries; num_slots *= 2)
+            ;
+
+        size = KTocPathIndexSize ((uint32_t)b.num_entries, num_slots, (uint32_t)b.paths_size);
+        block = calloc (1, size);
+        if (block == NULL)
+            rc = RC (rcFS, rcToc, rcPersisting, rcMemory, rcExhausted);
+        else
+        {
+            uint32_t mask = num_slots - 1;
+            KTocPathIndexTrailer tr;
+
+            for (ix = 0; ix < (uint32_t)b.num_entries; ++ ix)
+            {
+                uint32_t slot = b.entries [3 * ix] & mask;
+                while (block [slot] != 0)
+                    slot = (slot + 1) & mask;
+                block [slot] = ix + 1;
+            }
+            memcpy (block + num_slots, b.entries, 3 * sizeof * b.entries * b.num_entries);
+            memcpy (block + num_slots + 3 * b.num_entries, b.paths, b.paths_size);
+
+            tr.num_entries = (uint32_t)b.num_entries;
+            tr.num_slots = num_slots;
+            tr.paths_size = (uint32_t)b.paths_size;
+            tr.index_size = (uint32_t)size;
+            memcpy (tr.magic, KTOC_PIX_MAGIC, sizeof tr.magic);
+            memcpy ((uint8_t*)block + size - sizeof tr, &tr, sizeof tr);
+
+            *index = block;
+            *index_size = size;
+        }
+    }
+
+    free (b.entries);
+    free (b.paths);
+    return rc;
+}
+
 /*****
  ***** CURRENTLY DOES NOT SUPPORT any form of crossing of
  ***** KDirectory type paths
@@ -1402,7 +1803,7 @@ rc_t KTocResolvePathTocEntry ( const KToc *self,
     const char *  	next_facet;	/* points to the start of the current facet */
     const char *	end;		/* points to the character after the path */
     const KTocEntry * dentry;		/* the current entry we are at during the walk through */
-    KTocEntry * 	tentry;		/* points to a Temporary ENTRY built for comparisons */
+    KTocEntry   	tentry;		/* Temporary ENTRY used as the key for comparisons */
     union
     {
         const BSTNode     * b;		/* access to the BSTree Node starting the KToc entry */
@@ -1437,6 +1838,44 @@ rc_t KTocResolvePathTocEntry ( const KToc *self,
         return 0;
     }
 
+    /* -----
+     * an archive with a path index resolves a full path in one probe;
+     * anything the index can not answer by itself takes the walk below
+     */
+    if (self->pix.by_ordinal != NULL)
+    {
+        bool want_dir = (path [path_len - 1] == '/');
+        const KTocEntry * hit = KTocPathIndexFind (self, path, path_len - want_dir);
+
+        if (hit != NULL)
+        {
+            switch (hit->type)
+            {
+            case ktocentrytype_dir:
+                *pentry = hit;
+                *ptype = hit->type;
+                *unusedpath = end;
+                return 0;
+
+            case ktocentrytype_emptyfile:
+            case ktocentrytype_file:
+            case ktocentrytype_chunked:
+            case ktocentrytype_zombiefile:
+                if (! want_dir)
+                {
+                    *pentry = hit;
+                    *ptype = hit->type;
+                    *unusedpath = end;
+                    return 0;
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
 
     /* -----
      * now start wending our way down through subdirectories
@@ -1472,16 +1911,13 @@ rc_t KTocResolvePathTocEntry ( const KToc *self,
         facet_size = slash - next_facet;	/* how many characters in this facet */
 
         /* -----
-         * build a temporary entry for comparisons
+         * only the name of the key entry takes part in comparisons
+         * so it can live on the stack
          */
-        rc = KTocEntryNewDirectory (&tentry, next_facet, facet_size, 0, 0555);
-        if (rc != 0)
-        {
-            *pentry = NULL;		/* if we couldn't make then fail */
-            return rc;
-        }
-        fentry.b = BSTreeFind (&dentry->u.dir.tree, tentry, KTocEntryCmpVoid);
-        KTocEntryDelete(tentry);	/* clean up the temporary entry */
+        while (facet_size > 0 && next_facet [facet_size - 1] == '/')
+            -- facet_size;
+        StringInit (&tentry.name, next_facet, facet_size, (uint32_t)facet_size);
+        fentry.b = BSTreeFind (&dentry->u.dir.tree, &tentry, KTocEntryCmpVoid);
 
         if (fentry.b == NULL)
         {
@@ -1686,12 +2122,16 @@ rc_t KTocPersist ( const KToc * self,
     KSraHeader * header;
     uint8_t * bbuffer;
     uint64_t filesize;
+    void * index;
+    size_t index_size;
 
     TOC_FUNC_ENTRY();
 
     rc = 0;
     treesize = 0;
     bbuffer = NULL;
+    index = NULL;
+    index_size = 0;
     *buffer = NULL;
     *buffer_size = 0;
     *virtual_file_size = 0;
@@ -1701,9 +2141,14 @@ rc_t KTocPersist ( const KToc * self,
     {
         LOGMSG (klogErr, "Failure to Persist Toc Root Entry");
     }
+    else if ((rc = KTocPathIndexMake (self, &index, &index_size)) != 0)
+    {
+        LOGERR (klogErr, rc, "Failure to build Toc path index");
+    }
     else
     {
-        rc = SraHeaderMake (&header, treesize, self->alignment);
+        /* the path index goes last, ending right at the file offset */
+        rc = SraHeaderMake (&header, treesize + index_size, self->alignment);
         if (header == NULL)
         {
             rc = RC (rcFS, rcToc, rcPersisting, rcMemory, rcExhausted);
@@ -1735,15 +2180,24 @@ rc_t KTocPersist ( const KToc * self,
                 if (rc == 0)
                 {
                             KTocEntryPersistWriteFuncData wdata;
+                            uint64_t toc_end = SraHeaderGetFileOffset(header);
                             wdata.buffptr = bbuffer + SraHeaderSize(NULL);
-                            wdata.limit = bbuffer + SraHeaderGetFileOffset(header);
+                            wdata.limit = bbuffer + toc_end - index_size;
                             rc = KTocEntryPersistNodeDir (NULL, &self->entry, &treesize,
                                                           KTocEntryPersistWriteFunc, 
                                                           &wdata);
+                            if (rc == 0 && index != NULL)
+                            {
+                                /* filler between tree and index is part of the buffer */
+                                memset (wdata.buffptr, 0, wdata.limit - wdata.buffptr);
+                                memcpy (wdata.limit, index, index_size);
+                                treesize = (size_t)toc_end - SraHeaderSize(NULL);
+                            }
                 }
             }
         }
     }
+    free (index);
     if (rc == 0)
     {
         ((KToc*)self)->header = (KSraHeader *)bbuffer;
@@ -50,6 +50,9 @@ struct KMMap
     KFile *f;
     size_t pg_size;
 
+    /* when not NULL, "addr" points into this map rather than a region of our own */
+    const KMMap *view;
+
     uint32_t addr_adj;
     uint32_t size_adj;
 
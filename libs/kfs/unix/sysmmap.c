@@ -28,6 +28,7 @@
 #include "sysfile-priv.h"
 #include <klib/rc.h>
 #include <sysalloc.h>
+#include <atomic32.h>
 
 #include <unistd.h>
 #include <stdlib.h>
@@ -35,6 +36,10 @@
 #include <sys/mman.h>
 #include <errno.h>
 
+#if LINUX
+#include <fcntl.h>
+#endif
+
 
 /*--------------------------------------------------------------------------
  * KMMap
@@ -141,3 +146,51 @@ rc_t KMMapUnmap ( KMMap *self )
 
     return 0;
 }
+
+
+/* AdviseSys
+ */
+rc_t KMMapAdviseSys ( const KMMap *self, uint32_t advice )
+{
+    char *addr = self -> addr - self -> addr_adj;
+    size_t const size = self -> size + self -> size_adj;
+
+    if ( ( advice & kmmapAdviseReserve ) != 0 && ! self -> read_only )
+    {
+#if LINUX
+        uint64_t off;
+        KSysFile *sf = KFileGetSysFile ( self -> f, & off );
+        if ( sf != NULL )
+        {
+            /* without it, running out of space shows up as SIGBUS on first touch */
+            if ( fallocate ( sf -> fd, 0, off + self -> pos - self -> addr_adj, size ) != 0 && errno == ENOSPC )
+                return RC ( rcFS, rcMemMap, rcUpdating, rcStorage, rcExhausted );
+        }
+#endif
+    }
+
+#ifdef MADV_HUGEPAGE
+    if ( ( advice & kmmapAdviseHugePages ) != 0 )
+        madvise ( addr, size, MADV_HUGEPAGE );
+#endif
+
+    if ( ( advice & kmmapAdvisePrefault ) != 0 )
+    {
+        size_t i;
+
+#if defined MADV_POPULATE_READ && defined MADV_POPULATE_WRITE
+        if ( madvise ( addr, size, self -> read_only ? MADV_POPULATE_READ : MADV_POPULATE_WRITE ) == 0 )
+            return 0;
+#endif
+        /* older kernels: touch every page, writing nothing */
+        for ( i = 0; i < size; i += self -> pg_size )
+        {
+            if ( self -> read_only )
+                ( void ) ( ( volatile char* ) addr ) [ i ];
+            else
+                atomic32_read_and_add ( ( atomic32_t* ) & addr [ i ], 0 );
+        }
+    }
+
+    return 0;
+}
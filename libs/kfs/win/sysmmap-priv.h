@@ -50,6 +50,9 @@ struct KMMap
     struct KFile *f;
     size_t pg_size;
 
+    /* when not NULL, "addr" points into this map rather than a region of our own */
+    const KMMap *view;
+
     /* file mapping handle */
     HANDLE handle;
 
@@ -136,3 +136,12 @@ rc_t KMMapUnmap ( KMMap *self )
 
     return 0;
 }
+
+
+/* AdviseSys
+ *  windows has no equivalent hints for file mappings
+ */
+rc_t KMMapAdviseSys ( const KMMap *self, uint32_t advice )
+{
+    return 0;
+}
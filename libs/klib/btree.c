@@ -300,6 +300,7 @@ struct EntryData
 {
     Pager *pager;
     Pager_vt const *vt;
+    Pager_hint_vt const *hints;
     uint32_t root;
     uint32_t *id;
     const void *key;
@@ -1156,6 +1157,18 @@ rc_t branch_entry ( EntryData *pb, void const *page, Split *rsplit)
             {
                 split . left = nid;
                 
+                /* the neighbors of the split child take the
+                   following inserts of a clustered load */
+                if ( pb->hints != NULL && pb->hints->prefetch != NULL )
+                {
+                    if ( upper < node -> count )
+                        pb->hints->prefetch(pb->pager, node -> ord [ upper ] . trans >> 1);
+                    if ( upper > 1 )
+                        pb->hints->prefetch(pb->pager, node -> ord [ upper - 2 ] . trans >> 1);
+                    else if ( upper == 1 )
+                        pb->hints->prefetch(pb->pager, node -> ltrans >> 1);
+                }
+
                 /* if we are also full, we have to split */
                 if ( branch_node_full ( node, split.ksize ) )
                 {
@@ -1289,6 +1302,13 @@ static rc_t tree_entry(EntryData *pb)
 
 LIB_EXPORT rc_t CC BTreeEntry ( uint32_t *root, Pager *pager, Pager_vt const *vt, uint32_t *id,
                                bool *was_inserted, const void *key, size_t key_size )
+{
+    return BTreeEntryWithHints(root, pager, vt, NULL, id, was_inserted, key, key_size);
+}
+
+LIB_EXPORT rc_t CC BTreeEntryWithHints ( uint32_t *root, Pager *pager, Pager_vt const *vt,
+                                        Pager_hint_vt const *hints, uint32_t *id,
+                                        bool *was_inserted, const void *key, size_t key_size )
 {
     assert(root != NULL);
     assert(vt != NULL);
@@ -1301,6 +1321,7 @@ LIB_EXPORT rc_t CC BTreeEntry ( uint32_t *root, Pager *pager, Pager_vt const *vt
         
         pb.pager = pager;
         pb.vt = vt;
+        pb.hints = hints;
         pb.root = *root;
         pb.id = id;
         pb.key = key;
@@ -397,6 +397,188 @@ void Pack64b ( uint32_t packed, void *dst, const void *src, uint32_t count )
     }
 }
 
+/*--------------------------------------------------------------------------
+ * vector packing
+ *  bytes into 1, 2 or 4 bits and 16 or 32 bit elements into bytes are
+ *  packed a vector at a time with SSE2, which x86_64 always has.
+ *
+ *  the scalar code does not mask its input, so an element wider than
+ *  "packed" bleeds into its neighbors. rather than imitate that, the
+ *  vector loop stops at the first such element and leaves the rest to
+ *  the scalar code, which picks up at the byte boundary reached.
+ */
+#if defined __GNUC__ && defined __x86_64__ && __BYTE_ORDER == __LITTLE_ENDIAN
+#define PACK_VEC 1
+#endif
+
+#if PACK_VEC
+
+#include <emmintrin.h>
+
+/* true if any element of "x" has bits outside of "keep" */
+#define OUT_OF_RANGE( x, keep ) \
+    ( _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( _mm_andnot_si128 ( keep, x ), _mm_setzero_si128 () ) ) != 0xFFFF )
+
+/* 1 from 8: 16 elements => 2 bytes */
+static
+uint32_t PackVec1From8 ( void *dst, const void *src, uint32_t count )
+{
+    const __m128i keep = _mm_set1_epi8 ( 1 );
+    uint32_t i;
+
+    for ( i = 0; i + 16 <= count; i += 16 )
+    {
+        __m128i x = _mm_loadu_si128 ( ( const __m128i* ) ( ( const uint8_t* ) src + i ) );
+        uint16_t bits;
+        if ( OUT_OF_RANGE ( x, keep ) )
+            break;
+
+        /* reverse each group of 8 so the first element lands in the MSB */
+        x = _mm_shufflelo_epi16 ( x, 0x1B );
+        x = _mm_shufflehi_epi16 ( x, 0x1B );
+        x = _mm_or_si128 ( _mm_slli_epi16 ( x, 8 ), _mm_srli_epi16 ( x, 8 ) );
+
+        bits = ( uint16_t ) _mm_movemask_epi8 ( _mm_slli_epi16 ( x, 7 ) );
+        memcpy ( ( uint8_t* ) dst + ( i >> 3 ), & bits, 2 );
+    }
+    return i;
+}
+
+/* 2 from 8: 64 elements => 16 bytes */
+static
+uint32_t PackVec2From8 ( void *dst, const void *src, uint32_t count )
+{
+    const __m128i keep = _mm_set1_epi8 ( 3 );
+    const __m128i lo16 = _mm_set1_epi16 ( 0xFF );
+    const __m128i lo32 = _mm_set1_epi32 ( 0xFFFF );
+    uint32_t i;
+
+    for ( i = 0; i + 64 <= count; i += 64 )
+    {
+        const __m128i *in = ( const __m128i* ) ( ( const uint8_t* ) src + i );
+        __m128i x [ 4 ];
+        uint32_t j;
+
+        for ( j = 0; j < 4; ++ j )
+        {
+            x [ j ] = _mm_loadu_si128 ( in + j );
+            if ( OUT_OF_RANGE ( x [ j ], keep ) )
+                return i;
+        }
+
+        /* pairs into nibbles within 16 bits, then nibbles into bytes within 32 */
+        for ( j = 0; j < 4; ++ j )
+        {
+            __m128i y = _mm_or_si128 ( _mm_slli_epi16 ( _mm_and_si128 ( x [ j ], lo16 ), 2 ), _mm_srli_epi16 ( x [ j ], 8 ) );
+            x [ j ] = _mm_or_si128 ( _mm_slli_epi32 ( _mm_and_si128 ( y, lo32 ), 4 ), _mm_srli_epi32 ( y, 16 ) );
+        }
+
+        _mm_storeu_si128 ( ( __m128i* ) ( ( uint8_t* ) dst + ( i >> 2 ) ),
+            _mm_packus_epi16 ( _mm_packs_epi32 ( x [ 0 ], x [ 1 ] ), _mm_packs_epi32 ( x [ 2 ], x [ 3 ] ) ) );
+    }
+    return i;
+}
+
+/* 4 from 8: 32 elements => 16 bytes */
+static
+uint32_t PackVec4From8 ( void *dst, const void *src, uint32_t count )
+{
+    const __m128i keep = _mm_set1_epi8 ( 15 );
+    const __m128i lo16 = _mm_set1_epi16 ( 0xFF );
+    uint32_t i;
+
+    for ( i = 0; i + 32 <= count; i += 32 )
+    {
+        const __m128i *in = ( const __m128i* ) ( ( const uint8_t* ) src + i );
+        __m128i x0 = _mm_loadu_si128 ( in );
+        __m128i x1 = _mm_loadu_si128 ( in + 1 );
+        if ( OUT_OF_RANGE ( x0, keep ) || OUT_OF_RANGE ( x1, keep ) )
+            break;
+
+        x0 = _mm_or_si128 ( _mm_slli_epi16 ( _mm_and_si128 ( x0, lo16 ), 4 ), _mm_srli_epi16 ( x0, 8 ) );
+        x1 = _mm_or_si128 ( _mm_slli_epi16 ( _mm_and_si128 ( x1, lo16 ), 4 ), _mm_srli_epi16 ( x1, 8 ) );
+        _mm_storeu_si128 ( ( __m128i* ) ( ( uint8_t* ) dst + ( i >> 1 ) ), _mm_packus_epi16 ( x0, x1 ) );
+    }
+    return i;
+}
+
+/* 8 from 16: 16 elements => 16 bytes */
+static
+uint32_t PackVec8From16 ( void *dst, const void *src, uint32_t count )
+{
+    const __m128i keep = _mm_set1_epi16 ( 0xFF );
+    uint32_t i;
+
+    for ( i = 0; i + 16 <= count; i += 16 )
+    {
+        const __m128i *in = ( const __m128i* ) ( ( const uint16_t* ) src + i );
+        __m128i x0 = _mm_loadu_si128 ( in );
+        __m128i x1 = _mm_loadu_si128 ( in + 1 );
+        if ( OUT_OF_RANGE ( x0, keep ) || OUT_OF_RANGE ( x1, keep ) )
+            break;
+        _mm_storeu_si128 ( ( __m128i* ) ( ( uint8_t* ) dst + i ), _mm_packus_epi16 ( x0, x1 ) );
+    }
+    return i;
+}
+
+/* 8 from 32: 16 elements => 16 bytes */
+static
+uint32_t PackVec8From32 ( void *dst, const void *src, uint32_t count )
+{
+    const __m128i keep = _mm_set1_epi32 ( 0xFF );
+    uint32_t i;
+
+    for ( i = 0; i + 16 <= count; i += 16 )
+    {
+        const __m128i *in = ( const __m128i* ) ( ( const uint32_t* ) src + i );
+        __m128i x0 = _mm_loadu_si128 ( in );
+        __m128i x1 = _mm_loadu_si128 ( in + 1 );
+        __m128i x2 = _mm_loadu_si128 ( in + 2 );
+        __m128i x3 = _mm_loadu_si128 ( in + 3 );
+        if ( OUT_OF_RANGE ( x0, keep ) || OUT_OF_RANGE ( x1, keep ) ||
+             OUT_OF_RANGE ( x2, keep ) || OUT_OF_RANGE ( x3, keep ) )
+            break;
+        _mm_storeu_si128 ( ( __m128i* ) ( ( uint8_t* ) dst + i ),
+            _mm_packus_epi16 ( _mm_packs_epi32 ( x0, x1 ), _mm_packs_epi32 ( x2, x3 ) ) );
+    }
+    return i;
+}
+
+/* PackVec
+ *  returns the number of leading elements packed,
+ *  always a whole number of destination bytes
+ */
+static
+uint32_t PackVec ( uint32_t unpacked, uint32_t packed, void *dst, const void *src, uint32_t count )
+{
+    switch ( unpacked )
+    {
+    case 8:
+        switch ( packed )
+        {
+        case 1:
+            return PackVec1From8 ( dst, src, count );
+        case 2:
+            return PackVec2From8 ( dst, src, count );
+        case 4:
+            return PackVec4From8 ( dst, src, count );
+        }
+        break;
+    case 16:
+        if ( packed == 8 )
+            return PackVec8From16 ( dst, src, count );
+        break;
+    case 32:
+        if ( packed == 8 )
+            return PackVec8From32 ( dst, src, count );
+        break;
+    }
+    return 0;
+}
+
+#endif /* PACK_VEC */
+
+
 /* Pack
  *  accepts a series of unpacked source bits
  *  produces a series of packed destination bits by eliminating MSB
@@ -494,6 +676,21 @@ LIB_EXPORT rc_t CC Pack ( uint32_t unpacked, uint32_t packed,
     if ( dst_off != 0 )
         return RC ( rcXF, rcBuffer, rcPacking, rcOffset, rcUnsupported );
 
+#if PACK_VEC
+    {
+        uint32_t done = PackVec ( unpacked, packed, dst, src,
+            ( uint32_t ) ( ssize / ( unpacked >> 3 ) ) );
+        if ( done != 0 )
+        {
+            dst = & ( ( char* ) dst ) [ ( ( size_t ) done * packed ) >> 3 ];
+            src = & ( ( const char* ) src ) [ ( ( size_t ) done * unpacked ) >> 3 ];
+            ssize -= ( ( size_t ) done * unpacked ) >> 3;
+            if ( ssize == 0 )
+                return 0;
+        }
+    }
+#endif
+
     switch ( unpacked )
     {
     case 8:
@@ -211,26 +211,34 @@ uint8_t unpack_8_from_1_arr[256][8]={
 static
 void CC Unpack8From2(uint8_t *dst,const uint8_t *src,int32_t count)
 {
+	/* last to first, so that unpacking in place is safe */
 	if(count > 0){
-		int i;
-		for(i=0;i<count/4;i++,dst+=4,src++){
-			memcpy(dst,unpack_8_from_2_arr[*src],4);
+		int i, n = count/4;
+		if((count&3) != 0){
+			const uint8_t *tail = unpack_8_from_2_arr[src[n]];
+			for(i=0;i< (count&3);i++){
+				dst[n*4+i] = tail[i];
+			}
 		}
-		for(i=0;i< (count&3);i++){
-			dst[i] = unpack_8_from_2_arr[*src][i];
+		while(n-- > 0){
+			memcpy(dst+n*4,unpack_8_from_2_arr[src[n]],4);
 		}
 	}
 }
 static
 void CC Unpack8From1(uint8_t *dst,const uint8_t *src,int32_t count)
 {
+	/* last to first, so that unpacking in place is safe */
 	if(count > 0){
-		int i;
-		for(i=0;i<count/8;i++,dst+=8,src++){
-			memcpy(dst,unpack_8_from_1_arr[*src],8);
+		int i, n = count/8;
+		if((count&7) != 0){
+			const uint8_t *tail = unpack_8_from_1_arr[src[n]];
+			for(i=0;i< (count&7);i++){
+				dst[n*8+i] = tail[i];
+			}
 		}
-		for(i=0;i< (count&7);i++){
-			dst[i] = unpack_8_from_1_arr[*src][i];
+		while(n-- > 0){
+			memcpy(dst+n*8,unpack_8_from_1_arr[src[n]],8);
 		}
 	}
 }
@@ -716,6 +724,337 @@ void CC Unpack64b ( uint32_t packed, uint32_t count, void *dst,
 }
 
 
+/*--------------------------------------------------------------------------
+ * vector unpacking
+ *  the narrow widths that dominate real data - 1, 2 and 4 bits into
+ *  bytes, bytes into 16 or 32 bits - are unpacked a vector at a time.
+ *  SSE2 is part of x86_64 and always available; AVX2 is picked up at
+ *  run time. like the scalar code, vectors are written from last to
+ *  first so that unpacking in place remains safe.
+ */
+#if defined __GNUC__ && defined __x86_64__ && __BYTE_ORDER == __LITTLE_ENDIAN
+#define UNPACK_VEC 1
+#endif
+
+#if UNPACK_VEC
+
+#include <immintrin.h>
+
+/* unpack "iter" vectors of source, where each iteration
+   consumes "bytes" source bytes and produces "elems" elements */
+typedef void ( * UnpackVecFunc ) ( void *dst, const void *src, uint32_t iter );
+
+typedef struct UnpackVecKernel UnpackVecKernel;
+struct UnpackVecKernel
+{
+    UnpackVecFunc func;
+    uint32_t elems;
+};
+
+/* 8 from 1: 16 bytes => 128 elements */
+static
+void UnpackVec8From1 ( void *dst, const void *src, uint32_t iter )
+{
+    const __m128i one = _mm_set1_epi8 ( 1 );
+    while ( iter -- != 0 )
+    {
+        __m128i *out = ( __m128i* ) dst + iter * 8;
+        __m128i x = _mm_loadu_si128 ( ( const __m128i* ) src + iter );
+        __m128i b7 = _mm_and_si128 ( _mm_srli_epi16 ( x, 7 ), one );
+        __m128i b6 = _mm_and_si128 ( _mm_srli_epi16 ( x, 6 ), one );
+        __m128i b5 = _mm_and_si128 ( _mm_srli_epi16 ( x, 5 ), one );
+        __m128i b4 = _mm_and_si128 ( _mm_srli_epi16 ( x, 4 ), one );
+        __m128i b3 = _mm_and_si128 ( _mm_srli_epi16 ( x, 3 ), one );
+        __m128i b2 = _mm_and_si128 ( _mm_srli_epi16 ( x, 2 ), one );
+        __m128i b1 = _mm_and_si128 ( _mm_srli_epi16 ( x, 1 ), one );
+        __m128i b0 = _mm_and_si128 ( x, one );
+
+        /* interleave so that each source byte spreads MSB first */
+        __m128i p76 = _mm_unpacklo_epi8 ( b7, b6 ), p54 = _mm_unpacklo_epi8 ( b5, b4 );
+        __m128i p32 = _mm_unpacklo_epi8 ( b3, b2 ), p10 = _mm_unpacklo_epi8 ( b1, b0 );
+        __m128i q74 = _mm_unpacklo_epi16 ( p76, p54 ), q30 = _mm_unpacklo_epi16 ( p32, p10 );
+        __m128i o0 = _mm_unpacklo_epi32 ( q74, q30 ), o1 = _mm_unpackhi_epi32 ( q74, q30 );
+        __m128i o2, o3, o4, o5, o6, o7;
+        q74 = _mm_unpackhi_epi16 ( p76, p54 ); q30 = _mm_unpackhi_epi16 ( p32, p10 );
+        o2 = _mm_unpacklo_epi32 ( q74, q30 ); o3 = _mm_unpackhi_epi32 ( q74, q30 );
+
+        p76 = _mm_unpackhi_epi8 ( b7, b6 ); p54 = _mm_unpackhi_epi8 ( b5, b4 );
+        p32 = _mm_unpackhi_epi8 ( b3, b2 ); p10 = _mm_unpackhi_epi8 ( b1, b0 );
+        q74 = _mm_unpacklo_epi16 ( p76, p54 ); q30 = _mm_unpacklo_epi16 ( p32, p10 );
+        o4 = _mm_unpacklo_epi32 ( q74, q30 ); o5 = _mm_unpackhi_epi32 ( q74, q30 );
+        q74 = _mm_unpackhi_epi16 ( p76, p54 ); q30 = _mm_unpackhi_epi16 ( p32, p10 );
+        o6 = _mm_unpacklo_epi32 ( q74, q30 ); o7 = _mm_unpackhi_epi32 ( q74, q30 );
+
+        _mm_storeu_si128 ( out + 0, o0 ); _mm_storeu_si128 ( out + 1, o1 );
+        _mm_storeu_si128 ( out + 2, o2 ); _mm_storeu_si128 ( out + 3, o3 );
+        _mm_storeu_si128 ( out + 4, o4 ); _mm_storeu_si128 ( out + 5, o5 );
+        _mm_storeu_si128 ( out + 6, o6 ); _mm_storeu_si128 ( out + 7, o7 );
+    }
+}
+
+/* 8 from 2: 16 bytes => 64 elements */
+static
+void UnpackVec8From2 ( void *dst, const void *src, uint32_t iter )
+{
+    const __m128i m = _mm_set1_epi8 ( 3 );
+    while ( iter -- != 0 )
+    {
+        __m128i *out = ( __m128i* ) dst + iter * 4;
+        __m128i x = _mm_loadu_si128 ( ( const __m128i* ) src + iter );
+        __m128i a = _mm_and_si128 ( _mm_srli_epi16 ( x, 6 ), m );
+        __m128i b = _mm_and_si128 ( _mm_srli_epi16 ( x, 4 ), m );
+        __m128i c = _mm_and_si128 ( _mm_srli_epi16 ( x, 2 ), m );
+        __m128i d = _mm_and_si128 ( x, m );
+        __m128i ab = _mm_unpacklo_epi8 ( a, b ), cd = _mm_unpacklo_epi8 ( c, d );
+        __m128i o0 = _mm_unpacklo_epi16 ( ab, cd ), o1 = _mm_unpackhi_epi16 ( ab, cd );
+        ab = _mm_unpackhi_epi8 ( a, b );
+        cd = _mm_unpackhi_epi8 ( c, d );
+        _mm_storeu_si128 ( out + 0, o0 );
+        _mm_storeu_si128 ( out + 1, o1 );
+        _mm_storeu_si128 ( out + 2, _mm_unpacklo_epi16 ( ab, cd ) );
+        _mm_storeu_si128 ( out + 3, _mm_unpackhi_epi16 ( ab, cd ) );
+    }
+}
+
+/* 8 from 4: 16 bytes => 32 elements */
+static
+void UnpackVec8From4 ( void *dst, const void *src, uint32_t iter )
+{
+    const __m128i m = _mm_set1_epi8 ( 15 );
+    while ( iter -- != 0 )
+    {
+        __m128i *out = ( __m128i* ) dst + iter * 2;
+        __m128i x = _mm_loadu_si128 ( ( const __m128i* ) src + iter );
+        __m128i hi = _mm_and_si128 ( _mm_srli_epi16 ( x, 4 ), m );
+        __m128i lo = _mm_and_si128 ( x, m );
+        _mm_storeu_si128 ( out + 0, _mm_unpacklo_epi8 ( hi, lo ) );
+        _mm_storeu_si128 ( out + 1, _mm_unpackhi_epi8 ( hi, lo ) );
+    }
+}
+
+/* 16 from 8: 16 bytes => 16 elements */
+static
+void UnpackVec16From8 ( void *dst, const void *src, uint32_t iter )
+{
+    const __m128i z = _mm_setzero_si128 ();
+    while ( iter -- != 0 )
+    {
+        __m128i *out = ( __m128i* ) dst + iter * 2;
+        __m128i x = _mm_loadu_si128 ( ( const __m128i* ) src + iter );
+        _mm_storeu_si128 ( out + 0, _mm_unpacklo_epi8 ( x, z ) );
+        _mm_storeu_si128 ( out + 1, _mm_unpackhi_epi8 ( x, z ) );
+    }
+}
+
+/* 32 from 8: 16 bytes => 16 elements */
+static
+void UnpackVec32From8 ( void *dst, const void *src, uint32_t iter )
+{
+    const __m128i z = _mm_setzero_si128 ();
+    while ( iter -- != 0 )
+    {
+        __m128i *out = ( __m128i* ) dst + iter * 4;
+        __m128i x = _mm_loadu_si128 ( ( const __m128i* ) src + iter );
+        __m128i lo = _mm_unpacklo_epi8 ( x, z ), hi = _mm_unpackhi_epi8 ( x, z );
+        _mm_storeu_si128 ( out + 0, _mm_unpacklo_epi16 ( lo, z ) );
+        _mm_storeu_si128 ( out + 1, _mm_unpackhi_epi16 ( lo, z ) );
+        _mm_storeu_si128 ( out + 2, _mm_unpacklo_epi16 ( hi, z ) );
+        _mm_storeu_si128 ( out + 3, _mm_unpackhi_epi16 ( hi, z ) );
+    }
+}
+
+/* the AVX2 versions do the same work per 128 bit lane, which leaves
+   the results of the low lane in "r[0..n)" low halves and those of the
+   high lane in the high halves; StoreLanes puts them back in order */
+#define AVX2_FUNC __attribute__ ( ( target ( "avx2" ) ) )
+
+static AVX2_FUNC
+void StoreLanes ( __m256i *out, const __m256i *r, uint32_t n )
+{
+    uint32_t i;
+    for ( i = 0; i < n; i += 2 )
+    {
+        _mm256_storeu_si256 ( out + i / 2, _mm256_permute2x128_si256 ( r [ i ], r [ i + 1 ], 0x20 ) );
+        _mm256_storeu_si256 ( out + ( n + i ) / 2, _mm256_permute2x128_si256 ( r [ i ], r [ i + 1 ], 0x31 ) );
+    }
+}
+
+/* 8 from 1: 32 bytes => 256 elements */
+static AVX2_FUNC
+void UnpackVec8From1_avx2 ( void *dst, const void *src, uint32_t iter )
+{
+    const __m256i one = _mm256_set1_epi8 ( 1 );
+    while ( iter -- != 0 )
+    {
+        __m256i b [ 8 ], r [ 8 ], p76, p54, p32, p10, q74, q30;
+        __m256i x = _mm256_loadu_si256 ( ( const __m256i* ) src + iter );
+        uint32_t i;
+
+        for ( i = 0; i < 8; ++ i )
+            b [ i ] = _mm256_and_si256 ( _mm256_srl_epi16 ( x, _mm_cvtsi32_si128 ( 7 - i ) ), one );
+
+        p76 = _mm256_unpacklo_epi8 ( b [ 0 ], b [ 1 ] ); p54 = _mm256_unpacklo_epi8 ( b [ 2 ], b [ 3 ] );
+        p32 = _mm256_unpacklo_epi8 ( b [ 4 ], b [ 5 ] ); p10 = _mm256_unpacklo_epi8 ( b [ 6 ], b [ 7 ] );
+        q74 = _mm256_unpacklo_epi16 ( p76, p54 ); q30 = _mm256_unpacklo_epi16 ( p32, p10 );
+        r [ 0 ] = _mm256_unpacklo_epi32 ( q74, q30 ); r [ 1 ] = _mm256_unpackhi_epi32 ( q74, q30 );
+        q74 = _mm256_unpackhi_epi16 ( p76, p54 ); q30 = _mm256_unpackhi_epi16 ( p32, p10 );
+        r [ 2 ] = _mm256_unpacklo_epi32 ( q74, q30 ); r [ 3 ] = _mm256_unpackhi_epi32 ( q74, q30 );
+
+        p76 = _mm256_unpackhi_epi8 ( b [ 0 ], b [ 1 ] ); p54 = _mm256_unpackhi_epi8 ( b [ 2 ], b [ 3 ] );
+        p32 = _mm256_unpackhi_epi8 ( b [ 4 ], b [ 5 ] ); p10 = _mm256_unpackhi_epi8 ( b [ 6 ], b [ 7 ] );
+        q74 = _mm256_unpacklo_epi16 ( p76, p54 ); q30 = _mm256_unpacklo_epi16 ( p32, p10 );
+        r [ 4 ] = _mm256_unpacklo_epi32 ( q74, q30 ); r [ 5 ] = _mm256_unpackhi_epi32 ( q74, q30 );
+        q74 = _mm256_unpackhi_epi16 ( p76, p54 ); q30 = _mm256_unpackhi_epi16 ( p32, p10 );
+        r [ 6 ] = _mm256_unpacklo_epi32 ( q74, q30 ); r [ 7 ] = _mm256_unpackhi_epi32 ( q74, q30 );
+
+        StoreLanes ( ( __m256i* ) dst + iter * 8, r, 8 );
+    }
+}
+
+/* 8 from 2: 32 bytes => 128 elements */
+static AVX2_FUNC
+void UnpackVec8From2_avx2 ( void *dst, const void *src, uint32_t iter )
+{
+    const __m256i m = _mm256_set1_epi8 ( 3 );
+    while ( iter -- != 0 )
+    {
+        __m256i r [ 4 ];
+        __m256i x = _mm256_loadu_si256 ( ( const __m256i* ) src + iter );
+        __m256i a = _mm256_and_si256 ( _mm256_srli_epi16 ( x, 6 ), m );
+        __m256i b = _mm256_and_si256 ( _mm256_srli_epi16 ( x, 4 ), m );
+        __m256i c = _mm256_and_si256 ( _mm256_srli_epi16 ( x, 2 ), m );
+        __m256i d = _mm256_and_si256 ( x, m );
+        __m256i ab = _mm256_unpacklo_epi8 ( a, b ), cd = _mm256_unpacklo_epi8 ( c, d );
+        r [ 0 ] = _mm256_unpacklo_epi16 ( ab, cd );
+        r [ 1 ] = _mm256_unpackhi_epi16 ( ab, cd );
+        ab = _mm256_unpackhi_epi8 ( a, b );
+        cd = _mm256_unpackhi_epi8 ( c, d );
+        r [ 2 ] = _mm256_unpacklo_epi16 ( ab, cd );
+        r [ 3 ] = _mm256_unpackhi_epi16 ( ab, cd );
+        StoreLanes ( ( __m256i* ) dst + iter * 4, r, 4 );
+    }
+}
+
+/* 8 from 4: 32 bytes => 64 elements */
+static AVX2_FUNC
+void UnpackVec8From4_avx2 ( void *dst, const void *src, uint32_t iter )
+{
+    const __m256i m = _mm256_set1_epi8 ( 15 );
+    while ( iter -- != 0 )
+    {
+        __m256i r [ 2 ];
+        __m256i x = _mm256_loadu_si256 ( ( const __m256i* ) src + iter );
+        __m256i hi = _mm256_and_si256 ( _mm256_srli_epi16 ( x, 4 ), m );
+        __m256i lo = _mm256_and_si256 ( x, m );
+        r [ 0 ] = _mm256_unpacklo_epi8 ( hi, lo );
+        r [ 1 ] = _mm256_unpackhi_epi8 ( hi, lo );
+        StoreLanes ( ( __m256i* ) dst + iter * 2, r, 2 );
+    }
+}
+
+/* 16 from 8: 16 bytes => 16 elements */
+static AVX2_FUNC
+void UnpackVec16From8_avx2 ( void *dst, const void *src, uint32_t iter )
+{
+    while ( iter -- != 0 )
+    {
+        __m128i x = _mm_loadu_si128 ( ( const __m128i* ) src + iter );
+        _mm256_storeu_si256 ( ( __m256i* ) dst + iter, _mm256_cvtepu8_epi16 ( x ) );
+    }
+}
+
+/* 32 from 8: 16 bytes => 16 elements */
+static AVX2_FUNC
+void UnpackVec32From8_avx2 ( void *dst, const void *src, uint32_t iter )
+{
+    while ( iter -- != 0 )
+    {
+        __m128i x = _mm_loadu_si128 ( ( const __m128i* ) src + iter );
+        __m256i *out = ( __m256i* ) dst + iter * 2;
+        __m256i lo = _mm256_cvtepu8_epi32 ( x );
+        __m256i hi = _mm256_cvtepu8_epi32 ( _mm_srli_si128 ( x, 8 ) );
+        _mm256_storeu_si256 ( out + 0, lo );
+        _mm256_storeu_si256 ( out + 1, hi );
+    }
+}
+
+/* [ packed / 4 ] for 8 bit output, then 8 into 16 and 32 */
+static const UnpackVecKernel unpack_sse2 [ 5 ] =
+{
+    { UnpackVec8From1, 128 }, { UnpackVec8From2, 64 }, { UnpackVec8From4, 32 },
+    { UnpackVec16From8, 16 }, { UnpackVec32From8, 16 }
+};
+static const UnpackVecKernel unpack_avx2 [ 5 ] =
+{
+    { UnpackVec8From1_avx2, 256 }, { UnpackVec8From2_avx2, 128 }, { UnpackVec8From4_avx2, 64 },
+    { UnpackVec16From8_avx2, 16 }, { UnpackVec32From8_avx2, 16 }
+};
+
+static
+const UnpackVecKernel *UnpackVecKernels ( void )
+{
+    /* benign race: every thread computes the same answer */
+    static const UnpackVecKernel *kernels;
+    if ( kernels == NULL )
+        kernels = __builtin_cpu_supports ( "avx2" ) ? unpack_avx2 : unpack_sse2;
+    return kernels;
+}
+
+/* UnpackVec
+ *  returns true if the vector kernels handled the request
+ *  any tail that does not fill a vector is unpacked first by the scalar code
+ */
+static
+bool UnpackVec ( uint32_t packed, uint32_t unpacked, uint32_t count,
+    void *dst, const void *src, bitsz_t ssize )
+{
+    const UnpackVecKernel *k;
+    uint32_t n;
+
+    /* elements must start at bit 0 of the source */
+    if ( ssize != ( bitsz_t ) count * packed )
+        return false;
+
+    if ( unpacked == 8 && ( packed == 1 || packed == 2 || packed == 4 ) )
+        k = & UnpackVecKernels () [ packed >> 1 ];
+    else if ( packed == 8 && unpacked == 16 )
+        k = & UnpackVecKernels () [ 3 ];
+    else if ( packed == 8 && unpacked == 32 )
+        k = & UnpackVecKernels () [ 4 ];
+    else
+        return false;
+
+    n = count - count % k -> elems;
+    if ( n == 0 )
+        return false;
+
+    if ( n != count )
+    {
+        void *tdst = ( uint8_t* ) dst + ( ( size_t ) n * unpacked >> 3 );
+        const void *tsrc = ( const uint8_t* ) src + ( ( size_t ) n * packed >> 3 );
+        bitsz_t tsize = ( bitsz_t ) ( count - n ) * packed;
+
+        switch ( unpacked )
+        {
+        case 8:
+            Unpack8 ( packed, count - n, tdst, tsrc, 0, tsize );
+            break;
+        case 16:
+            Unpack16 ( packed, count - n, tdst, tsrc, 0, tsize );
+            break;
+        case 32:
+            Unpack32 ( packed, count - n, tdst, tsrc, 0, tsize );
+            break;
+        }
+    }
+
+    ( * k -> func ) ( dst, src, n / k -> elems );
+    return true;
+}
+
+#endif /* UNPACK_VEC */
+
+
 /* Unpack
  *  accepts a series of packed source bits
  *  produces a series of unpacked destination bits by left-padding zeros
@@ -810,6 +1149,11 @@ LIB_EXPORT rc_t CC Unpack ( uint32_t packed, uint32_t unpacked,
     if ( src_off != 0 )
         return RC ( rcXF, rcBuffer, rcUnpacking, rcOffset, rcUnsupported );
 
+#if UNPACK_VEC
+    if ( UnpackVec ( packed, unpacked, count, dst, src, ssize ) )
+        return 0;
+#endif
+
     switch ( unpacked )
     {
     case 8:
@@ -34,6 +34,7 @@ typedef struct KHttpFile KHttpFile;
 #include "stream-priv.h"
 
 #include <kproc/lock.h>
+#include <kproc/thread.h>
 #include <kns/adapt.h>
 #include <kns/endpoint.h>
 #include <kns/http.h>
@@ -637,3 +638,275 @@ LIB_EXPORT bool CC KFileIsKHttpFile ( const struct KFile * self )
 {
     return self != NULL && &self->vt->v1 == &vtKHttpFile;
 }
+
+
+/*--------------------------------------------------------------------------
+ * parallel download
+ *  the object is cut into ranges that are claimed in order by up to
+ *  "num_streams" workers, each reading over its own KHttpFile connection
+ */
+#define PARALLEL_DOWNLOAD_MAX_STREAMS 16
+#define PARALLEL_DOWNLOAD_RANGE_SIZE ( ( size_t ) ( 8 * 1024 * 1024 ) )
+
+typedef struct KHttpDownload KHttpDownload;
+struct KHttpDownload
+{
+    KFile *dst;
+    KLock *lock;        /* guards "next", "rc" and writes into "dst" */
+
+    uint64_t file_size;
+    uint64_t next;
+    size_t range_size;
+
+    rc_t rc;            /* first failure seen by any worker */
+};
+
+typedef struct KHttpDownloadStream KHttpDownloadStream;
+struct KHttpDownloadStream
+{
+    KHttpDownload *dl;
+    const KHttpFile *src;
+    KThread *thread;
+};
+
+/* ReadRange
+ *  read an entire range from one connection,
+ *  retrying failed requests according to the configured HTTP retry schedule
+ */
+static
+rc_t KHttpFileReadRange ( const KHttpFile *self, KHttpRetrier *retrier,
+    uint64_t pos, uint8_t *buffer, size_t bsize )
+{
+    rc_t rc = 0;
+    size_t total = 0;
+    bool reopened = false;
+
+    while ( total < bsize )
+    {
+        size_t num_read = 0;
+        uint32_t http_status = 0;
+        struct timeout_t tm;
+
+        TimeoutInit ( & tm, self -> kns -> http_read_timeout );
+        rc = KHttpFileTimedReadLocked ( self, pos + total,
+            buffer + total, bsize - total, & num_read, & tm, & http_status );
+        if ( rc == 0 && num_read == 0 )
+            rc = RC ( rcNS, rcFile, rcReading, rcTransfer, rcIncomplete );
+
+        if ( rc == 0 )
+        {
+            total += num_read;
+            reopened = false;
+            continue;
+        }
+
+        DBGMSG ( DBG_KNS, DBG_FLAG ( DBG_KNS_HTTP ),
+            ( "KHttpFileReadRange(pos=%lu): read failed with status %u\n", pos + total, http_status ) );
+
+        /* a dropped connection gets one immediate reopen,
+           error statuses follow the retry schedule */
+        if ( reopened && ! KHttpRetrierWait ( retrier, http_status ) )
+            break;
+
+        rc = KClientHttpReopen ( self -> http );
+        if ( rc != 0 )
+            break;
+        reopened = true;
+    }
+
+    return rc;
+}
+
+static
+rc_t CC KHttpDownloadRun ( const KThread *t, void *data )
+{
+    KHttpDownloadStream *s = data;
+    KHttpDownload *dl = s -> dl;
+    const KHttpFile *src = s -> src;
+
+    rc_t rc = 0;
+    uint8_t *buffer = malloc ( dl -> range_size );
+    if ( buffer == NULL )
+        rc = RC ( rcNS, rcFile, rcReading, rcMemory, rcExhausted );
+
+    while ( rc == 0 )
+    {
+        uint64_t pos;
+        size_t bsize;
+        KHttpRetrier retrier;
+
+        /* claim the next range unless somebody has failed */
+        rc = KLockAcquire ( dl -> lock );
+        if ( rc != 0 )
+            break;
+        pos = dl -> next;
+        if ( dl -> rc != 0 || pos >= dl -> file_size )
+        {
+            KLockUnlock ( dl -> lock );
+            break;
+        }
+        bsize = dl -> range_size;
+        if ( ( uint64_t ) bsize > dl -> file_size - pos )
+            bsize = ( size_t ) ( dl -> file_size - pos );
+        dl -> next = pos + bsize;
+        KLockUnlock ( dl -> lock );
+
+        /* every range gets the whole retry schedule */
+        rc = KHttpRetrierInit ( & retrier, src -> url_buffer . base, src -> kns );
+        if ( rc != 0 )
+            break;
+        rc = KHttpFileReadRange ( src, & retrier, pos, buffer, bsize );
+        KHttpRetrierDestroy ( & retrier );
+
+        if ( rc == 0 )
+        {
+            rc = KLockAcquire ( dl -> lock );
+            if ( rc == 0 )
+            {
+                size_t num_writ;
+                rc = KFileWriteAll ( dl -> dst, pos, buffer, bsize, & num_writ );
+                if ( rc == 0 && num_writ != bsize )
+                    rc = RC ( rcNS, rcFile, rcWriting, rcTransfer, rcIncomplete );
+                KLockUnlock ( dl -> lock );
+            }
+        }
+    }
+
+    if ( rc != 0 && KLockAcquire ( dl -> lock ) == 0 )
+    {
+        if ( dl -> rc == 0 )
+            dl -> rc = rc;
+        KLockUnlock ( dl -> lock );
+    }
+
+    free ( buffer );
+
+    return rc;
+}
+
+LIB_EXPORT rc_t CC KNSManagerVDownloadHttpFile ( const KNSManager *self,
+    KFile *dst, uint64_t *size, KStream *conn, ver_t vers,
+    uint32_t num_streams, size_t range_size, const char *url, va_list args )
+{
+    rc_t rc;
+    const KFile *first;
+
+    if ( size != NULL )
+        * size = 0;
+
+    if ( dst == NULL )
+        return RC ( rcNS, rcFile, rcCopying, rcParam, rcNull );
+
+    rc = KNSManagerVMakeHttpFileInt ( self, & first, conn, vers, false, url, args );
+    if ( rc == 0 )
+    {
+        KHttpDownload dl;
+        KHttpDownloadStream streams [ PARALLEL_DOWNLOAD_MAX_STREAMS ];
+        const KHttpFile *f = ( const KHttpFile * ) first;
+        uint64_t num_ranges;
+        uint32_t i, started = 0;
+
+        memset ( & dl, 0, sizeof dl );
+        memset ( streams, 0, sizeof streams );
+
+        dl . dst = dst;
+        dl . file_size = f -> file_size;
+        dl . range_size = range_size != 0 ? range_size : PARALLEL_DOWNLOAD_RANGE_SIZE;
+
+        /* no point opening more connections than there are ranges */
+        num_ranges = ( dl . file_size + dl . range_size - 1 ) / dl . range_size;
+        if ( num_streams == 0 )
+            num_streams = 1;
+        else if ( num_streams > PARALLEL_DOWNLOAD_MAX_STREAMS )
+            num_streams = PARALLEL_DOWNLOAD_MAX_STREAMS;
+        if ( ( uint64_t ) num_streams > num_ranges )
+            num_streams = num_ranges == 0 ? 1 : ( uint32_t ) num_ranges;
+
+        rc = KFileSetSize ( dst, dl . file_size );
+        if ( rc == 0 )
+            rc = KLockMake ( & dl . lock );
+
+        if ( rc == 0 )
+        {
+            streams [ 0 ] . dl = & dl;
+            streams [ 0 ] . src = f;
+
+            /* every extra stream opens its own connection to the same URL,
+               "conn" serves only the first */
+            for ( i = 1; rc == 0 && i < num_streams; ++ i )
+            {
+                const KFile *extra;
+                rc = KNSManagerMakeHttpFile ( self, & extra, NULL, vers, "%s", f -> url_buffer . base );
+                if ( rc == 0 )
+                {
+                    const KHttpFile *e = ( const KHttpFile * ) extra;
+                    if ( e -> file_size != f -> file_size )
+                    {
+                        rc = RC ( rcNS, rcFile, rcOpening, rcSize, rcInconsistent );
+                        KFileRelease ( extra );
+                    }
+                    else
+                    {
+                        streams [ i ] . dl = & dl;
+                        streams [ i ] . src = e;
+                    }
+                }
+            }
+
+            /* a server refusing extra connections only costs parallelism */
+            if ( rc != 0 && i > 1 )
+            {
+                num_streams = i - 1;
+                rc = 0;
+            }
+
+            if ( rc == 0 )
+            {
+                /* the calling thread works the first stream,
+                   falling back to it alone if threads are unavailable */
+                for ( i = 1; i < num_streams; ++ i )
+                {
+                    if ( KThreadMake ( & streams [ i ] . thread, KHttpDownloadRun, & streams [ i ] ) != 0 )
+                        break;
+                    ++ started;
+                }
+
+                KHttpDownloadRun ( NULL, & streams [ 0 ] );
+
+                for ( i = 1; i <= started; ++ i )
+                {
+                    rc_t status = 0;
+                    KThreadWait ( streams [ i ] . thread, & status );
+                    KThreadRelease ( streams [ i ] . thread );
+                }
+
+                rc = dl . rc;
+                if ( rc == 0 && size != NULL )
+                    * size = dl . file_size;
+            }
+
+            for ( i = 1; i < num_streams; ++ i )
+            {
+                if ( streams [ i ] . src != NULL )
+                    KFileRelease ( & streams [ i ] . src -> dad );
+            }
+        }
+
+        KLockRelease ( dl . lock );
+        KFileRelease ( first );
+    }
+
+    return rc;
+}
+
+LIB_EXPORT rc_t CC KNSManagerDownloadHttpFile ( const KNSManager *self,
+    KFile *dst, uint64_t *size, KStream *conn, ver_t vers,
+    uint32_t num_streams, size_t range_size, const char *url, ... )
+{
+    rc_t rc;
+    va_list args;
+    va_start ( args, url );
+    rc = KNSManagerVDownloadHttpFile ( self, dst, size, conn, vers, num_streams, range_size, url, args );
+    va_end ( args );
+    return rc;
+}
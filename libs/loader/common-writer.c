@@ -34,6 +34,7 @@
 #include <klib/rc.h>
 #include <klib/printf.h>
 #include <klib/status.h>
+#include <klib/sort.h>
 
 #include <kdb/btree.h>
 
@@ -51,6 +52,7 @@
 #include <loader/alignment-writer.h>
 #include <loader/reference-writer.h>
 #include <loader/common-writer.h>
+#include <loader/extsort.h>
 #include <loader/common-reader-priv.h>
 
 /*--------------------------------------------------------------------------
@@ -69,7 +71,8 @@ typedef struct {
              pcr_dup: 1,
              has_a_read: 1,
              unaligned_1: 1,
-             unaligned_2: 1;
+             unaligned_2: 1,
+             mates_sorted: 2;  /* mateSortMemory: reads handed to the sort */
 } ctx_value_t;
 
 #define CTX_VALUE_SET_P_ID(O,N,V) do { int64_t tv = (V); (O).primaryId[N] = (uint32_t)tv; (O).pId_ext[N] = tv >> 32; } while(0);
@@ -78,6 +81,8 @@ typedef struct {
 #define CTX_VALUE_SET_S_ID(O,V) do { int64_t tv = (V); (O).spotId = (uint32_t)tv; (O).spotId_ext = tv >> 32; } while(0);
 #define CTX_VALUE_GET_S_ID(O) ((((int64_t)(O).spotId_ext) << 32) | (O).spotId)
 
+#define MAX_WARNINGS_FLAG_CONFLICT 10000 /*** maximum errors to report ***/
+
 typedef struct FragmentInfo {
     uint64_t ti;
     uint32_t readlen;
@@ -115,6 +120,14 @@ rc_t OpenKBTree(const CommonWriterSettings* settings, struct KBTree **const rslt
                               NULL
                               );
         KFileRelease(file);
+        if (rc == 0) {
+            /* don't stall inserts on page eviction */
+            rc = KBTreeSetWriteBack(*rslt, cacheSize / 4);
+            if (rc) {
+                KBTreeRelease(*rslt);
+                *rslt = NULL;
+            }
+        }
 #if PERF
         if (rc == 0) {
             static unsigned treecount = 0;
@@ -126,6 +139,282 @@ rc_t OpenKBTree(const CommonWriterSettings* settings, struct KBTree **const rslt
     return rc;
 }
 
+/*--------------------------------------------------------------------------
+ * SpotNameHash
+ *  an open addressing table of spot names in front of the key2id B-trees.
+ *  until it outgrows its memory the B-trees aren't used at all; then its
+ *  contents are spilled to them in name order and the table is released.
+ *  (keeping it on as a cache of recent names measured slower than the
+ *  B-trees' own page cache)
+ */
+typedef struct SpotNameEntry {
+    uint64_t fp;        /* 0: empty slot */
+    uint64_t name;      /* offset into names */
+    uint32_t id;
+    uint16_t tree;
+    uint16_t namelen;
+} SpotNameEntry;
+
+typedef struct SpotNameHash SpotNameHash;
+struct SpotNameHash {
+    SpotNameEntry *slot;
+    char *names;
+    size_t memory;      /* budget for slot and names together */
+    size_t mask;        /* number of slots - 1 */
+    size_t count;
+    size_t names_used;
+    size_t names_max;
+    uint64_t lookups;
+    uint64_t hits;
+    bool spilled;       /* the B-trees have every name, slot and names are gone */
+};
+
+#define SPOT_NAME_HASH_MIN_SLOTS (1u << 10)
+#define SPOT_NAME_HASH_MAX_SLOTS (1u << 16) /* to start with */
+#define SPOT_NAME_HASH_NAME_BYTES (16)      /* per slot, to start with */
+
+static uint64_t SpotNameFingerprint(unsigned const tree, char const name[], size_t const namelen)
+{
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325ull ^ tree;
+    size_t i;
+
+    for (i = 0; i < namelen; ++i) {
+        h ^= (uint8_t)name[i];
+        h *= 0x100000001b3ull;
+    }
+    return h == 0 ? 1 : h;
+}
+
+static void SpotNameHashWhack(SpotNameHash *const self)
+{
+    if (self) {
+        free(self->slot);
+        free(self->names);
+        free(self);
+    }
+}
+
+static size_t SpotNameHashMemory(SpotNameHash const *const self, size_t const slots, size_t const names)
+{
+    return slots * sizeof(self->slot[0]) + names;
+}
+
+/* starts as large as the budget allows, up to SPOT_NAME_HASH_MAX_SLOTS */
+static rc_t SpotNameHashMake(SpotNameHash **const rslt, size_t const memory)
+{
+    SpotNameHash *self;
+    size_t slots = SPOT_NAME_HASH_MAX_SLOTS;
+
+    *rslt = NULL;
+    if (memory < NAME_HASH_MIN_MEMORY)
+        return RC(rcExe, rcName, rcAllocating, rcParam, rcInsufficient);
+    self = calloc(1, sizeof(*self));
+    if (self == NULL)
+        return RC(rcExe, rcName, rcAllocating, rcMemory, rcExhausted);
+    while (slots > SPOT_NAME_HASH_MIN_SLOTS &&
+           SpotNameHashMemory(self, slots, slots * SPOT_NAME_HASH_NAME_BYTES) > memory)
+    {
+        slots /= 2;
+    }
+    assert(SpotNameHashMemory(self, slots, slots * SPOT_NAME_HASH_NAME_BYTES) <= memory);
+    self->memory = memory;
+    self->mask = slots - 1;
+    self->names_max = slots * SPOT_NAME_HASH_NAME_BYTES;
+    self->slot = calloc(self->mask + 1, sizeof(self->slot[0]));
+    self->names = malloc(self->names_max);
+    if (self->slot == NULL || self->names == NULL) {
+        SpotNameHashWhack(self);
+        return RC(rcExe, rcName, rcAllocating, rcMemory, rcExhausted);
+    }
+    *rslt = self;
+    return 0;
+}
+
+static SpotNameEntry *SpotNameHashFind(SpotNameHash const *const self, uint64_t const fp,
+                                       unsigned const tree, char const name[], size_t const namelen)
+{
+    size_t i = (size_t)fp & self->mask;
+
+    for ( ; ; i = (i + 1) & self->mask) {
+        SpotNameEntry *const entry = &self->slot[i];
+
+        if (entry->fp == 0)
+            return entry;
+        if (entry->fp == fp && entry->tree == tree && entry->namelen == namelen &&
+            memcmp(self->names + entry->name, name, namelen) == 0)
+        {
+            return entry;
+        }
+    }
+}
+
+/* keeps the load at most 1/2; the old slots live until the new ones are filled */
+static bool SpotNameHashGrowSlots(SpotNameHash *const self)
+{
+    size_t const slots = (self->mask + 1) * 2;
+    SpotNameEntry *const old = self->slot;
+    size_t const old_slots = self->mask + 1;
+    size_t i;
+
+    if (SpotNameHashMemory(self, old_slots + slots, self->names_max) > self->memory)
+        return false;
+    self->slot = calloc(slots, sizeof(self->slot[0]));
+    if (self->slot == NULL) {
+        self->slot = old;
+        return false;
+    }
+    self->mask = slots - 1;
+    for (i = 0; i < old_slots; ++i) {
+        if (old[i].fp) {
+            size_t j = (size_t)old[i].fp & self->mask;
+
+            while (self->slot[j].fp)
+                j = (j + 1) & self->mask;
+            self->slot[j] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+static bool SpotNameHashGrowNames(SpotNameHash *const self, size_t const need)
+{
+    size_t max = self->names_max * 2;
+    void *tmp;
+
+    while (max < need)
+        max *= 2;
+    if (SpotNameHashMemory(self, self->mask + 1, max) > self->memory)
+        return false;
+    tmp = realloc(self->names, max);
+    if (tmp == NULL)
+        return false;
+    self->names = tmp;
+    self->names_max = max;
+    return true;
+}
+
+/* false if there is no room left */
+static bool SpotNameHashInsert(SpotNameHash *const self, uint64_t const fp, unsigned const tree,
+                               uint32_t const id, char const name[], size_t const namelen)
+{
+    SpotNameEntry *entry;
+
+    if ((self->count + 1) * 2 > self->mask + 1 && !SpotNameHashGrowSlots(self))
+        return false;
+    if (self->names_used + namelen > self->names_max && !SpotNameHashGrowNames(self, self->names_used + namelen))
+        return false;
+
+    entry = SpotNameHashFind(self, fp, tree, name, namelen);
+    assert(entry->fp == 0);
+    memcpy(self->names + self->names_used, name, namelen);
+    entry->fp = fp;
+    entry->name = self->names_used;
+    entry->id = id;
+    entry->tree = (uint16_t)tree;
+    entry->namelen = (uint16_t)namelen;
+    self->names_used += namelen;
+    ++self->count;
+    return true;
+}
+
+static int64_t CC SpotNameEntryCompare(void const *A, void const *B, void *Data)
+{
+    SpotNameHash const *const self = Data;
+    SpotNameEntry const *const a = A;
+    SpotNameEntry const *const b = B;
+    size_t const n = a->namelen < b->namelen ? a->namelen : b->namelen;
+    int diff;
+
+    /* empty slots go last */
+    if (a->fp == 0 || b->fp == 0)
+        return (a->fp == 0) - (b->fp == 0);
+    if (a->tree != b->tree)
+        return (int64_t)a->tree - (int64_t)b->tree;
+    diff = memcmp(self->names + a->name, self->names + b->name, n);
+    if (diff)
+        return diff;
+    return (int64_t)a->namelen - (int64_t)b->namelen;
+}
+
+/* moves every name into the B-trees, sorted so that inserts stay local */
+static rc_t SpotNameHashSpill(SpotNameHash *const self, SpotAssembler *const ctx)
+{
+    size_t i;
+
+    ksort(self->slot, self->mask + 1, sizeof(self->slot[0]), SpotNameEntryCompare, self);
+    for (i = 0; i < self->count; ++i) {
+        SpotNameEntry const *const entry = &self->slot[i];
+        uint64_t id = entry->id;
+        bool wasInserted;
+        rc_t const rc = KBTreeEntry(ctx->key2id[entry->tree], &id, &wasInserted,
+                                    self->names + entry->name, entry->namelen);
+        if (rc)
+            return rc;
+        if (!wasInserted || id != entry->id)
+            return RC(rcExe, rcTree, rcWriting, rcData, rcInconsistent);
+    }
+    free(self->slot);
+    free(self->names);
+    self->slot = NULL;
+    self->names = NULL;
+    self->count = 0;
+    self->spilled = true;
+    return 0;
+}
+
+/* same contract as KBTreeEntry: *id is the id to give the name if it's new */
+static rc_t SpotNameHashEntry(SpotNameHash *const self, SpotAssembler *const ctx, unsigned const tree,
+                              uint64_t *const id, bool *const wasInserted,
+                              char const name[], size_t const namelen)
+{
+    uint64_t fp;
+    SpotNameEntry const *entry;
+    rc_t rc;
+
+    if (self->spilled || namelen > UINT16_MAX)
+        return KBTreeEntry(ctx->key2id[tree], id, wasInserted, name, namelen);
+
+    fp = SpotNameFingerprint(tree, name, namelen);
+    entry = SpotNameHashFind(self, fp, tree, name, namelen);
+    ++self->lookups;
+    if (entry->fp) {
+        ++self->hits;
+        *id = entry->id;
+        *wasInserted = false;
+        return 0;
+    }
+    *wasInserted = true;
+    if (SpotNameHashInsert(self, fp, tree, (uint32_t)*id, name, namelen))
+        return 0;
+
+    rc = SpotNameHashSpill(self, ctx);
+    if (rc == 0) {
+        uint64_t tmpKey = *id;
+
+        rc = KBTreeEntry(ctx->key2id[tree], &tmpKey, wasInserted, name, namelen);
+        if (rc == 0 && (!*wasInserted || tmpKey != *id))
+            rc = RC(rcExe, rcTree, rcWriting, rcData, rcInconsistent);
+    }
+    return rc;
+}
+
+/* looks the name up in the table if there is one, else in the B-tree */
+static rc_t KeyIdEntry(CommonWriterSettings const *const settings, SpotAssembler *const ctx, unsigned const tree,
+                       uint64_t *const id, bool *const wasInserted,
+                       char const name[], size_t const namelen)
+{
+    if (ctx->nameHash == NULL && settings->nameHashMemory > 0) {
+        rc_t const rc = SpotNameHashMake(&ctx->nameHash, settings->nameHashMemory);
+        if (rc)
+            return rc;
+    }
+    if (ctx->nameHash)
+        return SpotNameHashEntry(ctx->nameHash, ctx, tree, id, wasInserted, name, namelen);
+    return KBTreeEntry(ctx->key2id[tree], id, wasInserted, name, namelen);
+}
+
 rc_t GetKeyIDOld(const CommonWriterSettings* settings, SpotAssembler* const ctx, uint64_t *const rslt, bool *const wasInserted, char const key[], char const name[], size_t const namelen)
 {
     size_t const keylen = strlen(key);
@@ -140,7 +429,7 @@ rc_t GetKeyIDOld(const CommonWriterSettings* settings, SpotAssembler* const ctx,
     if (keylen == 0 || memcmp(key, name, keylen) == 0) {
         /* qname starts with read group; no append */
         tmpKey = ctx->idCount[0];
-        rc = KBTreeEntry(ctx->key2id[0], &tmpKey, wasInserted, name, namelen);
+        rc = KeyIdEntry(settings, ctx, 0, &tmpKey, wasInserted, name, namelen);
     }
     else {
         char sbuf[4096];
@@ -158,7 +447,7 @@ rc_t GetKeyIDOld(const CommonWriterSettings* settings, SpotAssembler* const ctx,
         rc = string_printf(buf, bsize, &actsize, "%s\t%.*s", key, (int)namelen, name);
         
         tmpKey = ctx->idCount[0];
-        rc = KBTreeEntry(ctx->key2id[0], &tmpKey, wasInserted, buf, actsize);
+        rc = KeyIdEntry(settings, ctx, 0, &tmpKey, wasInserted, buf, actsize);
         if (hbuf)
             free(hbuf);
     }
@@ -382,7 +671,7 @@ rc_t GetKeyID(CommonWriterSettings *const settings,
             }
         GET_ID:
             tmpKey = ctx->idCount[f];
-            rc = KBTreeEntry(ctx->key2id[f], &tmpKey, wasInserted, name, namelen);
+            rc = KeyIdEntry(settings, ctx, (unsigned)f, &tmpKey, wasInserted, name, namelen);
             if (rc == 0) {
                 *rslt = (((uint64_t)f) << 32) | tmpKey;
                 if (*wasInserted)
@@ -407,7 +696,8 @@ static rc_t OpenMMapFile(const CommonWriterSettings* settings, SpotAssembler *co
     rc = KDirectoryCreateFile(dir, &file, true, 0600, kcmInit, "%s", fname);
     KDirectoryRemove(dir, 0, "%s", fname);
     if (rc == 0)
-        rc = MMArrayMake(&ctx->id2value, file, sizeof(ctx_value_t));
+        rc = MMArrayMakeWithOptions(&ctx->id2value, file, sizeof(ctx_value_t),
+                                    settings->prefaultIdMap ? (mma_Reserve | mma_HugePages | mma_Prefetch) : 0);
     KFileRelease(file);
     return rc;
 }
@@ -431,6 +721,24 @@ static rc_t OpenMBankFile(const CommonWriterSettings* settings, SpotAssembler *c
     return rc;
 }
 
+static rc_t OpenSortFile(const CommonWriterSettings* settings, SpotAssembler *const ctx, KDirectory *const dir)
+{
+    KFile *file = NULL;
+    char fname[4096];
+    rc_t rc = string_printf(fname, sizeof(fname), NULL, "%s/mates.%u", settings->tmpfs, settings->pid);
+    
+    if (rc)
+        return rc;
+    
+    rc = KDirectoryCreateFile(dir, &file, true, 0600, kcmInit, "%s", fname);
+    KDirectoryRemove(dir, 0, "%s", fname);
+    if (rc == 0) {
+        rc = ExtSortMake(&ctx->mates, file, settings->mateSortMemory);
+        KFileRelease(file);
+    }
+    return rc;
+}
+
 rc_t SetupContext(const CommonWriterSettings* settings, SpotAssembler *ctx)
 {
     rc_t rc = 0;
@@ -439,6 +747,12 @@ rc_t SetupContext(const CommonWriterSettings* settings, SpotAssembler *ctx)
     
     ctx->pass = 1;
     
+    if (settings->nameHashMemory > 0 && settings->nameHashMemory < NAME_HASH_MIN_MEMORY) {
+        rc = RC(rcExe, rcName, rcAllocating, rcParam, rcInsufficient);
+        (void)PLOGERR(klogErr, (klogErr, rc, "spot name table memory must be 0 or at least $(min) bytes", "min=%u", (unsigned)NAME_HASH_MIN_MEMORY));
+        return rc;
+    }
+    
     if (settings->mode == mode_Archive) {
         KDirectory *dir;
 
@@ -456,6 +770,8 @@ rc_t SetupContext(const CommonWriterSettings* settings, SpotAssembler *ctx)
             rc = OpenMMapFile(settings, ctx, dir);
         if (rc == 0)
             rc = OpenMBankFile(settings, ctx, dir);
+        if (rc == 0 && settings->mateSortMemory > 0)
+            rc = OpenSortFile(settings, ctx, dir);
         KDirectoryRelease(dir);
     }
     return rc;
@@ -465,6 +781,36 @@ void ContextReleaseMemBank(SpotAssembler *ctx)
 {
     KMemBankRelease(ctx->fragsBoth);
     ctx->fragsBoth = NULL;
+    if (ctx->mates) {
+        ExtSortStats stats;
+
+        ExtSortGetStats(ctx->mates, &stats);
+        STSMSG(1, ("mates: %lu fragments sorted, %lu runs, %luM spilled\n",
+                   stats.records, stats.runs, stats.spilled / 1024 / 1024));
+        ExtSortWhack(ctx->mates);
+        ctx->mates = NULL;
+    }
+}
+
+void ContextReleaseKeyIds(SpotAssembler *ctx)
+{
+    size_t i;
+
+    for (i = 0; i != ctx->key2id_count; ++i) {
+        KBTreeDropBacking(ctx->key2id[i]);
+        KBTreeRelease(ctx->key2id[i]);
+        ctx->key2id[i] = NULL;
+    }
+    free(ctx->key2id_names);
+    ctx->key2id_names = NULL;
+    if (ctx->nameHash) {
+        SpotNameHash const *const nameHash = ctx->nameHash;
+
+        STSMSG(1, ("spot names: %lu lookups, %lu found in memory%s\n",
+                   nameHash->lookups, nameHash->hits, nameHash->spilled ? ", spilled to B-trees" : ""));
+        SpotNameHashWhack(ctx->nameHash);
+        ctx->nameHash = NULL;
+    }
 }
 
 void ContextRelease(SpotAssembler *ctx)
@@ -473,7 +819,61 @@ void ContextRelease(SpotAssembler *ctx)
     KLoadProgressbar_Release(ctx->progress[1], true);
     KLoadProgressbar_Release(ctx->progress[2], true);
     KLoadProgressbar_Release(ctx->progress[3], true);
-    MMArrayWhack(ctx->id2value);
+    if (ctx->id2value) {
+        MMArrayStats stats;
+
+        MMArrayGetStats(ctx->id2value, &stats);
+        STSMSG(1, ("id map: %lu mmaps (%lu ahead, %lu waits), %luM pre-faulted\n",
+                   stats.maps, stats.prefetched, stats.waits, stats.prefaulted / 1024 / 1024));
+        MMArrayWhack(ctx->id2value);
+    }
+}
+
+static
+rc_t WriteSoloFragment(const CommonWriterSettings* settings, SpotAssembler* ctx, SequenceWriter *seq,
+                       SequenceRecord *srec, uint64_t const keyId, ctx_value_t *value, FragmentInfo const *fip)
+{
+    unsigned readLen[2];
+    unsigned read = 0;
+    uint8_t const *src = (uint8_t const *)&fip[1];
+    rc_t rc;
+    
+    readLen[0] = readLen[1] = 0;
+    if (!value->unmated && (   (fip->aligned && CTX_VALUE_GET_P_ID(*value, 0) == 0)
+                             || (value->unaligned_2)))
+    {
+        read = 1;
+    }
+    
+    readLen[read] = fip->readlen;
+    rc = SequenceRecordInit(srec, value->unmated ? 1 : 2, readLen);
+    if (rc) {
+        (void)LOGERR(klogErr, rc, "SequenceRecordInit failed");
+        return rc;
+    }
+    
+    srec->ti[read] = fip->ti;
+    srec->aligned[read] = fip->aligned;
+    srec->is_bad[read] = fip->is_bad;
+    srec->orientation[read] = fip->orientation;
+    srec->cskey[read] = fip->cskey;
+    memcpy(srec->seq + srec->readStart[read], src, srec->readLen[read]);
+    src += fip->readlen;
+    
+    memcpy(srec->qual + srec->readStart[read], src, srec->readLen[read]);
+    src += fip->readlen;
+    srec->spotGroup = (char *)src;
+    srec->spotGroupLen = fip->sglen;
+    srec->keyId = keyId;
+    
+    rc = SequenceWriteRecord(seq, srec, ctx->isColorSpace, value->pcr_dup, value->platform, 
+                            settings->keepMismatchQual, settings->no_real_output, settings->hasTI, settings->QualQuantizer);
+    if (rc) {
+        (void)LOGERR(klogErr, rc, "SequenceWriteRecord failed");
+        return rc;
+    }
+    CTX_VALUE_SET_S_ID(*value, ++ctx->spotId);
+    return 0;
 }
 
 static
@@ -506,10 +906,6 @@ rc_t WriteSoloFragments(const CommonWriterSettings* settings, SpotAssembler* ctx
             size_t rsize;
             uint64_t id;
             uint64_t sz;
-            unsigned readLen[2];
-            unsigned read = 0;
-            FragmentInfo const *fip;
-            uint8_t const *src;
             KMemBank *frags = ctx->fragsBoth;
             
             rc = MMArrayGet(ctx->id2value, (void **)&value, keyId);
@@ -537,48 +933,140 @@ rc_t WriteSoloFragments(const CommonWriterSettings* settings, SpotAssembler* ctx
                 break;
             }
             assert( rsize == sz );
-            fip = (FragmentInfo const *)fragBuf.base;
-            src = (uint8_t const *)&fip[1];
-            
-            readLen[0] = readLen[1] = 0;
-            if (!value->unmated && (   (fip->aligned && CTX_VALUE_GET_P_ID(*value, 0) == 0)
-                                     || (value->unaligned_2)))
-            {
-                read = 1;
-            }
-            
-            readLen[read] = fip->readlen;
-            rc = SequenceRecordInit(&srec, value->unmated ? 1 : 2, readLen);
-            if (rc) {
-                (void)LOGERR(klogErr, rc, "SequenceRecordInit failed");
+            /*rc = KMemBankFree(frags, id);*/
+            rc = WriteSoloFragment(settings, ctx, seq, &srec, keyId, value, fragBuf.base);
+            if (rc)
                 break;
-            }
-            
-            srec.ti[read] = fip->ti;
-            srec.aligned[read] = fip->aligned;
-            srec.is_bad[read] = fip->is_bad;
-            srec.orientation[read] = fip->orientation;
-            srec.cskey[read] = fip->cskey;
-            memcpy(srec.seq + srec.readStart[read], src, srec.readLen[read]);
-            src += fip->readlen;
-            
-            memcpy(srec.qual + srec.readStart[read], src, srec.readLen[read]);
-            src += fip->readlen;
-            srec.spotGroup = (char *)src;
-            srec.spotGroupLen = fip->sglen;
-            srec.keyId = keyId;
+        }
+    }
+    /*printf("DONE_SOLO:\tcnt2=%d\tcnt1=%d\n",fcountBoth,fcountOne);*/
+    KDataBufferWhack(&fragBuf);
+    KDataBufferWhack(&srec.storage);
+    return rc;
+}
+
+static
+rc_t WriteSortedMate(const CommonWriterSettings* settings, SpotAssembler* ctx, SequenceWriter *seq,
+                     SequenceRecord *srec, uint64_t const keyId, ctx_value_t *value,
+                     FragmentInfo const *first, FragmentInfo const *second, size_t const secondSize,
+                     uint64_t *filterFlagConflictRecords)
+{
+    FragmentInfo const *frag[2];
+    unsigned readLen[2];
+    unsigned i;
+    rc_t rc;
+    
+    /* lower read number goes first, as when mates are paired while loading */
+    frag[0] = first->otherReadNo < second->otherReadNo ? first : second;
+    frag[1] = frag[0] == first ? second : first;
+    readLen[0] = frag[0]->readlen;
+    readLen[1] = frag[1]->readlen;
+    rc = SequenceRecordInit(srec, 2, readLen);
+    if (rc) {
+        (void)LOGERR(klogErr, rc, "SequenceRecordInit failed");
+        return rc;
+    }
+    for (i = 0; i < 2; ++i) {
+        uint8_t const *const src = (uint8_t const *)&frag[i][1];
+        
+        srec->ti[i] = frag[i]->ti;
+        srec->aligned[i] = frag[i]->aligned;
+        srec->is_bad[i] = frag[i]->is_bad;
+        srec->orientation[i] = frag[i]->orientation;
+        srec->cskey[i] = frag[i]->cskey;
+        memcpy(srec->seq + srec->readStart[i], src, frag[i]->readlen);
+        memcpy(srec->qual + srec->readStart[i], src + frag[i]->readlen, frag[i]->readlen);
+    }
+    /* the spot group of the mate that came in last, as when paired while loading */
+    srec->spotGroup = (char *)&second[1] + 2 * second->readlen;
+    srec->spotGroupLen = second->sglen;
+    srec->keyId = keyId;
+    if (value->pcr_dup && (srec->is_bad[0] || srec->is_bad[1])) {
+        /* the spot name follows the spot group */
+        char const *const name = srec->spotGroup + second->sglen;
+        int const namelen = (int)(secondSize - sizeof(*second) - 2 * second->readlen - second->sglen);
+
+        ++*filterFlagConflictRecords;
+        if (*filterFlagConflictRecords < MAX_WARNINGS_FLAG_CONFLICT) {
+            (void)PLOGMSG(klogWarn, (klogWarn, "Spot '$(name)': both 'duplicate' and 'lowQuality' flag bits set, only 'duplicate' will be saved", "name=%.*s", namelen, name));
+        }
+        else if (*filterFlagConflictRecords == MAX_WARNINGS_FLAG_CONFLICT) {
+            (void)PLOGMSG(klogWarn, (klogWarn, "Last reported warning: Spot '$(name)': both 'duplicate' and 'lowQuality' flag bits set, only 'duplicate' will be saved", "name=%.*s", namelen, name));
+        }
+    }
+    
+    rc = SequenceWriteRecord(seq, srec, ctx->isColorSpace, value->pcr_dup, value->platform, 
+                            settings->keepMismatchQual, settings->no_real_output, settings->hasTI, settings->QualQuantizer);
+    if (rc) {
+        (void)LOGERR(klogErr, rc, "SequenceWriteRecord failed");
+        return rc;
+    }
+    CTX_VALUE_SET_S_ID(*value, ++ctx->spotId);
+    return 0;
+}
+
+/* mateSortMemory: fragments come back from the sort by spot, mates next to each other */
+static
+rc_t WriteSortedMates(const CommonWriterSettings* settings, SpotAssembler* ctx, SequenceWriter *seq)
+{
+    KDataBuffer fragBuf;
+    SequenceRecord srec;
+    uint64_t firstId = 0;
+    uint64_t pairs = 0;
+    uint64_t filterFlagConflictRecords = 0; /*** counts number of conflicts between flags 'duplicate' and 'lowQuality' ***/
+    bool have = false;
+    rc_t rc;
+    
+    memset(&srec, 0, sizeof(srec));
+    rc = KDataBufferMake(&fragBuf, 8, 0);
+    if (rc) {
+        (void)LOGERR(klogErr, rc, "KDataBufferMake failed");
+        return rc;
+    }
+    for ( ; ; ) {
+        uint64_t keyId = 0;
+        void const *data;
+        size_t size;
+        
+        rc = ExtSortNext(ctx->mates, &keyId, &data, &size);
+        if (rc) {
+            (void)LOGERR(klogErr, rc, "ExtSortNext failed");
+            break;
+        }
+        if (have) {
+            ctx_value_t *value;
             
-            rc = SequenceWriteRecord(seq, &srec, ctx->isColorSpace, value->pcr_dup, value->platform, 
-                                    settings->keepMismatchQual, settings->no_real_output, settings->hasTI, settings->QualQuantizer);
-            if (rc) {
-                (void)LOGERR(klogErr, rc, "SequenceWriteRecord failed");
+            have = false;
+            rc = MMArrayGet(ctx->id2value, (void **)&value, firstId);
+            if (rc)
                 break;
+            if (data != NULL && keyId == firstId) {
+                rc = WriteSortedMate(settings, ctx, seq, &srec, keyId, value, fragBuf.base, data, size,
+                                     &filterFlagConflictRecords);
+                if (rc)
+                    break;
+                ++pairs;
+                continue;
             }
-            /*rc = KMemBankFree(frags, id);*/
-            CTX_VALUE_SET_S_ID(*value, ++ctx->spotId);
+            rc = WriteSoloFragment(settings, ctx, seq, &srec, firstId, value, fragBuf.base);
+            if (rc)
+                break;
+        }
+        if (data == NULL)
+            break;
+        /* data only lasts until the next ExtSortNext */
+        rc = KDataBufferResize(&fragBuf, size);
+        if (rc) {
+            (void)LOGERR(klogErr, rc, "KDataBufferResize failed");
+            break;
         }
+        memcpy(fragBuf.base, data, size);
+        firstId = keyId;
+        have = true;
+    }
+    if (filterFlagConflictRecords > 0) {
+        (void)PLOGMSG(klogWarn, (klogWarn, "$(cnt1) out of $(cnt2) mate pairs contained warning : both 'duplicate' and 'lowQuality' flag bits set, only 'duplicate' will be saved", "cnt1=%lu,cnt2=%lu", filterFlagConflictRecords, pairs));
     }
-    /*printf("DONE_SOLO:\tcnt2=%d\tcnt1=%d\n",fcountBoth,fcountOne);*/
     KDataBufferWhack(&fragBuf);
     KDataBufferWhack(&srec.storage);
     return rc;
@@ -972,7 +1460,6 @@ rc_t ArchiveFile(const struct ReaderFile *const reader,
     int unmapRefSeqId = -1;
     uint64_t recordsProcessed = 0;
     uint64_t filterFlagConflictRecords=0; /*** counts number of conflicts between flags 'duplicate' and 'lowQuality' ***/
-#define MAX_WARNINGS_FLAG_CONFLICT 10000 /*** maximum errors to report ***/
 
     bool isColorSpace = false;
     bool isNotColorSpace = G->noColorSpace;
@@ -1599,11 +2086,11 @@ rc_t ArchiveFile(const struct ReaderFile *const reader,
         }
         if (mated) {
             if (isPrimary || !originally_aligned) {
-                if (CTX_VALUE_GET_S_ID(*value) != 0) {
+                if (CTX_VALUE_GET_S_ID(*value) != 0 || value->mates_sorted == 3) {
                     (void)PLOGMSG(klogWarn, (klogWarn, "Spot '$(name)' has already been assigned a spot id", "name=%.*s", namelen, name));
                 }
-                else if (!value->has_a_read) {
-                    /* new mated fragment - do spot assembly */
+                else if (ctx->mates != NULL ? (value->mates_sorted & AR_READNO(data)) == 0 : !value->has_a_read) {
+                    /* new mated fragment - do spot assembly, or leave it to WriteSortedMates */
                     unsigned sz;
                     uint64_t    fragmentId;
                     FragmentInfo fi;
@@ -1623,16 +2110,12 @@ rc_t ArchiveFile(const struct ReaderFile *const reader,
                     fi.cskey = cskey;
                     fi.is_bad = SequenceIsLowQuality(sequence);
                     sz = sizeof(fi) + 2*fi.readlen + fi.sglen;
+                    if (ctx->mates != NULL)
+                        sz += namelen; /* for the warnings when the mates are paired */
                     if (align && aligned) {
                         AlignmentGetMateRefSeqId(alignment, &mate_refSeqId);
                         AlignmentGetMatePosition(alignment, &pnext);
                     }
-                    rc = KMemBankAlloc(frags, &fragmentId, sz, 0);
-                    value->fragmentId = fragmentId;
-                    if (rc) {
-                        (void)LOGERR(klogErr, rc, "KMemBankAlloc failed");
-                        goto LOOP_END;
-                    }
                     
                     rc = KDataBufferResize(&fragBuf, sz);
                     if (rc) {
@@ -1648,13 +2131,31 @@ rc_t ArchiveFile(const struct ReaderFile *const reader,
                         COPY_QUAL(dst, qual, fi.readlen, (isColorSpace && !aligned) ? 0 : fi.orientation == ReadOrientationReverse);
                         dst += fi.readlen;
                         memcpy(dst,spotGroup,fi.sglen);
+                        if (ctx->mates != NULL)
+                            memcpy(dst + fi.sglen, name, namelen);
                     }}
-                    rc = KMemBankWrite(frags, fragmentId, 0, fragBuf.base, sz, &rsize);
-                    if (rc) {
-                        (void)PLOGERR(klogErr, (klogErr, rc, "KMemBankWrite failed writing fragment $(id)", "id=%u", fragmentId));
-                        goto LOOP_END;
+                    if (ctx->mates != NULL) {
+                        value->mates_sorted |= AR_READNO(data);
+                        rc = ExtSortAdd(ctx->mates, keyId, fragBuf.base, sz);
+                        if (rc) {
+                            (void)PLOGERR(klogErr, (klogErr, rc, "ExtSortAdd failed on spot '$(name)'", "name=%s", name));
+                            goto LOOP_END;
+                        }
+                    }
+                    else {
+                        rc = KMemBankAlloc(frags, &fragmentId, sz, 0);
+                        value->fragmentId = fragmentId;
+                        if (rc) {
+                            (void)LOGERR(klogErr, rc, "KMemBankAlloc failed");
+                            goto LOOP_END;
+                        }
+                        rc = KMemBankWrite(frags, fragmentId, 0, fragBuf.base, sz, &rsize);
+                        if (rc) {
+                            (void)PLOGERR(klogErr, (klogErr, rc, "KMemBankWrite failed writing fragment $(id)", "id=%u", fragmentId));
+                            goto LOOP_END;
+                        }
+                        value->has_a_read = 1;
                     }
-                    value->has_a_read = 1;
                 }
                 else if (value->fragmentId != 0 ) {
                     /* might be second fragment */
@@ -2003,20 +2504,19 @@ rc_t CommonWriterComplete(CommonWriter* self, bool quitting, uint64_t maxDistanc
 {
     rc_t rc=0;
     /*** No longer need memory for key2id ***/
-    size_t i;
-    for (i = 0; i != self->ctx.key2id_count; ++i) {
-        KBTreeDropBacking(self->ctx.key2id[i]);
-        KBTreeRelease(self->ctx.key2id[i]);
-        self->ctx.key2id[i] = NULL;
-    }
-    free(self->ctx.key2id_names);
-    self->ctx.key2id_names = NULL;
+    ContextReleaseKeyIds(&self->ctx);
     /*******************/
 
     if (self->had_sequences) {
         if (!quitting) {
-            (void)LOGMSG(klogInfo, "Writing unpaired sequences");
-            rc = WriteSoloFragments(&self->settings, &self->ctx, self->seq);
+            if (self->ctx.mates) {
+                (void)LOGMSG(klogInfo, "Writing sorted mate pairs");
+                rc = WriteSortedMates(&self->settings, &self->ctx, self->seq);
+            }
+            if (rc == 0) {
+                (void)LOGMSG(klogInfo, "Writing unpaired sequences");
+                rc = WriteSoloFragments(&self->settings, &self->ctx, self->seq);
+            }
             ContextReleaseMemBank(&self->ctx);
             if (rc == 0) {
                 rc = SequenceDoneWriting(self->seq);
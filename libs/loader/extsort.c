@@ -0,0 +1,437 @@
+/*===========================================================================
+ *
+ *                            PUBLIC DOMAIN NOTICE
+ *               National Center for Biotechnology Information
+ *
+ *  This software/database is a "United States Government Work" under the
+ *  terms of the United States Copyright Act.  It was written as part of
+ *  the author's official duties as a United States Government employee and
+ *  thus cannot be copyrighted.  This software/database is freely available
+ *  to the public for use. The National Library of Medicine and the U.S.
+ *  Government have not placed any restriction on its use or reproduction.
+ *
+ *  Although all reasonable efforts have been taken to ensure the accuracy
+ *  and reliability of the software and data, the NLM and the U.S.
+ *  Government do not and cannot warrant the performance or results that
+ *  may be obtained by using this software or data. The NLM and the U.S.
+ *  Government disclaim all warranties, express or implied, including
+ *  warranties of performance, merchantability or fitness for any particular
+ *  purpose.
+ *
+ *  Please cite the author in any work or product based on this material.
+ *
+ * ===========================================================================
+ *
+ */
+
+#include <loader/extsort.h>
+
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <klib/rc.h>
+#include <klib/sort.h>
+
+#include <kfs/file.h>
+
+#define EXTSORT_IO_SIZE (1024u * 1024u) /* write buffer, and the least memory to sort in */
+#define EXTSORT_MIN_READ (64u * 1024u) /* least read buffer per run while merging */
+
+/* a record is its header followed by its data, padded to 8 bytes */
+typedef struct es_rec_s {
+    uint64_t key;
+    uint32_t size;
+    uint32_t pad;
+} es_rec_t;
+
+#define ES_REC_SIZE(N) (sizeof(es_rec_t) + (((size_t)(N) + 7) & ~(size_t)7))
+
+typedef struct es_index_s {
+    uint64_t key;
+    size_t offset;  /* ties go by offset, i.e. by arrival */
+} es_index_t;
+
+typedef struct es_run_s {
+    uint64_t pos;   /* in the file */
+    uint64_t end;
+    uint8_t *buf;
+    size_t bufsize;
+    size_t len;
+    size_t cur;
+    uint64_t key;   /* of the record at cur */
+} es_run_t;
+
+typedef struct ExtSort {
+    KFile *fp;
+    size_t memory;
+    ExtSortStats stats;
+
+    /* the run being collected: records from the front of buf, index from the back */
+    uint8_t *buf;
+    size_t used;
+    size_t count;
+    uint8_t *iobuf;
+
+    /* spilled runs */
+    es_run_t *run;
+    unsigned nruns;
+    unsigned maxruns;
+    uint64_t fsize;
+
+    /* merging */
+    unsigned *heap;
+    unsigned heapsize;
+    size_t next;    /* in index, if nothing was spilled */
+    int last;       /* run whose record was returned last */
+    bool merging;
+} ExtSort;
+
+rc_t ExtSortMake(ExtSort **const rslt, KFile *const fp, size_t const memory)
+{
+    ExtSort *const self = calloc(1, sizeof(*self));
+
+    *rslt = NULL;
+    if (self == NULL)
+        return RC(rcExe, rcMemory, rcAllocating, rcMemory, rcExhausted);
+
+    self->memory = (memory < 2 * EXTSORT_IO_SIZE ? 2 * EXTSORT_IO_SIZE : memory) & ~(size_t)15;
+    /* mostly untouched until it fills */
+    self->buf = malloc(self->memory);
+    if (self->buf == NULL) {
+        free(self);
+        return RC(rcExe, rcMemory, rcAllocating, rcMemory, rcExhausted);
+    }
+    self->last = -1;
+    self->fp = fp;
+    KFileAddRef(fp);
+    *rslt = self;
+    return 0;
+}
+
+static es_index_t *ExtSortIndex(ExtSort const *const self)
+{
+    return (es_index_t *)(self->buf + self->memory) - self->count;
+}
+
+static void ExtSortSortIndex(ExtSort *const self)
+{
+    es_index_t *const index = ExtSortIndex(self);
+    es_index_t tmp;
+
+#define CMP(A, B) (((es_index_t const *)(A))->key < ((es_index_t const *)(B))->key ? -1 : \
+                   ((es_index_t const *)(A))->key > ((es_index_t const *)(B))->key ?  1 : \
+                   ((es_index_t const *)(A))->offset < ((es_index_t const *)(B))->offset ? -1 : 1)
+#define SWAP(A, B, C, D) do { tmp = *(es_index_t *)(A); *(es_index_t *)(A) = *(es_index_t *)(B); *(es_index_t *)(B) = tmp; } while(0)
+    {
+    KSORT(index, self->count, sizeof(index[0]), 0, 0);
+    }
+#undef SWAP
+#undef CMP
+}
+
+static rc_t ExtSortFlush(ExtSort *const self, size_t *const iolen)
+{
+    size_t num_writ;
+    rc_t const rc = KFileWriteAll(self->fp, self->fsize, self->iobuf, *iolen, &num_writ);
+
+    if (rc == 0 && num_writ != *iolen)
+        return RC(rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete);
+    self->fsize += *iolen;
+    self->stats.spilled += *iolen;
+    *iolen = 0;
+    return rc;
+}
+
+/* writes the current run out in key order */
+static rc_t ExtSortSpill(ExtSort *const self)
+{
+    es_index_t const *const index = ExtSortIndex(self);
+    size_t iolen = 0;
+    size_t i;
+    rc_t rc = 0;
+
+    if (self->iobuf == NULL) {
+        self->iobuf = malloc(EXTSORT_IO_SIZE);
+        if (self->iobuf == NULL)
+            return RC(rcExe, rcMemory, rcAllocating, rcMemory, rcExhausted);
+    }
+    if (self->nruns == self->maxruns) {
+        unsigned const maxruns = self->maxruns ? self->maxruns * 2 : 16;
+        void *const tmp = realloc(self->run, maxruns * sizeof(self->run[0]));
+
+        if (tmp == NULL)
+            return RC(rcExe, rcMemory, rcAllocating, rcMemory, rcExhausted);
+        self->run = tmp;
+        self->maxruns = maxruns;
+    }
+    memset(&self->run[self->nruns], 0, sizeof(self->run[0]));
+    self->run[self->nruns].pos = self->fsize;
+
+    ExtSortSortIndex(self);
+    for (i = 0; i < self->count && rc == 0; ++i) {
+        uint8_t const *const rec = self->buf + index[i].offset;
+        size_t const size = ES_REC_SIZE(((es_rec_t const *)rec)->size);
+
+        if (iolen + size > EXTSORT_IO_SIZE) {
+            rc = ExtSortFlush(self, &iolen);
+            if (rc == 0 && size > EXTSORT_IO_SIZE) {
+                size_t num_writ;
+
+                rc = KFileWriteAll(self->fp, self->fsize, rec, size, &num_writ);
+                if (rc == 0 && num_writ != size)
+                    rc = RC(rcExe, rcFile, rcWriting, rcTransfer, rcIncomplete);
+                self->fsize += size;
+                self->stats.spilled += size;
+                continue;
+            }
+        }
+        memcpy(self->iobuf + iolen, rec, size);
+        iolen += size;
+    }
+    if (rc == 0 && iolen > 0)
+        rc = ExtSortFlush(self, &iolen);
+    if (rc == 0) {
+        self->run[self->nruns++].end = self->fsize;
+        ++self->stats.runs;
+        self->used = 0;
+        self->count = 0;
+    }
+    return rc;
+}
+
+rc_t ExtSortAdd(ExtSort *const self, uint64_t const key, void const *const data, size_t const size)
+{
+    size_t const recsize = ES_REC_SIZE(size);
+    es_rec_t *rec;
+    es_index_t *index;
+
+    if (self->merging)
+        return RC(rcExe, rcData, rcInserting, rcSelf, rcBusy);
+    if (size > UINT32_MAX || recsize + sizeof(es_index_t) > self->memory)
+        return RC(rcExe, rcData, rcInserting, rcSize, rcExcessive);
+    if (self->used + recsize + (self->count + 1) * sizeof(es_index_t) > self->memory) {
+        rc_t const rc = ExtSortSpill(self);
+        if (rc)
+            return rc;
+    }
+    rec = (es_rec_t *)(self->buf + self->used);
+    rec->key = key;
+    rec->size = (uint32_t)size;
+    rec->pad = 0;
+    memcpy(&rec[1], data, size);
+
+    ++self->count;
+    index = ExtSortIndex(self);
+    index->key = key;
+    index->offset = self->used;
+
+    self->used += recsize;
+    ++self->stats.records;
+    return 0;
+}
+
+/* makes need bytes at cur available, fewer only at the end of the run */
+static rc_t ExtSortRunFill(ExtSort *const self, es_run_t *const run, size_t const need)
+{
+    size_t const have = run->len - run->cur;
+
+    if (have >= need)
+        return 0;
+    if (need > run->bufsize) {
+        void *const tmp = realloc(run->buf, need);
+
+        if (tmp == NULL)
+            return RC(rcExe, rcMemory, rcAllocating, rcMemory, rcExhausted);
+        run->buf = tmp;
+        run->bufsize = need;
+    }
+    memmove(run->buf, run->buf + run->cur, have);
+    run->cur = 0;
+    run->len = have;
+    while (run->len < need && run->pos < run->end) {
+        uint64_t const left = run->end - run->pos;
+        size_t const want = left < run->bufsize - run->len ? (size_t)left : run->bufsize - run->len;
+        size_t num_read;
+        rc_t const rc = KFileReadAll(self->fp, run->pos, run->buf + run->len, want, &num_read);
+
+        if (rc)
+            return rc;
+        if (num_read == 0)
+            return RC(rcExe, rcFile, rcReading, rcTransfer, rcIncomplete);
+        run->pos += num_read;
+        run->len += num_read;
+    }
+    return 0;
+}
+
+/* makes the record at cur available; *more is false when the run is done */
+static rc_t ExtSortRunLoad(ExtSort *const self, es_run_t *const run, bool *const more)
+{
+    size_t need;
+    rc_t rc;
+
+    *more = false;
+    rc = ExtSortRunFill(self, run, sizeof(es_rec_t));
+    if (rc)
+        return rc;
+    if (run->len == run->cur)
+        return 0;
+    if (run->len - run->cur < sizeof(es_rec_t))
+        return RC(rcExe, rcFile, rcReading, rcData, rcInsufficient);
+
+    need = ES_REC_SIZE(((es_rec_t const *)(run->buf + run->cur))->size);
+    rc = ExtSortRunFill(self, run, need);
+    if (rc)
+        return rc;
+    if (run->len - run->cur < need)
+        return RC(rcExe, rcFile, rcReading, rcData, rcInsufficient);
+
+    run->key = ((es_rec_t const *)(run->buf + run->cur))->key;
+    *more = true;
+    return 0;
+}
+
+static bool ExtSortRunLess(ExtSort const *const self, unsigned const a, unsigned const b)
+{
+    uint64_t const ka = self->run[a].key;
+    uint64_t const kb = self->run[b].key;
+
+    return ka < kb || (ka == kb && a < b);
+}
+
+static void ExtSortSiftDown(ExtSort *const self, unsigned i)
+{
+    unsigned *const heap = self->heap;
+
+    for ( ; ; ) {
+        unsigned const l = 2 * i + 1;
+        unsigned const r = l + 1;
+        unsigned m = i;
+        unsigned tmp;
+
+        if (l < self->heapsize && ExtSortRunLess(self, heap[l], heap[m]))
+            m = l;
+        if (r < self->heapsize && ExtSortRunLess(self, heap[r], heap[m]))
+            m = r;
+        if (m == i)
+            break;
+        tmp = heap[i]; heap[i] = heap[m]; heap[m] = tmp;
+        i = m;
+    }
+}
+
+static rc_t ExtSortStartMerge(ExtSort *const self)
+{
+    size_t bufsize;
+    unsigned i;
+    rc_t rc;
+
+    self->merging = true;
+    if (self->nruns == 0) {
+        ExtSortSortIndex(self);
+        return 0;
+    }
+    if (self->count > 0) {
+        rc = ExtSortSpill(self);
+        if (rc)
+            return rc;
+    }
+    free(self->buf);
+    free(self->iobuf);
+    self->buf = NULL;
+    self->iobuf = NULL;
+
+    self->heap = malloc(self->nruns * sizeof(self->heap[0]));
+    if (self->heap == NULL)
+        return RC(rcExe, rcMemory, rcAllocating, rcMemory, rcExhausted);
+
+    bufsize = (self->memory / self->nruns) & ~(size_t)7;
+    if (bufsize < EXTSORT_MIN_READ)
+        bufsize = EXTSORT_MIN_READ;
+    for (i = 0; i < self->nruns; ++i) {
+        es_run_t *const run = &self->run[i];
+        bool more;
+
+        run->bufsize = run->end - run->pos < bufsize ? (size_t)(run->end - run->pos) : bufsize;
+        run->buf = malloc(run->bufsize);
+        if (run->buf == NULL)
+            return RC(rcExe, rcMemory, rcAllocating, rcMemory, rcExhausted);
+        rc = ExtSortRunLoad(self, run, &more);
+        if (rc)
+            return rc;
+        if (more)
+            self->heap[self->heapsize++] = i;
+    }
+    for (i = self->heapsize / 2; i > 0; --i)
+        ExtSortSiftDown(self, i - 1);
+    return 0;
+}
+
+rc_t ExtSortNext(ExtSort *const self, uint64_t *const key, void const **const data, size_t *const size)
+{
+    es_rec_t const *rec;
+    rc_t rc;
+
+    *data = NULL;
+    *size = 0;
+    if (!self->merging) {
+        rc = ExtSortStartMerge(self);
+        if (rc)
+            return rc;
+    }
+    if (self->nruns == 0) {
+        es_index_t const *index;
+
+        if (self->next == self->count)
+            return 0;
+        index = ExtSortIndex(self) + self->next++;
+        rec = (es_rec_t const *)(self->buf + index->offset);
+    }
+    else {
+        if (self->last >= 0) {
+            es_run_t *const run = &self->run[self->last];
+            bool more;
+
+            assert(self->heap[0] == (unsigned)self->last);
+            run->cur += ES_REC_SIZE(((es_rec_t const *)(run->buf + run->cur))->size);
+            self->last = -1;
+            rc = ExtSortRunLoad(self, run, &more);
+            if (rc)
+                return rc;
+            if (!more)
+                self->heap[0] = self->heap[--self->heapsize];
+            ExtSortSiftDown(self, 0);
+        }
+        if (self->heapsize == 0)
+            return 0;
+        self->last = (int)self->heap[0];
+        rec = (es_rec_t const *)(self->run[self->last].buf + self->run[self->last].cur);
+    }
+    *key = rec->key;
+    *data = &rec[1];
+    *size = rec->size;
+    return 0;
+}
+
+void ExtSortGetStats(ExtSort const *const self, ExtSortStats *const stats)
+{
+    *stats = self->stats;
+}
+
+void ExtSortWhack(ExtSort *const self)
+{
+    if (self) {
+        unsigned i;
+
+        for (i = 0; i < self->nruns; ++i)
+            free(self->run[i].buf);
+        free(self->run);
+        free(self->heap);
+        free(self->buf);
+        free(self->iobuf);
+        KFileRelease(self->fp);
+        free(self);
+    }
+}
@@ -28,21 +28,49 @@
 
 #include <sysalloc.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <klib/rc.h>
 
 #include <kfs/mmap.h>
 #include <kfs/file.h>
 
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <kproc/cond.h>
+
 #define MMA_NUM_CHUNKS_BITS (24u)
 #define MMA_NUM_SUBCHUNKS_BITS ((32u)-(MMA_NUM_CHUNKS_BITS))
 #define MMA_SUBCHUNK_SIZE (1u << MMA_NUM_CHUNKS_BITS)
 #define MMA_SUBCHUNK_COUNT (1u << MMA_NUM_SUBCHUNKS_BITS)
+#define MMA_RESERVE_SUBCHUNKS (4u) /* file growth step with any option set */
+#define MMA_PREFETCH_SLOTS (4u) /* id spaces that can be growing at once */
 
 typedef struct MMArray {
     KFile *fp;
     size_t elemSize;
     uint64_t fsize;
+    uint64_t freserved;         /* file size, fsize rounded up to a reservation */
+    uint32_t options;
+    MMArrayStats stats;
+
+    /* mma_Prefetch: the next subchunks, mapped by a background thread */
+    KThread *prefetcher;
+    KLock *lock;
+    KCondition *cond;
+    struct mma_pending_s {
+        KMMap *mmap;
+        uint8_t *base;
+        uint64_t offset;
+        rc_t rc;
+        unsigned bin_no;
+        unsigned subbin;
+        bool requested;
+        bool busy;
+        bool ready;
+    } pending[MMA_PREFETCH_SLOTS];
+    bool quit;
+
     struct mma_map_s {
         struct mma_submap_s {
             uint8_t *base;
@@ -51,7 +79,9 @@ typedef struct MMArray {
     } map[NUM_ID_SPACES];
 } MMArray;
 
-rc_t MMArrayMake(struct MMArray **rslt, KFile *fp, uint32_t elemSize)
+static rc_t CC MMArrayPrefetcher(KThread const *const th, void *const vp);
+
+rc_t MMArrayMakeWithOptions(struct MMArray **rslt, KFile *fp, uint32_t elemSize, uint32_t options)
 {
     MMArray *const self = calloc(1, sizeof(*self));
 
@@ -59,11 +89,218 @@ rc_t MMArrayMake(struct MMArray **rslt, KFile *fp, uint32_t elemSize)
         return RC(rcExe, rcMemMap, rcConstructing, rcMemory, rcExhausted);
     self->elemSize = (elemSize + 3) & ~(3u); /** align to 4 byte **/
     self->fp = fp;
+    self->options = options;
     KFileAddRef(fp);
+
+    if (options & mma_Prefetch) {
+        rc_t rc = KLockMake(&self->lock);
+        if (rc == 0)
+            rc = KConditionMake(&self->cond);
+        if (rc == 0)
+            rc = KThreadMake(&self->prefetcher, MMArrayPrefetcher, self);
+        if (rc) {
+            MMArrayWhack(self);
+            return rc;
+        }
+    }
     *rslt = self;
     return 0;
 }
 
+rc_t MMArrayMake(struct MMArray **rslt, KFile *fp, uint32_t elemSize)
+{
+    return MMArrayMakeWithOptions(rslt, fp, elemSize, 0);
+}
+
+void MMArrayGetStats(struct MMArray const *self, MMArrayStats *stats)
+{
+    if (self->lock)
+        KLockAcquire(self->lock);
+    *stats = self->stats;
+    if (self->lock)
+        KLockUnlock(self->lock);
+}
+
+/* picks the file offset of the next subchunk; called under the lock if any */
+static rc_t MMArrayNextOffset(MMArray *const self, uint64_t *const offset)
+{
+    size_t const chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
+    uint64_t const fsize = self->fsize + chunk;
+
+    if (fsize + chunk > self->freserved) {
+        /* the file only grows here, so mapping never has to resize it */
+        uint64_t const reserve = fsize + chunk * MMA_RESERVE_SUBCHUNKS;
+        rc_t const rc = KFileSetSize(self->fp, reserve);
+
+        if (rc)
+            return rc;
+        self->stats.reserved += reserve - self->freserved;
+        self->freserved = reserve;
+    }
+    self->fsize = fsize;
+    *offset = fsize;
+    return 0;
+}
+
+/* maps a subchunk and applies the hints; safe to call without the lock */
+static rc_t MMArrayMapSubchunk(MMArray const *const self, uint64_t const offset,
+                               KMMap **const mmap, uint8_t **const base)
+{
+    size_t const chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
+    rc_t rc = KMMapMakeRgnUpdate(mmap, self->fp, offset, chunk);
+
+    if (rc == 0) {
+        uint32_t advice = 0;
+
+        if (self->options & mma_Reserve)
+            advice |= kmmapAdviseReserve;
+        if (self->options & mma_HugePages)
+            advice |= kmmapAdviseHugePages;
+        if (self->options & mma_Prefetch)
+            advice |= kmmapAdvisePrefault;
+        if (advice)
+            rc = KMMapAdvise(*mmap, advice);
+        if (rc == 0) {
+            void *addr;
+
+            rc = KMMapAddrUpdate(*mmap, &addr);
+            if (rc == 0) {
+                *base = addr;
+                return 0;
+            }
+        }
+        KMMapRelease(*mmap);
+        *mmap = NULL;
+    }
+    return rc;
+}
+
+static rc_t CC MMArrayPrefetcher(KThread const *const th, void *const vp)
+{
+    MMArray *const self = vp;
+
+    KLockAcquire(self->lock);
+    while (!self->quit) {
+        struct mma_pending_s *pending = NULL;
+        unsigned i;
+
+        for (i = 0; i < MMA_PREFETCH_SLOTS; ++i) {
+            if (self->pending[i].requested && !self->pending[i].busy && !self->pending[i].ready) {
+                pending = &self->pending[i];
+                break;
+            }
+        }
+        if (pending) {
+            KMMap *mmap = NULL;
+            uint8_t *base = NULL;
+            rc_t rc;
+
+            pending->busy = true;
+            KLockUnlock(self->lock);
+            rc = MMArrayMapSubchunk(self, pending->offset, &mmap, &base);
+            KLockAcquire(self->lock);
+            pending->mmap = mmap;
+            pending->base = base;
+            pending->rc = rc;
+            pending->busy = false;
+            pending->ready = true;
+            if (rc == 0) {
+                self->stats.prefetched += 1;
+                self->stats.prefaulted += MMA_SUBCHUNK_SIZE * self->elemSize;
+            }
+            KConditionBroadcast(self->cond);
+        }
+        else
+            KConditionWait(self->cond, self->lock);
+    }
+    KLockUnlock(self->lock);
+    return 0;
+}
+
+/* takes the subchunk from the prefetcher if it was asked for, waiting for
+ * it if need be; called under the lock
+ */
+static bool MMArrayTakePrefetched(MMArray *const self,
+                                  unsigned const bin_no, unsigned const subbin)
+{
+    struct mma_submap_s *const submap = &self->map[bin_no].submap[subbin];
+    unsigned i;
+
+    for (i = 0; i < MMA_PREFETCH_SLOTS; ++i) {
+        struct mma_pending_s *const pending = &self->pending[i];
+
+        if (pending->requested && pending->bin_no == bin_no && pending->subbin == subbin) {
+            if (!pending->ready) {
+                ++self->stats.waits;
+                while (!pending->ready)
+                    KConditionWait(self->cond, self->lock);
+            }
+            /* if it failed, the subchunk gets mapped again in the foreground */
+            if (pending->rc == 0) {
+                submap->mmap = pending->mmap;
+                submap->base = pending->base;
+                ++self->stats.maps;
+            }
+            memset(pending, 0, sizeof(*pending));
+            break;
+        }
+    }
+    return submap->base != NULL;
+}
+
+static void MMArrayRequestPrefetch(MMArray *const self, unsigned const bin_no, unsigned const subbin)
+{
+    struct mma_pending_s *pending = NULL;
+    unsigned i;
+
+    if (subbin >= MMA_SUBCHUNK_COUNT || self->map[bin_no].submap[subbin].base != NULL)
+        return;
+    for (i = 0; i < MMA_PREFETCH_SLOTS; ++i) {
+        if (!self->pending[i].requested)
+            pending = &self->pending[i];
+        else if (self->pending[i].bin_no == bin_no && self->pending[i].subbin == subbin)
+            return;
+    }
+    if (pending == NULL)
+        return;
+    if (MMArrayNextOffset(self, &pending->offset) != 0)
+        return;
+    pending->bin_no = bin_no;
+    pending->subbin = subbin;
+    pending->requested = true;
+    KConditionBroadcast(self->cond);
+}
+
+/* only the calling thread touches map[], the lock covers pending and stats */
+static rc_t MMArrayGetSubchunk(MMArray *const self, unsigned const bin_no, unsigned const subbin)
+{
+    struct mma_submap_s *const submap = &self->map[bin_no].submap[subbin];
+    uint64_t offset = 0;
+    rc_t rc = 0;
+
+    if (self->lock)
+        KLockAcquire(self->lock);
+    if (self->lock == NULL || !MMArrayTakePrefetched(self, bin_no, subbin))
+        rc = MMArrayNextOffset(self, &offset);
+    if (self->lock)
+        KLockUnlock(self->lock);
+
+    if (rc == 0 && submap->base == NULL)
+        rc = MMArrayMapSubchunk(self, offset, &submap->mmap, &submap->base);
+    if (rc == 0 && self->lock) {
+        KLockAcquire(self->lock);
+        if (offset != 0) {
+            ++self->stats.maps;
+            self->stats.prefaulted += MMA_SUBCHUNK_SIZE * self->elemSize;
+        }
+        MMArrayRequestPrefetch(self, bin_no, subbin + 1);
+        KLockUnlock(self->lock);
+    }
+    else if (rc == 0)
+        ++self->stats.maps;
+    return rc;
+}
+
 #define PERF 0
 
 rc_t MMArrayGet(struct MMArray *const self, void **const value, uint64_t const element)
@@ -75,7 +312,12 @@ rc_t MMArrayGet(struct MMArray *const self, void **const value, uint64_t const e
     if (bin_no >= sizeof(self->map)/sizeof(self->map[0]))
         return RC(rcExe, rcMemMap, rcConstructing, rcId, rcExcessive);
     
-    if (self->map[bin_no].submap[subbin].base == NULL) {
+    if (self->map[bin_no].submap[subbin].base == NULL && self->options != 0) {
+        rc_t const rc = MMArrayGetSubchunk(self, bin_no, subbin);
+        if (rc)
+            return rc;
+    }
+    else if (self->map[bin_no].submap[subbin].base == NULL) {
         size_t const chunk = MMA_SUBCHUNK_SIZE * self->elemSize;
         size_t const fsize = self->fsize + chunk;
         rc_t rc = KFileSetSize(self->fp, fsize);
@@ -95,6 +337,7 @@ rc_t MMArrayGet(struct MMArray *const self, void **const value, uint64_t const e
 
                     (void)PLOGMSG(klogInfo, (klogInfo, "Number of mmaps: $(cnt)", "cnt=%u", ++mapcount));
 #endif
+                    ++self->stats.maps;
                     self->map[bin_no].submap[subbin].mmap = mmap;
                     self->map[bin_no].submap[subbin].base = base;
 
@@ -114,6 +357,21 @@ void MMArrayWhack(struct MMArray *self)
 {
     unsigned i;
 
+    if (self->prefetcher) {
+        KLockAcquire(self->lock);
+        self->quit = true;
+        KConditionBroadcast(self->cond);
+        KLockUnlock(self->lock);
+        KThreadWait(self->prefetcher, NULL);
+        KThreadRelease(self->prefetcher);
+    }
+    for (i = 0; i < MMA_PREFETCH_SLOTS; ++i) {
+        if (self->pending[i].mmap)
+            KMMapRelease(self->pending[i].mmap);
+    }
+    KConditionRelease(self->cond);
+    KLockRelease(self->lock);
+
     for (i = 0; i != sizeof(self->map)/sizeof(self->map[0]); ++i) {
         unsigned j;
         
@@ -127,5 +385,3 @@ void MMArrayWhack(struct MMArray *self)
     KFileRelease(self->fp);
     free(self);
 }
-
-
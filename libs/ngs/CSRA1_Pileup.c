@@ -50,6 +50,8 @@ struct CSRA1_Pileup;
 
 #include <klib/rc.h>
 
+#include <string.h>
+
 #if UNIX
 #include <sys/resource.h>
 #endif
@@ -1453,6 +1455,441 @@ bool CSRA1_PileupIteratorGetNext ( CSRA1_Pileup * self, ctx_t ctx )
     return pos_valid;
 }
 
+/*--------------------------------------------------------------------------
+ * CSRA1_Pileup counts
+ *  bulk mode. alignments are gathered chunk by chunk exactly as for
+ *  iteration, but each one is walked once from start to end as it comes
+ *  off of the waiting list, adding into dense arrays. coverage goes into
+ *  a difference array, and matches are never visited individually:
+ *  they are what remains of depth after mismatches and deletions, and
+ *  are attributed to the reference base in a final pass.
+ */
+
+#if defined __GNUC__ && defined __SSE2__
+#define PILEUP_COUNTS_VEC 1
+#include <emmintrin.h>
+#endif
+
+static
+uint32_t CSRA1_PileupCountsBin ( INSDC_dna_text base )
+{
+    switch ( base )
+    {
+    case 'A':
+        return NGS_PileupCountsBase_A;
+    case 'C':
+        return NGS_PileupCountsBase_C;
+    case 'G':
+        return NGS_PileupCountsBase_G;
+    case 'T':
+        return NGS_PileupCountsBase_T;
+    }
+    return NGS_PileupCountsBase_N;
+}
+
+/* number of true values in b [ 0, n ) */
+static
+uint32_t CSRA1_PileupCountsTrue ( const bool * b, uint32_t n )
+{
+    uint32_t i = 0, total = 0;
+#if PILEUP_COUNTS_VEC
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i sum = zero;
+    for ( ; i + 16 <= n; i += 16 )
+    {
+        /* bool is a 0/1 byte: SAD against zero sums each half */
+        __m128i v = _mm_loadu_si128 ( ( const __m128i * ) & b [ i ] );
+        sum = _mm_add_epi64 ( sum, _mm_sad_epu8 ( v, zero ) );
+    }
+    total = ( uint32_t ) _mm_cvtsi128_si32 ( sum ) +
+        ( uint32_t ) _mm_cvtsi128_si32 ( _mm_unpackhi_epi64 ( sum, sum ) );
+#endif
+    for ( ; i < n; ++ i )
+        total += b [ i ];
+    return total;
+}
+
+/* index of next true value in b [ i, n ), or n */
+static
+uint32_t CSRA1_PileupCountsNextTrue ( const bool * b, uint32_t i, uint32_t n )
+{
+#if PILEUP_COUNTS_VEC
+    const __m128i zero = _mm_setzero_si128 ();
+    for ( ; i + 16 <= n; i += 16 )
+    {
+        __m128i v = _mm_loadu_si128 ( ( const __m128i * ) & b [ i ] );
+        int mask = _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( v, zero ) ) ^ 0xFFFF;
+        if ( mask != 0 )
+            return i + __builtin_ctz ( mask );
+    }
+#endif
+    for ( ; i < n; ++ i )
+    {
+        if ( b [ i ] )
+            break;
+    }
+    return i;
+}
+
+/* dst [ 0, n ) += q [ 0, n ) */
+static
+void CSRA1_PileupCountsAddQuality ( uint32_t * dst, const INSDC_quality_phred * q, uint32_t n )
+{
+    uint32_t i = 0;
+#if PILEUP_COUNTS_VEC
+    const __m128i zero = _mm_setzero_si128 ();
+    for ( ; i + 16 <= n; i += 16 )
+    {
+        __m128i * d = ( __m128i * ) & dst [ i ];
+        __m128i v = _mm_loadu_si128 ( ( const __m128i * ) & q [ i ] );
+        __m128i lo = _mm_unpacklo_epi8 ( v, zero );
+        __m128i hi = _mm_unpackhi_epi8 ( v, zero );
+
+        _mm_storeu_si128 ( d + 0, _mm_add_epi32 ( _mm_loadu_si128 ( d + 0 ), _mm_unpacklo_epi16 ( lo, zero ) ) );
+        _mm_storeu_si128 ( d + 1, _mm_add_epi32 ( _mm_loadu_si128 ( d + 1 ), _mm_unpackhi_epi16 ( lo, zero ) ) );
+        _mm_storeu_si128 ( d + 2, _mm_add_epi32 ( _mm_loadu_si128 ( d + 2 ), _mm_unpacklo_epi16 ( hi, zero ) ) );
+        _mm_storeu_si128 ( d + 3, _mm_add_epi32 ( _mm_loadu_si128 ( d + 3 ), _mm_unpackhi_epi16 ( hi, zero ) ) );
+    }
+#endif
+    for ( ; i < n; ++ i )
+        dst [ i ] += q [ i ];
+}
+
+/* credit matches at [ i, i + n ) to the reference bases "ref" */
+static
+void CSRA1_PileupCountsAddMatches ( NGS_PileupCounts * counts, uint64_t i,
+    const INSDC_dna_text * ref, uint32_t n )
+{
+    uint32_t j = 0;
+    uint32_t * depth = & counts -> depth [ i ];
+    uint32_t * deletion = & counts -> deletion [ i ];
+    uint32_t * A = & counts -> base [ NGS_PileupCountsBase_A ] [ i ];
+    uint32_t * C = & counts -> base [ NGS_PileupCountsBase_C ] [ i ];
+    uint32_t * G = & counts -> base [ NGS_PileupCountsBase_G ] [ i ];
+    uint32_t * T = & counts -> base [ NGS_PileupCountsBase_T ] [ i ];
+    uint32_t * N = & counts -> base [ NGS_PileupCountsBase_N ] [ i ];
+
+#if PILEUP_COUNTS_VEC
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i ones = _mm_cmpeq_epi32 ( zero, zero );
+    const __m128i bA = _mm_set1_epi32 ( 'A' );
+    const __m128i bC = _mm_set1_epi32 ( 'C' );
+    const __m128i bG = _mm_set1_epi32 ( 'G' );
+    const __m128i bT = _mm_set1_epi32 ( 'T' );
+
+#define LOADU( p ) _mm_loadu_si128 ( ( const __m128i * ) ( p ) )
+#define ADDU( p, v ) _mm_storeu_si128 ( ( __m128i * ) ( p ), _mm_add_epi32 ( LOADU ( p ), v ) )
+
+    for ( ; j + 4 <= n; j += 4 )
+    {
+        int32_t word;
+        __m128i r, mA, mC, mG, mT, mN;
+
+        /* matches are whatever is left of depth */
+        __m128i m = _mm_sub_epi32 ( LOADU ( & depth [ j ] ), LOADU ( & deletion [ j ] ) );
+        m = _mm_sub_epi32 ( m, LOADU ( & A [ j ] ) );
+        m = _mm_sub_epi32 ( m, LOADU ( & C [ j ] ) );
+        m = _mm_sub_epi32 ( m, LOADU ( & G [ j ] ) );
+        m = _mm_sub_epi32 ( m, LOADU ( & T [ j ] ) );
+        m = _mm_sub_epi32 ( m, LOADU ( & N [ j ] ) );
+
+        /* widen 4 reference bases to 32-bit lanes */
+        memmove ( & word, & ref [ j ], sizeof word );
+        r = _mm_unpacklo_epi8 ( _mm_cvtsi32_si128 ( word ), zero );
+        r = _mm_unpacklo_epi16 ( r, zero );
+
+        mA = _mm_cmpeq_epi32 ( r, bA );
+        mC = _mm_cmpeq_epi32 ( r, bC );
+        mG = _mm_cmpeq_epi32 ( r, bG );
+        mT = _mm_cmpeq_epi32 ( r, bT );
+        mN = _mm_andnot_si128 ( _mm_or_si128 ( _mm_or_si128 ( mA, mC ), _mm_or_si128 ( mG, mT ) ), ones );
+
+        ADDU ( & A [ j ], _mm_and_si128 ( m, mA ) );
+        ADDU ( & C [ j ], _mm_and_si128 ( m, mC ) );
+        ADDU ( & G [ j ], _mm_and_si128 ( m, mG ) );
+        ADDU ( & T [ j ], _mm_and_si128 ( m, mT ) );
+        ADDU ( & N [ j ], _mm_and_si128 ( m, mN ) );
+    }
+
+#undef LOADU
+#undef ADDU
+#endif
+
+    for ( ; j < n; ++ j )
+    {
+        uint32_t m = depth [ j ] - deletion [ j ] - A [ j ] - C [ j ] - G [ j ] - T [ j ] - N [ j ];
+        counts -> base [ CSRA1_PileupCountsBin ( ref [ j ] ) ] [ i + j ] += m;
+    }
+}
+
+static
+void CSRA1_PileupCountsLoadEntry ( CSRA1_Pileup * self, ctx_t ctx, CSRA1_Pileup_Entry * entry )
+{
+    FUNC_ENTRY ( ctx, rcSRA, rcCursor, rcAccessing );
+
+    static const uint32_t cols [] =
+    {
+        pileup_event_col_HAS_MISMATCH,
+        pileup_event_col_MISMATCH,
+        pileup_event_col_HAS_REF_OFFSET,
+        pileup_event_col_REF_OFFSET,
+        pileup_event_col_QUALITY
+    };
+
+    uint32_t i;
+    CSRA1_Pileup_AlignCursorData * cd = entry -> secondary ? & self -> sa : & self -> pa;
+
+    /* the entry is finished before the next one is read,
+       so cell data can be borrowed from the cursor blobs */
+    for ( i = 0; i < sizeof cols / sizeof cols [ 0 ]; ++ i )
+    {
+        ON_FAIL ( CSRA1_Pileup_AlignCursorDataGetCell ( cd, ctx, entry -> row_id, cols [ i ] ) )
+            return;
+
+        entry -> cell_data [ cols [ i ] ] = cd -> cell_data [ cols [ i ] ];
+        entry -> cell_len [ cols [ i ] ] = cd -> cell_len [ cols [ i ] ];
+    }
+}
+
+static
+void CSRA1_PileupCountsAddEntry ( NGS_PileupCounts * counts, CSRA1_Pileup_Entry * entry )
+{
+    const bool * HAS_MISMATCH = entry -> cell_data [ pileup_event_col_HAS_MISMATCH ];
+    const INSDC_dna_text * MISMATCH = entry -> cell_data [ pileup_event_col_MISMATCH ];
+    const INSDC_quality_phred * QUALITY = entry -> cell_data [ pileup_event_col_QUALITY ];
+    uint32_t mismatch_len = entry -> cell_len [ pileup_event_col_MISMATCH ];
+    uint32_t quality_len = entry -> cell_len [ pileup_event_col_QUALITY ];
+
+    /* clip projection to window */
+    int64_t win_xend = counts -> first + ( int64_t ) counts -> length;
+    int64_t zstart = entry -> zstart > counts -> first ? entry -> zstart : counts -> first;
+    int64_t xend = entry -> xend < win_xend ? entry -> xend : win_xend;
+    uint64_t k = ( uint64_t ) ( zstart - counts -> first );
+
+    if ( zstart >= xend || entry -> cell_len [ pileup_event_col_HAS_REF_OFFSET ] == 0 )
+        return;
+
+    if ( entry -> cell_len [ pileup_event_col_REF_OFFSET ] == 0 )
+    {
+        /* no indels: reference and sequence advance together,
+           so the whole alignment is one run of match/mismatch events */
+        uint32_t i, mm, n;
+        uint32_t s = ( uint32_t ) ( zstart - entry -> zstart );
+        uint32_t e = ( uint32_t ) ( xend - entry -> zstart );
+
+        if ( e > entry -> cell_len [ pileup_event_col_HAS_REF_OFFSET ] )
+            e = entry -> cell_len [ pileup_event_col_HAS_REF_OFFSET ];
+        if ( e > entry -> cell_len [ pileup_event_col_HAS_MISMATCH ] )
+            e = entry -> cell_len [ pileup_event_col_HAS_MISMATCH ];
+        if ( s >= e )
+            return;
+        n = e - s;
+
+        counts -> depth [ k ] += 1;
+        if ( k + n < counts -> length )
+            counts -> depth [ k + n ] -= 1;
+
+        if ( quality_len > s )
+            CSRA1_PileupCountsAddQuality ( & counts -> quality [ k ], & QUALITY [ s ], quality_len < e ? quality_len - s : n );
+
+        /* visit only the mismatches */
+        mm = CSRA1_PileupCountsTrue ( HAS_MISMATCH, s );
+        for ( i = CSRA1_PileupCountsNextTrue ( HAS_MISMATCH, s, e ); i < e;
+              i = CSRA1_PileupCountsNextTrue ( HAS_MISMATCH, i + 1, e ), ++ mm )
+        {
+            INSDC_dna_text base = mm < mismatch_len ? MISMATCH [ mm ] : 0;
+            counts -> base [ CSRA1_PileupCountsBin ( base ) ] [ k + i - s ] += 1;
+        }
+    }
+    else
+    {
+        /* walk the events exactly as the event iterator would */
+        int64_t pos = zstart;
+
+        CSRA1_PileupEntryInit ( entry );
+        while ( pos < xend )
+        {
+            const CSRA1_Pileup_Entry_State * state = & entry -> state_curr;
+            uint64_t i = ( uint64_t ) ( pos - counts -> first );
+
+            CSRA1_PileupEntryFocus ( entry, pos );
+            ++ pos;
+
+            if ( state -> del_cnt != 0 )
+                counts -> deletion [ i ] += 1;
+            else
+            {
+                if ( HAS_MISMATCH [ state -> seq_idx ] )
+                {
+                    INSDC_dna_text base = state -> mismatch_idx < mismatch_len ? MISMATCH [ state -> mismatch_idx ] : 0;
+                    counts -> base [ CSRA1_PileupCountsBin ( base ) ] [ i ] += 1;
+                }
+                if ( state -> seq_idx < quality_len )
+                    counts -> quality [ i ] += QUALITY [ state -> seq_idx ];
+            }
+
+            if ( state -> ins_cnt != 0 )
+                counts -> insertion [ i ] += 1;
+
+            if ( entry -> status == pileup_entry_status_DONE )
+                break;
+        }
+
+        counts -> depth [ k ] += 1;
+        if ( ( uint64_t ) ( pos - counts -> first ) < counts -> length )
+            counts -> depth [ pos - counts -> first ] -= 1;
+    }
+}
+
+static
+void CSRA1_PileupCountsDrain ( CSRA1_Pileup * self, ctx_t ctx, NGS_PileupCounts * counts )
+{
+    FUNC_ENTRY ( ctx, rcSRA, rcCursor, rcAccessing );
+
+    DLNode * node;
+
+    /* consume everything gathered so far; after a failure, just dispose */
+    while ( ( node = DLListPopHead ( & self -> align . waiting ) ) != NULL )
+    {
+        CSRA1_Pileup_Entry * entry = ( CSRA1_Pileup_Entry * ) node;
+        self -> align . avail -= 1;
+
+        if ( ! FAILED () )
+        {
+            TRY ( CSRA1_PileupCountsLoadEntry ( self, ctx, entry ) )
+            {
+                CSRA1_PileupCountsAddEntry ( counts, entry );
+            }
+        }
+
+        CSRA1_Pileup_EntryWhack ( node, ( void * ) ctx );
+    }
+}
+
+static
+void CSRA1_PileupCountsFinish ( CSRA1_Pileup * self, ctx_t ctx, NGS_PileupCounts * counts )
+{
+    FUNC_ENTRY ( ctx, rcSRA, rcCursor, rcAccessing );
+
+    uint64_t i;
+    uint32_t depth = 0;
+    uint64_t ref_len = 0;
+
+    /* integrate coverage */
+    for ( i = 0; i < counts -> length; ++ i )
+        counts -> depth [ i ] = depth += counts -> depth [ i ];
+
+    if ( self -> circular )
+    {
+        ON_FAIL ( ref_len = NGS_ReferenceGetLength ( self -> dad . dad . dad . ref, ctx ) )
+            return;
+    }
+
+    /* attribute matches to the reference, one REFERENCE row at a time */
+    for ( i = 0; i < counts -> length; )
+    {
+        const void * base;
+        uint32_t elem_bits, boff, row_len, off, n;
+
+        int64_t pos = counts -> first + ( int64_t ) i;
+        if ( self -> circular && ( uint64_t ) pos >= ref_len )
+            pos -= ref_len;
+
+        ON_FAIL ( NGS_CursorCellDataDirect ( self -> ref . curs, ctx,
+                  pos / self -> ref . max_seq_len + self -> reference_start_id,
+                  reference_READ, & elem_bits, & base, & boff, & row_len ) )
+        {
+            return;
+        }
+
+        off = ( uint32_t ) ( pos % self -> ref . max_seq_len );
+        if ( row_len <= off )
+        {
+            INTERNAL_ERROR ( xcColumnEmpty, "REFERENCE.READ ends before position %ld", pos );
+            return;
+        }
+
+        n = row_len - off;
+        if ( n > counts -> length - i )
+            n = ( uint32_t ) ( counts -> length - i );
+
+        CSRA1_PileupCountsAddMatches ( counts, i, ( const INSDC_dna_text * ) base + off, n );
+        i += n;
+    }
+}
+
+static
+void CSRA1_PileupGetCounts ( CSRA1_Pileup * self, ctx_t ctx, NGS_PileupCounts * counts )
+{
+    FUNC_ENTRY ( ctx, rcSRA, rcCursor, rcAccessing );
+
+    uint32_t i, * block;
+    uint64_t length;
+
+    if ( self -> state != pileup_state_initial )
+    {
+        USER_ERROR ( xcFunctionUnsupported, "Pileup counts requested after a call to PileupIteratorNext()" );
+        return;
+    }
+
+    length = ( uint64_t ) ( self -> slice_xend - self -> slice_zstart );
+
+    /* one block for all arrays */
+    block = calloc ( length * ( NGS_PileupCountsBase_count + 4 ) + 1, sizeof * block );
+    if ( block == NULL )
+    {
+        SYSTEM_ERROR ( xcNoMemory, "allocating pileup counts for %lu positions", length );
+        return;
+    }
+
+    counts -> first = self -> slice_zstart;
+    counts -> length = length;
+    counts -> depth = block;
+    for ( i = 0; i < NGS_PileupCountsBase_count; ++ i )
+        counts -> base [ i ] = block + length * ( i + 1 );
+    counts -> deletion = block + length * ( NGS_PileupCountsBase_count + 1 );
+    counts -> insertion = block + length * ( NGS_PileupCountsBase_count + 2 );
+    counts -> quality = block + length * ( NGS_PileupCountsBase_count + 3 );
+
+    /* the first chunk, plus anything overlapping it from the left */
+    TRY ( CSRA1_PileupFirst ( self, ctx ) )
+    {
+        TRY ( CSRA1_PileupCountsDrain ( self, ctx, counts ) )
+        {
+            /* the rest of the slice */
+            while ( self -> ref_chunk_id <= self -> slice_end_id )
+            {
+                if ( self -> ref_chunk_id < self -> idx_chunk_id )
+                    self -> ref_chunk_id = self -> idx_chunk_id;
+                else
+                {
+                    ON_FAIL ( CSRA1_PileupPopulate ( self, ctx, READ_AHEAD_LIMIT ) )
+                        break;
+                    ON_FAIL ( CSRA1_PileupCountsDrain ( self, ctx, counts ) )
+                        break;
+                }
+            }
+
+            if ( ! FAILED () )
+                CSRA1_PileupCountsFinish ( self, ctx, counts );
+        }
+    }
+
+    /* the pileup has been consumed either way */
+    CSRA1_PileupCountsDrain ( self, ctx, counts );
+
+    if ( FAILED () )
+    {
+        self -> state = pileup_state_err;
+        NGS_PileupCountsWhack ( counts );
+    }
+    else
+    {
+        self -> ref_zpos = self -> slice_xend;
+        self -> state = pileup_state_finished;
+    }
+}
+
 static NGS_Pileup_vt CSRA1_Pileup_vt =
 {
     {
@@ -1482,7 +1919,8 @@ static NGS_Pileup_vt CSRA1_Pileup_vt =
     CSRA1_PileupGetReferencePosition,
     CSRA1_PileupGetReferenceBase,           
     CSRA1_PileupGetDepth,            
-    CSRA1_PileupIteratorGetNext     
+    CSRA1_PileupIteratorGetNext,
+    CSRA1_PileupGetCounts
 };
 
 
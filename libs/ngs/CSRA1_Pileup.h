@@ -313,6 +313,16 @@ struct NGS_Pileup * CSRA1_PileupIteratorMakeSlice ( ctx_t ctx, struct NGS_Refere
 const void * CSRA1_PileupGetEntry ( CSRA1_Pileup * self, ctx_t ctx,
     CSRA1_Pileup_Entry * entry, uint32_t col_idx );
 
+/* EntryInit
+ *  prepare a new entry for walking; needs HAS_MISMATCH, REF_OFFSET and HAS_REF_OFFSET
+ */
+void CSRA1_PileupEntryInit ( CSRA1_Pileup_Entry * entry );
+
+/* EntryFocus
+ *  walk entry forward to reference position "ref_zpos"
+ */
+void CSRA1_PileupEntryFocus ( CSRA1_Pileup_Entry * entry, int64_t ref_zpos );
+
 /* PileupEntry method declarations */
 void CSRA1_PileupEventWhack ( struct CSRA1_PileupEvent * self, ctx_t ctx );
 int CSRA1_PileupEventGetMappingQuality ( struct CSRA1_PileupEvent const * self, ctx_t ctx );
@@ -654,8 +654,11 @@ int CSRA1_PileupEventGetIndelType ( const CSRA1_PileupEvent * self, ctx_t ctx )
     return 0;
 }
 
-static
-void CSRA1_PileupEventEntryFocus ( CSRA1_PileupEvent * self, CSRA1_Pileup_Entry * entry )
+/* EntryFocus
+ *  walk an initialized entry forward to reference position "ref_zpos",
+ *  leaving the event at that position in "state_curr"
+ */
+void CSRA1_PileupEntryFocus ( CSRA1_Pileup_Entry * entry, int64_t ref_zpos )
 {
     const bool * HAS_MISMATCH = entry -> cell_data [ pileup_event_col_HAS_MISMATCH ];
     const bool * HAS_REF_OFFSET = entry -> cell_data [ pileup_event_col_HAS_REF_OFFSET ];
@@ -667,7 +670,7 @@ void CSRA1_PileupEventEntryFocus ( CSRA1_PileupEvent * self, CSRA1_Pileup_Entry
 
 advance_to_the_next_position: /* TODO: try to reorganise the function not to have this goto */
 
-    ref_zpos_adj = CSRA1_PileupEventGetPileup ( self ) -> ref_zpos - entry -> zstart;
+    ref_zpos_adj = ( int32_t ) ( ref_zpos - entry -> zstart );
     plus_end_pos = entry->status == pileup_entry_status_INITIAL ? 0 : 1;
     assert ( ref_zpos_adj >= 0 );
 
@@ -783,50 +786,56 @@ advance_to_the_next_position: /* TODO: try to reorganise the function not to hav
     }
 }
 
-static
-void CSRA1_PileupEventEntryInit ( CSRA1_PileupEvent * self, ctx_t ctx, CSRA1_Pileup_Entry * entry )
+/* EntryInit
+ *  skip any left soft-clip and capture an initial deletion;
+ *  the HAS_MISMATCH, REF_OFFSET and HAS_REF_OFFSET cells must be loaded
+ */
+void CSRA1_PileupEntryInit ( CSRA1_Pileup_Entry * entry )
 {
-    FUNC_ENTRY ( ctx, rcSRA, rcCursor, rcAccessing );
+    const bool * HAS_MISMATCH = entry -> cell_data [ pileup_event_col_HAS_MISMATCH ];
+    const bool * HAS_REF_OFFSET = entry -> cell_data [ pileup_event_col_HAS_REF_OFFSET ];
+    const int32_t * REF_OFFSET = entry -> cell_data [ pileup_event_col_REF_OFFSET ];
 
-    const bool * HAS_MISMATCH;
+    /* if there are no offsets, then there are no indels, which means
+       that there are only match and mismatch events */
+    if ( entry -> cell_len [ pileup_event_col_REF_OFFSET ] == 0 )
+        return;
 
-    TRY ( HAS_MISMATCH = CSRA1_PileupEventGetEntry ( self, ctx, entry, pileup_event_col_HAS_MISMATCH ) )
+    /* check for left soft-clip */
+    while ( HAS_REF_OFFSET [ entry -> state_next . seq_idx ] && REF_OFFSET [ entry -> state_next . ref_off_idx ] < 0 )
     {
-        const int32_t * REF_OFFSET;
-
-        TRY ( REF_OFFSET = CSRA1_PileupEventGetEntry ( self, ctx, entry, pileup_event_col_REF_OFFSET ) )
-        {
-            const bool * HAS_REF_OFFSET;
+        uint32_t i, end = entry -> state_next . seq_idx - REF_OFFSET [ entry -> state_next . ref_off_idx ++ ];
 
-            TRY ( HAS_REF_OFFSET = CSRA1_PileupEventGetEntry ( self, ctx, entry, pileup_event_col_HAS_REF_OFFSET ) )
-            {
-                /* if there are no offsets, then there are no indels, which means
-                   that there are only match and mismatch events */
-                if ( entry -> cell_len [ pileup_event_col_REF_OFFSET ] == 0 )
-                    return;
-
-                /* check for left soft-clip */
-                while ( HAS_REF_OFFSET [ entry -> state_next . seq_idx ] && REF_OFFSET [ entry -> state_next . ref_off_idx ] < 0 )
-                {
-                    uint32_t i, end = entry -> state_next . seq_idx - REF_OFFSET [ entry -> state_next . ref_off_idx ++ ];
+        /* safety check */
+        if ( end > entry -> cell_len [ pileup_event_col_HAS_REF_OFFSET ] )
+            end = entry -> cell_len [ pileup_event_col_HAS_REF_OFFSET ];
 
-                    /* safety check */
-                    if ( end > entry -> cell_len [ pileup_event_col_HAS_REF_OFFSET ] )
-                        end = entry -> cell_len [ pileup_event_col_HAS_REF_OFFSET ];
+        /* skip over soft-clip */
+        for ( i = entry -> state_next . seq_idx; i < end; ++ i )
+            entry -> state_next . mismatch_idx += HAS_MISMATCH [ i ];
 
-                    /* skip over soft-clip */
-                    for ( i = entry -> state_next . seq_idx; i < end; ++ i )
-                        entry -> state_next . mismatch_idx += HAS_MISMATCH [ i ];
+        entry -> state_next . seq_idx = end;
+    }
 
-                    entry -> state_next . seq_idx = end;
-                }
+    /* capture initial deletion - should never occur */
+    if ( HAS_REF_OFFSET [ entry -> state_next . seq_idx ] && REF_OFFSET [ entry -> state_next . ref_off_idx ] > 0 )
+        entry -> state_next . del_cnt = REF_OFFSET [ entry -> state_next . ref_off_idx ];
 
-                /* capture initial deletion - should never occur */
-                if ( HAS_REF_OFFSET [ entry -> state_next . seq_idx ] && REF_OFFSET [ entry -> state_next . ref_off_idx ] > 0 )
-                    entry -> state_next . del_cnt = REF_OFFSET [ entry -> state_next . ref_off_idx ];
+    /* TODO: maybe pileup_entry_status_VALID must be set here */
+}
 
-                /* TODO: maybe pileup_entry_status_VALID must be set here */
+static
+void CSRA1_PileupEventEntryInit ( CSRA1_PileupEvent * self, ctx_t ctx, CSRA1_Pileup_Entry * entry )
+{
+    FUNC_ENTRY ( ctx, rcSRA, rcCursor, rcAccessing );
 
+    TRY ( CSRA1_PileupEventGetEntry ( self, ctx, entry, pileup_event_col_HAS_MISMATCH ) )
+    {
+        TRY ( CSRA1_PileupEventGetEntry ( self, ctx, entry, pileup_event_col_REF_OFFSET ) )
+        {
+            TRY ( CSRA1_PileupEventGetEntry ( self, ctx, entry, pileup_event_col_HAS_REF_OFFSET ) )
+            {
+                CSRA1_PileupEntryInit ( entry );
                 return;
             }
         }
@@ -898,7 +907,7 @@ bool CSRA1_PileupEventIteratorNext ( CSRA1_PileupEvent * self, ctx_t ctx )
     }
 
     /* this is an entry we've seen before */
-    CSRA1_PileupEventEntryFocus ( self, entry );
+    CSRA1_PileupEntryFocus ( entry, CSRA1_PileupEventGetPileup ( self ) -> ref_zpos );
 
     return true;
 }
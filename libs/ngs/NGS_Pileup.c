@@ -39,6 +39,10 @@
 #include <kfc/except.h>
 #include <kfc/xc.h>
 
+#include <sysalloc.h>
+#include <stdlib.h>
+#include <string.h>
+
 /*--------------------------------------------------------------------------
  * NGS_Pileup_v1
  */
@@ -148,6 +152,7 @@ void NGS_PileupInit ( ctx_t ctx,
         assert ( vt -> get_reference_base != NULL );
         assert ( vt -> get_pileup_depth != NULL );
         assert ( vt -> next != NULL );
+        assert ( vt -> get_counts != NULL );
     }
 }
 
@@ -233,3 +238,31 @@ bool NGS_PileupIteratorNext ( NGS_Pileup* self, ctx_t ctx )
     return false;
 }
 
+void NGS_PileupGetCounts ( NGS_Pileup* self, ctx_t ctx, NGS_PileupCounts * counts )
+{
+    if ( self == NULL )
+    {
+        FUNC_ENTRY ( ctx, rcSRA, rcDatabase, rcAccessing );
+        INTERNAL_ERROR ( xcSelfNull, "failed to get pileup counts" );
+    }
+    else if ( counts == NULL )
+    {
+        FUNC_ENTRY ( ctx, rcSRA, rcDatabase, rcAccessing );
+        INTERNAL_ERROR ( xcParamNull, "failed to get pileup counts" );
+    }
+    else
+    {
+        memset ( counts, 0, sizeof * counts );
+        VT ( self, get_counts ) ( self, ctx, counts );
+    }
+}
+
+void NGS_PileupCountsWhack ( NGS_PileupCounts * self )
+{
+    if ( self != NULL )
+    {
+        /* all arrays live in the single block behind "depth" */
+        free ( self -> depth );
+        memset ( self, 0, sizeof * self );
+    }
+}
@@ -104,6 +104,58 @@ unsigned int NGS_PileupGetPileupDepth ( const NGS_Pileup* self, ctx_t ctx );
 bool NGS_PileupIteratorNext ( NGS_Pileup* self, ctx_t ctx );
 
 
+/*--------------------------------------------------------------------------
+ * NGS_PileupCounts
+ *  per-position tallies of the events a pileup would produce across
+ *  its window, as dense arrays indexed from the start of the window
+ */
+enum NGS_PileupCountsBase
+{
+    NGS_PileupCountsBase_A,
+    NGS_PileupCountsBase_C,
+    NGS_PileupCountsBase_G,
+    NGS_PileupCountsBase_T,
+    NGS_PileupCountsBase_N,         /* anything else */
+
+    NGS_PileupCountsBase_count
+};
+
+typedef struct NGS_PileupCounts NGS_PileupCounts;
+struct NGS_PileupCounts
+{
+    /* reference window: [ first, first + length ) */
+    int64_t first;                  /* ZERO-BASED */
+    uint64_t length;
+
+    /* number of events at each position, i.e. pileup depth */
+    uint32_t * depth;
+
+    /* aligned base of match and mismatch events */
+    uint32_t * base [ NGS_PileupCountsBase_count ];
+
+    /* deletion events, and events preceded by an insertion */
+    uint32_t * deletion;
+    uint32_t * insertion;
+
+    /* sum of phred quality over match and mismatch events */
+    uint32_t * quality;
+};
+
+/* GetCounts
+ *  run a pileup that has not yet been advanced across its entire window,
+ *  decoding each alignment once instead of revisiting it at every position.
+ *  the pileup is exhausted afterward.
+ *
+ *  "counts" [ OUT ] - filled in on success, release with NGS_PileupCountsWhack
+ */
+void NGS_PileupGetCounts ( NGS_Pileup* self, ctx_t ctx, NGS_PileupCounts * counts );
+
+/* Whack
+ *  release arrays
+ */
+void NGS_PileupCountsWhack ( NGS_PileupCounts * self );
+
+
 /*--------------------------------------------------------------------------
  * implementation details
  */
@@ -125,6 +177,9 @@ struct NGS_Pileup_vt
 
     /* PileupIterator interface */
     bool ( * next ) ( NGS_PILEUP * self, ctx_t ctx );
+
+    /* bulk interface */
+    void ( * get_counts ) ( NGS_PILEUP * self, ctx_t ctx, NGS_PileupCounts * counts );
 };
 
 /* Init
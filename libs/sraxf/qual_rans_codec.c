@@ -0,0 +1,601 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "qual_rans_codec.h"
+
+#include <klib/rc.h>
+#include <klib/vlen-encode.h>
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#define SCALE_BITS 12
+#define SCALE ( 1u << SCALE_BITS )
+
+/* coder states stay within [ STATE_LOW, STATE_LOW << 16 ) and move
+   16 bits at a time */
+#define STATE_LOW ( 1u << 15 )
+
+#define WAYS 4
+
+/* order 2 keeps 3 contexts per score, so its tables grow with the
+   square of the alphabet; binned qualities are far below this */
+#define ORDER_2_MAX_SYMS 64
+
+/* model_ctx
+ *  the context in which a score is coded, from the dense indices
+ *  of the one ( p1 ) and two ( p2 ) before it in its run
+ */
+static
+uint32_t model_ctx ( uint32_t order, uint32_t p1, uint32_t p2 )
+{
+    if ( order == qual_rans_order_1 )
+        return p1;
+    return p1 * 3 + ( p2 == p1 ? 0 : p2 < p1 ? 1 : 2 );
+}
+
+static
+uint32_t model_nctx ( uint32_t order, uint32_t nsym )
+{
+    return order == qual_rans_order_1 ? nsym : nsym * 3;
+}
+
+/* the runs coded by each of the interleaved states: all but the last
+   are "count / WAYS" long, the last takes the remainder */
+#define RUN_START( w, seg ) ( ( size_t ) ( w ) * ( seg ) )
+
+static
+void count_contexts ( uint32_t *counts, uint32_t nsym, uint32_t order,
+    const uint8_t *idx, const uint8_t *src, size_t count )
+{
+    size_t const seg = count / WAYS;
+    uint32_t w;
+
+    for ( w = 0; w < WAYS; ++ w )
+    {
+        size_t i = RUN_START ( w, seg );
+        size_t const end = w + 1 < WAYS ? i + seg : count;
+        uint32_t p1 = 0, p2 = 0;
+
+        for ( ; i < end; ++ i )
+        {
+            uint32_t const s = idx [ src [ i ] ];
+            ++ counts [ model_ctx ( order, p1, p2 ) * nsym + s ];
+            p2 = p1;
+            p1 = s;
+        }
+    }
+}
+
+/* model_cost
+ *  bits for the coded scores at their empirical entropy,
+ *  plus a rough size for the tables
+ */
+static
+double model_cost ( const uint32_t *counts, uint32_t nctx, uint32_t nsym )
+{
+    double bits = 0;
+    uint32_t c, s;
+
+    for ( c = 0; c < nctx; ++ c )
+    {
+        const uint32_t *row = counts + ( size_t ) c * nsym;
+        uint64_t total = 0;
+
+        bits += 8;
+        for ( s = 0; s < nsym; ++ s )
+            total += row [ s ];
+        for ( s = 0; s < nsym; ++ s )
+        {
+            if ( row [ s ] != 0 )
+                bits += row [ s ] * log2 ( ( double ) total / row [ s ] ) + 24;
+        }
+    }
+    return bits;
+}
+
+/* normalize
+ *  scale counts to frequencies summing to SCALE, never rounding a
+ *  score that occurs down to nothing
+ */
+static
+void normalize ( uint16_t *freq, const uint32_t *cnt, uint32_t nsym )
+{
+    uint64_t total = 0;
+    uint32_t s, sum = 0;
+
+    for ( s = 0; s < nsym; ++ s )
+        total += cnt [ s ];
+
+    if ( total == 0 )
+    {
+        memset ( freq, 0, nsym * sizeof freq [ 0 ] );
+        return;
+    }
+
+    for ( s = 0; s < nsym; ++ s )
+    {
+        uint32_t f = 0;
+        if ( cnt [ s ] != 0 )
+        {
+            f = ( uint32_t ) ( ( uint64_t ) cnt [ s ] * SCALE / total );
+            if ( f == 0 )
+                f = 1;
+        }
+        freq [ s ] = ( uint16_t ) f;
+        sum += f;
+    }
+
+    /* rounding down leaves a remainder, rounding rare scores up can
+       overshoot: settle either on the most frequent */
+    while ( sum != SCALE )
+    {
+        uint32_t best = 0;
+        for ( s = 1; s < nsym; ++ s )
+        {
+            if ( freq [ s ] > freq [ best ] )
+                best = s;
+        }
+
+        if ( sum < SCALE )
+        {
+            freq [ best ] += SCALE - sum;
+            sum = SCALE;
+        }
+        else
+        {
+            uint32_t take = sum - SCALE;
+            if ( take > freq [ best ] - 1u )
+                take = freq [ best ] - 1u;
+            freq [ best ] -= take;
+            sum -= take;
+        }
+    }
+}
+
+static
+rc_t put_vlen ( uint8_t **p, const uint8_t *end, uint64_t x )
+{
+    uint64_t n;
+    rc_t rc = vlen_encodeU1 ( * p, end - * p, & n, x );
+    if ( rc == 0 )
+        * p += n;
+    return rc;
+}
+
+static
+rc_t get_vlen ( const uint8_t **p, const uint8_t *end, uint64_t *x )
+{
+    uint64_t n;
+    rc_t rc;
+
+    if ( * p >= end )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    rc = vlen_decodeU1 ( x, * p, end - * p, & n );
+    if ( rc != 0 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    * p += n;
+    return 0;
+}
+
+rc_t qual_rans_encode ( void *Dst, size_t dsize, size_t *used,
+    const uint8_t *src, size_t count, uint32_t order )
+{
+    uint8_t *dst = Dst;
+    uint8_t *p = dst;
+    uint8_t * const end = dst + dsize;
+    uint8_t sym [ 256 ], idx [ 256 ];
+    uint64_t hist [ 256 ];
+    uint32_t *counts = NULL;
+    uint16_t *freq = NULL, *cum;
+    uint32_t nsym, nctx, c, s;
+    uint32_t x [ WAYS ];
+    uint8_t *base, *out;
+    size_t seg, i;
+    rc_t rc;
+
+    assert ( used != NULL );
+    * used = 0;
+
+    if ( order > qual_rans_order_2 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcParam, rcInvalid );
+
+    /* the scores present, as dense indices */
+    memset ( hist, 0, sizeof hist );
+    for ( i = 0; i < count; ++ i )
+        ++ hist [ src [ i ] ];
+    for ( nsym = 0, s = 0; s < 256; ++ s )
+    {
+        if ( hist [ s ] != 0 )
+        {
+            idx [ s ] = ( uint8_t ) nsym;
+            sym [ nsym ++ ] = ( uint8_t ) s;
+        }
+    }
+    if ( nsym == 0 )
+        sym [ nsym ++ ] = 0;
+
+    if ( nsym > ORDER_2_MAX_SYMS )
+        order = qual_rans_order_1;
+
+    /* choose the model */
+    if ( order == qual_rans_order_auto )
+    {
+        uint32_t * counts1 = calloc ( ( size_t ) model_nctx ( qual_rans_order_1, nsym ) * nsym, sizeof * counts1 );
+        uint32_t * counts2 = calloc ( ( size_t ) model_nctx ( qual_rans_order_2, nsym ) * nsym, sizeof * counts2 );
+        if ( counts1 == NULL || counts2 == NULL )
+        {
+            free ( counts1 );
+            free ( counts2 );
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        }
+        count_contexts ( counts1, nsym, qual_rans_order_1, idx, src, count );
+        count_contexts ( counts2, nsym, qual_rans_order_2, idx, src, count );
+        if ( model_cost ( counts2, model_nctx ( qual_rans_order_2, nsym ), nsym ) <
+             model_cost ( counts1, model_nctx ( qual_rans_order_1, nsym ), nsym ) )
+        {
+            order = qual_rans_order_2;
+            counts = counts2;
+            free ( counts1 );
+        }
+        else
+        {
+            order = qual_rans_order_1;
+            counts = counts1;
+            free ( counts2 );
+        }
+    }
+    else
+    {
+        counts = calloc ( ( size_t ) model_nctx ( order, nsym ) * nsym, sizeof * counts );
+        if ( counts == NULL )
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        count_contexts ( counts, nsym, order, idx, src, count );
+    }
+    nctx = model_nctx ( order, nsym );
+
+    /* frequencies and their running totals */
+    freq = malloc ( ( size_t ) nctx * nsym * 2 * sizeof * freq );
+    if ( freq == NULL )
+    {
+        free ( counts );
+        return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    }
+    cum = freq + ( size_t ) nctx * nsym;
+    for ( c = 0; c < nctx; ++ c )
+    {
+        uint16_t * const f = freq + ( size_t ) c * nsym;
+        uint32_t total = 0;
+        normalize ( f, counts + ( size_t ) c * nsym, nsym );
+        for ( s = 0; s < nsym; ++ s )
+        {
+            cum [ ( size_t ) c * nsym + s ] = ( uint16_t ) total;
+            total += f [ s ];
+        }
+    }
+    free ( counts );
+
+    /* header and tables */
+    rc = RC ( rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient );
+    if ( p + 2 + nsym > end )
+        goto DONE;
+    * p ++ = ( uint8_t ) order;
+    if ( put_vlen ( & p, end, count ) != 0 || p + 1 + nsym > end )
+        goto DONE;
+    * p ++ = ( uint8_t ) ( nsym - 1 );
+    memmove ( p, sym, nsym );
+    p += nsym;
+
+    for ( c = 0; c < nctx; ++ c )
+    {
+        const uint16_t * const f = freq + ( size_t ) c * nsym;
+        uint32_t k = 0;
+        for ( s = 0; s < nsym; ++ s )
+            k += f [ s ] != 0;
+        if ( put_vlen ( & p, end, k ) != 0 )
+            goto DONE;
+        for ( s = 0; s < nsym; ++ s )
+        {
+            if ( f [ s ] != 0 )
+            {
+                if ( p >= end )
+                    goto DONE;
+                * p ++ = ( uint8_t ) s;
+                if ( put_vlen ( & p, end, f [ s ] ) != 0 )
+                    goto DONE;
+            }
+        }
+    }
+
+    /* code back to front into the end of the buffer: each state is
+       flushed before the symbol that would overflow it */
+    base = p + 4 * WAYS;
+    if ( base > end )
+        goto DONE;
+    out = end;
+    for ( s = 0; s < WAYS; ++ s )
+        x [ s ] = STATE_LOW;
+
+#define ENCODE_ONE( X, pos, start )                                         \
+    {                                                                       \
+        uint32_t const sc = idx [ src [ pos ] ];                            \
+        uint32_t const p1 = ( pos ) > ( start ) ? idx [ src [ ( pos ) - 1 ] ] : 0; \
+        uint32_t const p2 = ( pos ) > ( start ) + 1 ? idx [ src [ ( pos ) - 2 ] ] : 0; \
+        size_t const e = ( size_t ) model_ctx ( order, p1, p2 ) * nsym + sc; \
+        uint32_t const f = freq [ e ];                                      \
+        if ( X >= ( f << ( 31 - SCALE_BITS ) ) )                            \
+        {                                                                   \
+            if ( out - base < 2 )                                           \
+                goto DONE;                                                  \
+            out -= 2;                                                       \
+            out [ 0 ] = ( uint8_t ) X;                                      \
+            out [ 1 ] = ( uint8_t ) ( X >> 8 );                             \
+            X >>= 16;                                                       \
+        }                                                                   \
+        X = ( ( X / f ) << SCALE_BITS ) + ( X % f ) + cum [ e ];            \
+    }
+
+    seg = count / WAYS;
+    for ( i = count; i > WAYS * seg; )
+    {
+        -- i;
+        ENCODE_ONE ( x [ WAYS - 1 ], i, RUN_START ( WAYS - 1, seg ) );
+    }
+    for ( i = seg; i > 0; )
+    {
+        -- i;
+        for ( s = WAYS; s > 0; )
+        {
+            -- s;
+            ENCODE_ONE ( x [ s ], RUN_START ( s, seg ) + i, RUN_START ( s, seg ) );
+        }
+    }
+
+#undef ENCODE_ONE
+
+    for ( s = 0; s < WAYS; ++ s )
+    {
+        p [ 0 ] = ( uint8_t ) x [ s ];
+        p [ 1 ] = ( uint8_t ) ( x [ s ] >> 8 );
+        p [ 2 ] = ( uint8_t ) ( x [ s ] >> 16 );
+        p [ 3 ] = ( uint8_t ) ( x [ s ] >> 24 );
+        p += 4;
+    }
+    memmove ( base, out, end - out );
+    * used = ( base - dst ) + ( end - out );
+    rc = 0;
+
+DONE:
+    free ( freq );
+    return rc;
+}
+
+/* a context's decoding table: the dense score at each of the SCALE
+   slots, and each score's frequency and cumulative frequency */
+typedef struct QualRansCtx QualRansCtx;
+struct QualRansCtx
+{
+    const uint8_t *slot;
+    const uint32_t *fc;
+};
+
+#define FC_FREQ( e ) ( ( e ) & 0xFFFF )
+#define FC_CUM( e ) ( ( e ) >> 16 )
+
+/* decode_runs
+ *  the interleaved loop, advancing all WAYS states one score per pass
+ *  through its own run; "order" is a constant at each call
+ */
+static
+rc_t decode_runs ( uint8_t *dst, size_t count, const uint8_t *in, const uint8_t *end,
+    uint32_t x [ WAYS ], const QualRansCtx *ctxs, const uint8_t *sym, uint32_t order )
+{
+    size_t const seg = count / WAYS;
+    uint32_t ctx [ WAYS ] = { 0 }, p1 [ WAYS ] = { 0 };
+    uint8_t *run [ WAYS ];
+    size_t i;
+    uint32_t w;
+
+#define DECODE_ONE( w, out )                                                \
+    {                                                                       \
+        uint32_t const m = x [ w ] & ( SCALE - 1 );                         \
+        uint32_t const s = ctxs [ ctx [ w ] ] . slot [ m ];                 \
+        uint32_t const e = ctxs [ ctx [ w ] ] . fc [ s ];                   \
+        x [ w ] = FC_FREQ ( e ) * ( x [ w ] >> SCALE_BITS ) + m - FC_CUM ( e ); \
+        out = sym [ s ];                                                    \
+        ctx [ w ] = model_ctx ( order, s, p1 [ w ] );                       \
+        p1 [ w ] = s;                                                       \
+        if ( x [ w ] < STATE_LOW )                                          \
+        {                                                                   \
+            if ( end - in < 2 )                                             \
+                return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt ); \
+            x [ w ] = ( x [ w ] << 16 ) | in [ 0 ] | ( ( uint32_t ) in [ 1 ] << 8 ); \
+            in += 2;                                                        \
+        }                                                                   \
+    }
+
+    for ( w = 0; w < WAYS; ++ w )
+        run [ w ] = dst + RUN_START ( w, seg );
+
+    for ( i = 0; i < seg; ++ i )
+    {
+        DECODE_ONE ( 0, run [ 0 ] [ i ] );
+        DECODE_ONE ( 1, run [ 1 ] [ i ] );
+        DECODE_ONE ( 2, run [ 2 ] [ i ] );
+        DECODE_ONE ( 3, run [ 3 ] [ i ] );
+    }
+    for ( i = WAYS * seg; i < count; ++ i )
+        DECODE_ONE ( WAYS - 1, dst [ i ] );
+
+#undef DECODE_ONE
+
+    /* the encoder started every state at STATE_LOW and used every word */
+    for ( w = 0; w < WAYS; ++ w )
+    {
+        if ( x [ w ] != STATE_LOW )
+            return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    }
+    if ( in != end )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    return 0;
+}
+
+rc_t qual_rans_decode ( uint8_t *dst, size_t dsize, const void *Src, size_t ssize )
+{
+    const uint8_t *p = Src;
+    const uint8_t * const end = p + ssize;
+    const uint8_t *tables;
+    uint8_t sym [ 256 ];
+    uint32_t order, nsym, nctx, nused, c, s;
+    uint32_t x [ WAYS ];
+    uint64_t count;
+    QualRansCtx *ctxs;
+    uint32_t *fc;
+    uint8_t *slots;
+    rc_t rc;
+
+    /* header */
+    if ( ssize < 1 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    order = * p ++;
+    if ( order != qual_rans_order_1 && order != qual_rans_order_2 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcUnrecognized );
+    rc = get_vlen ( & p, end, & count );
+    if ( rc != 0 )
+        return rc;
+    if ( count != dsize )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcInvalid );
+    if ( p >= end )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    nsym = * p ++ + 1u;
+    if ( end - p < ( ptrdiff_t ) nsym )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    if ( order == qual_rans_order_2 && nsym > ORDER_2_MAX_SYMS )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    memmove ( sym, p, nsym );
+    p += nsym;
+    nctx = model_nctx ( order, nsym );
+
+    /* count the contexts in use, to size their slot tables */
+    tables = p;
+    for ( nused = 0, c = 0; c < nctx; ++ c )
+    {
+        uint64_t k, f;
+        rc = get_vlen ( & p, end, & k );
+        if ( rc != 0 )
+            return rc;
+        if ( k > nsym )
+            return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+        nused += k != 0;
+        for ( ; k != 0; -- k )
+        {
+            if ( ++ p > end )
+                return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+            rc = get_vlen ( & p, end, & f );
+            if ( rc != 0 )
+                return rc;
+        }
+    }
+
+    ctxs = malloc ( nctx * sizeof * ctxs +
+                    ( size_t ) nctx * nsym * sizeof * fc +
+                    ( size_t ) ( nused + 1 ) * SCALE );
+    if ( ctxs == NULL )
+        return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    fc = ( uint32_t* ) ( ctxs + nctx );
+    slots = ( uint8_t* ) ( fc + ( size_t ) nctx * nsym );
+    memset ( fc, 0, ( size_t ) nctx * nsym * sizeof * fc );
+
+    /* an unused context decodes as a single certain score; the encoder
+       never reaches one, and corrupt data still decodes safely */
+    memset ( slots, 0, SCALE );
+
+    /* build the tables */
+    p = tables;
+    for ( nused = 0, c = 0; c < nctx; ++ c )
+    {
+        uint32_t * const row = fc + ( size_t ) c * nsym;
+        uint32_t total = 0;
+        uint64_t k;
+        int last = -1;
+
+        get_vlen ( & p, end, & k );
+        ctxs [ c ] . fc = row;
+        if ( k == 0 )
+        {
+            row [ 0 ] = SCALE;
+            ctxs [ c ] . slot = slots;
+            continue;
+        }
+        ctxs [ c ] . slot = slots + ( size_t ) ( ++ nused ) * SCALE;
+        for ( ; k != 0; -- k )
+        {
+            uint64_t f;
+            s = * p ++;
+            get_vlen ( & p, end, & f );
+            if ( ( int ) s <= last || s >= nsym || f == 0 || f > SCALE - total )
+            {
+                free ( ctxs );
+                return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+            }
+            last = s;
+            row [ s ] = ( uint32_t ) f | ( total << 16 );
+            memset ( ( uint8_t* ) ctxs [ c ] . slot + total, ( int ) s, ( size_t ) f );
+            total += ( uint32_t ) f;
+        }
+        if ( total != SCALE )
+        {
+            free ( ctxs );
+            return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+        }
+    }
+
+    /* states, then the words */
+    if ( end - p < 4 * WAYS || ( ( end - p ) & 1 ) != 0 )
+        rc = RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    else
+    {
+        for ( s = 0; s < WAYS; ++ s, p += 4 )
+        {
+            x [ s ] = p [ 0 ] | ( ( uint32_t ) p [ 1 ] << 8 ) |
+                ( ( uint32_t ) p [ 2 ] << 16 ) | ( ( uint32_t ) p [ 3 ] << 24 );
+            if ( x [ s ] < STATE_LOW )
+                break;
+        }
+        if ( s != WAYS )
+            rc = RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+        else if ( order == qual_rans_order_1 )
+            rc = decode_runs ( dst, dsize, p, end, x, ctxs, sym, qual_rans_order_1 );
+        else
+            rc = decode_runs ( dst, dsize, p, end, x, ctxs, sym, qual_rans_order_2 );
+    }
+
+    free ( ctxs );
+    return rc;
+}
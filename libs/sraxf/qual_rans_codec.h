@@ -0,0 +1,85 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_sraxf_qual_rans_codec_
+#define _h_sraxf_qual_rans_codec_
+
+#include <klib/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*--------------------------------------------------------------------------
+ * qual_rans
+ *  context modelled rANS coding of quality scores
+ *
+ *  each score is coded with a static frequency table chosen by the
+ *  scores before it - the previous one ( order 1 ), or the previous
+ *  one and whether the one before that was equal, lower or higher
+ *  ( order 2 ). tables are built per blob over the scores actually
+ *  present, and the blob is cut into four runs decoded in lock step
+ *  by four interleaved coders sharing one stream of 16 bit words.
+ *
+ *  format:
+ *   U8   order, 1 or 2
+ *   vlen count of scores
+ *   U8   number of distinct scores - 1, then the scores, ascending
+ *   per context: vlen number of scores seen, then for each the
+ *     U8 index of the score and vlen frequency, out of 4096
+ *   U32 x 4 final coder states, little-endian
+ *   U16 * words of coded data, little-endian
+ */
+enum
+{
+    qual_rans_order_auto = 0,
+    qual_rans_order_1,
+    qual_rans_order_2
+};
+
+/* qual_rans_encode
+ *  code "count" scores from "src" into "dst"
+ *
+ *  "order" [ IN ] - a qual_rans_order value; auto picks whichever
+ *  model's tables and estimated entropy come out smaller
+ *
+ *  returns rcBuffer, rcInsufficient when the result would not fit
+ *  into "dsize" bytes
+ */
+rc_t qual_rans_encode ( void *dst, size_t dsize, size_t *used,
+    const uint8_t *src, size_t count, uint32_t order );
+
+/* qual_rans_decode
+ *  decode exactly "dsize" scores into "dst"
+ */
+rc_t qual_rans_decode ( uint8_t *dst, size_t dsize,
+    const void *src, size_t ssize );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_sraxf_qual_rans_codec_ */
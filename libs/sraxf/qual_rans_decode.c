@@ -0,0 +1,62 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <vdb/extern.h>
+
+#include <klib/defs.h>
+#include <klib/rc.h>
+#include <vdb/xform.h>
+#include <vdb/schema.h>
+#include "qual_rans_codec.h"
+#include <sysalloc.h>
+
+#include <stdint.h>
+
+static
+rc_t CC qual_rans_decode_func ( void *self, const VXformInfo *info,
+    VBlobResult *dst, const VBlobData *src, VBlobHeader *hdr )
+{
+    if ( VBlobHeaderVersion ( hdr ) != 1 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcParam, rcBadVersion );
+    if ( dst -> elem_bits != 8 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcType, rcInvalid );
+
+    dst -> byte_order = vboNone;
+    return qual_rans_decode ( dst -> data, ( size_t ) dst -> elem_count,
+        src -> data, ( ( size_t ) src -> elem_count * src -> elem_bits + 7 ) >> 3 );
+}
+
+/* qual_rans_decode
+ *  function INSDC:quality:phred INSDC:SRA:qual_rans_decode #1.0
+ *      ( INSDC:SRA:qual_rans_fmt in );
+ */
+VTRANSFACT_IMPL ( INSDC_SRA_qual_rans_decode, 1, 0, 0 ) ( const void *Self, const VXfactInfo *info,
+    VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
+{
+    rslt -> variant = vftBlob;
+    rslt -> u . bf = qual_rans_decode_func;
+    return 0;
+}
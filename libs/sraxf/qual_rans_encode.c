@@ -0,0 +1,88 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <vdb/extern.h>
+
+#include <klib/defs.h>
+#include <klib/rc.h>
+#include <vdb/xform.h>
+#include <vdb/schema.h>
+#include "qual_rans_codec.h"
+#include <sysalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static
+rc_t CC qual_rans_encode_func ( void *self, const VXformInfo *info,
+    VBlobResult *dst, const VBlobData *src, VBlobHeader *hdr )
+{
+    size_t used;
+    rc_t rc;
+
+    /* available output size */
+    size_t const dsize = ( ( size_t ) dst -> elem_count * dst -> elem_bits + 7 ) >> 3;
+
+    if ( src -> elem_bits != 8 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcType, rcInvalid );
+
+    VBlobHeaderSetVersion ( hdr, 1 );
+
+    /* an rcInsufficient result has the caller store the blob as-is */
+    rc = qual_rans_encode ( dst -> data, dsize, & used,
+        src -> data, ( size_t ) src -> elem_count, ( uint32_t ) ( size_t ) self );
+    if ( rc == 0 )
+    {
+        dst -> elem_bits = 1;
+        dst -> byte_order = vboNone;
+        dst -> elem_count = ( uint64_t ) used << 3;
+    }
+    return rc;
+}
+
+/* qual_rans_encode
+ *  function INSDC:SRA:qual_rans_fmt INSDC:SRA:qual_rans_encode #1.0 < * U8 order >
+ *      ( INSDC:quality:phred in );
+ *
+ *  "order" is 1 or 2 for that many preceding scores of context,
+ *  or 0 ( the default ) to pick whichever codes each blob smaller
+ */
+VTRANSFACT_IMPL ( INSDC_SRA_qual_rans_encode, 1, 0, 0 ) ( const void *Self, const VXfactInfo *info,
+    VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
+{
+    uint32_t order = qual_rans_order_auto;
+    if ( cp -> argc > 0 )
+    {
+        order = cp -> argv [ 0 ] . data . u8 [ 0 ];
+        if ( order > qual_rans_order_2 )
+            return RC ( rcXF, rcFunction, rcConstructing, rcParam, rcInvalid );
+    }
+
+    rslt -> self = ( void* ) ( size_t ) order;
+    rslt -> variant = vftBlob;
+    rslt -> u . bf = qual_rans_encode_func;
+    return 0;
+}
@@ -57,6 +57,7 @@ extern VTRANSFACT_DECL ( vdb_transpose );
 extern VTRANSFACT_DECL ( vdb_detranspose );
 extern VTRANSFACT_DECL ( vdb_delta_average );
 extern VTRANSFACT_DECL ( vdb_undelta_average );
+extern VTRANSFACT_DECL ( INSDC_SRA_spot_name_decode );
 extern VTRANSFACT_DECL ( meta_read );
 extern VTRANSFACT_DECL ( meta_value );
 extern VTRANSFACT_DECL ( meta_attr_read );
@@ -81,6 +82,7 @@ extern VTRANSFACT_DECL ( ALIGN_seq_restore_linkage_group );
 extern VTRANSFACT_DECL ( INSDC_SEQ_rand_4na_2na );
 extern VTRANSFACT_DECL ( INSDC_SRA_format_spot_name );
 extern VTRANSFACT_DECL ( INSDC_SRA_format_spot_name_no_coord );
+extern VTRANSFACT_DECL ( INSDC_SRA_qual_rans_decode );
 extern VTRANSFACT_DECL ( NCBI_SRA_ABI_tokenize_spot_name );
 extern VTRANSFACT_DECL ( NCBI_SRA_Helicos_tokenize_spot_name );
 extern VTRANSFACT_DECL ( NCBI_SRA_Illumina_tokenize_spot_name );
@@ -178,6 +180,7 @@ extern VTRANSFACT_DECL ( NCBI_unpack );
 extern VTRANSFACT_DECL ( NCBI_unzip );
 extern VTRANSFACT_DECL ( NCBI_var_tokenize_var_id );
 extern VTRANSFACT_DECL ( vdb_add_row_id );
+extern VTRANSFACT_DECL ( vdb_aunzip );
 extern VTRANSFACT_DECL ( vdb_bit_or );
 extern VTRANSFACT_DECL ( vdb_bunzip );
 extern VTRANSFACT_DECL ( vdb_ceil );
@@ -216,6 +219,7 @@ extern VTRANSFACT_DECL ( vdb_trunc );
 extern VTRANSFACT_DECL ( vdb_undelta );
 extern VTRANSFACT_DECL ( vdb_unpack );
 extern VTRANSFACT_DECL ( vdb_unzip );
+extern VTRANSFACT_DECL ( vdb_unzstd );
 extern VTRANSFACT_DECL ( vdb_vec_sum );
 
 struct KTable;
@@ -446,6 +450,7 @@ rc_t VLinkerInitFactoriesRead ( VLinker *self,  KSymTable *tbl, const SchemaEnv
         { vdb_detranspose, "vdb:detranspose" },
         { vdb_delta_average, "vdb:delta_average" },
         { vdb_undelta_average, "vdb:undelta_average" },
+        { INSDC_SRA_spot_name_decode, "INSDC:SRA:spot_name_decode" },
         { meta_read, "meta:read" },
         { meta_value, "meta:value" },
         { meta_attr_read, "meta:attr:read" },
@@ -469,6 +474,7 @@ rc_t VLinkerInitFactoriesRead ( VLinker *self,  KSymTable *tbl, const SchemaEnv
         { INSDC_SEQ_rand_4na_2na, "INSDC:SEQ:rand_4na_2na" },
         { INSDC_SRA_format_spot_name, "INSDC:SRA:format_spot_name" },
         { INSDC_SRA_format_spot_name_no_coord, "INSDC:SRA:format_spot_name_no_coord" },
+        { INSDC_SRA_qual_rans_decode, "INSDC:SRA:qual_rans_decode" },
         { NCBI_SRA_ABI_tokenize_spot_name, "NCBI:SRA:ABI:tokenize_spot_name" },
         { NCBI_SRA_Helicos_tokenize_spot_name, "NCBI:SRA:Helicos:tokenize_spot_name" },
         { NCBI_SRA_Illumina_tokenize_spot_name, "NCBI:SRA:Illumina:tokenize_spot_name" },
@@ -568,6 +574,7 @@ rc_t VLinkerInitFactoriesRead ( VLinker *self,  KSymTable *tbl, const SchemaEnv
         { NCBI_unzip, "NCBI:unzip" },
         { NCBI_var_tokenize_var_id, "NCBI:var:tokenize_var_id" },
         { vdb_add_row_id, "vdb:add_row_id" },
+        { vdb_aunzip, "vdb:aunzip" },
         { vdb_bit_or, "vdb:bit_or" },
         { vdb_bunzip, "vdb:bunzip" },
         { vdb_ceil, "vdb:ceil" },
@@ -605,6 +612,7 @@ rc_t VLinkerInitFactoriesRead ( VLinker *self,  KSymTable *tbl, const SchemaEnv
         { vdb_undelta, "vdb:undelta" },
         { vdb_unpack, "vdb:unpack" },
         { vdb_unzip, "vdb:unzip" },
+        { vdb_unzstd, "vdb:unzstd" },
         { vdb_vec_sum, "vdb:vec_sum" },
 
         { vdb_hello, "vdb:hello" }
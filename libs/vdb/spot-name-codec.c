@@ -0,0 +1,911 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <vdb/extern.h>
+
+#include <vdb/xform.h>
+#include <klib/rc.h>
+#include <klib/vlen-encode.h>
+#include <klib/data-buffer.h>
+
+#include "spot-name-codec.h"
+#include "xform-priv.h"
+#include "blob-priv.h"
+#include "blob-headers.h"
+#include "blob.h"
+#include "page-map.h"
+
+#include <sysalloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* names with more tokens keep the rest in their last one */
+#define MAX_TOKENS 32
+
+/* the largest number that is coded as one */
+#define MAX_NUMBER 999999999999999999ULL
+
+enum { tagEnd, tagDup, tagDelta, tagNum, tagNew, tagRef, tagCount };
+enum { prevNone, prevNum, prevStr };
+
+#define INSUFFICIENT() RC ( rcVDB, rcFunction, rcExecuting, rcBuffer, rcInsufficient )
+#define CORRUPT() RC ( rcVDB, rcFunction, rcExecuting, rcData, rcCorrupt )
+
+
+/*--------------------------------------------------------------------------
+ * Token
+ */
+typedef struct Token Token;
+struct Token
+{
+    uint64_t val;
+    uint32_t off;
+    uint32_t len;
+    bool num;
+};
+
+#define IS_DIGIT( c ) ( ( uint8_t ) ( ( c ) - '0' ) < 10 )
+
+static
+uint32_t tokenize ( Token *tok, const char *src, uint32_t off, uint32_t len )
+{
+    uint32_t n, i, end = off + len;
+
+    for ( n = 0, i = off; i < end; ++ n )
+    {
+        Token *t = & tok [ n ];
+        bool const digits = IS_DIGIT ( src [ i ] );
+
+        t -> off = i;
+        if ( n + 1 == MAX_TOKENS )
+            i = end;
+        else
+        {
+            for ( ++ i; i < end && IS_DIGIT ( src [ i ] ) == digits; ++ i )
+                ( void ) 0;
+        }
+        t -> len = i - t -> off;
+
+        /* numbers must print back the same */
+        t -> num = false;
+        if ( digits && t -> len <= 18 && ( t -> len == 1 || src [ t -> off ] != '0' ) )
+        {
+            uint64_t val = 0;
+            uint32_t j;
+            for ( j = t -> off; j < i && IS_DIGIT ( src [ j ] ); ++ j )
+                val = val * 10 + ( src [ j ] - '0' );
+            if ( j == i )
+            {
+                t -> num = true;
+                t -> val = val;
+            }
+        }
+    }
+
+    return n;
+}
+
+
+/*--------------------------------------------------------------------------
+ * Stream
+ *  a growing sub-stream, never larger than the whole result may be
+ */
+typedef struct Stream Stream;
+struct Stream
+{
+    uint8_t *buf;
+    size_t size;
+    size_t cap;
+};
+
+static
+rc_t StreamReserve ( Stream *self, size_t more, size_t limit )
+{
+    if ( self -> size + more > self -> cap )
+    {
+        uint8_t *buf;
+        size_t cap = self -> cap != 0 ? self -> cap * 2 : 256;
+        while ( cap < self -> size + more )
+            cap *= 2;
+        if ( cap > limit )
+        {
+            if ( self -> size + more > limit )
+                return INSUFFICIENT ();
+            cap = limit;
+        }
+        buf = realloc ( self -> buf, cap );
+        if ( buf == NULL )
+            return RC ( rcVDB, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        self -> buf = buf;
+        self -> cap = cap;
+    }
+    return 0;
+}
+
+static
+rc_t StreamPutVlen ( Stream *self, uint64_t x, size_t limit )
+{
+    uint64_t n;
+    rc_t rc = StreamReserve ( self, 10, limit );
+    if ( rc != 0 )
+    {
+        /* the last few bytes may still be enough */
+        vlen_encodeU1 ( NULL, 0, & n, x );
+        rc = StreamReserve ( self, n, limit );
+        if ( rc != 0 )
+            return rc;
+    }
+    rc = vlen_encodeU1 ( self -> buf + self -> size, self -> cap - self -> size, & n, x );
+    if ( rc == 0 )
+        self -> size += n;
+    return rc;
+}
+
+
+/*--------------------------------------------------------------------------
+ * EncColumn
+ *  token position being coded
+ */
+typedef struct EncColumn EncColumn;
+struct EncColumn
+{
+    Stream tags, ints, strs;
+
+    /* pending run of tags */
+    uint64_t run;
+    uint8_t tag;
+
+    /* token at this position in the last name that had one */
+    uint8_t prev;
+    uint64_t val;
+    uint32_t off, len;
+
+    /* strings seen, hashed into "slot" as index + 1 */
+    SpotNameRec *dict;
+    uint32_t *slot;
+    uint32_t ndict, dict_cap, nslot;
+};
+
+static
+void EncColumnWhack ( EncColumn *self )
+{
+    free ( self -> tags . buf );
+    free ( self -> ints . buf );
+    free ( self -> strs . buf );
+    free ( self -> dict );
+    free ( self -> slot );
+}
+
+static
+rc_t EncColumnFlushTags ( EncColumn *self, size_t limit )
+{
+    rc_t rc = 0;
+    if ( self -> run != 0 )
+    {
+        rc = StreamReserve ( & self -> tags, 1, limit );
+        if ( rc == 0 )
+        {
+            self -> tags . buf [ self -> tags . size ++ ] = self -> tag;
+            rc = StreamPutVlen ( & self -> tags, self -> run, limit );
+        }
+        self -> run = 0;
+    }
+    return rc;
+}
+
+static
+rc_t EncColumnPutTag ( EncColumn *self, uint8_t tag, size_t limit )
+{
+    if ( self -> run != 0 && self -> tag == tag )
+    {
+        ++ self -> run;
+        return 0;
+    }
+    else
+    {
+        rc_t rc = EncColumnFlushTags ( self, limit );
+        self -> tag = tag;
+        self -> run = 1;
+        return rc;
+    }
+}
+
+static
+uint32_t hash_bytes ( const char *p, uint32_t len )
+{
+    uint32_t i, h = 2166136261U;
+    for ( i = 0; i < len; ++ i )
+        h = ( h ^ ( uint8_t ) p [ i ] ) * 16777619U;
+    return h;
+}
+
+/* EncColumnFindString
+ *  look the string up in the dictionary, adding it when absent
+ */
+static
+rc_t EncColumnFindString ( EncColumn *self, const char *src,
+    uint32_t off, uint32_t len, uint32_t *idx, bool *found )
+{
+    uint32_t h, mask;
+
+    if ( ( self -> ndict + 1 ) * 2 > self -> nslot )
+    {
+        uint32_t i, nslot = self -> nslot != 0 ? self -> nslot * 2 : 64;
+        uint32_t *slot = calloc ( nslot, sizeof * slot );
+        if ( slot == NULL )
+            return RC ( rcVDB, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        for ( i = 0; i < self -> ndict; ++ i )
+        {
+            h = hash_bytes ( src + self -> dict [ i ] . off, self -> dict [ i ] . len ) & ( nslot - 1 );
+            while ( slot [ h ] != 0 )
+                h = ( h + 1 ) & ( nslot - 1 );
+            slot [ h ] = i + 1;
+        }
+        free ( self -> slot );
+        self -> slot = slot;
+        self -> nslot = nslot;
+    }
+
+    mask = self -> nslot - 1;
+    for ( h = hash_bytes ( src + off, len ) & mask; self -> slot [ h ] != 0; h = ( h + 1 ) & mask )
+    {
+        const SpotNameRec *e = & self -> dict [ self -> slot [ h ] - 1 ];
+        if ( e -> len == len && memcmp ( src + e -> off, src + off, len ) == 0 )
+        {
+            * idx = self -> slot [ h ] - 1;
+            * found = true;
+            return 0;
+        }
+    }
+
+    if ( self -> ndict == self -> dict_cap )
+    {
+        uint32_t cap = self -> dict_cap != 0 ? self -> dict_cap * 2 : 64;
+        SpotNameRec *dict = realloc ( self -> dict, cap * sizeof * dict );
+        if ( dict == NULL )
+            return RC ( rcVDB, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        self -> dict = dict;
+        self -> dict_cap = cap;
+    }
+    self -> dict [ self -> ndict ] . off = off;
+    self -> dict [ self -> ndict ] . len = len;
+    self -> slot [ h ] = ++ self -> ndict;
+    * found = false;
+    return 0;
+}
+
+static
+rc_t EncColumnPutToken ( EncColumn *self, const char *src, const Token *t, size_t limit )
+{
+    rc_t rc;
+
+    if ( t -> num )
+    {
+        if ( self -> prev != prevNum )
+        {
+            rc = EncColumnPutTag ( self, tagNum, limit );
+            if ( rc == 0 )
+                rc = StreamPutVlen ( & self -> ints, t -> val, limit );
+        }
+        else if ( self -> val == t -> val )
+            rc = EncColumnPutTag ( self, tagDup, limit );
+        else
+        {
+            /* both are below 10^18, so the difference fits */
+            int64_t const d = ( int64_t ) ( t -> val - self -> val );
+            rc = EncColumnPutTag ( self, tagDelta, limit );
+            if ( rc == 0 )
+                rc = StreamPutVlen ( & self -> ints, ( ( uint64_t ) d << 1 ) ^ ( uint64_t ) ( d >> 63 ), limit );
+        }
+        self -> prev = prevNum;
+        self -> val = t -> val;
+    }
+    else
+    {
+        if ( self -> prev == prevStr && self -> len == t -> len &&
+             memcmp ( src + self -> off, src + t -> off, t -> len ) == 0 )
+        {
+            rc = EncColumnPutTag ( self, tagDup, limit );
+        }
+        else
+        {
+            uint32_t idx;
+            bool found;
+            rc = EncColumnFindString ( self, src, t -> off, t -> len, & idx, & found );
+            if ( rc == 0 && found )
+            {
+                rc = EncColumnPutTag ( self, tagRef, limit );
+                if ( rc == 0 )
+                    rc = StreamPutVlen ( & self -> ints, idx, limit );
+            }
+            else if ( rc == 0 )
+            {
+                rc = EncColumnPutTag ( self, tagNew, limit );
+                if ( rc == 0 )
+                    rc = StreamPutVlen ( & self -> ints, t -> len, limit );
+                if ( rc == 0 )
+                    rc = StreamReserve ( & self -> strs, t -> len, limit );
+                if ( rc == 0 )
+                {
+                    memmove ( self -> strs . buf + self -> strs . size, src + t -> off, t -> len );
+                    self -> strs . size += t -> len;
+                }
+            }
+        }
+        self -> prev = prevStr;
+        self -> off = t -> off;
+        self -> len = t -> len;
+    }
+
+    return rc;
+}
+
+rc_t SpotNameEncode ( void *Dst, size_t dsize, size_t *used,
+    const char *src, const SpotNameRec *recs, uint32_t nrecs )
+{
+    EncColumn col [ MAX_TOKENS + 1 ];
+    Token tok [ MAX_TOKENS ];
+    uint32_t c, r, ncols = 1;
+    rc_t rc = 0;
+
+    assert ( used != NULL );
+    * used = 0;
+
+    memset ( col, 0, sizeof col );
+    for ( r = 0; rc == 0 && r < nrecs; ++ r )
+    {
+        uint32_t const n = tokenize ( tok, src, recs [ r ] . off, recs [ r ] . len );
+        for ( c = 0; rc == 0 && c < n; ++ c )
+            rc = EncColumnPutToken ( & col [ c ], src, & tok [ c ], dsize );
+        if ( rc == 0 )
+            rc = EncColumnPutTag ( & col [ n ], tagEnd, dsize );
+        if ( n >= ncols )
+            ncols = n + 1;
+    }
+    for ( c = 0; rc == 0 && c < ncols; ++ c )
+        rc = EncColumnFlushTags ( & col [ c ], dsize );
+
+    if ( rc == 0 )
+    {
+        /* header, then the streams column by column */
+        Stream out;
+        out . buf = Dst;
+        out . size = 0;
+        out . cap = dsize;
+
+        rc = StreamPutVlen ( & out, nrecs, dsize );
+        if ( rc == 0 )
+            rc = StreamReserve ( & out, 1, dsize );
+        if ( rc == 0 )
+            out . buf [ out . size ++ ] = ( uint8_t ) ncols;
+        for ( c = 0; rc == 0 && c < ncols; ++ c )
+        {
+            rc = StreamPutVlen ( & out, col [ c ] . tags . size, dsize );
+            if ( rc == 0 )
+                rc = StreamPutVlen ( & out, col [ c ] . ints . size, dsize );
+            if ( rc == 0 )
+                rc = StreamPutVlen ( & out, col [ c ] . strs . size, dsize );
+        }
+        for ( c = 0; rc == 0 && c < ncols; ++ c )
+        {
+            const Stream *s [ 3 ];
+            uint32_t i;
+            s [ 0 ] = & col [ c ] . tags;
+            s [ 1 ] = & col [ c ] . ints;
+            s [ 2 ] = & col [ c ] . strs;
+            for ( i = 0; rc == 0 && i < 3; ++ i )
+            {
+                if ( out . size + s [ i ] -> size > dsize )
+                    rc = INSUFFICIENT ();
+                else if ( s [ i ] -> size != 0 )
+                {
+                    memmove ( out . buf + out . size, s [ i ] -> buf, s [ i ] -> size );
+                    out . size += s [ i ] -> size;
+                }
+            }
+        }
+        if ( rc == 0 )
+            * used = out . size;
+    }
+
+    for ( c = 0; c <= MAX_TOKENS; ++ c )
+        EncColumnWhack ( & col [ c ] );
+
+    return rc;
+}
+
+
+/*--------------------------------------------------------------------------
+ * DecColumn
+ *  token position being restored
+ */
+typedef struct DecColumn DecColumn;
+struct DecColumn
+{
+    const uint8_t *tags, *tags_end;
+    const uint8_t *ints, *ints_end;
+    const uint8_t *strs, *strs_end;
+
+    uint64_t run;
+    uint8_t tag;
+
+    /* the previous token, as it lies in the output */
+    uint8_t prev;
+    uint64_t val;
+    uint32_t off, len;
+
+    SpotNameRec *dict;
+    uint32_t ndict, dict_cap;
+};
+
+static
+rc_t get_vlen ( const uint8_t **p, const uint8_t *end, uint64_t *x )
+{
+    uint64_t n;
+
+    if ( * p >= end )
+        return CORRUPT ();
+    if ( ** p < 0x80 )
+    {
+        * x = * ( * p ) ++;
+        return 0;
+    }
+    if ( vlen_decodeU1 ( x, * p, end - * p, & n ) != 0 )
+        return CORRUPT ();
+    * p += n;
+    return 0;
+}
+
+static
+rc_t DecColumnNextTag ( DecColumn *self, uint8_t *tag )
+{
+    if ( self -> run == 0 )
+    {
+        rc_t rc;
+        if ( self -> tags >= self -> tags_end )
+            return CORRUPT ();
+        self -> tag = * self -> tags ++;
+        rc = get_vlen ( & self -> tags, self -> tags_end, & self -> run );
+        if ( rc != 0 )
+            return rc;
+        if ( self -> tag >= tagCount || self -> run == 0 )
+            return CORRUPT ();
+    }
+    -- self -> run;
+    * tag = self -> tag;
+    return 0;
+}
+
+/* print_number
+ *  write the decimal digits of "val" at "dst" if they fit before "end"
+ */
+static
+rc_t print_number ( char *dst, uint32_t *pos, uint32_t end, uint64_t val, uint32_t *len )
+{
+    char buf [ 20 ];
+    uint32_t n = sizeof buf;
+
+    do
+    {
+        buf [ -- n ] = ( char ) ( '0' + val % 10 );
+        val /= 10;
+    }
+    while ( val != 0 );
+
+    * len = sizeof buf - n;
+    if ( * len > end - * pos )
+        return CORRUPT ();
+    memmove ( dst + * pos, buf + n, * len );
+    * pos += * len;
+    return 0;
+}
+
+static
+rc_t copy_string ( char *dst, uint32_t *pos, uint32_t end, uint32_t off, uint32_t len )
+{
+    if ( len > end - * pos )
+        return CORRUPT ();
+    memmove ( dst + * pos, dst + off, len );
+    * pos += len;
+    return 0;
+}
+
+static
+rc_t DecColumnToken ( DecColumn *self, uint8_t tag, char *dst, uint32_t *pos, uint32_t end )
+{
+    uint32_t const start = * pos;
+    uint64_t x;
+    rc_t rc;
+
+    switch ( tag )
+    {
+    case tagDup:
+        if ( self -> prev == prevNum )
+            return print_number ( dst, pos, end, self -> val, & self -> len );
+        if ( self -> prev != prevStr )
+            return CORRUPT ();
+        rc = copy_string ( dst, pos, end, self -> off, self -> len );
+        break;
+
+    case tagDelta:
+        if ( self -> prev != prevNum )
+            return CORRUPT ();
+        rc = get_vlen ( & self -> ints, self -> ints_end, & x );
+        if ( rc != 0 )
+            return rc;
+        x = self -> val + ( ( x >> 1 ) ^ ( 0 - ( x & 1 ) ) );
+        if ( x > MAX_NUMBER )
+            return CORRUPT ();
+        self -> val = x;
+        return print_number ( dst, pos, end, x, & self -> len );
+
+    case tagNum:
+        rc = get_vlen ( & self -> ints, self -> ints_end, & x );
+        if ( rc != 0 )
+            return rc;
+        if ( x > MAX_NUMBER )
+            return CORRUPT ();
+        self -> prev = prevNum;
+        self -> val = x;
+        return print_number ( dst, pos, end, x, & self -> len );
+
+    case tagNew:
+        rc = get_vlen ( & self -> ints, self -> ints_end, & x );
+        if ( rc != 0 )
+            return rc;
+        if ( x > ( uint64_t ) ( self -> strs_end - self -> strs ) || x > end - start )
+            return CORRUPT ();
+        memmove ( dst + start, self -> strs, ( size_t ) x );
+        self -> strs += x;
+        * pos = start + ( uint32_t ) x;
+
+        if ( self -> ndict == self -> dict_cap )
+        {
+            uint32_t cap = self -> dict_cap != 0 ? self -> dict_cap * 2 : 64;
+            SpotNameRec *dict = realloc ( self -> dict, cap * sizeof * dict );
+            if ( dict == NULL )
+                return RC ( rcVDB, rcFunction, rcExecuting, rcMemory, rcExhausted );
+            self -> dict = dict;
+            self -> dict_cap = cap;
+        }
+        self -> dict [ self -> ndict ] . off = start;
+        self -> dict [ self -> ndict ++ ] . len = ( uint32_t ) x;
+        break;
+
+    case tagRef:
+        rc = get_vlen ( & self -> ints, self -> ints_end, & x );
+        if ( rc != 0 )
+            return rc;
+        if ( x >= self -> ndict )
+            return CORRUPT ();
+        rc = copy_string ( dst, pos, end, self -> dict [ x ] . off, self -> dict [ x ] . len );
+        break;
+
+    default:
+        return CORRUPT ();
+    }
+
+    if ( rc == 0 )
+    {
+        self -> prev = prevStr;
+        self -> off = start;
+        self -> len = * pos - start;
+    }
+    return rc;
+}
+
+rc_t SpotNameDecode ( char *dst, size_t dsize,
+    const SpotNameRec *recs, uint32_t nrecs, const void *Src, size_t ssize )
+{
+    DecColumn col [ MAX_TOKENS + 1 ];
+    const uint8_t *p = Src;
+    const uint8_t * const end = p + ssize;
+    uint64_t count, size [ 3 * ( MAX_TOKENS + 1 ) ];
+    uint32_t c, r, ncols;
+    rc_t rc;
+
+    /* header */
+    rc = get_vlen ( & p, end, & count );
+    if ( rc != 0 )
+        return rc;
+    if ( count != nrecs || p >= end )
+        return CORRUPT ();
+    ncols = * p ++;
+    if ( ncols == 0 || ncols > MAX_TOKENS + 1 )
+        return CORRUPT ();
+    for ( c = 0; c < 3 * ncols; ++ c )
+    {
+        rc = get_vlen ( & p, end, & size [ c ] );
+        if ( rc != 0 )
+            return rc;
+    }
+
+    memset ( col, 0, sizeof col );
+    for ( c = 0; c < ncols; ++ c )
+    {
+        const uint8_t ** const s [ 3 ] = { & col [ c ] . tags, & col [ c ] . ints, & col [ c ] . strs };
+        const uint8_t ** const e [ 3 ] = { & col [ c ] . tags_end, & col [ c ] . ints_end, & col [ c ] . strs_end };
+        uint32_t i;
+        for ( i = 0; i < 3; ++ i )
+        {
+            if ( size [ 3 * c + i ] > ( uint64_t ) ( end - p ) )
+                return CORRUPT ();
+            * s [ i ] = p;
+            p += size [ 3 * c + i ];
+            * e [ i ] = p;
+        }
+    }
+    if ( p != end )
+        return CORRUPT ();
+
+    for ( r = 0; rc == 0 && r < nrecs; ++ r )
+    {
+        uint32_t pos = recs [ r ] . off;
+        uint32_t const rec_end = pos + recs [ r ] . len;
+
+        if ( rec_end < pos || rec_end > dsize )
+            rc = CORRUPT ();
+
+        for ( c = 0; rc == 0; ++ c )
+        {
+            uint8_t tag;
+            if ( c == ncols )
+                rc = CORRUPT ();
+            else
+                rc = DecColumnNextTag ( & col [ c ], & tag );
+            if ( rc == 0 )
+            {
+                if ( tag == tagEnd )
+                    break;
+                rc = DecColumnToken ( & col [ c ], tag, dst, & pos, rec_end );
+            }
+        }
+
+        if ( rc == 0 && pos != rec_end )
+            rc = CORRUPT ();
+    }
+
+    /* every stream is used up */
+    for ( c = 0; c < ncols; ++ c )
+    {
+        if ( rc == 0 && ( col [ c ] . run != 0 ||
+                          col [ c ] . tags != col [ c ] . tags_end ||
+                          col [ c ] . ints != col [ c ] . ints_end ||
+                          col [ c ] . strs != col [ c ] . strs_end ) )
+        {
+            rc = CORRUPT ();
+        }
+        free ( col [ c ] . dict );
+    }
+
+    return rc;
+}
+
+
+/*--------------------------------------------------------------------------
+ * spot_name_encode, spot_name_decode
+ *  the codec applied to a blob of names, whose page map says where they lie
+ */
+
+/* collect_records
+ *  the blob's data records in row order, each once, which must lie
+ *  within the "bytes" of names
+ */
+static
+rc_t collect_records ( const VBlob *blob, uint64_t bytes, SpotNameRec **precs, uint32_t *nrecs )
+{
+    PageMapIterator it;
+    SpotNameRec *recs;
+    uint32_t n = 0;
+
+    rc_t rc = PageMapNewIterator ( blob -> pm, & it, 0, -1 );
+    if ( rc != 0 )
+        return ResetRCContext ( rc, rcVDB, rcFunction, rcExecuting );
+
+    recs = malloc ( ( size_t ) BlobRowCount ( blob ) * sizeof * recs );
+    if ( recs == NULL )
+        return RC ( rcVDB, rcFunction, rcExecuting, rcMemory, rcExhausted );
+
+    for ( ; ; )
+    {
+        elem_count_t const len = PageMapIteratorDataLength ( & it );
+        elem_count_t const off = PageMapIteratorDataOffset ( & it );
+        if ( ( uint64_t ) off + len > bytes )
+        {
+            free ( recs );
+            return RC ( rcVDB, rcFunction, rcExecuting, rcData, rcCorrupt );
+        }
+        if ( n == 0 || recs [ n - 1 ] . off != off || recs [ n - 1 ] . len != len )
+        {
+            recs [ n ] . off = off;
+            recs [ n ++ ] . len = len;
+        }
+        if ( ! PageMapIteratorAdvance ( & it, PageMapIteratorRepeatCount ( & it ) ) )
+            break;
+    }
+
+    * precs = recs;
+    * nrecs = n;
+    return 0;
+}
+
+static
+rc_t CC spot_name_encode_func ( void *self, const VXformInfo *info, int64_t row_id,
+    VBlob **rslt, uint32_t argc, const VBlob *argv [] )
+{
+    const VBlob *in = argv [ 0 ];
+    size_t const ssize = BlobBufferBytes ( in );
+    SpotNameRec *recs;
+    uint32_t nrecs;
+    VBlob *out;
+    rc_t rc;
+
+    if ( in -> data . elem_bits != 8 )
+        return RC ( rcVDB, rcFunction, rcExecuting, rcType, rcUnsupported );
+
+    rc = collect_records ( in, ssize, & recs, & nrecs );
+    if ( rc != 0 )
+        return rc;
+
+    rc = VBlobNew ( & out, in -> start_id, in -> stop_id, "spot_name_encode" );
+    if ( rc == 0 )
+    {
+        rc = BlobHeadersCreateChild ( in -> headers, & out -> headers );
+        if ( rc == 0 )
+        {
+            VBlobHeader *hdr = BlobHeadersGetHdrWrite ( out -> headers );
+            if ( hdr == NULL )
+                rc = RC ( rcVDB, rcFunction, rcExecuting, rcMemory, rcExhausted );
+            else
+            {
+                VBlobHeaderSetVersion ( hdr, 1 );
+                VBlobHeaderSetSourceSize ( hdr, ssize );
+
+                rc = KDataBufferMakeBytes ( & out -> data, ssize );
+                if ( rc == 0 )
+                {
+                    size_t used;
+                    rc = SpotNameEncode ( out -> data . base, ssize, & used, in -> data . base, recs, nrecs );
+                    if ( rc == 0 )
+                        out -> data . elem_count = used;
+                    else if ( GetRCObject ( rc ) == ( enum RCObject ) rcBuffer && GetRCState ( rc ) == rcInsufficient )
+                    {
+                        /* no smaller than the names themselves: keep those */
+                        VBlobHeaderSetFlags ( hdr, 1 );
+                        KDataBufferWhack ( & out -> data );
+                        rc = KDataBufferSub ( & in -> data, & out -> data, 0, UINT64_MAX );
+                    }
+                }
+                VBlobHeaderRelease ( hdr );
+            }
+        }
+
+        if ( rc == 0 )
+        {
+            /* the page map still describes the names, not the coded
+               data: it must not be applied to the data downstream */
+            out -> pm = in -> pm;
+            PageMapAddRef ( out -> pm );
+            out -> pm -> optimized = eBlobPageMapOptimizedFailed;
+            out -> byte_order = in -> byte_order;
+            * rslt = out;
+        }
+        else
+        {
+            VBlobRelease ( out );
+        }
+    }
+
+    free ( recs );
+    return rc;
+}
+
+static
+rc_t CC spot_name_decode_func ( void *self, const VXformInfo *info, int64_t row_id,
+    VBlob **rslt, uint32_t argc, const VBlob *argv [] )
+{
+    const VBlob *in = argv [ 0 ];
+    VBlobHeader *hdr;
+    VBlob *out;
+    rc_t rc;
+
+    if ( in -> headers == NULL )
+        return RC ( rcVDB, rcFunction, rcExecuting, rcData, rcCorrupt );
+    hdr = BlobHeadersGetHeader ( in -> headers );
+    if ( hdr == NULL )
+        return RC ( rcVDB, rcFunction, rcExecuting, rcMemory, rcExhausted );
+
+    if ( VBlobHeaderVersion ( hdr ) != 1 )
+        rc = RC ( rcVDB, rcFunction, rcExecuting, rcParam, rcBadVersion );
+    else
+        rc = VBlobNew ( & out, in -> start_id, in -> stop_id, "spot_name_decode" );
+    if ( rc == 0 )
+    {
+        /* later stages of decoding get the remaining headers */
+        out -> headers = ( BlobHeaders * ) BlobHeadersGetNextFrame ( in -> headers );
+        BlobHeadersAddRef ( out -> headers );
+
+        if ( ( VBlobHeaderFlags ( hdr ) & 1 ) != 0 )
+            rc = KDataBufferCast ( & in -> data, & out -> data, 8, true );
+        else
+        {
+            SpotNameRec *recs;
+            uint32_t nrecs;
+            rc = collect_records ( in, VBlobHeaderSourceSize ( hdr ), & recs, & nrecs );
+            if ( rc == 0 )
+            {
+                rc = KDataBufferMakeBytes ( & out -> data, VBlobHeaderSourceSize ( hdr ) );
+                if ( rc == 0 )
+                {
+                    rc = SpotNameDecode ( out -> data . base, KDataBufferBytes ( & out -> data ),
+                        recs, nrecs, in -> data . base, BlobBufferBytes ( in ) );
+                }
+                free ( recs );
+            }
+        }
+
+        if ( rc == 0 )
+        {
+            out -> pm = in -> pm;
+            PageMapAddRef ( out -> pm );
+            out -> byte_order = in -> byte_order;
+            * rslt = out;
+        }
+        else
+        {
+            VBlobRelease ( out );
+        }
+    }
+
+    VBlobHeaderRelease ( hdr );
+    return rc;
+}
+
+/* spot_name_encode
+ *  function INSDC:SRA:spot_name_fmt INSDC:SRA:spot_name_encode #1.0 ( ascii in );
+ */
+VTRANSFACT_BUILTIN_IMPL ( INSDC_SRA_spot_name_encode, 1, 0, 0 )
+    ( const void *self, const VXfactInfo *info, VFuncDesc *rslt,
+      const VFactoryParams *cp, const VFunctionParams *dp )
+{
+    VFUNCDESC_INTERNAL_FUNCS ( rslt ) -> bfN = spot_name_encode_func;
+    rslt -> variant = vftBlobN;
+    return 0;
+}
+
+/* spot_name_decode
+ *  function ascii INSDC:SRA:spot_name_decode #1.0 ( INSDC:SRA:spot_name_fmt in );
+ */
+VTRANSFACT_BUILTIN_IMPL ( INSDC_SRA_spot_name_decode, 1, 0, 0 )
+    ( const void *self, const VXfactInfo *info, VFuncDesc *rslt,
+      const VFactoryParams *cp, const VFunctionParams *dp )
+{
+    VFUNCDESC_INTERNAL_FUNCS ( rslt ) -> bfN = spot_name_decode_func;
+    rslt -> variant = vftBlobN;
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_spot_name_codec_
+#define _h_spot_name_codec_
+
+#ifndef _h_klib_defs_
+#include <klib/defs.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*--------------------------------------------------------------------------
+ * SpotName codec
+ *  columnar coding of spot names
+ *
+ *  each name is cut into tokens at every change between digits and
+ *  other characters. token position N of every name in a blob forms
+ *  column N, which is coded as a series of tags with their own
+ *  sub-streams:
+ *
+ *    end   - the name has no token at this position
+ *    dup   - same as the previous name's token at this position
+ *    delta - a number, as a zig-zag vlen difference from the previous one
+ *    num   - a number, as a vlen
+ *    new   - a string, as a vlen length then its bytes; added to the
+ *            column's dictionary
+ *    ref   - a string, as a vlen index into the column's dictionary
+ *
+ *  digit runs are numbers only when they print back identically, i.e.
+ *  without leading zeros and up to 18 digits; others are strings.
+ *  the tags of a column are run-length coded, so constant fields cost
+ *  a few bytes per blob.
+ *
+ *  format:
+ *   vlen count of records
+ *   U8   number of columns
+ *   per column: vlen size of tags, of numbers, of strings
+ *   per column: tags as ( U8 tag, vlen run length ) pairs,
+ *     then the numbers, then the strings
+ */
+
+/* SpotNameRec
+ *  where a name lies in its blob's data
+ */
+typedef struct SpotNameRec SpotNameRec;
+struct SpotNameRec
+{
+    uint32_t off;
+    uint32_t len;
+};
+
+/* SpotNameEncode
+ *  code the "nrecs" names described by "recs" from "src" into "dst"
+ *
+ *  returns rcBuffer, rcInsufficient when the result would not fit
+ *  into "dsize" bytes
+ */
+rc_t SpotNameEncode ( void *dst, size_t dsize, size_t *used,
+    const char *src, const SpotNameRec *recs, uint32_t nrecs );
+
+/* SpotNameDecode
+ *  restore the names described by "recs" into "dst"
+ */
+rc_t SpotNameDecode ( char *dst, size_t dsize,
+    const SpotNameRec *recs, uint32_t nrecs, const void *src, size_t ssize );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_spot_name_codec_ */
@@ -54,12 +54,16 @@ extern VTRANSFACT_DECL ( NCBI_align_stats_trigger );
 extern VTRANSFACT_DECL ( NCBI_seq_stats_trigger );
 #endif
 extern VTRANSFACT_DECL ( NCBI_refSeq_stats );
+extern VTRANSFACT_DECL ( INSDC_SRA_qual_rans_encode );
+extern VTRANSFACT_DECL ( INSDC_SRA_spot_name_encode );
 extern VTRANSFACT_DECL ( idx_text_insert );
+extern VTRANSFACT_DECL ( vdb_azip );
 extern VTRANSFACT_DECL ( vdb_bzip );
 extern VTRANSFACT_DECL ( vdb_checksum );
 extern VTRANSFACT_DECL ( vdb_fzip );
 extern VTRANSFACT_DECL ( vdb_rlencode );
 extern VTRANSFACT_DECL ( vdb_zip );
+extern VTRANSFACT_DECL ( vdb_zstd );
 
 /* InitFactories
  */
@@ -83,12 +87,16 @@ rc_t VLinkerInitFactories ( VLinker *self, struct KSymTable *tbl, struct SchemaE
         { NCBI_seq_stats_trigger, "NCBI:seq:stats_trigger" },
 #endif
         { NCBI_refSeq_stats, "NCBI:refSeq:stats" },
+        { INSDC_SRA_qual_rans_encode, "INSDC:SRA:qual_rans_encode" },
+        { INSDC_SRA_spot_name_encode, "INSDC:SRA:spot_name_encode" },
         { idx_text_insert, "idx:text:insert" },
+        { vdb_azip, "vdb:azip" },
         { vdb_bzip, "vdb:bzip" },
         { vdb_checksum, "vdb:checksum" },
         { vdb_fzip, "vdb:fzip" },
         { vdb_rlencode, "vdb:rlencode" },
-        { vdb_zip, "vdb:zip" }
+        { vdb_zip, "vdb:zip" },
+        { vdb_zstd, "vdb:zstd" }
     };
 
     rc_t rc = VLinkerInitFactoriesRead ( self, tbl, env );
@@ -0,0 +1,205 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <vdb/extern.h>
+#include <klib/defs.h>
+#include <klib/rc.h>
+#include <vdb/xform.h>
+#include <vdb/schema.h>
+#include <vdb/vdb-priv.h>
+#include <sysalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+#include <assert.h>
+
+#include "zstd-common.h"
+#include "azip-common.h"
+#include "raw-inflate.h"
+
+typedef struct self_t self_t;
+struct self_t
+{
+    atomic_ptr_t spare;
+};
+
+static
+rc_t invoke_inflate ( void *dst, size_t dsize, const void *src, size_t ssize )
+{
+    int zr;
+    rc_t rc = 0;
+    z_stream s;
+
+    size_t dused, sused;
+    if ( vxf_raw_inflate ( dst, dsize, & dused, src, ssize, & sused ) )
+        return 0;
+
+    memset ( & s, 0, sizeof s );
+    s . next_in = ( void * ) src;
+    s . avail_in = ( uInt ) ssize;
+    s . next_out = dst;
+    s . avail_out = ( uInt ) dsize;
+
+    zr = inflateInit2 ( & s, -15 );
+    switch ( zr )
+    {
+    case Z_OK:
+        break;
+    case Z_MEM_ERROR:
+        return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    default:
+        return RC ( rcXF, rcFunction, rcExecuting, rcNoObj, rcUnexpected );
+    }
+
+    zr = inflate ( & s, Z_FINISH );
+    switch ( zr )
+    {
+    case Z_STREAM_END:
+        break;
+    case Z_OK:
+    case Z_BUF_ERROR:
+        rc = RC ( rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient );
+        break;
+    case Z_MEM_ERROR:
+        rc = RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        break;
+    default:
+        rc = RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+        break;
+    }
+
+    inflateEnd ( & s );
+    return rc;
+}
+
+static
+rc_t invoke_zstd ( self_t *self, void *dst, size_t dsize, const void *src, size_t ssize )
+{
+    size_t zr;
+    ZSTD_DCtx *dctx = zstd_take_ctx ( & self -> spare );
+    if ( dctx == NULL )
+    {
+        dctx = ZSTD_createDCtx ();
+        if ( dctx == NULL )
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    }
+
+    zr = ZSTD_decompressDCtx ( dctx, dst, dsize, src, ssize );
+
+    if ( ! zstd_give_ctx ( & self -> spare, dctx ) )
+        ZSTD_freeDCtx ( dctx );
+
+    if ( ZSTD_isError ( zr ) )
+    {
+        switch ( ZSTD_getErrorCode ( zr ) )
+        {
+        case ZSTD_error_memory_allocation:
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        case ZSTD_error_dstSize_tooSmall:
+            return RC ( rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient );
+        default:
+            return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+        }
+    }
+
+    return 0;
+}
+
+static
+rc_t CC aunzip_func ( void *Self, const VXformInfo *info,
+    VBlobResult *dst, const VBlobData *src, VBlobHeader *hdr )
+{
+    rc_t rc;
+    uint8_t codec;
+    int64_t trailing;
+    size_t dsize, ssize;
+
+    if ( VBlobHeaderVersion ( hdr ) != 1 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcParam, rcBadVersion );
+
+    rc = VBlobHeaderOpPopHead ( hdr, & codec );
+    if ( rc == 0 )
+        rc = VBlobHeaderArgPopHead ( hdr, & trailing );
+    if ( rc != 0 )
+        return rc;
+    if ( trailing < 0 || trailing > 7 )
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+
+    dst -> elem_count *= dst -> elem_bits;
+    dst -> byte_order = src -> byte_order;
+    dst -> elem_bits = 1;
+
+    dsize = ( size_t ) ( ( dst -> elem_count + 7 ) >> 3 );
+    ssize = ( size_t ) ( ( src -> elem_count * src -> elem_bits + 7 ) >> 3 );
+
+    switch ( codec )
+    {
+    case azipDeflate:
+        rc = invoke_inflate ( dst -> data, dsize, src -> data, ssize );
+        break;
+    case azipZstd:
+        rc = invoke_zstd ( Self, dst -> data, dsize, src -> data, ssize );
+        break;
+    default:
+        return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+    }
+
+    /* if the original source was not byte aligned,
+       back off the rounded up byte and add in the original bit count */
+    if ( rc == 0 && trailing != 0 )
+        dst -> elem_count -= 8 - trailing;
+
+    return rc;
+}
+
+static
+void CC vxf_aunzip_wrapper ( void *ptr )
+{
+    self_t *self = ptr;
+    ZSTD_freeDCtx ( self -> spare . ptr );
+    free ( self );
+}
+
+/* aunzip
+ *  function any aunzip #1.0 ( azip_fmt in );
+ */
+VTRANSFACT_IMPL ( vdb_aunzip, 1, 0, 0 ) ( const void *Self, const VXfactInfo *info,
+    VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
+{
+    self_t *self = calloc ( 1, sizeof * self );
+    if ( self == NULL )
+        return RC ( rcXF, rcFunction, rcConstructing, rcMemory, rcExhausted );
+
+    rslt -> self = self;
+    rslt -> whack = vxf_aunzip_wrapper;
+    rslt -> variant = vftBlob;
+    rslt -> u . bf = aunzip_func;
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_vxf_azip_common_
+#define _h_vxf_azip_common_
+
+/*--------------------------------------------------------------------------
+ * azip
+ *  the blob header of an azip blob has version 1, one op naming the
+ *  codec that won and one arg with the count of trailing bits of the
+ *  source, as zip and zstd keep it in their version 2 headers.
+ *  blobs that were best left as they are carry no header of their own;
+ *  they are stored raw by the usual header flag.
+ */
+enum
+{
+    azipDeflate = 1,
+    azipZstd
+};
+
+#endif /* _h_vxf_azip_common_ */
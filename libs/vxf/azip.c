@@ -0,0 +1,436 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <vdb/extern.h>
+#include <klib/defs.h>
+#include <klib/rc.h>
+#include <vdb/xform.h>
+#include <vdb/schema.h>
+#include <sysalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+#include <assert.h>
+
+#include "zstd-common.h"
+#include "azip-common.h"
+
+/* candidates, in the bit order of the schema's AZIP_* constants */
+enum
+{
+    candRaw,
+    candZstdFast,
+    candZstd,
+    candDeflateRLE,
+    candDeflate,
+
+    candCount
+};
+
+#define CAND_ALL ( ( 1U << candCount ) - 1 )
+
+typedef struct candidate_t candidate_t;
+struct candidate_t
+{
+    uint8_t codec;
+
+    /* relative decode cost: raw < zstd < inflate */
+    uint8_t cost;
+
+    int32_t strategy;
+    int32_t level;
+};
+
+static candidate_t const candidates [ candCount ] =
+{
+    { 0, 0, 0, 0 },
+    { azipZstd, 1, 0, 1 },
+    { azipZstd, 1, 0, 9 },
+    { azipDeflate, 2, Z_RLE, Z_BEST_SPEED },
+    { azipDeflate, 2, Z_DEFAULT_STRATEGY, Z_DEFAULT_COMPRESSION }
+};
+
+typedef struct self_t self_t;
+struct self_t
+{
+    atomic_ptr_t spare;
+    uint32_t cands;
+    uint32_t tolerance;
+    uint32_t sample;
+};
+
+static
+rc_t invoke_zlib ( void *dst, uint32_t *dsize, const void *src, uint32_t ssize, int32_t strategy, int32_t level )
+{
+    z_stream s;
+    int zr;
+    rc_t rc = 0;
+
+    memset ( & s, 0, sizeof s );
+    s . next_in = ( void * ) src;
+    s . avail_in = ssize;
+    s . next_out = dst;
+    s . avail_out = * dsize;
+
+    * dsize = 0;
+    zr = deflateInit2 ( & s, level, Z_DEFLATED, -15, 9, strategy );
+    switch ( zr )
+    {
+    case Z_OK:
+        break;
+    case Z_MEM_ERROR:
+        return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    default:
+        return RC ( rcXF, rcFunction, rcExecuting, rcSelf, rcUnexpected );
+    }
+
+    zr = deflate ( & s, Z_FINISH );
+    switch ( zr )
+    {
+    case Z_STREAM_END:
+        assert ( s . total_out <= UINT32_MAX );
+        * dsize = ( uint32_t ) s . total_out;
+        break;
+    case Z_OK:
+    case Z_BUF_ERROR:
+        rc = RC ( rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient );
+        break;
+    default:
+        rc = RC ( rcXF, rcFunction, rcExecuting, rcSelf, rcUnexpected );
+        break;
+    }
+
+    deflateEnd ( & s );
+    return rc;
+}
+
+static
+rc_t invoke_zstd ( self_t *self, void *dst, uint32_t *dsize, const void *src, uint32_t ssize, int32_t level )
+{
+    size_t zr;
+    ZSTD_CCtx *cctx = zstd_take_ctx ( & self -> spare );
+    if ( cctx == NULL )
+    {
+        cctx = ZSTD_createCCtx ();
+        if ( cctx == NULL )
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    }
+
+    zr = ZSTD_compressCCtx ( cctx, dst, * dsize, src, ssize, level );
+
+    if ( ! zstd_give_ctx ( & self -> spare, cctx ) )
+        ZSTD_freeCCtx ( cctx );
+
+    * dsize = 0;
+    if ( ZSTD_isError ( zr ) )
+    {
+        switch ( ZSTD_getErrorCode ( zr ) )
+        {
+        case ZSTD_error_dstSize_tooSmall:
+            return RC ( rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient );
+        case ZSTD_error_memory_allocation:
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        default:
+            return RC ( rcXF, rcFunction, rcExecuting, rcSelf, rcUnexpected );
+        }
+    }
+
+    assert ( zr <= UINT32_MAX );
+    * dsize = ( uint32_t ) zr;
+    return 0;
+}
+
+/* try
+ *  code "src" with candidate "c" into "dst"
+ *  a result that does not fit into "dsize" is not an error,
+ *  it just leaves "dsize" at 0
+ */
+static
+rc_t try_candidate ( self_t *self, uint32_t c,
+    void *dst, uint32_t *dsize, const void *src, uint32_t ssize )
+{
+    rc_t rc;
+    candidate_t const *cand = & candidates [ c ];
+
+    if ( cand -> codec == azipZstd )
+        rc = invoke_zstd ( self, dst, dsize, src, ssize, cand -> level );
+    else
+        rc = invoke_zlib ( dst, dsize, src, ssize, cand -> strategy, cand -> level );
+
+    if ( GetRCObject ( rc ) == ( enum RCObject ) rcBuffer && GetRCState ( rc ) == rcInsufficient )
+    {
+        * dsize = 0;
+        rc = 0;
+    }
+    return rc;
+}
+
+/* choose
+ *  the winner is the candidate of least decode cost whose size is
+ *  within "tolerance" percent of the smallest; equal cost goes to size
+ */
+static
+uint32_t choose ( const self_t *self, const uint64_t size [ candCount ] )
+{
+    uint32_t c, win = candCount;
+    uint64_t best = UINT64_MAX;
+
+    for ( c = 0; c < candCount; ++ c )
+    {
+        if ( size [ c ] != 0 && size [ c ] < best )
+            best = size [ c ];
+    }
+
+    for ( c = 0; c < candCount; ++ c )
+    {
+        if ( size [ c ] == 0 || size [ c ] * 100 > best * ( 100 + self -> tolerance ) )
+            continue;
+        if ( win == candCount ||
+             candidates [ c ] . cost < candidates [ win ] . cost ||
+             ( candidates [ c ] . cost == candidates [ win ] . cost && size [ c ] < size [ win ] ) )
+        {
+            win = c;
+        }
+    }
+
+    return win;
+}
+
+/* azip_sampled
+ *  rank the candidates on the head of the blob,
+ *  then code all of it with the winner only
+ */
+static
+rc_t azip_sampled ( self_t *self, void *dst, uint32_t *dsize,
+    const void *src, uint32_t ssize, uint32_t *win )
+{
+    rc_t rc = 0;
+    uint32_t c;
+    uint64_t size [ candCount ];
+    uint32_t const sample = self -> sample;
+
+    void *scratch = malloc ( sample );
+    if ( scratch == NULL )
+        return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+
+    for ( c = 0; c < candCount; ++ c )
+    {
+        size [ c ] = 0;
+        if ( ( self -> cands & ( 1U << c ) ) == 0 )
+            continue;
+        if ( c == candRaw )
+            size [ c ] = sample;
+        else
+        {
+            uint32_t used = sample;
+            rc = try_candidate ( self, c, scratch, & used, src, sample );
+            if ( rc != 0 )
+                break;
+            size [ c ] = used;
+        }
+    }
+    free ( scratch );
+
+    if ( rc == 0 )
+    {
+        * win = choose ( self, size );
+        if ( * win != candCount && * win != candRaw )
+            rc = try_candidate ( self, * win, dst, dsize, src, ssize );
+    }
+    return rc;
+}
+
+/* azip_full
+ *  code the whole blob with every candidate, keeping the smallest
+ *  result of each decode cost ( raw needs no buffer )
+ */
+static
+rc_t azip_full ( self_t *self, void *dst, uint32_t *dsize,
+    const void *src, uint32_t ssize, uint32_t *win )
+{
+    rc_t rc = 0;
+    uint32_t c;
+    uint64_t size [ candCount ];
+    uint8_t *keep [ 3 ] = { NULL, NULL, NULL };
+    uint32_t const cap = * dsize;
+
+    /* one buffer per cost class beyond raw, plus one to try into */
+    uint8_t *scratch, *mem = malloc ( ( size_t ) cap * 3 );
+    if ( mem == NULL )
+        return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    scratch = mem;
+    keep [ 1 ] = mem + cap;
+    keep [ 2 ] = mem + ( size_t ) cap * 2;
+
+    for ( c = 0; c < candCount; ++ c )
+    {
+        uint32_t used;
+        uint8_t cost;
+
+        size [ c ] = 0;
+        if ( ( self -> cands & ( 1U << c ) ) == 0 )
+            continue;
+        if ( c == candRaw )
+        {
+            size [ c ] = ssize;
+            continue;
+        }
+
+        used = cap;
+        rc = try_candidate ( self, c, scratch, & used, src, ssize );
+        if ( rc != 0 )
+            break;
+        size [ c ] = used;
+
+        /* keep it if it is the smallest of its cost so far */
+        cost = candidates [ c ] . cost;
+        if ( used != 0 )
+        {
+            uint32_t i;
+            bool smallest = true;
+            for ( i = 0; i < c; ++ i )
+            {
+                if ( candidates [ i ] . cost == cost && size [ i ] != 0 && size [ i ] <= used )
+                    smallest = false;
+            }
+            if ( smallest )
+            {
+                uint8_t *tmp = keep [ cost ];
+                keep [ cost ] = scratch;
+                scratch = tmp;
+            }
+        }
+    }
+
+    if ( rc == 0 )
+    {
+        * win = choose ( self, size );
+        if ( * win != candCount && * win != candRaw )
+        {
+            * dsize = ( uint32_t ) size [ * win ];
+            memmove ( dst, keep [ candidates [ * win ] . cost ], * dsize );
+        }
+    }
+
+    free ( mem );
+    return rc;
+}
+
+static
+rc_t CC azip_func ( void *Self, const VXformInfo *info,
+    VBlobResult *dst, const VBlobData *src, VBlobHeader *hdr )
+{
+    rc_t rc;
+    self_t *self = Self;
+    uint32_t win = candCount;
+
+    /* input bits */
+    uint64_t sbits = ( uint64_t ) src -> elem_count * src -> elem_bits;
+
+    /* input bytes */
+    uint32_t ssize = ( uint32_t ) ( ( sbits + 7 ) >> 3 );
+
+    /* available output size */
+    uint32_t dsize = ( uint32_t ) ( ( ( size_t ) dst -> elem_count * dst -> elem_bits + 7 ) >> 3 );
+
+    if ( self -> sample != 0 && ssize > self -> sample )
+        rc = azip_sampled ( self, dst -> data, & dsize, src -> data, ssize, & win );
+    else
+        rc = azip_full ( self, dst -> data, & dsize, src -> data, ssize, & win );
+
+    if ( rc == 0 )
+    {
+        /* raw wins, or nothing fit: the caller stores the blob as-is */
+        if ( win == candCount || win == candRaw || dsize == 0 )
+            return RC ( rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient );
+
+        VBlobHeaderSetVersion ( hdr, 1 );
+        rc = VBlobHeaderOpPushTail ( hdr, candidates [ win ] . codec );
+        if ( rc == 0 )
+            rc = VBlobHeaderArgPushTail ( hdr, ( int64_t ) ( sbits & 7 ) );
+        if ( rc == 0 )
+        {
+            dst -> elem_bits = 1;
+            dst -> byte_order = src -> byte_order;
+            dst -> elem_count = ( uint64_t ) dsize << 3;
+        }
+    }
+    return rc;
+}
+
+static
+void CC vxf_azip_wrapper ( void *ptr )
+{
+    self_t *self = ptr;
+    ZSTD_freeCCtx ( self -> spare . ptr );
+    free ( self );
+}
+
+/* azip
+ *  function azip_fmt azip #1.0 < * U32 candidates, U32 tolerance, U32 sample > ( any in );
+ */
+VTRANSFACT_IMPL ( vdb_azip, 1, 0, 0 ) ( const void *Self, const VXfactInfo *info,
+    VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
+{
+    self_t *self;
+
+    uint32_t cands = CAND_ALL;
+    uint32_t tolerance = 0;
+    uint32_t sample = 0;
+
+    if ( cp -> argc > 0 )
+    {
+        cands = cp -> argv [ 0 ] . data . u32 [ 0 ];
+        if ( cands == 0 || ( cands & ~ CAND_ALL ) != 0 )
+            return RC ( rcXF, rcFunction, rcConstructing, rcParam, rcInvalid );
+        if ( cp -> argc > 1 )
+        {
+            tolerance = cp -> argv [ 1 ] . data . u32 [ 0 ];
+            if ( tolerance > 1000 )
+                return RC ( rcXF, rcFunction, rcConstructing, rcRange, rcInvalid );
+            if ( cp -> argc > 2 )
+                sample = cp -> argv [ 2 ] . data . u32 [ 0 ];
+        }
+    }
+
+    self = calloc ( 1, sizeof * self );
+    if ( self == NULL )
+        return RC ( rcXF, rcFunction, rcConstructing, rcMemory, rcExhausted );
+
+    self -> cands = cands;
+    self -> tolerance = tolerance;
+    self -> sample = sample;
+
+    rslt -> self = self;
+    rslt -> whack = vxf_azip_wrapper;
+    rslt -> variant = vftBlob;
+    rslt -> u . bf = azip_func;
+    return 0;
+}
@@ -39,11 +39,18 @@
 
 #define DECODING 1
 #include "fsplit-join.impl.h"
+#include "raw-inflate.h"
 
 static rc_t invoke_zlib(void *dst, uint32_t dsize, uint32_t *psize, const void *src, uint32_t ssize) {
     z_stream s;
     int zr;
     rc_t rc;
+    size_t dused, sused;
+    
+    if (vxf_raw_inflate(dst, dsize, &dused, src, ssize, &sused)) {
+        *psize = (uint32_t)dused;
+        return 0;
+    }
     
     memset(&s, 0, sizeof(s));
     s.next_in = (void *)src;
@@ -33,31 +33,28 @@
 #include <assert.h>
 #include <string.h>
 
+#include "prefix-sum.h"
+
 
 #define INTEGRAL_NAME( T )  integral_ ## T
-#define INTEGRAL( T )                                                    \
+#define INTEGRAL( T, SUM )                                               \
 static                                                                   \
 rc_t CC INTEGRAL_NAME ( T ) ( void *data,                                \
     const VXformInfo *info, int64_t row_id, const VFixedRowResult *rslt, \
     uint32_t argc, const VRowData argv [] )                              \
 {                                                                        \
-    uint32_t i;                                                          \
-    T prior, * dst = rslt -> base;                                       \
+    T * dst = rslt -> base;                                              \
     const T * src = argv [ 0 ] . u . data . base;                        \
-    dst += rslt -> first_elem;						                     \
-    src += argv [ 0 ] . u . data . first_elem;				             \
-    for ( prior = 0, i = 0; i < rslt -> elem_count; ++ i )               \
-    {                                                                    \
-        dst [ i ] = prior;                                               \
-        prior += src [ i ];                                              \
-    }                                                                    \
+    dst += rslt -> first_elem;                                           \
+    src += argv [ 0 ] . u . data . first_elem;                           \
+    SUM ( dst, src, rslt -> elem_count, true );                          \
     return 0;                                                            \
 }
 
-INTEGRAL ( int8_t )
-INTEGRAL ( int16_t )
-INTEGRAL ( int32_t )
-INTEGRAL ( int64_t )
+INTEGRAL ( int8_t, vxf_prefix_sum_i8 )
+INTEGRAL ( int16_t, vxf_prefix_sum_i16 )
+INTEGRAL ( int32_t, vxf_prefix_sum_i32 )
+INTEGRAL ( int64_t, vxf_prefix_sum_i64 )
 
 static VFixedRowFunc integral0_func [] =
 {
@@ -47,6 +47,10 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include "raw-inflate.h"
+#include "prefix-sum.h"
+#include "izip-vec.h"
+
 typedef struct {
     size_t size;
     size_t used;
@@ -101,6 +105,11 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
     z_stream s;
     int zr;
     rc_t rc;
+    size_t dused;
+    
+    /* reports input consumed, as zlib's total_in */
+    if (vxf_raw_inflate(dst, dsize, &dused, src, ssize, psize))
+        return 0;
     
     memset(&s, 0, sizeof(s));
     s.next_in = (void *)src;
@@ -146,9 +155,11 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
 #define USTYPE uint8_t
 #define ENCODE encode_i8
 #define DECODE decode_i8
+#define PREFIX_SUM(Y, N) vxf_prefix_sum_i8((int8_t *)(Y), (const int8_t *)(Y), (N), false)
 #include "irzip.impl.h"
 #undef ENCODE
 #undef DECODE
+#undef PREFIX_SUM
 #undef STYPE
 #undef USTYPE
 
@@ -156,9 +167,11 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
 #define USTYPE uint16_t
 #define ENCODE encode_i16
 #define DECODE decode_i16
+#define PREFIX_SUM(Y, N) vxf_prefix_sum_i16((int16_t *)(Y), (const int16_t *)(Y), (N), false)
 #include "irzip.impl.h"
 #undef ENCODE
 #undef DECODE
+#undef PREFIX_SUM
 #undef STYPE
 #undef USTYPE
 
@@ -166,11 +179,13 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
 #define USTYPE uint32_t
 #define ENCODE encode_i32
 #define DECODE decode_i32
+#define PREFIX_SUM(Y, N) vxf_prefix_sum_i32((int32_t *)(Y), (const int32_t *)(Y), (N), false)
 #define TRY2SERIES 1
 #include "irzip.impl.h"
 #undef TRY2SERIES
 #undef ENCODE
 #undef DECODE
+#undef PREFIX_SUM
 #undef STYPE
 #undef USTYPE
 
@@ -178,11 +193,13 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
 #define USTYPE uint64_t
 #define ENCODE encode_i64
 #define DECODE decode_i64
+#define PREFIX_SUM(Y, N) vxf_prefix_sum_i64((int64_t *)(Y), (const int64_t *)(Y), (N), false)
 #define TRY2SERIES 1
 #include "irzip.impl.h"
 #undef TRY2SERIES
 #undef ENCODE
 #undef DECODE
+#undef PREFIX_SUM
 #undef STYPE
 #undef USTYPE
 
@@ -190,9 +207,11 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
 #define USTYPE uint8_t
 #define ENCODE encode_u8
 #define DECODE decode_u8
+#define PREFIX_SUM(Y, N) vxf_prefix_sum_i8((int8_t *)(Y), (const int8_t *)(Y), (N), false)
 #include "irzip.impl.h"
 #undef ENCODE
 #undef DECODE
+#undef PREFIX_SUM
 #undef STYPE
 #undef USTYPE
 
@@ -200,9 +219,11 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
 #define USTYPE uint16_t
 #define ENCODE encode_u16
 #define DECODE decode_u16
+#define PREFIX_SUM(Y, N) vxf_prefix_sum_i16((int16_t *)(Y), (const int16_t *)(Y), (N), false)
 #include "irzip.impl.h"
 #undef ENCODE
 #undef DECODE
+#undef PREFIX_SUM
 #undef STYPE
 #undef USTYPE
 
@@ -210,11 +231,13 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
 #define USTYPE uint32_t
 #define ENCODE encode_u32
 #define DECODE decode_u32
+#define PREFIX_SUM(Y, N) vxf_prefix_sum_i32((int32_t *)(Y), (const int32_t *)(Y), (N), false)
 #define TRY2SERIES 1
 #include "irzip.impl.h"
 #undef TRY2SERIES
 #undef ENCODE
 #undef DECODE
+#undef PREFIX_SUM
 #undef STYPE
 #undef USTYPE
 
@@ -222,11 +245,13 @@ static rc_t zlib_decompress(void *dst, size_t dsize, size_t *psize, const void *
 #define USTYPE uint64_t
 #define ENCODE encode_u64
 #define DECODE decode_u64
+#define PREFIX_SUM(Y, N) vxf_prefix_sum_i64((int64_t *)(Y), (const int64_t *)(Y), (N), false)
 #define TRY2SERIES 1
 #include "irzip.impl.h"
 #undef TRY2SERIES
 #undef ENCODE
 #undef DECODE
+#undef PREFIX_SUM
 #undef STYPE
 #undef USTYPE
 
@@ -320,27 +320,35 @@ static rc_t DECODE(STYPE Y[], unsigned N, int64_t* min, int64_t* slope, uint8_t
     unsigned i;
     uint8_t *scratch=NULL;
     rc_t rc=0;
-    bool    first;
+    unsigned present;
 
-    memset(Y, 0, sizeof(Y[0]) * N);
-    for (j = k = 0, m = 1,first=true; m < 0x100; m <<= 1, k += 8) {
+    /* each byte plane is inflated into its own row of scratch and the
+     * rows are interleaved in one pass; planes beyond the width of STYPE
+     * carry nothing and go to a spare row */
+    scratch = malloc((size_t)N * (sizeof(Y[0]) + 1));
+    if (scratch == NULL)
+        return RC(rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted);
+    for (j = k = 0, m = 1, present = 0; m < 0x100; m <<= 1, k += 8) {
         size_t n;
+        unsigned const row = k / 8 < sizeof(Y[0]) ? k / 8 : sizeof(Y[0]);
         
         if ((planes & m) == 0)
             continue;
         
         n = 0;
-	if( !scratch ) scratch = malloc(N);
-	
-        rc = zlib_decompress(scratch, N, &n, src + j, ssize - j);
+        rc = zlib_decompress(scratch + (size_t)row * N, N, &n, src + j, ssize - j);
         if (rc) goto DONE;
         j += n;
-	if(first){
-		for (i = 0; i != N; ++i) Y[i] = ((STYPE)scratch[i]) << k;
-		first = false;
-	} else {
-		for (i = 0; i != N; ++i) Y[i] |= ((STYPE)scratch[i]) << k;
-	}
+        present |= m;
+    }
+    if (present == 0)
+        memset(Y, 0, sizeof(Y[0]) * N);
+    else {
+        for (k = 0; k != sizeof(Y[0]); ++k) {
+            if ((present & (1u << k)) == 0)
+                memset(scratch + (size_t)k * N, 0, N);
+        }
+        vxf_izip_merge_planes(Y, sizeof(Y[0]), scratch, N);
     }
     if(series_count == 2){
 #if 0 /** trying to unroll ***/
@@ -447,24 +455,25 @@ static rc_t DECODE(STYPE Y[], unsigned N, int64_t* min, int64_t* slope, uint8_t
     } else if(slope[0] == DELTA_POS){
 	assert(Y[0] == 0);
 	Y[0] = (STYPE)min[0];
-	for (i = 1; i != N; ++i){
-		Y[i] = Y[i-1] + Y[i];
-	}
+	PREFIX_SUM(Y, N);
     } else if (slope[0] == DELTA_NEG ) {
 	assert(Y[0] == 0);
 	Y[0] = (STYPE)min[0];
 	for (i = 1; i != N; ++i){
-		Y[i] =  Y[i-1] - Y[i];
+		Y[i] = (STYPE)( 0 - (USTYPE)Y[i] );
 	}
+	PREFIX_SUM(Y, N);
     } else if (slope[0] == DELTA_BOTH){
 	assert(Y[0] == 0);
 	Y[0] = (STYPE)min[0];
+	/* the low bit is the sign of the delta: negate without a branch */
 	for (i = 1; i != N; ++i){
+		USTYPE const neg = (USTYPE)0 - ((USTYPE)Y[i] & 1);
 		USTYPE val = (USTYPE)Y[i];
 		val >>= 1;
-		if(Y[i] & 1) Y[i] = Y[i-1] - val;
-		else         Y[i] = Y[i-1] + val;
+		Y[i] = (STYPE)( (val ^ neg) - neg );
 	}
+	PREFIX_SUM(Y, N);
     } else if(slope[0] == 0) {
 	for (i = 0; i != N; ++i){
 		Y[i]  += (STYPE)min[0];
@@ -44,6 +44,8 @@
 #include <assert.h>
 
 #include "izip-common.h"
+#include "raw-inflate.h"
+#include "izip-vec.h"
 
 static void unpack_nbuf16_swap(nbuf *x) {
     unsigned i;
@@ -61,42 +63,18 @@ static void unpack_nbuf32_swap(nbuf *x) {
     }
 }
 
-static void unpack_nbuf8(nbuf *x) {
-    unsigned i;
-    
-    for (i = x->used; i; --i) {
-        x->data.raw[i - 1] = x->data.u8[i - 1] + x->min;
-    }
-}
-
-static void unpack_nbuf16(nbuf *x) {
-    unsigned i;
-    
-    for (i = x->used; i; --i) {
-        x->data.raw[i - 1] = x->data.u16[i - 1] + x->min;
-    }
-}
-
-static void unpack_nbuf32(nbuf *x) {
-    unsigned i;
-    
-    for (i = x->used; i; --i) {
-        x->data.raw[i - 1] = x->data.u32[i - 1] + x->min;
-    }
-}
-
 static void unpack_nbuf(nbuf *x) {
     unsigned i;
     
     switch (x->var) {
     case 4:
-        unpack_nbuf8(x);
+        vxf_izip_widen_u8(x->data.raw, x->used, x->min);
         break;
     case 3:
-        unpack_nbuf16(x);
+        vxf_izip_widen_u16(x->data.raw, x->used, x->min);
         break;
     case 2:
-        unpack_nbuf32(x);
+        vxf_izip_widen_u32(x->data.raw, x->used, x->min);
         break;
     default:
         for (i = x->used; i; --i) {
@@ -112,7 +90,7 @@ static void unpack_nbuf_swap(nbuf *x) {
     
     switch (x->var) {
     case 4:
-        unpack_nbuf8(x);
+        vxf_izip_widen_u8(x->data.raw, x->used, x->min);
         break;
     case 3:
         unpack_nbuf16_swap(x);
@@ -135,6 +113,12 @@ static rc_t zlib_decompress(void *dst, unsigned dsize, unsigned *psize, const vo
     z_stream s;
     int zr;
     rc_t rc = 0;
+    size_t dused, sused;
+    
+    if (vxf_raw_inflate(dst, dsize, &dused, src, ssize, &sused)) {
+        *psize = (unsigned)dused;
+        return 0;
+    }
     
     memset(&s, 0, sizeof(s));
     s.next_in = (void *)src;
@@ -0,0 +1,222 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "izip-vec.h"
+
+#include <string.h>
+#include <endian.h>
+
+/*--------------------------------------------------------------------------
+ * izip decoding kernels
+ *  the residual planes of izip and irzip come out of zlib as narrow
+ *  integers or as separate bytes; these put them back together sixteen
+ *  or eight elements at a time.
+ *
+ *  SSE2 is always present on x86_64; every call finishes with the
+ *  scalar loop, which is also all there is elsewhere.
+ */
+#if defined __GNUC__ && defined __x86_64__ && __BYTE_ORDER == __LITTLE_ENDIAN
+#define IZIP_VEC 1
+#include <emmintrin.h>
+#endif
+
+#if IZIP_VEC
+/* zero extends the two 32 bit halves of "d" to four 64 bit values
+   plus "vmin" and stores them at "dst" */
+#define WIDEN_STORE32( dst, d, zero, vmin )                                         \
+    _mm_storeu_si128 ( ( __m128i* ) ( dst ),                                        \
+        _mm_add_epi64 ( _mm_unpacklo_epi32 ( d, zero ), vmin ) );                   \
+    _mm_storeu_si128 ( ( __m128i* ) ( dst ) + 1,                                    \
+        _mm_add_epi64 ( _mm_unpackhi_epi32 ( d, zero ), vmin ) )
+#endif
+
+/* every loop runs back to front: the unread narrow elements are always
+   below the 64 bit ones being written */
+void vxf_izip_widen_u8 ( void *buf, unsigned count, int64_t min )
+{
+    const uint8_t *src = buf;
+    int64_t *dst = buf;
+    unsigned i = count;
+#if IZIP_VEC
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i vmin = _mm_set1_epi64x ( min );
+    while ( i >= 16 )
+    {
+        __m128i b, w0, w1;
+        i -= 16;
+        b = _mm_loadu_si128 ( ( const __m128i* ) ( src + i ) );
+        w0 = _mm_unpacklo_epi8 ( b, zero );
+        w1 = _mm_unpackhi_epi8 ( b, zero );
+        WIDEN_STORE32 ( dst + i + 12, _mm_unpackhi_epi16 ( w1, zero ), zero, vmin );
+        WIDEN_STORE32 ( dst + i + 8, _mm_unpacklo_epi16 ( w1, zero ), zero, vmin );
+        WIDEN_STORE32 ( dst + i + 4, _mm_unpackhi_epi16 ( w0, zero ), zero, vmin );
+        WIDEN_STORE32 ( dst + i, _mm_unpacklo_epi16 ( w0, zero ), zero, vmin );
+    }
+#endif
+    for ( ; i; -- i )
+        dst [ i - 1 ] = src [ i - 1 ] + min;
+}
+
+void vxf_izip_widen_u16 ( void *buf, unsigned count, int64_t min )
+{
+    const uint16_t *src = buf;
+    int64_t *dst = buf;
+    unsigned i = count;
+#if IZIP_VEC
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i vmin = _mm_set1_epi64x ( min );
+    while ( i >= 8 )
+    {
+        __m128i w;
+        i -= 8;
+        w = _mm_loadu_si128 ( ( const __m128i* ) ( src + i ) );
+        WIDEN_STORE32 ( dst + i + 4, _mm_unpackhi_epi16 ( w, zero ), zero, vmin );
+        WIDEN_STORE32 ( dst + i, _mm_unpacklo_epi16 ( w, zero ), zero, vmin );
+    }
+#endif
+    for ( ; i; -- i )
+        dst [ i - 1 ] = src [ i - 1 ] + min;
+}
+
+void vxf_izip_widen_u32 ( void *buf, unsigned count, int64_t min )
+{
+    const uint32_t *src = buf;
+    int64_t *dst = buf;
+    unsigned i = count;
+#if IZIP_VEC
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i vmin = _mm_set1_epi64x ( min );
+    while ( i >= 8 )
+    {
+        __m128i d0, d1;
+        i -= 8;
+        d0 = _mm_loadu_si128 ( ( const __m128i* ) ( src + i ) );
+        d1 = _mm_loadu_si128 ( ( const __m128i* ) ( src + i + 4 ) );
+        WIDEN_STORE32 ( dst + i + 4, d1, zero, vmin );
+        WIDEN_STORE32 ( dst + i, d0, zero, vmin );
+    }
+#endif
+    for ( ; i; -- i )
+        dst [ i - 1 ] = src [ i - 1 ] + min;
+}
+
+void vxf_izip_merge_planes ( void *dst, unsigned width, const uint8_t *planes, unsigned count )
+{
+    const uint8_t *p0 = planes;
+    const uint8_t *p1 = p0 + count;
+    const uint8_t *p2 = p1 + count;
+    const uint8_t *p3 = p2 + count;
+    unsigned i = 0;
+
+    switch ( width )
+    {
+    case 1:
+        memmove ( dst, planes, count );
+        break;
+    case 2:
+    {
+        uint16_t *y = dst;
+#if IZIP_VEC
+        for ( ; i + 16 <= count; i += 16 )
+        {
+            __m128i a = _mm_loadu_si128 ( ( const __m128i* ) ( p0 + i ) );
+            __m128i b = _mm_loadu_si128 ( ( const __m128i* ) ( p1 + i ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i ), _mm_unpacklo_epi8 ( a, b ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 8 ), _mm_unpackhi_epi8 ( a, b ) );
+        }
+#endif
+        for ( ; i < count; ++ i )
+            y [ i ] = ( uint16_t ) ( p0 [ i ] | ( p1 [ i ] << 8 ) );
+        break;
+    }
+    case 4:
+    {
+        uint32_t *y = dst;
+#if IZIP_VEC
+        for ( ; i + 16 <= count; i += 16 )
+        {
+            __m128i a = _mm_loadu_si128 ( ( const __m128i* ) ( p0 + i ) );
+            __m128i b = _mm_loadu_si128 ( ( const __m128i* ) ( p1 + i ) );
+            __m128i c = _mm_loadu_si128 ( ( const __m128i* ) ( p2 + i ) );
+            __m128i d = _mm_loadu_si128 ( ( const __m128i* ) ( p3 + i ) );
+            __m128i ab0 = _mm_unpacklo_epi8 ( a, b ), ab1 = _mm_unpackhi_epi8 ( a, b );
+            __m128i cd0 = _mm_unpacklo_epi8 ( c, d ), cd1 = _mm_unpackhi_epi8 ( c, d );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i ), _mm_unpacklo_epi16 ( ab0, cd0 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 4 ), _mm_unpackhi_epi16 ( ab0, cd0 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 8 ), _mm_unpacklo_epi16 ( ab1, cd1 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 12 ), _mm_unpackhi_epi16 ( ab1, cd1 ) );
+        }
+#endif
+        for ( ; i < count; ++ i )
+            y [ i ] = p0 [ i ] | ( ( uint32_t ) p1 [ i ] << 8 ) |
+                ( ( uint32_t ) p2 [ i ] << 16 ) | ( ( uint32_t ) p3 [ i ] << 24 );
+        break;
+    }
+    case 8:
+    {
+        const uint8_t *p4 = p3 + count;
+        const uint8_t *p5 = p4 + count;
+        const uint8_t *p6 = p5 + count;
+        const uint8_t *p7 = p6 + count;
+        uint64_t *y = dst;
+#if IZIP_VEC
+        for ( ; i + 16 <= count; i += 16 )
+        {
+            __m128i a = _mm_loadu_si128 ( ( const __m128i* ) ( p0 + i ) );
+            __m128i b = _mm_loadu_si128 ( ( const __m128i* ) ( p1 + i ) );
+            __m128i c = _mm_loadu_si128 ( ( const __m128i* ) ( p2 + i ) );
+            __m128i d = _mm_loadu_si128 ( ( const __m128i* ) ( p3 + i ) );
+            __m128i e = _mm_loadu_si128 ( ( const __m128i* ) ( p4 + i ) );
+            __m128i f = _mm_loadu_si128 ( ( const __m128i* ) ( p5 + i ) );
+            __m128i g = _mm_loadu_si128 ( ( const __m128i* ) ( p6 + i ) );
+            __m128i h = _mm_loadu_si128 ( ( const __m128i* ) ( p7 + i ) );
+            __m128i ab0 = _mm_unpacklo_epi8 ( a, b ), ab1 = _mm_unpackhi_epi8 ( a, b );
+            __m128i cd0 = _mm_unpacklo_epi8 ( c, d ), cd1 = _mm_unpackhi_epi8 ( c, d );
+            __m128i ef0 = _mm_unpacklo_epi8 ( e, f ), ef1 = _mm_unpackhi_epi8 ( e, f );
+            __m128i gh0 = _mm_unpacklo_epi8 ( g, h ), gh1 = _mm_unpackhi_epi8 ( g, h );
+            __m128i lo0 = _mm_unpacklo_epi16 ( ab0, cd0 ), lo1 = _mm_unpackhi_epi16 ( ab0, cd0 );
+            __m128i lo2 = _mm_unpacklo_epi16 ( ab1, cd1 ), lo3 = _mm_unpackhi_epi16 ( ab1, cd1 );
+            __m128i hi0 = _mm_unpacklo_epi16 ( ef0, gh0 ), hi1 = _mm_unpackhi_epi16 ( ef0, gh0 );
+            __m128i hi2 = _mm_unpacklo_epi16 ( ef1, gh1 ), hi3 = _mm_unpackhi_epi16 ( ef1, gh1 );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i ), _mm_unpacklo_epi32 ( lo0, hi0 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 2 ), _mm_unpackhi_epi32 ( lo0, hi0 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 4 ), _mm_unpacklo_epi32 ( lo1, hi1 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 6 ), _mm_unpackhi_epi32 ( lo1, hi1 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 8 ), _mm_unpacklo_epi32 ( lo2, hi2 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 10 ), _mm_unpackhi_epi32 ( lo2, hi2 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 12 ), _mm_unpacklo_epi32 ( lo3, hi3 ) );
+            _mm_storeu_si128 ( ( __m128i* ) ( y + i + 14 ), _mm_unpackhi_epi32 ( lo3, hi3 ) );
+        }
+#endif
+        for ( ; i < count; ++ i )
+            y [ i ] = p0 [ i ] | ( ( uint64_t ) p1 [ i ] << 8 ) |
+                ( ( uint64_t ) p2 [ i ] << 16 ) | ( ( uint64_t ) p3 [ i ] << 24 ) |
+                ( ( uint64_t ) p4 [ i ] << 32 ) | ( ( uint64_t ) p5 [ i ] << 40 ) |
+                ( ( uint64_t ) p6 [ i ] << 48 ) | ( ( uint64_t ) p7 [ i ] << 56 );
+        break;
+    }
+    }
+}
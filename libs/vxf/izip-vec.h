@@ -0,0 +1,56 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_vxf_izip_vec_
+#define _h_vxf_izip_vec_
+
+#include <klib/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* vxf_izip_widen
+ *  replaces "count" packed unsigned elements at the front of "buf" with
+ *  64 bit values, each plus "min". works in place, back to front, the
+ *  way the packed nbuf planes are expanded
+ */
+void vxf_izip_widen_u8 ( void *buf, unsigned count, int64_t min );
+void vxf_izip_widen_u16 ( void *buf, unsigned count, int64_t min );
+void vxf_izip_widen_u32 ( void *buf, unsigned count, int64_t min );
+
+/* vxf_izip_merge_planes
+ *  interleaves "width" byte planes of "count" bytes each, laid end to
+ *  end in "planes" with the least significant first, into "count"
+ *  native integers of "width" bytes at "dst"
+ */
+void vxf_izip_merge_planes ( void *dst, unsigned width, const uint8_t *planes, unsigned count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_vxf_izip_vec_ */
@@ -0,0 +1,128 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include <klib/rc.h>
+#include <kproc/thread.h>
+#include <kproc/lock.h>
+#include <sysalloc.h>
+
+#include "par-chunks.h"
+
+typedef struct ChunkJob ChunkJob;
+struct ChunkJob
+{
+    vxf_chunk_func f;
+    void *data;
+    KLock *lock;        /* guards "next" and "rc" */
+    uint32_t next;
+    uint32_t count;
+    rc_t rc;            /* first failure seen by any thread */
+};
+
+static
+rc_t CC ChunkJobRun ( const KThread *t, void *data )
+{
+    ChunkJob *job = data;
+    rc_t rc = 0;
+
+    while ( rc == 0 )
+    {
+        uint32_t idx;
+
+        /* claim the next chunk unless somebody has failed */
+        rc = KLockAcquire ( job -> lock );
+        if ( rc != 0 )
+            break;
+        idx = job -> next;
+        if ( job -> rc != 0 || idx >= job -> count )
+        {
+            KLockUnlock ( job -> lock );
+            break;
+        }
+        job -> next = idx + 1;
+        KLockUnlock ( job -> lock );
+
+        rc = job -> f ( job -> data, idx );
+    }
+
+    if ( rc != 0 && KLockAcquire ( job -> lock ) == 0 )
+    {
+        if ( job -> rc == 0 )
+            job -> rc = rc;
+        KLockUnlock ( job -> lock );
+    }
+
+    return rc;
+}
+
+rc_t vxf_run_chunks ( vxf_chunk_func f, void *data, uint32_t count, uint32_t threads )
+{
+    rc_t rc;
+    uint32_t i, started;
+    ChunkJob job;
+    KThread *helpers [ VXF_CHUNK_THREADS_MAX - 1 ];
+
+    if ( threads > count )
+        threads = count;
+    if ( threads > VXF_CHUNK_THREADS_MAX )
+        threads = VXF_CHUNK_THREADS_MAX;
+
+    /* nothing to share */
+    if ( threads <= 1 )
+    {
+        for ( rc = 0, i = 0; rc == 0 && i < count; ++ i )
+            rc = f ( data, i );
+        return rc;
+    }
+
+    job . f = f;
+    job . data = data;
+    job . next = 0;
+    job . count = count;
+    job . rc = 0;
+    rc = KLockMake ( & job . lock );
+    if ( rc != 0 )
+        return rc;
+
+    for ( started = 0; started < threads - 1; ++ started )
+    {
+        if ( KThreadMake ( & helpers [ started ], ChunkJobRun, & job ) != 0 )
+            break;
+    }
+
+    ChunkJobRun ( NULL, & job );
+
+    for ( i = 0; i < started; ++ i )
+    {
+        rc_t status;
+        KThreadWait ( helpers [ i ], & status );
+        KThreadRelease ( helpers [ i ] );
+    }
+
+    rc = job . rc;
+    KLockRelease ( job . lock );
+    return rc;
+}
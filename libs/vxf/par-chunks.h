@@ -0,0 +1,57 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_vxf_par_chunks_
+#define _h_vxf_par_chunks_
+
+#include <klib/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* most threads a transform runs on at once, its caller included */
+#define VXF_CHUNK_THREADS_MAX 8
+
+/* vxf_chunk_func
+ *  works chunk "idx" of the job described by "data"
+ */
+typedef rc_t ( CC * vxf_chunk_func ) ( void *data, uint32_t idx );
+
+/* vxf_run_chunks
+ *  calls "f" once for each of "count" chunks, which are claimed in order
+ *  by the caller and by up to "threads" - 1 helper threads
+ *
+ *  returns the first failure; the chunks not yet claimed by then are
+ *  skipped. when threads cannot be made, the work is done by fewer
+ */
+rc_t vxf_run_chunks ( vxf_chunk_func f, void *data, uint32_t count, uint32_t threads );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_vxf_par_chunks_ */
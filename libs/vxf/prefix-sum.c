@@ -0,0 +1,262 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "prefix-sum.h"
+
+#include <endian.h>
+
+/*--------------------------------------------------------------------------
+ * prefix sums
+ *  each vector is summed in register with log2(lanes) shift-and-add
+ *  steps, then the running total of earlier vectors is added in and its
+ *  last lane broadcast as the total for the next. the only serial work
+ *  left per vector is one add and one shuffle.
+ *
+ *  SSE2 is always present on x86_64, and the 32 and 64 bit sums - the
+ *  positions and ids that dominate - use AVX2 when the cpu has it.
+ *  anything else, and the tail of every call, uses the scalar loop.
+ */
+#if defined __GNUC__ && defined __x86_64__ && __BYTE_ORDER == __LITTLE_ENDIAN
+#define PREFIX_SUM_VEC 1
+#include <immintrin.h>
+#endif
+
+/* "UT" is the unsigned twin of "T", so that the sum wraps */
+#define PREFIX_SUM_SCALAR( T, UT, dst, src, i, count, prior, exclusive ) \
+    if ( exclusive )                                                 \
+    {                                                                \
+        for ( ; i < count; ++ i )                                    \
+        {                                                            \
+            T cur = src [ i ];                                       \
+            dst [ i ] = prior;                                       \
+            prior = ( T ) ( ( UT ) prior + ( UT ) cur );             \
+        }                                                            \
+    }                                                                \
+    else                                                             \
+    {                                                                \
+        for ( ; i < count; ++ i )                                    \
+        {                                                            \
+            prior = ( T ) ( ( UT ) prior + ( UT ) src [ i ] );       \
+            dst [ i ] = prior;                                       \
+        }                                                            \
+    }
+
+#if PREFIX_SUM_VEC
+
+/* PREFIX_SUM_VEC_LOOP
+ *  "SCAN" sums a vector in place, "LAST" broadcasts its final lane.
+ *  two vectors per pass: the second is offset by the first off the
+ *  critical path, leaving one add and shuffle of carry per pass
+ */
+#define PREFIX_SUM_VEC_LOOP( T, ADD, SUB, SCAN, LAST )                   \
+    {                                                                   \
+        __m128i carry = _mm_setzero_si128 ();                           \
+        const uint64_t lanes = sizeof ( __m128i ) / sizeof ( T );       \
+        for ( ; i + 2 * lanes <= count; i += 2 * lanes )                \
+        {                                                               \
+            __m128i x0 = _mm_loadu_si128 ( ( const __m128i* ) ( src + i ) ); \
+            __m128i x1 = _mm_loadu_si128 ( ( const __m128i* ) ( src + i + lanes ) ); \
+            __m128i s0 = x0, s1 = x1;                                   \
+            SCAN ( s0 );                                                \
+            SCAN ( s1 );                                                \
+            s1 = ADD ( s1, LAST ( s0 ) );                               \
+            s0 = ADD ( s0, carry );                                     \
+            s1 = ADD ( s1, carry );                                     \
+            carry = LAST ( s1 );                                        \
+            if ( exclusive )                                            \
+            {                                                           \
+                s0 = SUB ( s0, x0 );                                    \
+                s1 = SUB ( s1, x1 );                                    \
+            }                                                           \
+            _mm_storeu_si128 ( ( __m128i* ) ( dst + i ), s0 );          \
+            _mm_storeu_si128 ( ( __m128i* ) ( dst + i + lanes ), s1 );  \
+        }                                                               \
+        prior = ( T ) _mm_cvtsi128_si64 ( carry );                      \
+    }
+
+#define SCAN8( s )                                            \
+    s = _mm_add_epi8 ( s, _mm_slli_si128 ( s, 1 ) );          \
+    s = _mm_add_epi8 ( s, _mm_slli_si128 ( s, 2 ) );          \
+    s = _mm_add_epi8 ( s, _mm_slli_si128 ( s, 4 ) );          \
+    s = _mm_add_epi8 ( s, _mm_slli_si128 ( s, 8 ) )
+#define LAST8( s ) \
+    _mm_shuffle_epi32 ( _mm_unpackhi_epi16 ( _mm_unpackhi_epi8 ( s, s ), _mm_unpackhi_epi8 ( s, s ) ), 0xFF )
+
+#define SCAN16( s )                                           \
+    s = _mm_add_epi16 ( s, _mm_slli_si128 ( s, 2 ) );         \
+    s = _mm_add_epi16 ( s, _mm_slli_si128 ( s, 4 ) );         \
+    s = _mm_add_epi16 ( s, _mm_slli_si128 ( s, 8 ) )
+#define LAST16( s ) \
+    _mm_shuffle_epi32 ( _mm_unpackhi_epi16 ( s, s ), 0xFF )
+
+#define SCAN32( s )                                           \
+    s = _mm_add_epi32 ( s, _mm_slli_si128 ( s, 4 ) );         \
+    s = _mm_add_epi32 ( s, _mm_slli_si128 ( s, 8 ) )
+#define LAST32( s ) \
+    _mm_shuffle_epi32 ( s, 0xFF )
+
+#define SCAN64( s )                                           \
+    s = _mm_add_epi64 ( s, _mm_slli_si128 ( s, 8 ) )
+#define LAST64( s ) \
+    _mm_shuffle_epi32 ( s, 0xEE )
+
+/* AVX2: the same scan within each 128 bit lane, then the low lane's
+   total is carried into the high lane */
+#define AVX2_FUNC __attribute__ ( ( target ( "avx2" ) ) )
+
+static AVX2_FUNC
+uint64_t prefix_sum_i32_avx2 ( int32_t *dst, const int32_t *src, uint64_t count, bool exclusive, int32_t *prior )
+{
+    const __m256i last = _mm256_set1_epi32 ( 7 );
+    __m256i carry = _mm256_setzero_si256 ();
+    uint64_t i;
+
+    for ( i = 0; i + 16 <= count; i += 16 )
+    {
+        __m256i x0 = _mm256_loadu_si256 ( ( const __m256i* ) ( src + i ) );
+        __m256i x1 = _mm256_loadu_si256 ( ( const __m256i* ) ( src + i + 8 ) );
+        __m256i s0 = x0, s1 = x1, t0, t1;
+
+        s0 = _mm256_add_epi32 ( s0, _mm256_slli_si256 ( s0, 4 ) );
+        s1 = _mm256_add_epi32 ( s1, _mm256_slli_si256 ( s1, 4 ) );
+        s0 = _mm256_add_epi32 ( s0, _mm256_slli_si256 ( s0, 8 ) );
+        s1 = _mm256_add_epi32 ( s1, _mm256_slli_si256 ( s1, 8 ) );
+        t0 = _mm256_shuffle_epi32 ( s0, 0xFF );
+        t1 = _mm256_shuffle_epi32 ( s1, 0xFF );
+        s0 = _mm256_add_epi32 ( s0, _mm256_permute2x128_si256 ( t0, t0, 0x08 ) );
+        s1 = _mm256_add_epi32 ( s1, _mm256_permute2x128_si256 ( t1, t1, 0x08 ) );
+
+        s1 = _mm256_add_epi32 ( s1, _mm256_permutevar8x32_epi32 ( s0, last ) );
+        s0 = _mm256_add_epi32 ( s0, carry );
+        s1 = _mm256_add_epi32 ( s1, carry );
+        carry = _mm256_permutevar8x32_epi32 ( s1, last );
+
+        if ( exclusive )
+        {
+            s0 = _mm256_sub_epi32 ( s0, x0 );
+            s1 = _mm256_sub_epi32 ( s1, x1 );
+        }
+        _mm256_storeu_si256 ( ( __m256i* ) ( dst + i ), s0 );
+        _mm256_storeu_si256 ( ( __m256i* ) ( dst + i + 8 ), s1 );
+    }
+
+    * prior = _mm256_cvtsi256_si32 ( carry );
+    return i;
+}
+
+static AVX2_FUNC
+uint64_t prefix_sum_i64_avx2 ( int64_t *dst, const int64_t *src, uint64_t count, bool exclusive, int64_t *prior )
+{
+    const __m256i zero = _mm256_setzero_si256 ();
+    __m256i carry = zero;
+    uint64_t i;
+
+    for ( i = 0; i + 8 <= count; i += 8 )
+    {
+        __m256i x0 = _mm256_loadu_si256 ( ( const __m256i* ) ( src + i ) );
+        __m256i x1 = _mm256_loadu_si256 ( ( const __m256i* ) ( src + i + 4 ) );
+        __m256i s0 = x0, s1 = x1;
+
+        s0 = _mm256_add_epi64 ( s0, _mm256_slli_si256 ( s0, 8 ) );
+        s1 = _mm256_add_epi64 ( s1, _mm256_slli_si256 ( s1, 8 ) );
+        s0 = _mm256_add_epi64 ( s0, _mm256_blend_epi32 ( zero, _mm256_permute4x64_epi64 ( s0, 0x50 ), 0xF0 ) );
+        s1 = _mm256_add_epi64 ( s1, _mm256_blend_epi32 ( zero, _mm256_permute4x64_epi64 ( s1, 0x50 ), 0xF0 ) );
+
+        s1 = _mm256_add_epi64 ( s1, _mm256_permute4x64_epi64 ( s0, 0xFF ) );
+        s0 = _mm256_add_epi64 ( s0, carry );
+        s1 = _mm256_add_epi64 ( s1, carry );
+        carry = _mm256_permute4x64_epi64 ( s1, 0xFF );
+
+        if ( exclusive )
+        {
+            s0 = _mm256_sub_epi64 ( s0, x0 );
+            s1 = _mm256_sub_epi64 ( s1, x1 );
+        }
+        _mm256_storeu_si256 ( ( __m256i* ) ( dst + i ), s0 );
+        _mm256_storeu_si256 ( ( __m256i* ) ( dst + i + 4 ), s1 );
+    }
+
+    * prior = _mm_cvtsi128_si64 ( _mm256_castsi256_si128 ( carry ) );
+    return i;
+}
+
+static
+bool have_avx2 ( void )
+{
+    /* benign race: every thread computes the same answer */
+    static int avx2 = -1;
+    if ( avx2 < 0 )
+        avx2 = __builtin_cpu_supports ( "avx2" ) ? 1 : 0;
+    return avx2 != 0;
+}
+
+#endif /* PREFIX_SUM_VEC */
+
+void vxf_prefix_sum_i8 ( int8_t *dst, const int8_t *src, uint64_t count, bool exclusive )
+{
+    uint64_t i = 0;
+    int8_t prior = 0;
+#if PREFIX_SUM_VEC
+    PREFIX_SUM_VEC_LOOP ( int8_t, _mm_add_epi8, _mm_sub_epi8, SCAN8, LAST8 );
+#endif
+    PREFIX_SUM_SCALAR ( int8_t, uint8_t, dst, src, i, count, prior, exclusive );
+}
+
+void vxf_prefix_sum_i16 ( int16_t *dst, const int16_t *src, uint64_t count, bool exclusive )
+{
+    uint64_t i = 0;
+    int16_t prior = 0;
+#if PREFIX_SUM_VEC
+    PREFIX_SUM_VEC_LOOP ( int16_t, _mm_add_epi16, _mm_sub_epi16, SCAN16, LAST16 );
+#endif
+    PREFIX_SUM_SCALAR ( int16_t, uint16_t, dst, src, i, count, prior, exclusive );
+}
+
+void vxf_prefix_sum_i32 ( int32_t *dst, const int32_t *src, uint64_t count, bool exclusive )
+{
+    uint64_t i = 0;
+    int32_t prior = 0;
+#if PREFIX_SUM_VEC
+    if ( have_avx2 () )
+        i = prefix_sum_i32_avx2 ( dst, src, count, exclusive, & prior );
+    else
+        PREFIX_SUM_VEC_LOOP ( int32_t, _mm_add_epi32, _mm_sub_epi32, SCAN32, LAST32 );
+#endif
+    PREFIX_SUM_SCALAR ( int32_t, uint32_t, dst, src, i, count, prior, exclusive );
+}
+
+void vxf_prefix_sum_i64 ( int64_t *dst, const int64_t *src, uint64_t count, bool exclusive )
+{
+    uint64_t i = 0;
+    int64_t prior = 0;
+#if PREFIX_SUM_VEC
+    if ( have_avx2 () )
+        i = prefix_sum_i64_avx2 ( dst, src, count, exclusive, & prior );
+    else
+        PREFIX_SUM_VEC_LOOP ( int64_t, _mm_add_epi64, _mm_sub_epi64, SCAN64, LAST64 );
+#endif
+    PREFIX_SUM_SCALAR ( int64_t, uint64_t, dst, src, i, count, prior, exclusive );
+}
@@ -0,0 +1,53 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_vxf_prefix_sum_
+#define _h_vxf_prefix_sum_
+
+#include <klib/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* vxf_prefix_sum
+ *  running sum of "count" elements of "src" into "dst", starting at 0
+ *  with "exclusive" each output is the sum of the elements before it,
+ *  otherwise it includes its own element
+ *
+ *  arithmetic wraps as it does in a scalar loop over the same type,
+ *  and "dst" may be the same as "src"
+ */
+void vxf_prefix_sum_i8 ( int8_t *dst, const int8_t *src, uint64_t count, bool exclusive );
+void vxf_prefix_sum_i16 ( int16_t *dst, const int16_t *src, uint64_t count, bool exclusive );
+void vxf_prefix_sum_i32 ( int32_t *dst, const int32_t *src, uint64_t count, bool exclusive );
+void vxf_prefix_sum_i64 ( int64_t *dst, const int64_t *src, uint64_t count, bool exclusive );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_vxf_prefix_sum_ */
@@ -0,0 +1,600 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#include "raw-inflate.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <byteswap.h>
+
+/*--------------------------------------------------------------------------
+ * a one-shot decoder for raw deflate ( RFC 1951 ) streams
+ *
+ *  blobs are always inflated whole into a buffer sized from the blob
+ *  header, so none of zlib's streaming machinery is needed: no state
+ *  allocation, no sliding window, no resumable bit reader. the input
+ *  is read 64 bits at a time, literal/length and distance codes are
+ *  resolved by single table lookups and matches are copied in words.
+ *
+ *  anything unusual - incomplete code sets, corrupt or truncated data,
+ *  an output buffer that is too small - is not diagnosed here; the
+ *  caller re-runs zlib, so results and error codes never change.
+ */
+
+#define MAXBITS 15
+#define MAXLCODES 288
+#define MAXDCODES 32
+#define LENBITS 11
+#define DISTBITS 9
+#define CLENBITS 7
+
+/* table entry kinds */
+#define OP_LITERAL 0
+#define OP_BASE 1
+#define OP_EOB 2
+#define OP_LONG 3
+#define OP_INVALID 4
+
+typedef struct HCode HCode;
+struct HCode
+{
+    uint16_t val;       /* literal byte, length or distance base */
+    uint8_t bits;       /* code length */
+    uint8_t op;         /* kind, and extra bit count above it */
+};
+
+#define HCODE_KIND( e ) ( ( e ) . op & 7 )
+#define HCODE_EXTRA( e ) ( ( e ) . op >> 3 )
+
+typedef struct HTable HTable;
+struct HTable
+{
+    HCode *fast;
+    uint32_t fast_bits;
+    uint16_t count [ MAXBITS + 1 ];
+    uint16_t symbol [ MAXLCODES ];
+};
+
+/* per-symbol decode templates */
+static const uint16_t len_base [ 29 ] =
+{
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t len_extra [ 29 ] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base [ 30 ] =
+{
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra [ 30 ] =
+{
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+typedef enum { sym_litlen, sym_dist, sym_clen } SymKind;
+
+static
+HCode symbol_template ( SymKind kind, uint32_t sym )
+{
+    HCode e;
+    e . bits = 0;
+    e . val = ( uint16_t ) sym;
+    e . op = OP_LITERAL;
+
+    switch ( kind )
+    {
+    case sym_litlen:
+        if ( sym == 256 )
+            e . op = OP_EOB;
+        else if ( sym > 256 )
+        {
+            if ( sym - 257 < 29 )
+            {
+                e . val = len_base [ sym - 257 ];
+                e . op = OP_BASE | ( len_extra [ sym - 257 ] << 3 );
+            }
+            else
+                e . op = OP_INVALID;
+        }
+        break;
+    case sym_dist:
+        if ( sym < 30 )
+        {
+            e . val = dist_base [ sym ];
+            e . op = OP_BASE | ( dist_extra [ sym ] << 3 );
+        }
+        else
+            e . op = OP_INVALID;
+        break;
+    case sym_clen:
+        break;
+    }
+    return e;
+}
+
+/* build_table
+ *  canonical Huffman code from code lengths
+ *  codes up to "fast_bits" long resolve with a single lookup,
+ *  longer ones leave an OP_LONG marker and are walked bit by bit.
+ *  only complete codes are accepted.
+ */
+static
+bool build_table ( HTable *t, SymKind kind, const uint8_t *lens, uint32_t n )
+{
+    uint16_t offs [ MAXBITS + 2 ];
+    uint32_t len, sym, idx, code, mask = ( 1U << t -> fast_bits ) - 1;
+    int32_t left = 1;
+
+    memset ( t -> count, 0, sizeof t -> count );
+    for ( sym = 0; sym < n; ++ sym )
+        ++ t -> count [ lens [ sym ] ];
+    t -> count [ 0 ] = 0;
+
+    for ( len = 1; len <= MAXBITS; ++ len )
+    {
+        left <<= 1;
+        left -= t -> count [ len ];
+        if ( left < 0 )
+            return false;
+    }
+    if ( left != 0 )
+        return false;
+
+    offs [ 1 ] = 0;
+    for ( len = 1; len <= MAXBITS; ++ len )
+        offs [ len + 1 ] = offs [ len ] + t -> count [ len ];
+    for ( sym = 0; sym < n; ++ sym )
+    {
+        if ( lens [ sym ] != 0 )
+            t -> symbol [ offs [ lens [ sym ] ] ++ ] = ( uint16_t ) sym;
+    }
+
+    for ( code = 0, idx = 0, len = 1; len <= MAXBITS; ++ len, code <<= 1 )
+    {
+        uint32_t k;
+        for ( k = 0; k < t -> count [ len ]; ++ k, ++ code, ++ idx )
+        {
+            /* deflate sends codes most significant bit first */
+            uint32_t i, rev = 0;
+            for ( i = 0; i < len; ++ i )
+                rev |= ( ( code >> i ) & 1 ) << ( len - 1 - i );
+
+            if ( len <= t -> fast_bits )
+            {
+                HCode e = symbol_template ( kind, t -> symbol [ idx ] );
+                e . bits = ( uint8_t ) len;
+                for ( i = rev; i <= mask; i += 1U << len )
+                    t -> fast [ i ] = e;
+            }
+            else
+            {
+                t -> fast [ rev & mask ] . op = OP_LONG;
+                t -> fast [ rev & mask ] . bits = 0;
+            }
+        }
+    }
+    return true;
+}
+
+/* decode_long
+ *  walk a code longer than the lookup table, one bit at a time
+ */
+static
+HCode decode_long ( const HTable *t, SymKind kind, uint64_t bitbuf )
+{
+    int32_t code = 0, first = 0, index = 0;
+    uint32_t len;
+    HCode e;
+
+    for ( len = 1; len <= MAXBITS; ++ len )
+    {
+        int32_t count = t -> count [ len ];
+        code |= ( int32_t ) ( bitbuf & 1 );
+        bitbuf >>= 1;
+        if ( code - count < first )
+        {
+            e = symbol_template ( kind, t -> symbol [ index + ( code - first ) ] );
+            e . bits = ( uint8_t ) len;
+            return e;
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    e . val = 0;
+    e . bits = 0;
+    e . op = OP_INVALID;
+    return e;
+}
+
+/*--------------------------------------------------------------------------
+ * bit reader
+ *  "cnt" valid bits sit at the bottom of "buf"; refills always leave at
+ *  least 56. bits above "cnt" may already hold the next input bytes,
+ *  which the following refill ORs in again at the same position.
+ *  reads past the end supply zero bytes that are only tallied, so an
+ *  overrun is detected once, at the end.
+ */
+typedef struct BitReader BitReader;
+struct BitReader
+{
+    const uint8_t *in, *end;
+    uint64_t buf;
+    uint32_t cnt;
+    uint32_t overrun;
+};
+
+static
+uint64_t load_le64 ( const uint8_t *p )
+{
+    uint64_t v;
+    memcpy ( & v, p, sizeof v );
+#if __BYTE_ORDER == __BIG_ENDIAN
+    v = bswap_64 ( v );
+#endif
+    return v;
+}
+
+static
+void refill ( BitReader *br )
+{
+    if ( br -> end - br -> in >= 8 )
+    {
+        br -> buf |= load_le64 ( br -> in ) << br -> cnt;
+        br -> in += ( 63 - br -> cnt ) >> 3;
+        br -> cnt |= 56;
+    }
+    else
+    {
+        while ( br -> cnt < 56 )
+        {
+            if ( br -> in < br -> end )
+                br -> buf |= ( uint64_t ) * br -> in ++ << br -> cnt;
+            else
+                ++ br -> overrun;
+            br -> cnt += 8;
+        }
+    }
+}
+
+#define PEEK( br, n ) ( ( uint32_t ) ( br ) -> buf & ( ( 1U << ( n ) ) - 1 ) )
+
+static
+void consume ( BitReader *br, uint32_t n )
+{
+    br -> buf >>= n;
+    br -> cnt -= n;
+}
+
+static
+uint32_t take ( BitReader *br, uint32_t n )
+{
+    uint32_t v = PEEK ( br, n );
+    consume ( br, n );
+    return v;
+}
+
+/* overrun
+ *  true once phantom bytes have actually been consumed,
+ *  and a guard against looping on them forever
+ */
+static
+bool overrun ( const BitReader *br )
+{
+    return br -> overrun * 8 > br -> cnt || br -> overrun > 16;
+}
+
+/*--------------------------------------------------------------------------
+ * blocks
+ */
+typedef struct Inflater Inflater;
+struct Inflater
+{
+    BitReader br;
+    uint8_t *out_start, *out, *out_end;
+
+    HTable lit, dist;
+    HCode lit_fast [ 1 << LENBITS ];
+    HCode dist_fast [ 1 << DISTBITS ];
+};
+
+static
+bool stored_block ( Inflater *z )
+{
+    BitReader *br = & z -> br;
+    uint32_t len, nlen;
+
+    /* skip to a byte boundary and hand the buffered bytes back */
+    consume ( br, br -> cnt & 7 );
+    refill ( br );
+    len = take ( br, 16 );
+    nlen = take ( br, 16 );
+    if ( overrun ( br ) || len != ( ~ nlen & 0xFFFF ) )
+        return false;
+
+    br -> in -= ( br -> cnt >> 3 ) - br -> overrun;
+    br -> buf = 0;
+    br -> cnt = 0;
+    br -> overrun = 0;
+
+    if ( ( size_t ) ( br -> end - br -> in ) < len ||
+         ( size_t ) ( z -> out_end - z -> out ) < len )
+        return false;
+
+    memcpy ( z -> out, br -> in, len );
+    z -> out += len;
+    br -> in += len;
+    return true;
+}
+
+static
+void copy_match ( uint8_t *out, uint8_t *out_end, uint32_t dist, uint32_t len )
+{
+    const uint8_t *src = out - dist;
+
+    if ( dist >= 8 && ( size_t ) ( out_end - out ) >= len + 8 )
+    {
+        /* overlap never reaches back into the word being read */
+        uint8_t *stop = out + len;
+        do
+        {
+            memcpy ( out, src, 8 );
+            out += 8;
+            src += 8;
+        }
+        while ( out < stop );
+    }
+    else if ( dist == 1 )
+        memset ( out, * src, len );
+    else
+    {
+        uint32_t i;
+        for ( i = 0; i < len; ++ i )
+            out [ i ] = src [ i ];
+    }
+}
+
+static
+bool huffman_block ( Inflater *z )
+{
+    BitReader *br = & z -> br;
+    const uint32_t lmask = ( 1U << z -> lit . fast_bits ) - 1;
+    const uint32_t dmask = ( 1U << z -> dist . fast_bits ) - 1;
+    uint8_t *out = z -> out;
+    uint8_t * const out_end = z -> out_end;
+
+    for ( ;; )
+    {
+        HCode e;
+        uint32_t len, dist;
+
+        /* 15 + 5 length bits and 15 + 13 distance bits at most */
+        if ( br -> cnt < 48 )
+        {
+            refill ( br );
+            if ( br -> overrun != 0 && overrun ( br ) )
+                return false;
+        }
+
+        e = z -> lit . fast [ br -> buf & lmask ];
+        if ( HCODE_KIND ( e ) == OP_LONG )
+            e = decode_long ( & z -> lit, sym_litlen, br -> buf );
+        consume ( br, e . bits );
+
+        if ( HCODE_KIND ( e ) == OP_LITERAL )
+        {
+            if ( out == out_end )
+                return false;
+            * out ++ = ( uint8_t ) e . val;
+            continue;
+        }
+        if ( HCODE_KIND ( e ) == OP_EOB )
+            break;
+        if ( HCODE_KIND ( e ) != OP_BASE )
+            return false;
+
+        len = e . val + take ( br, HCODE_EXTRA ( e ) );
+
+        e = z -> dist . fast [ br -> buf & dmask ];
+        if ( HCODE_KIND ( e ) == OP_LONG )
+            e = decode_long ( & z -> dist, sym_dist, br -> buf );
+        if ( HCODE_KIND ( e ) != OP_BASE )
+            return false;
+        consume ( br, e . bits );
+        dist = e . val + take ( br, HCODE_EXTRA ( e ) );
+
+        if ( ( size_t ) ( out - z -> out_start ) < dist ||
+             ( size_t ) ( out_end - out ) < len )
+            return false;
+
+        copy_match ( out, out_end, dist, len );
+        out += len;
+    }
+
+    z -> out = out;
+    return true;
+}
+
+static
+bool fixed_tables ( Inflater *z )
+{
+    uint8_t lens [ MAXLCODES ];
+
+    memset ( lens, 8, 144 );
+    memset ( lens + 144, 9, 256 - 144 );
+    memset ( lens + 256, 7, 280 - 256 );
+    memset ( lens + 280, 8, MAXLCODES - 280 );
+    if ( ! build_table ( & z -> lit, sym_litlen, lens, MAXLCODES ) )
+        return false;
+
+    memset ( lens, 5, MAXDCODES );
+    return build_table ( & z -> dist, sym_dist, lens, MAXDCODES );
+}
+
+static
+bool dynamic_tables ( Inflater *z )
+{
+    static const uint8_t order [ 19 ] =
+        { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    BitReader *br = & z -> br;
+    uint8_t lens [ MAXLCODES + MAXDCODES ];
+    HCode clen_fast [ 1 << CLENBITS ];
+    HTable clen;
+    uint32_t nlen, ndist, ncode, i;
+
+    refill ( br );
+    nlen = take ( br, 5 ) + 257;
+    ndist = take ( br, 5 ) + 1;
+    ncode = take ( br, 4 ) + 4;
+    if ( nlen > 286 || ndist > 30 )
+        return false;
+
+    /* 19 * 3 bits can straddle one refill */
+    memset ( lens, 0, 19 );
+    for ( i = 0; i < ncode; ++ i )
+    {
+        if ( br -> cnt < 3 )
+            refill ( br );
+        lens [ order [ i ] ] = ( uint8_t ) take ( br, 3 );
+    }
+
+    clen . fast = clen_fast;
+    clen . fast_bits = CLENBITS;
+    if ( ! build_table ( & clen, sym_clen, lens, 19 ) )
+        return false;
+
+    for ( i = 0; i < nlen + ndist; )
+    {
+        HCode e;
+        uint32_t sym, rep;
+        uint8_t val = 0;
+
+        if ( br -> cnt < 16 )
+        {
+            refill ( br );
+            if ( br -> overrun != 0 && overrun ( br ) )
+                return false;
+        }
+
+        e = clen_fast [ PEEK ( br, CLENBITS ) ];
+        consume ( br, e . bits );
+        sym = e . val;
+        if ( sym < 16 )
+        {
+            lens [ i ++ ] = ( uint8_t ) sym;
+            continue;
+        }
+
+        if ( sym == 16 )
+        {
+            if ( i == 0 )
+                return false;
+            val = lens [ i - 1 ];
+            rep = 3 + take ( br, 2 );
+        }
+        else if ( sym == 17 )
+            rep = 3 + take ( br, 3 );
+        else
+            rep = 11 + take ( br, 7 );
+
+        if ( i + rep > nlen + ndist )
+            return false;
+        memset ( lens + i, val, rep );
+        i += rep;
+    }
+
+    /* a block without an end code cannot be terminated */
+    if ( lens [ 256 ] == 0 )
+        return false;
+
+    return build_table ( & z -> lit, sym_litlen, lens, nlen ) &&
+           build_table ( & z -> dist, sym_dist, lens + nlen, ndist );
+}
+
+bool vxf_raw_inflate ( void *dst, size_t dsize, size_t *dused,
+    const void *src, size_t ssize, size_t *sused )
+{
+    Inflater z;
+    uint32_t last;
+
+    z . br . in = src;
+    z . br . end = z . br . in + ssize;
+    z . br . buf = 0;
+    z . br . cnt = 0;
+    z . br . overrun = 0;
+
+    z . out_start = z . out = dst;
+    z . out_end = z . out + dsize;
+
+    z . lit . fast = z . lit_fast;
+    z . lit . fast_bits = LENBITS;
+    z . dist . fast = z . dist_fast;
+    z . dist . fast_bits = DISTBITS;
+
+    do
+    {
+        bool ok;
+
+        refill ( & z . br );
+        last = take ( & z . br, 1 );
+        switch ( take ( & z . br, 2 ) )
+        {
+        case 0:
+            ok = stored_block ( & z );
+            break;
+        case 1:
+            ok = fixed_tables ( & z ) && huffman_block ( & z );
+            break;
+        case 2:
+            ok = dynamic_tables ( & z ) && huffman_block ( & z );
+            break;
+        default:
+            ok = false;
+        }
+
+        if ( ! ok || overrun ( & z . br ) )
+            return false;
+    }
+    while ( ! last );
+
+    if ( z . br . overrun * 8 > z . br . cnt )
+        return false;
+
+    * dused = z . out - z . out_start;
+    * sused = ( z . br . in - ( const uint8_t * ) src ) - ( ( z . br . cnt >> 3 ) - z . br . overrun );
+    return true;
+}
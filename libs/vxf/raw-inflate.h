@@ -0,0 +1,55 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_vxf_raw_inflate_
+#define _h_vxf_raw_inflate_
+
+#include <klib/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* vxf_raw_inflate
+ *  decode a complete raw deflate stream ( zlib windowBits -15 )
+ *  into a caller supplied buffer in a single pass
+ *
+ *  returns true when the stream decoded cleanly through its final block
+ *  and fit into "dsize" bytes, with "dused" set to the bytes produced
+ *  and "sused" to the bytes consumed ( rounded up as zlib reports them )
+ *
+ *  returns false for anything else, including streams that are valid
+ *  but use constructs this decoder leaves alone; the caller must then
+ *  run zlib inflate, which alone decides the outcome and error code
+ */
+bool vxf_raw_inflate ( void *dst, size_t dsize, size_t *dused,
+    const void *src, size_t ssize, size_t *sused );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _h_vxf_raw_inflate_ */
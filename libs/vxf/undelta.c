@@ -33,30 +33,24 @@
 #include <assert.h>
 #include <string.h>
 
+#include "prefix-sum.h"
+
 
 #define UNDELTA_NAME( T )  undelta_ ## T
-#define UNDELTA( T )                                                       \
+#define UNDELTA( T, SUM )                                                \
 static                                                                   \
 rc_t CC UNDELTA_NAME ( T ) ( void *data,                                   \
     const VXformInfo *info,  void *rslt, const void *input,              \
     uint64_t elem_count)                                                 \
 {                                                                        \
-    uint32_t i;                                                          \
-    T *dst       = (T*) rslt;                                            \
-    const T *src = (const T*) input;                                     \
-    if(elem_count >0) {							 \
-        dst [ 0 ] = src [ 0 ];						 \
-	for ( i = 1; i < elem_count; ++ i ) {                            \
-	    dst [ i ] = src [ i ] + dst [ i - 1 ];                       \
-	}                                                                \
-    }									 \
+    SUM ( ( T* ) rslt, ( const T* ) input, elem_count, false );          \
     return 0;                                                            \
 }
 
-UNDELTA ( int8_t )
-UNDELTA ( int16_t )
-UNDELTA ( int32_t )
-UNDELTA ( int64_t )
+UNDELTA ( int8_t, vxf_prefix_sum_i8 )
+UNDELTA ( int16_t, vxf_prefix_sum_i16 )
+UNDELTA ( int32_t, vxf_prefix_sum_i32 )
+UNDELTA ( int64_t, vxf_prefix_sum_i64 )
 
 static VArrayFunc undelta_func [] =
 {
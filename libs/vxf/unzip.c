@@ -30,6 +30,7 @@
 #include <vdb/schema.h>
 #include <vdb/vdb-priv.h>
 #include <klib/data-buffer.h>
+#include <kfg/config.h>
 #include <sysalloc.h>
 
 #include <stdint.h>
@@ -40,12 +41,28 @@
 #include <zlib.h>
 #include <assert.h>
 
-static rc_t invoke_zlib(void *dst, size_t dsize, const void *src, size_t ssize, int windowBits)
+#include "raw-inflate.h"
+#include "par-chunks.h"
+
+static rc_t invoke_zlib(void *dst, size_t dsize, size_t *dused, const void *src, size_t ssize, int windowBits)
 {
     int zr;
     rc_t rc = 0;
 
     z_stream s;
+
+    /* raw streams go to the one-shot decoder first */
+    if ( windowBits < 0 )
+    {
+        size_t used, sused;
+        if ( vxf_raw_inflate ( dst, dsize, & used, src, ssize, & sused ) )
+        {
+            if ( dused != NULL )
+                * dused = used;
+            return 0;
+        }
+    }
+
     memset ( & s, 0, sizeof s );
 
     s.next_in = (void *)src;
@@ -83,6 +100,8 @@ static rc_t invoke_zlib(void *dst, size_t dsize, const void *src, size_t ssize,
         rc = RC(rcXF, rcFunction, rcExecuting, rcNoObj, rcUnexpected);
         break;
     }
+    if ( rc == 0 && dused != NULL )
+        * dused = s.total_out;
     zr = inflateEnd(&s);
     switch (zr)
     {
@@ -103,7 +122,7 @@ rc_t unzip_func_v1(
                    const VBlobData *src
 ) {
     dst->byte_order = src->byte_order;
-    return invoke_zlib(dst->data, (((size_t)dst->elem_count * dst->elem_bits + 7) >> 3),
+    return invoke_zlib(dst->data, (((size_t)dst->elem_count * dst->elem_bits + 7) >> 3), NULL,
                        src->data, (((size_t)src->elem_count * src->elem_bits + 7) >> 3),
                        -15);
 }
@@ -126,7 +145,7 @@ rc_t unzip_func_v2(
         /* the feed to zlib MUST be byte aligned
            so the output must be as well */
         assert ( ( dst -> elem_count & 7 ) == 0 );
-        rc = invoke_zlib(dst->data, (((size_t)dst->elem_count) >> 3),
+        rc = invoke_zlib(dst->data, (((size_t)dst->elem_count) >> 3), NULL,
                          src->data, (((size_t)src->elem_count * src->elem_bits + 7) >> 3),
                          -15);
 
@@ -139,6 +158,98 @@ rc_t unzip_func_v2(
     return rc;
 }
 
+/* version 3: chunked, see zip.c */
+typedef struct unzip_chunks_t unzip_chunks_t;
+struct unzip_chunks_t {
+    uint8_t *dst;
+    const uint8_t *src;
+    size_t dsize;
+    size_t chunk;
+    const size_t *coff;     /* count + 1 offsets of the coded chunks */
+};
+
+static
+rc_t CC unzip_chunk(void *data, uint32_t idx)
+{
+    const unzip_chunks_t *job = data;
+    size_t const off = (size_t)idx * job->chunk;
+    size_t const len = job->dsize - off < job->chunk ? job->dsize - off : job->chunk;
+    size_t dused = 0;
+
+    rc_t rc = invoke_zlib(job->dst + off, len, &dused,
+                          job->src + job->coff[idx], job->coff[idx + 1] - job->coff[idx], -15);
+    if (rc == 0 && dused != len)
+        rc = RC(rcXF, rcFunction, rcExecuting, rcData, rcCorrupt);
+    return rc;
+}
+
+static
+rc_t unzip_func_v3(
+                   uint32_t threads,
+                   const VXformInfo *info,
+                   VBlobResult *dst,
+                   const VBlobData *src,
+                   VBlobHeader *hdr
+) {
+    int64_t trailing, chunk, count;
+    size_t const ssize = (((size_t)src->elem_count * src->elem_bits + 7) >> 3);
+    size_t dsize;
+    size_t *coff;
+    uint32_t i;
+
+    rc_t rc = VBlobHeaderArgPopHead ( hdr, & trailing );
+    if ( rc == 0 )
+        rc = VBlobHeaderArgPopHead ( hdr, & chunk );
+    if ( rc == 0 )
+        rc = VBlobHeaderArgPopHead ( hdr, & count );
+    if ( rc != 0 )
+        return rc;
+
+    dst -> elem_count *= dst -> elem_bits;
+    dst -> byte_order = src -> byte_order;
+    dst -> elem_bits = 1;
+    assert ( ( dst -> elem_count & 7 ) == 0 );
+    dsize = ( size_t ) ( dst -> elem_count >> 3 );
+
+    if ( trailing < 0 || trailing > 7 || chunk <= 0 || count <= 0 ||
+         ( uint64_t ) count != ( dsize + chunk - 1 ) / chunk )
+        return RC(rcXF, rcFunction, rcExecuting, rcData, rcCorrupt);
+
+    coff = malloc ( ( ( size_t ) count + 1 ) * sizeof coff [ 0 ] );
+    if ( coff == NULL )
+        return RC(rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted);
+
+    for ( coff [ 0 ] = 0, i = 0; rc == 0 && i < count; ++ i )
+    {
+        int64_t csize;
+        rc = VBlobHeaderArgPopHead ( hdr, & csize );
+        if ( rc == 0 && ( csize <= 0 || ( uint64_t ) csize > ssize - coff [ i ] ) )
+            rc = RC(rcXF, rcFunction, rcExecuting, rcData, rcCorrupt);
+        if ( rc == 0 )
+            coff [ i + 1 ] = coff [ i ] + ( size_t ) csize;
+    }
+
+    if ( rc == 0 && coff [ count ] != ssize )
+        rc = RC(rcXF, rcFunction, rcExecuting, rcData, rcCorrupt);
+
+    if ( rc == 0 )
+    {
+        unzip_chunks_t job;
+        job.dst = dst->data;
+        job.src = src->data;
+        job.dsize = dsize;
+        job.chunk = ( size_t ) chunk;
+        job.coff = coff;
+        rc = vxf_run_chunks ( unzip_chunk, & job, ( uint32_t ) count, threads );
+    }
+    free ( coff );
+
+    if ( rc == 0 && trailing != 0 )
+        dst -> elem_count -= 8 - trailing;
+
+    return rc;
+}
+
 static
 rc_t CC legacy_unzip_func ( void *self, const VXformInfo *info,
     VLegacyBlobResult *rslt, const KDataBuffer *src )
@@ -167,7 +278,7 @@ rc_t CC legacy_unzip_func ( void *self, const VXformInfo *info,
         if ( rc != 0 )
             break;
 
-        rc = invoke_zlib ( dst -> base, bytes, & in [ 1 ], (size_t)KDataBufferBytes ( src ) - 4, 15 );
+        rc = invoke_zlib ( dst -> base, bytes, NULL, & in [ 1 ], (size_t)KDataBufferBytes ( src ) - 4, 15 );
         if ( rc == 0 )
         {
             dst -> elem_bits = 1;
@@ -203,17 +314,40 @@ rc_t CC unzip_func(
     case 2:
         return unzip_func_v2(info, dst, src, hdr);
         break;
+    case 3:
+        return unzip_func_v3((uint32_t)(size_t)Self, info, dst, src, hdr);
+        break;
     default:
         return RC(rcXF, rcFunction, rcExecuting, rcParam, rcBadVersion);
     }
 }
 
+/* unzip_threads
+ *  threads inflating the chunks of one version 3 blob, from the
+ *  configuration node "/vdb/unzip/threads". readers often run a cursor
+ *  per thread of their own, so a single thread is the default
+ */
+static
+uint32_t unzip_threads ( void )
+{
+    uint64_t threads = 1;
+    KConfig *kfg;
+    if ( KConfigMake ( & kfg, NULL ) == 0 )
+    {
+        if ( KConfigReadU64 ( kfg, "/vdb/unzip/threads", & threads ) != 0 || threads == 0 )
+            threads = 1;
+        KConfigRelease ( kfg );
+    }
+    return threads > VXF_CHUNK_THREADS_MAX ? VXF_CHUNK_THREADS_MAX : ( uint32_t ) threads;
+}
+
 /* unzip
  *  function any unzip #1.0 ( zlib_fmt in );
  */
 VTRANSFACT_IMPL ( vdb_unzip, 1, 0, 0 ) ( const void *self, const VXfactInfo *info,
     VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
 {
+    rslt->self = (void *)(size_t)unzip_threads();
     rslt->variant = vftBlob;
     rslt->u.bf = unzip_func;
 
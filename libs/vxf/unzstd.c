@@ -0,0 +1,181 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#include <vdb/extern.h>
+#include <klib/defs.h>
+#include <klib/rc.h>
+#include <vdb/xform.h>
+#include <vdb/schema.h>
+#include <vdb/vdb-priv.h>
+#include <sysalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+#include <assert.h>
+
+#include "zstd-common.h"
+
+typedef struct self_t self_t;
+struct self_t
+{
+    ZSTD_DDict *ddict;
+    atomic_ptr_t spare;
+};
+
+static
+rc_t invoke_zstd ( self_t *self, void *dst, size_t dsize, const void *src, size_t ssize )
+{
+    size_t zr;
+    ZSTD_DCtx *dctx = zstd_take_ctx ( & self -> spare );
+    if ( dctx == NULL )
+    {
+        dctx = ZSTD_createDCtx ();
+        if ( dctx == NULL )
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    }
+
+    if ( self -> ddict != NULL )
+        zr = ZSTD_decompress_usingDDict ( dctx, dst, dsize, src, ssize, self -> ddict );
+    else
+        zr = ZSTD_decompressDCtx ( dctx, dst, dsize, src, ssize );
+
+    if ( ! zstd_give_ctx ( & self -> spare, dctx ) )
+        ZSTD_freeDCtx ( dctx );
+
+    if ( ZSTD_isError ( zr ) )
+    {
+        switch ( ZSTD_getErrorCode ( zr ) )
+        {
+        case ZSTD_error_memory_allocation:
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        case ZSTD_error_dstSize_tooSmall:
+            return RC ( rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient );
+        case ZSTD_error_dictionary_wrong:
+            return RC ( rcXF, rcFunction, rcExecuting, rcParam, rcIncorrect );
+        default:
+            return RC ( rcXF, rcFunction, rcExecuting, rcData, rcCorrupt );
+        }
+    }
+
+    return 0;
+}
+
+static
+rc_t unzstd_func_v1 ( self_t *self, VBlobResult *dst, const VBlobData *src )
+{
+    dst -> byte_order = src -> byte_order;
+    return invoke_zstd ( self, dst -> data, ( ( ( size_t ) dst -> elem_count * dst -> elem_bits + 7 ) >> 3 ),
+                         src -> data, ( ( ( size_t ) src -> elem_count * src -> elem_bits + 7 ) >> 3 ) );
+}
+
+static
+rc_t unzstd_func_v2 ( self_t *self, VBlobResult *dst, const VBlobData *src, VBlobHeader *hdr )
+{
+    int64_t trailing;
+    rc_t rc = VBlobHeaderArgPopHead ( hdr, & trailing );
+    if ( rc == 0 )
+    {
+        dst -> elem_count *= dst -> elem_bits;
+        dst -> byte_order = src -> byte_order;
+        dst -> elem_bits = 1;
+
+        rc = invoke_zstd ( self, dst -> data, ( ( ( size_t ) dst -> elem_count + 7 ) >> 3 ),
+                           src -> data, ( ( ( size_t ) src -> elem_count * src -> elem_bits + 7 ) >> 3 ) );
+        /* if the original, uncompressed source was NOT byte aligned,
+           back off the rounded up byte and add in the original bit count */
+        if ( rc == 0 && trailing != 0 )
+            dst -> elem_count -= 8 - trailing;
+    }
+
+    return rc;
+}
+
+static
+rc_t CC unzstd_func ( void *Self, const VXformInfo *info,
+    VBlobResult *dst, const VBlobData *src, VBlobHeader *hdr )
+{
+    switch ( VBlobHeaderVersion ( hdr ) )
+    {
+    case 1:
+        return unzstd_func_v1 ( Self, dst, src );
+    case 2:
+        return unzstd_func_v2 ( Self, dst, src, hdr );
+    }
+
+    return RC ( rcXF, rcFunction, rcExecuting, rcParam, rcBadVersion );
+}
+
+static
+void CC vxf_unzstd_wrapper ( void *ptr )
+{
+    self_t *self = ptr;
+    ZSTD_freeDCtx ( self -> spare . ptr );
+    ZSTD_freeDDict ( self -> ddict );
+    free ( self );
+}
+
+/* unzstd
+ *  function any unzstd #1.0 < * ascii dict > ( zstd_fmt in );
+ */
+VTRANSFACT_IMPL ( vdb_unzstd, 1, 0, 0 ) ( const void *Self, const VXfactInfo *info,
+    VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
+{
+    rc_t rc = 0;
+    self_t *self = calloc ( 1, sizeof * self );
+    if ( self == NULL )
+        return RC ( rcXF, rcFunction, rcConstructing, rcMemory, rcExhausted );
+
+    if ( cp -> argc > 0 && cp -> argv [ 0 ] . count != 0 )
+    {
+        void *dict;
+        size_t dict_size;
+
+        assert ( cp -> argv [ 0 ] . desc . domain == vtdAscii );
+        rc = zstd_load_dict ( info -> tbl, cp -> argv [ 0 ] . data . ascii,
+            cp -> argv [ 0 ] . count, & dict, & dict_size );
+        if ( rc == 0 )
+        {
+            self -> ddict = ZSTD_createDDict ( dict, dict_size );
+            if ( self -> ddict == NULL )
+                rc = RC ( rcXF, rcFunction, rcConstructing, rcMemory, rcExhausted );
+            free ( dict );
+        }
+    }
+
+    if ( rc == 0 )
+    {
+        rslt -> self = self;
+        rslt -> whack = vxf_unzstd_wrapper;
+        rslt -> variant = vftBlob;
+        rslt -> u . bf = unzstd_func;
+        return 0;
+    }
+
+    free ( self );
+    return rc;
+}
@@ -57,11 +57,18 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include "par-chunks.h"
+
 #define BUFFER_GROWTH_RATE (64 * 1024)
 
+/* blobs larger than this are cut into chunks of this size,
+   each its own deflate stream, when more than one thread is asked for */
+#define ZIP_CHUNK_SIZE (1024 * 1024)
+
 struct self_t {
     int32_t strategy;
     int32_t level;
+    uint32_t threads;
 };
 
 #if _DEBUGGING
@@ -130,6 +137,77 @@ static rc_t invoke_zlib(void *dst, uint32_t *dsize, const void *src, uint32_t ss
     return rc;
 }
 
+/* version 3: chunked
+ *  the source is cut into ZIP_CHUNK_SIZE pieces that deflate independently,
+ *  so that they can be coded and decoded on several threads.
+ *  the header args are the count of trailing bits, the chunk size,
+ *  the chunk count and then the coded size of each chunk.
+ */
+typedef struct zip_chunks_t zip_chunks_t;
+struct zip_chunks_t {
+    const struct self_t *self;
+    uint8_t *dst;
+    const uint8_t *src;
+    uint32_t ssize;
+    uint32_t *csize;
+};
+
+static
+rc_t CC zip_chunk(void *data, uint32_t idx)
+{
+    zip_chunks_t *job = data;
+    uint32_t const off = idx * ZIP_CHUNK_SIZE;
+    uint32_t const len = job->ssize - off < ZIP_CHUNK_SIZE ? job->ssize - off : ZIP_CHUNK_SIZE;
+
+    /* each chunk codes into the room its source takes in the output;
+       one that does not fit there makes the whole blob go uncompressed */
+    uint32_t dsize = len;
+    rc_t rc = invoke_zlib(job->dst + off, &dsize, job->src + off, len, job->self->strategy, job->self->level);
+    if (rc == 0 && dsize == 0)
+        rc = RC(rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient);
+    job->csize[idx] = dsize;
+    return rc;
+}
+
+static
+rc_t zip_chunked(const struct self_t *self, void *dst, uint32_t *dsize,
+                 const void *src, uint32_t ssize, VBlobHeader *hdr)
+{
+    rc_t rc;
+    uint32_t i, used;
+    zip_chunks_t job;
+    uint32_t const count = (ssize + ZIP_CHUNK_SIZE - 1) / ZIP_CHUNK_SIZE;
+
+    if (*dsize < ssize)
+        return RC(rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient);
+
+    job.self = self;
+    job.dst = dst;
+    job.src = src;
+    job.ssize = ssize;
+    job.csize = malloc(count * sizeof job.csize[0]);
+    if (job.csize == NULL)
+        return RC(rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted);
+
+    rc = vxf_run_chunks(zip_chunk, &job, count, self->threads);
+    if (rc == 0)
+        rc = VBlobHeaderArgPushTail(hdr, ZIP_CHUNK_SIZE);
+    if (rc == 0)
+        rc = VBlobHeaderArgPushTail(hdr, count);
+
+    /* close up the gaps between the chunks */
+    for (used = 0, i = 0; rc == 0 && i < count; ++i) {
+        memmove(job.dst + used, job.dst + (size_t)i * ZIP_CHUNK_SIZE, job.csize[i]);
+        used += job.csize[i];
+        rc = VBlobHeaderArgPushTail(hdr, job.csize[i]);
+    }
+    if (rc == 0)
+        *dsize = used;
+
+    free(job.csize);
+    return rc;
+}
+
 static
 rc_t CC zip_func(
               void *Self,
@@ -150,16 +228,26 @@ rc_t CC zip_func(
     /* required output size */
     uint32_t dsize = ( uint32_t ) ( ( ( size_t ) dst -> elem_count * dst->elem_bits + 7 ) >> 3 );
 
-    if ( ( sbits & 7 ) == 0 )
-        /* version 1 is byte-aligned */
-        VBlobHeaderSetVersion ( hdr, 1 );
-    else
+    if ( self -> threads > 1 && ssize > ZIP_CHUNK_SIZE )
     {
-        VBlobHeaderSetVersion ( hdr, 2 );
-        VBlobHeaderArgPushTail ( hdr, ( int64_t ) ( sbits & 7 ) );
+        VBlobHeaderSetVersion ( hdr, 3 );
+        rc = VBlobHeaderArgPushTail ( hdr, ( int64_t ) ( sbits & 7 ) );
+        if ( rc == 0 )
+            rc = zip_chunked ( self, dst -> data, & dsize, src -> data, ssize, hdr );
     }
+    else
+    {
+        if ( ( sbits & 7 ) == 0 )
+            /* version 1 is byte-aligned */
+            VBlobHeaderSetVersion ( hdr, 1 );
+        else
+        {
+            VBlobHeaderSetVersion ( hdr, 2 );
+            VBlobHeaderArgPushTail ( hdr, ( int64_t ) ( sbits & 7 ) );
+        }
 
-    rc = invoke_zlib ( dst -> data, & dsize, src -> data, ssize, self->strategy, self->level);
+        rc = invoke_zlib ( dst -> data, & dsize, src -> data, ssize, self->strategy, self->level);
+    }
     if (rc == 0) {
         dst->elem_bits = 1;
         dst->byte_order = src->byte_order;
@@ -178,14 +266,15 @@ void CC vxf_zip_wrapper( void *ptr )
 }
 
 /* zip
- * function zlib_fmt zip #1.0 < * I32 strategy, I32 level > ( any in );
+ * function zlib_fmt zip #1.1 < * I32 strategy, I32 level, U32 threads > ( any in );
  */
-VTRANSFACT_IMPL(vdb_zip, 1, 0, 0) (const void *self, const VXfactInfo *info, VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
+VTRANSFACT_IMPL(vdb_zip, 1, 1, 0) (const void *self, const VXfactInfo *info, VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
 {
     struct self_t *ctx;
 
     int strategy = Z_RLE;
     int level = Z_BEST_SPEED;
+    uint32_t threads = 1;
 
     if ( cp -> argc > 0 )
     {
@@ -197,6 +286,12 @@ VTRANSFACT_IMPL(vdb_zip, 1, 0, 0) (const void *self, const VXfactInfo *info, VFu
             level = cp -> argv [ 1 ] . data . i32 [ 0 ];
             if ( level < Z_MIN_LEVEL || level > Z_MAX_LEVEL )
                 return RC(rcXF, rcFunction, rcConstructing, rcRange, rcInvalid);
+            if ( cp -> argc > 2 )
+            {
+                threads = cp -> argv [ 2 ] . data . u32 [ 0 ];
+                if ( threads > VXF_CHUNK_THREADS_MAX )
+                    threads = VXF_CHUNK_THREADS_MAX;
+            }
         }
     }
 
@@ -204,6 +299,7 @@ VTRANSFACT_IMPL(vdb_zip, 1, 0, 0) (const void *self, const VXfactInfo *info, VFu
     if (ctx) {
         ctx->strategy = strategy;
         ctx->level = level;
+        ctx->threads = threads;
        
         rslt->self = ctx;
         rslt->whack = vxf_zip_wrapper;
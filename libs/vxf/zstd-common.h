@@ -0,0 +1,111 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+#ifndef _h_vxf_zstd_common_
+#define _h_vxf_zstd_common_
+
+#include <vdb/table.h>
+#include <kdb/meta.h>
+#include <klib/rc.h>
+#include <atomic.h>
+
+#include <stdlib.h>
+
+/* zstd_load_dict
+ *  read a trained dictionary from a node of the table metadata
+ *  the node name comes from the optional "dict" factory parameter
+ */
+static __inline__
+rc_t zstd_load_dict ( const VTable *tbl, const char *name, uint32_t name_size,
+    void **dict, size_t *dict_size )
+{
+    const KMetadata *meta;
+    rc_t rc = VTableOpenMetadataRead ( tbl, & meta );
+
+    * dict = NULL;
+    * dict_size = 0;
+
+    if ( rc == 0 )
+    {
+        const KMDataNode *node;
+        rc = KMetadataOpenNodeRead ( meta, & node, "%.*s", name_size, name );
+        if ( rc == 0 )
+        {
+            size_t num_read, remaining;
+            rc = KMDataNodeRead ( node, 0, NULL, 0, & num_read, & remaining );
+            if ( rc == 0 )
+            {
+                if ( remaining == 0 )
+                    rc = RC ( rcXF, rcFunction, rcConstructing, rcData, rcEmpty );
+                else
+                {
+                    void *buf = malloc ( remaining );
+                    if ( buf == NULL )
+                        rc = RC ( rcXF, rcFunction, rcConstructing, rcMemory, rcExhausted );
+                    else
+                    {
+                        rc = KMDataNodeRead ( node, 0, buf, remaining, & num_read, NULL );
+                        if ( rc == 0 )
+                        {
+                            * dict = buf;
+                            * dict_size = num_read;
+                        }
+                        else
+                        {
+                            free ( buf );
+                        }
+                    }
+                }
+            }
+            KMDataNodeRelease ( node );
+        }
+        KMetadataRelease ( meta );
+    }
+
+    return rc;
+}
+
+/* zstd_take_ctx
+ * zstd_give_ctx
+ *  a function instance keeps one spare (de)compression context,
+ *  callers racing for it fall back to a private one
+ */
+static __inline__
+void *zstd_take_ctx ( atomic_ptr_t *spare )
+{
+    void *ctx = spare -> ptr;
+    if ( ctx != NULL && atomic_test_and_set_ptr ( spare, NULL, ctx ) == ctx )
+        return ctx;
+    return NULL;
+}
+
+static __inline__
+bool zstd_give_ctx ( atomic_ptr_t *spare, void *ctx )
+{
+    return atomic_test_and_set_ptr ( spare, ctx, NULL ) == NULL;
+}
+
+#endif /* _h_vxf_zstd_common_ */
@@ -0,0 +1,185 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+#include <vdb/extern.h>
+#include <klib/defs.h>
+#include <klib/rc.h>
+#include <vdb/xform.h>
+#include <vdb/schema.h>
+#include <sysalloc.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zstd.h>
+#include <zstd_errors.h>
+#include <assert.h>
+
+#include "zstd-common.h"
+
+typedef struct self_t self_t;
+struct self_t
+{
+    ZSTD_CDict *cdict;
+    atomic_ptr_t spare;
+    int32_t level;
+};
+
+static
+rc_t invoke_zstd ( self_t *self, void *dst, uint32_t *dsize, const void *src, uint32_t ssize )
+{
+    size_t zr;
+    ZSTD_CCtx *cctx = zstd_take_ctx ( & self -> spare );
+    if ( cctx == NULL )
+    {
+        cctx = ZSTD_createCCtx ();
+        if ( cctx == NULL )
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+    }
+
+    if ( self -> cdict != NULL )
+        zr = ZSTD_compress_usingCDict ( cctx, dst, * dsize, src, ssize, self -> cdict );
+    else
+        zr = ZSTD_compressCCtx ( cctx, dst, * dsize, src, ssize, self -> level );
+
+    if ( ! zstd_give_ctx ( & self -> spare, cctx ) )
+        ZSTD_freeCCtx ( cctx );
+
+    * dsize = 0;
+    if ( ZSTD_isError ( zr ) )
+    {
+        switch ( ZSTD_getErrorCode ( zr ) )
+        {
+        case ZSTD_error_dstSize_tooSmall:
+            /* incompressible: the caller stores the blob as-is */
+            return RC ( rcXF, rcFunction, rcExecuting, rcBuffer, rcInsufficient );
+        case ZSTD_error_memory_allocation:
+            return RC ( rcXF, rcFunction, rcExecuting, rcMemory, rcExhausted );
+        default:
+            return RC ( rcXF, rcFunction, rcExecuting, rcSelf, rcUnexpected );
+        }
+    }
+
+    assert ( zr <= UINT32_MAX );
+    * dsize = ( uint32_t ) zr;
+    return 0;
+}
+
+static
+rc_t CC zstd_func ( void *Self, const VXformInfo *info,
+    VBlobResult *dst, const VBlobData *src, VBlobHeader *hdr )
+{
+    rc_t rc;
+
+    /* input bits */
+    uint64_t sbits = ( uint64_t ) src -> elem_count * src -> elem_bits;
+
+    /* input bytes */
+    uint32_t ssize = ( uint32_t ) ( ( sbits + 7 ) >> 3 );
+
+    /* available output size */
+    uint32_t dsize = ( uint32_t ) ( ( ( size_t ) dst -> elem_count * dst -> elem_bits + 7 ) >> 3 );
+
+    if ( ( sbits & 7 ) == 0 )
+        /* version 1 is byte-aligned */
+        VBlobHeaderSetVersion ( hdr, 1 );
+    else
+    {
+        VBlobHeaderSetVersion ( hdr, 2 );
+        VBlobHeaderArgPushTail ( hdr, ( int64_t ) ( sbits & 7 ) );
+    }
+
+    rc = invoke_zstd ( Self, dst -> data, & dsize, src -> data, ssize );
+    if ( rc == 0 )
+    {
+        dst -> elem_bits = 1;
+        dst -> byte_order = src -> byte_order;
+        dst -> elem_count = ( uint64_t ) dsize << 3;
+    }
+    return rc;
+}
+
+static
+void CC vxf_zstd_wrapper ( void *ptr )
+{
+    self_t *self = ptr;
+    ZSTD_freeCCtx ( self -> spare . ptr );
+    ZSTD_freeCDict ( self -> cdict );
+    free ( self );
+}
+
+/* zstd
+ *  function zstd_fmt zstd #1.0 < * I32 level, ascii dict > ( any in );
+ */
+VTRANSFACT_IMPL ( vdb_zstd, 1, 0, 0 ) ( const void *Self, const VXfactInfo *info,
+    VFuncDesc *rslt, const VFactoryParams *cp, const VFunctionParams *dp )
+{
+    rc_t rc = 0;
+    self_t *self;
+
+    int32_t level = ZSTD_CLEVEL_DEFAULT;
+    if ( cp -> argc > 0 )
+    {
+        level = cp -> argv [ 0 ] . data . i32 [ 0 ];
+        if ( level == 0 )
+            level = ZSTD_CLEVEL_DEFAULT;
+        else if ( level < ZSTD_minCLevel () || level > ZSTD_maxCLevel () )
+            return RC ( rcXF, rcFunction, rcConstructing, rcRange, rcInvalid );
+    }
+
+    self = calloc ( 1, sizeof * self );
+    if ( self == NULL )
+        return RC ( rcXF, rcFunction, rcConstructing, rcMemory, rcExhausted );
+    self -> level = level;
+
+    if ( cp -> argc > 1 && cp -> argv [ 1 ] . count != 0 )
+    {
+        void *dict;
+        size_t dict_size;
+
+        assert ( cp -> argv [ 1 ] . desc . domain == vtdAscii );
+        rc = zstd_load_dict ( info -> tbl, cp -> argv [ 1 ] . data . ascii,
+            cp -> argv [ 1 ] . count, & dict, & dict_size );
+        if ( rc == 0 )
+        {
+            self -> cdict = ZSTD_createCDict ( dict, dict_size, level );
+            if ( self -> cdict == NULL )
+                rc = RC ( rcXF, rcFunction, rcConstructing, rcMemory, rcExhausted );
+            free ( dict );
+        }
+    }
+
+    if ( rc == 0 )
+    {
+        rslt -> self = self;
+        rslt -> whack = vxf_zstd_wrapper;
+        rslt -> variant = vftBlob;
+        rslt -> u . bf = zstd_func;
+        return 0;
+    }
+
+    free ( self );
+    return rc;
+}
@@ -0,0 +1,865 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for BAMFile
+*
+* The BAM files are generated by the tests: sorted alignments on a few
+* references, one reference without alignments, unmapped reads at the end,
+* and small BGZF blocks so that many records span blocks.
+*/
+#include <ktst/unit_test.hpp>
+
+#include <kapp/main.h>
+#include <kfg/config.h>
+#include <kfs/directory.h>
+#include <kfs/file.h>
+#include <klib/rc.h>
+
+#include <align/bam.h>
+
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+
+TEST_SUITE(BAMFileTestSuite);
+
+namespace
+{
+    struct Ref {
+        char const *name;
+        int32_t length;
+        unsigned alignments;
+    };
+
+    Ref const refs[] = {
+        { "chr1", 1000000, 4000 },
+        { "chr2",  200000, 1000 },
+        { "chrE",   50000,    0 },
+        { "chr3",  400000, 2000 },
+    };
+    unsigned const numRefs = sizeof(refs) / sizeof(refs[0]);
+    unsigned const numUnmapped = 20;
+
+    /* an alignment as written, and where its record is in the raw stream */
+    struct Alignment {
+        int32_t ref;
+        int32_t pos;
+        int32_t end;
+        size_t rawBeg;
+        size_t rawEnd;
+        string name;
+    };
+
+    void PutI32(string &out, int32_t const value)
+    {
+        uint32_t const u = (uint32_t)value;
+        char const bytes[4] = { char(u), char(u >> 8), char(u >> 16), char(u >> 24) };
+        out.append(bytes, 4);
+    }
+
+    void PutU16(string &out, uint16_t const value)
+    {
+        char const bytes[2] = { char(value), char(value >> 8) };
+        out.append(bytes, 2);
+    }
+
+    void PutU64(string &out, uint64_t const value)
+    {
+        PutI32(out, (int32_t)(uint32_t)value);
+        PutI32(out, (int32_t)(uint32_t)(value >> 32));
+    }
+
+    void SetI32(string &out, size_t const at, int32_t const value)
+    {
+        string bytes;
+        PutI32(bytes, value);
+        out.replace(at, 4, bytes);
+    }
+
+    /* the BGZF block holding "data" */
+    string BGZFBlock(string const &data)
+    {
+        static char const header[16] = {
+            31, (char)139, 8, 4, 0, 0, 0, 0, 0, (char)255, 6, 0, 'B', 'C', 2, 0
+        };
+        vector<Bytef> cdata(compressBound((uLong)data.size()) + 64);
+        z_stream zs;
+
+        memset(&zs, 0, sizeof(zs));
+        deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        zs.next_in = (Bytef *)data.data();
+        zs.avail_in = (uInt)data.size();
+        zs.next_out = &cdata[0];
+        zs.avail_out = (uInt)cdata.size();
+        deflate(&zs, Z_FINISH);
+        deflateEnd(&zs);
+
+        string block(header, sizeof(header));
+        PutU16(block, (uint16_t)(sizeof(header) + 2 + zs.total_out + 8 - 1));
+        block.append((char const *)&cdata[0], zs.total_out);
+        PutI32(block, (int32_t)crc32(crc32(0, NULL, 0), (Bytef const *)data.data(), (uInt)data.size()));
+        PutI32(block, (int32_t)data.size());
+        return block;
+    }
+}
+
+class BAMFixture
+{
+public:
+    BAMFixture()
+    :   m_wd(0),
+        m_blockSize(8000)
+    {
+        if (KDirectoryNativeDir(&m_wd) != 0)
+            throw logic_error("KDirectoryNativeDir failed");
+    }
+    ~BAMFixture()
+    {
+        for (vector<string>::const_iterator i = m_files.begin(); i != m_files.end(); ++i)
+            KDirectoryRemove(m_wd, true, "%s", i->c_str());
+        KDirectoryRelease(m_wd);
+    }
+
+    /* the uncompressed BAM stream: header, then "refs" sorted, then unmapped reads */
+    void MakeRaw(unsigned const seed)
+    {
+        string text = "@HD\tVN:1.4\tSO:coordinate\n";
+
+        srand(seed);
+        for (unsigned r = 0; r < numRefs; ++r)
+            text += string("@SQ\tSN:") + refs[r].name + "\tLN:" + to_string(refs[r].length) + "\n";
+
+        m_raw = string("BAM\1", 4);
+        PutI32(m_raw, (int32_t)text.size());
+        m_raw += text;
+        PutI32(m_raw, (int32_t)numRefs);
+        for (unsigned r = 0; r < numRefs; ++r) {
+            PutI32(m_raw, (int32_t)strlen(refs[r].name) + 1);
+            m_raw.append(refs[r].name, strlen(refs[r].name) + 1);
+            PutI32(m_raw, refs[r].length);
+        }
+        m_aligned.clear();
+        for (unsigned r = 0; r < numRefs; ++r) {
+            vector<int32_t> pos;
+
+            for (unsigned i = 0; i < refs[r].alignments; ++i)
+                pos.push_back(rand() % (refs[r].length - 70000));
+            sort(pos.begin(), pos.end());
+            for (unsigned i = 0; i < pos.size(); ++i) {
+                int const x = rand() % 100;
+                int32_t const alen = x < 90 ? 20 : x < 99 ? 100 + rand() % 1900 : 20000 + rand() % 40000;
+
+                AddRecord((int32_t)r, pos[i], alen);
+            }
+        }
+        for (unsigned i = 0; i < numUnmapped; ++i)
+            AddRecord(-1, -1, 0);
+    }
+
+    /* cuts the raw stream into BGZF blocks of m_blockSize bytes */
+    void Compress()
+    {
+        m_bgzf.clear();
+        m_blockStart.clear();
+        for (size_t i = 0; i < m_raw.size(); i += m_blockSize) {
+            m_blockStart.push_back(m_bgzf.size());
+            m_bgzf += BGZFBlock(m_raw.substr(i, m_blockSize));
+        }
+        m_eofStart = m_bgzf.size();
+        m_bgzf += BGZFBlock(string());
+    }
+
+    void MakeBAM(unsigned const seed = 1)
+    {
+        MakeRaw(seed);
+        Compress();
+    }
+
+    /* the BGZF virtual offset of "rawPos" in the uncompressed stream */
+    uint64_t VOffset(size_t const rawPos) const
+    {
+        size_t const block = rawPos / m_blockSize;
+
+        if (block >= m_blockStart.size())
+            return (uint64_t)m_eofStart << 16;
+        return ((uint64_t)m_blockStart[block] << 16) | (rawPos % m_blockSize);
+    }
+
+    /* a BAI index, or a CSI index of "depth" levels, as samtools would write it */
+    string MakeIndex(bool const csi, int const depth) const
+    {
+        int const minShift = 14;
+        string index = csi ? string("CSI\1", 4) : string("BAI\1", 4);
+
+        if (csi) {
+            PutI32(index, minShift);
+            PutI32(index, depth);
+            PutI32(index, 0);
+        }
+        PutI32(index, (int32_t)numRefs);
+        for (int32_t r = 0; r < (int32_t)numRefs; ++r) {
+            map<uint32_t, vector<pair<uint64_t, uint64_t> > > bins;
+            map<uint32_t, uint64_t> linear;
+            vector<Alignment const *> aligned;
+            uint32_t lastBin = ~0u;
+
+            for (size_t i = 0; i < m_aligned.size(); ++i) {
+                Alignment const &a = m_aligned[i];
+
+                if (a.ref != r)
+                    continue;
+                aligned.push_back(&a);
+
+                uint32_t const bin = Reg2Bin(a.pos, a.end, minShift, depth);
+                uint64_t const beg = VOffset(a.rawBeg);
+                uint64_t const end = VOffset(a.rawEnd);
+
+                if (bin == lastBin)
+                    bins[bin].back().second = end;
+                else
+                    bins[bin].push_back(make_pair(beg, end));
+                lastBin = bin;
+                for (int32_t w = a.pos >> 14; w <= (a.end - 1) >> 14; ++w) {
+                    if (linear.find(w) == linear.end())
+                        linear[w] = beg;
+                }
+            }
+            PutI32(index, (int32_t)bins.size());
+            for (map<uint32_t, vector<pair<uint64_t, uint64_t> > >::const_iterator i = bins.begin(); i != bins.end(); ++i) {
+                PutI32(index, (int32_t)i->first);
+                if (csi)
+                    PutU64(index, FirstOverlapping(aligned, BinStart(i->first, minShift, depth)));
+                PutI32(index, (int32_t)i->second.size());
+                for (size_t j = 0; j < i->second.size(); ++j) {
+                    PutU64(index, i->second[j].first);
+                    PutU64(index, i->second[j].second);
+                }
+            }
+            if (!csi) {
+                int32_t const n = linear.empty() ? 0 : linear.rbegin()->first + 1;
+                uint64_t offset = 0;
+
+                PutI32(index, n);
+                for (int32_t w = 0; w < n; ++w) {
+                    if (linear.find(w) != linear.end())
+                        offset = linear[w];
+                    PutU64(index, offset);
+                }
+            }
+        }
+        return index;
+    }
+
+    /* the BGZF compressed "data" */
+    static string BGZF(string const &data)
+    {
+        string bgzf;
+
+        for (size_t i = 0; i < data.size(); i += 0xFF00)
+            bgzf += BGZFBlock(data.substr(i, 0xFF00));
+        return bgzf + BGZFBlock(string());
+    }
+
+    void WriteFile(string const &name, string const &data)
+    {
+        KFile *file;
+        size_t written;
+
+        if (KDirectoryCreateFile(m_wd, &file, false, 0664, kcmInit, "%s", name.c_str()) != 0)
+            throw logic_error("KDirectoryCreateFile failed");
+        m_files.push_back(name);
+        rc_t const rc = KFileWriteAll(file, 0, data.data(), data.size(), &written);
+        KFileRelease(file);
+        if (rc != 0 || written != data.size())
+            throw logic_error("KFileWriteAll failed");
+    }
+
+    BAMFile const *Open(string const &name, unsigned const threads)
+    {
+        KFile const *file;
+        BAMFile const *bam = 0;
+
+        if (KDirectoryOpenFileRead(m_wd, &file, "%s", name.c_str()) != 0)
+            throw logic_error("KDirectoryOpenFileRead failed");
+        rc_t const rc = BAMFileMakeWithKFileAndThreads(&bam, file, threads);
+        KFileRelease(file);
+        if (rc != 0)
+            throw logic_error("BAMFileMakeWithKFileAndThreads failed");
+        return bam;
+    }
+
+    static string Format(BAMAlignment const *const rec)
+    {
+        char buffer[64 * 1024];
+        size_t actsize = 0;
+
+        if (BAMAlignmentFormatSAM(rec, &actsize, sizeof(buffer), buffer) != 0)
+            throw logic_error("BAMAlignmentFormatSAM failed");
+        return string(buffer, actsize);
+    }
+
+    /* every record up to the first error, in SAM, and the rc that ended the read */
+    static rc_t ReadAll(BAMFile const *const bam, vector<string> &records)
+    {
+        for ( ; ; ) {
+            BAMAlignment const *rec;
+            rc_t const rc = BAMFileRead2(bam, &rec);
+
+            if (rc != 0)
+                return rc;
+            records.push_back(Format(rec));
+            BAMAlignmentRelease(rec);
+        }
+    }
+
+    KDirectory *m_wd;
+    size_t m_blockSize;
+    string m_raw;
+    string m_bgzf;
+    vector<size_t> m_blockStart;
+    size_t m_eofStart;
+    vector<Alignment> m_aligned;
+    vector<string> m_files;
+
+private:
+    static uint32_t Reg2Bin(int64_t const beg, int64_t end, int const minShift, int const depth)
+    {
+        int shift = minShift;
+        uint32_t t = ((1u << depth * 3) - 1) / 7;
+
+        --end;
+        for (int level = depth; level > 0; --level) {
+            if (beg >> shift == end >> shift)
+                return t + (uint32_t)(beg >> shift);
+            shift += 3;
+            t -= 1u << (level - 1) * 3;
+        }
+        return 0;
+    }
+
+    static int64_t BinStart(uint32_t const bin, int const minShift, int const depth)
+    {
+        uint32_t first = 0;
+
+        for (int level = 0; level <= depth; ++level) {
+            if (bin < first + (1u << 3 * level))
+                return (int64_t)(bin - first) << (minShift + 3 * (depth - level));
+            first += 1u << 3 * level;
+        }
+        return 0;
+    }
+
+    /* the offset of the first alignment reaching past "pos" */
+    uint64_t FirstOverlapping(vector<Alignment const *> const &aligned, int64_t const pos) const
+    {
+        for (size_t i = 0; i < aligned.size(); ++i) {
+            if (aligned[i]->end > pos)
+                return VOffset(aligned[i]->rawBeg);
+        }
+        return VOffset(aligned.back()->rawEnd);
+    }
+
+    void AddRecord(int32_t const ref, int32_t const pos, int32_t const alen)
+    {
+        Alignment a;
+        string body;
+        unsigned const readLen = 20;
+
+        a.name = "r" + to_string(m_aligned.size());
+        a.ref = ref;
+        a.pos = pos;
+        a.end = ref < 0 ? 0 : pos + alen;
+
+        PutI32(body, ref);
+        PutI32(body, pos);
+        body += char(a.name.size() + 1);
+        body += char(ref < 0 ? 0 : 60);
+        PutU16(body, 4680);
+        PutU16(body, ref < 0 ? 0 : alen > (int32_t)readLen ? 3 : 1);
+        PutU16(body, ref < 0 ? 4 : 0);
+        PutI32(body, (int32_t)readLen);
+        PutI32(body, -1);
+        PutI32(body, -1);
+        PutI32(body, 0);
+        body.append(a.name.c_str(), a.name.size() + 1);
+        if (ref >= 0 && alen > (int32_t)readLen) {
+            /* 10M, a skip, 10M */
+            PutI32(body, (10 << 4) | 0);
+            PutI32(body, ((alen - readLen) << 4) | 3);
+            PutI32(body, (10 << 4) | 0);
+        }
+        else if (ref >= 0)
+            PutI32(body, (readLen << 4) | 0);
+        for (unsigned i = 0; i < readLen / 2; ++i)
+            body += "\x12\x48\x14\x81"[rand() % 4];
+        for (unsigned i = 0; i < readLen; ++i)
+            body += char(20 + rand() % 20);
+        if (rand() % 4 == 0) {
+            body += "NMC";
+            body += char(rand() % 4);
+        }
+
+        a.rawBeg = m_raw.size();
+        PutI32(m_raw, (int32_t)body.size());
+        m_raw += body;
+        a.rawEnd = m_raw.size();
+        m_aligned.push_back(a);
+    }
+};
+
+/* MARK: threaded reader */
+
+static void ThreadedMatchesPlain(BAMFixture &fixture, string const &name, size_t const minRecords)
+{
+    vector<string> expected;
+    BAMFile const *bam = fixture.Open(name, 0);
+    rc_t const expected_rc = BAMFixture::ReadAll(bam, expected);
+
+    BAMFileRelease(bam);
+    if (expected.size() < minRecords)
+        throw logic_error("too few records read by the plain reader");
+
+    unsigned const threads[] = { 1, 4 };
+    for (unsigned i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        vector<string> actual;
+
+        bam = fixture.Open(name, threads[i]);
+        rc_t const rc = BAMFixture::ReadAll(bam, actual);
+        BAMFileRelease(bam);
+
+        if (rc != expected_rc)
+            throw logic_error("the threaded reader ended with a different rc");
+        if (actual != expected)
+            throw logic_error("the threaded reader read different records");
+    }
+}
+
+FIXTURE_TEST_CASE(BAMFileThreads_MatchPlain, BAMFixture)
+{
+    MakeBAM();
+    WriteFile("test-bam-threads.bam", m_bgzf);
+
+    vector<string> records;
+    BAMFile const *bam = Open("test-bam-threads.bam", 0);
+    rc_t const rc = ReadAll(bam, records);
+    BAMFileRelease(bam);
+    REQUIRE_EQ(records.size(), m_aligned.size());
+    REQUIRE_EQ(GetRCState(rc), rcNotFound);
+
+    ThreadedMatchesPlain(*this, "test-bam-threads.bam", m_aligned.size());
+}
+
+FIXTURE_TEST_CASE(BAMFileThreads_TruncatedBlock, BAMFixture)
+{
+    MakeBAM();
+    /* cut the file in the middle of a block past the header */
+    size_t const block = m_blockStart.size() / 2;
+    size_t const cut = m_blockStart[block] + (m_blockStart[block + 1] - m_blockStart[block]) / 2;
+    WriteFile("test-bam-truncated.bam", m_bgzf.substr(0, cut));
+
+    vector<string> records;
+    BAMFile const *bam = Open("test-bam-truncated.bam", 0);
+    rc_t const rc = ReadAll(bam, records);
+    BAMFileRelease(bam);
+    REQUIRE_NE(rc, (rc_t)0);
+    REQUIRE_LT(records.size(), m_aligned.size());
+
+    ThreadedMatchesPlain(*this, "test-bam-truncated.bam", 1);
+}
+
+FIXTURE_TEST_CASE(BAMFileThreads_CorruptCRC, BAMFixture)
+{
+    MakeBAM();
+    /* the CRC is the 8 bytes before the next block, less the size */
+    size_t const block = m_blockStart.size() / 2;
+    string bgzf = m_bgzf;
+    bgzf[m_blockStart[block + 1] - 8] ^= 0x55;
+    WriteFile("test-bam-crc.bam", bgzf);
+
+    vector<string> records;
+    BAMFile const *bam = Open("test-bam-crc.bam", 0);
+    rc_t const rc = ReadAll(bam, records);
+    BAMFileRelease(bam);
+    REQUIRE_NE(rc, (rc_t)0);
+    REQUIRE_NE(GetRCState(rc), rcNotFound);
+    REQUIRE_LT(records.size(), m_aligned.size());
+
+    ThreadedMatchesPlain(*this, "test-bam-crc.bam", 1);
+}
+
+/* MARK: batch reader */
+
+/* reads the file in batches of "capacity", checking each record against
+ * the raw stream and BAMFileRead2; returns the rc that ended the read
+ */
+static rc_t ReadBatches(BAMFixture &fixture, string const &name, uint32_t const capacity,
+                        size_t &records, size_t &batches)
+{
+    BAMFile const *bam = fixture.Open(name, 0);
+    BAMFile const *bam2 = fixture.Open(name, 0);
+    BAMAlignmentBatch *batch;
+    rc_t rc = BAMAlignmentBatchMake(&batch, capacity);
+
+    records = batches = 0;
+    while (rc == 0) {
+        rc = BAMFileReadBatch(bam, batch);
+        if (batch->count > capacity)
+            throw logic_error("the batch is over capacity");
+        if (batch->count > 0)
+            ++batches;
+        for (uint32_t i = 0; i < batch->count; ++i, ++records) {
+            Alignment const &expected = fixture.m_aligned.at(records);
+            string const raw = fixture.m_raw.substr(expected.rawBeg + 4, expected.rawEnd - expected.rawBeg - 4);
+            BAMAlignment const *rec;
+            char const *readName;
+            int32_t refSeqId;
+            int64_t position;
+            uint16_t flags;
+            uint32_t readLen;
+
+            if (batch->recordSize[i] != raw.size() || memcmp(batch->record[i], raw.data(), raw.size()) != 0)
+                throw logic_error("the batch record differs from the file");
+            if (BAMFileRead2(bam2, &rec) != 0)
+                throw logic_error("BAMFileRead2 failed");
+            BAMAlignmentGetReadName(rec, &readName);
+            BAMAlignmentGetRefSeqId(rec, &refSeqId);
+            BAMAlignmentGetPosition(rec, &position);
+            BAMAlignmentGetFlags(rec, &flags);
+            BAMAlignmentGetReadLength(rec, &readLen);
+            if (strcmp(readName, (char const *)batch->record[i] + 32) != 0 ||
+                refSeqId != batch->refSeqId[i] ||
+                position != batch->position[i] ||
+                flags != batch->flags[i] ||
+                readLen != batch->readLen[i] ||
+                batch->tagOffset[i] > batch->recordSize[i])
+            {
+                throw logic_error("the batch record differs from BAMFileRead2");
+            }
+            BAMAlignmentRelease(rec);
+        }
+    }
+    BAMAlignmentBatchRelease(batch);
+    BAMFileRelease(bam2);
+    BAMFileRelease(bam);
+    return rc;
+}
+
+FIXTURE_TEST_CASE(BAMFileReadBatch_MatchesRead2, BAMFixture)
+{
+    MakeBAM();
+    WriteFile("test-bam-batch.bam", m_bgzf);
+
+    /* the records that span blocks go through the spill buffer */
+    size_t spanning = 0;
+    for (size_t i = 0; i < m_aligned.size(); ++i) {
+        if (m_aligned[i].rawBeg / m_blockSize != (m_aligned[i].rawEnd - 1) / m_blockSize)
+            ++spanning;
+    }
+    REQUIRE_GT(spanning, (size_t)10);
+
+    uint32_t const capacity[] = { 1, 7, 1000 };
+    for (unsigned i = 0; i < sizeof(capacity) / sizeof(capacity[0]); ++i) {
+        size_t records;
+        size_t batches;
+        rc_t const rc = ReadBatches(*this, "test-bam-batch.bam", capacity[i], records, batches);
+
+        REQUIRE_EQ(GetRCState(rc), rcNotFound);
+        REQUIRE_EQ(records, m_aligned.size());
+        /* batches stop at block ends */
+        REQUIRE_GE(batches, m_blockStart.size() - 1);
+    }
+}
+
+FIXTURE_TEST_CASE(BAMFileReadBatch_EndOfFile, BAMFixture)
+{
+    MakeBAM();
+    WriteFile("test-bam-batch-eof.bam", m_bgzf);
+
+    BAMFile const *bam = Open("test-bam-batch-eof.bam", 0);
+    BAMAlignmentBatch *batch;
+    size_t records = 0;
+    rc_t rc;
+
+    REQUIRE_RC(BAMAlignmentBatchMake(&batch, 100000));
+    while ((rc = BAMFileReadBatch(bam, batch)) == 0)
+        records += batch->count;
+    REQUIRE_EQ(records + batch->count, m_aligned.size());
+    REQUIRE_EQ(GetRCState(rc), rcNotFound);
+    REQUIRE_EQ(GetRCState(BAMFileReadBatch(bam, batch)), rcNotFound);
+    REQUIRE_EQ(batch->count, (uint32_t)0);
+    BAMAlignmentBatchRelease(batch);
+    BAMFileRelease(bam);
+}
+
+FIXTURE_TEST_CASE(BAMFileReadBatch_BadBlockSize, BAMFixture)
+{
+    MakeRaw(1);
+    /* a record within a block */
+    size_t bad = m_aligned.size() / 2;
+    while (m_aligned[bad].rawBeg / m_blockSize != (m_aligned[bad].rawEnd - 1) / m_blockSize)
+        ++bad;
+    SetI32(m_raw, m_aligned[bad].rawBeg, 0);
+    Compress();
+    WriteFile("test-bam-batch-size.bam", m_bgzf);
+
+    size_t records;
+    size_t batches;
+    rc_t const rc = ReadBatches(*this, "test-bam-batch-size.bam", 1000, records, batches);
+    REQUIRE_EQ(GetRCObject(rc), (RCObject)rcData);
+    REQUIRE_EQ(GetRCState(rc), rcInvalid);
+    REQUIRE_EQ(records, bad);
+}
+
+FIXTURE_TEST_CASE(BAMFileReadBatch_BadRecord, BAMFixture)
+{
+    MakeRaw(1);
+    /* a record that spans blocks, with a read longer than the record */
+    size_t bad = m_aligned.size() / 2;
+    while (m_aligned[bad].rawBeg / m_blockSize == (m_aligned[bad].rawEnd - 1) / m_blockSize)
+        ++bad;
+    SetI32(m_raw, m_aligned[bad].rawBeg + 4 + 16, 100000);
+    Compress();
+    WriteFile("test-bam-batch-record.bam", m_bgzf);
+
+    size_t records;
+    size_t batches;
+    rc_t const rc = ReadBatches(*this, "test-bam-batch-record.bam", 1000, records, batches);
+    REQUIRE_EQ(GetRCObject(rc), (RCObject)rcRow);
+    REQUIRE_EQ(GetRCState(rc), rcInvalid);
+    REQUIRE_EQ(records, bad);
+}
+
+/* MARK: region queries */
+
+typedef vector<vector<string> > RegionNames;
+
+/* the names of the alignments of each region by BAMFileSeek and a linear scan */
+static RegionNames SeekRegions(BAMFile const *const bam, vector<BAMRegion> const &regions)
+{
+    RegionNames names(regions.size());
+
+    for (size_t i = 0; i < regions.size(); ++i) {
+        BAMRegion const &reg = regions[i];
+
+        if (reg.start >= reg.end)
+            continue;
+        rc_t rc = BAMFileSeek(bam, reg.refSeqId, reg.start, reg.end);
+        if (rc != 0 && GetRCState(rc) == rcNotFound)
+            continue;
+        if (rc != 0)
+            throw logic_error("BAMFileSeek failed");
+        for ( ; ; ) {
+            BAMAlignment const *rec;
+            char const *name;
+            int32_t refSeqId;
+            int64_t pos;
+            uint32_t len;
+
+            rc = BAMFileRead2(bam, &rec);
+            if (rc != 0 && GetRCState(rc) == rcNotFound)
+                break;
+            if (rc != 0)
+                throw logic_error("BAMFileRead2 failed");
+            BAMAlignmentGetRefSeqId(rec, &refSeqId);
+            BAMAlignmentGetPosition2(rec, &pos, &len);
+            BAMAlignmentGetReadName(rec, &name);
+            string const copy = name;
+            BAMAlignmentRelease(rec);
+
+            if (refSeqId != (int32_t)reg.refSeqId || pos < 0 || (uint64_t)pos >= reg.end)
+                break;
+            if ((uint64_t)(pos + len) > reg.start)
+                names[i].push_back(copy);
+        }
+    }
+    return names;
+}
+
+static rc_t QueryRegions(BAMFile const *const bam, vector<BAMRegion> const &regions,
+                         uint32_t const threads, RegionNames &names)
+{
+    BAMRegionQuery *query;
+    rc_t rc = BAMFileMakeRegionQuery(bam, &query, regions.empty() ? 0 : &regions[0],
+                                     (uint32_t)regions.size(), threads);
+
+    names.assign(regions.size(), vector<string>());
+    while (rc == 0) {
+        BAMAlignment const *rec;
+        char const *name;
+        uint32_t region;
+
+        rc = BAMRegionQueryRead(query, &region, &rec);
+        if (rc == 0) {
+            BAMAlignmentGetReadName(rec, &name);
+            names.at(region).push_back(name);
+            BAMAlignmentRelease(rec);
+        }
+    }
+    BAMRegionQueryRelease(query);
+    return rc;
+}
+
+static vector<BAMRegion> TestRegions()
+{
+    BAMRegion const fixed[] = {
+        { 0,   1000,  50000 },
+        { 0,  20000,  30000 },  /* inside the one before */
+        { 0,  40000,  90000 },  /* overlaps the first */
+        { 0,  25000,  25000 },  /* empty */
+        { 0, 990000, 1000000 }, /* past the last alignment start */
+        { 1,      0, 200000 },
+        { 1, 150000, 150001 },
+        { 2,      0,  50000 },  /* a reference without alignments */
+        { 3, 100000, 100000 },  /* empty */
+        { 3,      0, 400000 },
+    };
+    vector<BAMRegion> regions(fixed, fixed + sizeof(fixed) / sizeof(fixed[0]));
+
+    srand(7);
+    for (unsigned i = 0; i < 40; ++i) {
+        BAMRegion reg;
+
+        reg.refSeqId = rand() % numRefs;
+        reg.start = rand() % refs[reg.refSeqId].length;
+        reg.end = reg.start + (i % 4 == 0 ? rand() % 200000 : rand() % 5000);
+        regions.push_back(reg);
+    }
+    return regions;
+}
+
+FIXTURE_TEST_CASE(BAMRegionQuery_MatchesSeek, BAMFixture)
+{
+    MakeBAM();
+    WriteFile("test-bam-region.bam", m_bgzf);
+    WriteFile("test-bam-region.bam.bai", MakeIndex(false, 5));
+    WriteFile("test-bam-region.bam.csi", BGZF(MakeIndex(true, 6)));
+    WriteFile("test-bam-region.plain.csi", MakeIndex(true, 5));
+
+    vector<BAMRegion> const regions = TestRegions();
+    BAMFile const *bam = Open("test-bam-region.bam", 0);
+    REQUIRE_RC(BAMFileOpenIndex(bam, "test-bam-region.bam.bai"));
+    RegionNames const expected = SeekRegions(bam, regions);
+    BAMFileRelease(bam);
+
+    /* the scan finds what was written */
+    size_t total = 0;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        size_t n = 0;
+
+        for (size_t j = 0; j < m_aligned.size(); ++j) {
+            Alignment const &a = m_aligned[j];
+
+            if (a.ref == (int32_t)regions[i].refSeqId && regions[i].start < regions[i].end &&
+                (uint64_t)a.pos < regions[i].end && (uint64_t)a.end > regions[i].start)
+                ++n;
+        }
+        REQUIRE_EQ(expected[i].size(), n);
+        total += n;
+    }
+    REQUIRE_GT(total, (size_t)1000);
+
+    char const *const indices[] = {
+        "test-bam-region.bam.bai", "test-bam-region.bam.csi", "test-bam-region.plain.csi"
+    };
+    uint32_t const threads[] = { 0, 1, 4 };
+    for (unsigned i = 0; i < sizeof(indices) / sizeof(indices[0]); ++i) {
+        bam = Open("test-bam-region.bam", 0);
+        REQUIRE_RC(BAMFileOpenIndex(bam, indices[i]));
+        for (unsigned t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+            RegionNames actual;
+            rc_t const rc = QueryRegions(bam, regions, threads[t], actual);
+
+            REQUIRE_EQ(GetRCState(rc), rcNotFound);
+            for (size_t r = 0; r < regions.size(); ++r)
+                REQUIRE(actual[r] == expected[r]);
+        }
+        BAMFileRelease(bam);
+    }
+}
+
+FIXTURE_TEST_CASE(BAMRegionQuery_NoChunks, BAMFixture)
+{
+    MakeBAM();
+    WriteFile("test-bam-nochunks.bam", m_bgzf);
+    WriteFile("test-bam-nochunks.bam.bai", MakeIndex(false, 5));
+
+    BAMRegion const regions[] = {
+        { 2, 0, 50000 },
+        { 0, 5000, 5000 },
+    };
+    BAMFile const *bam = Open("test-bam-nochunks.bam", 0);
+    REQUIRE_RC(BAMFileOpenIndex(bam, "test-bam-nochunks.bam.bai"));
+    for (uint32_t threads = 0; threads < 3; ++threads) {
+        for (uint32_t count = 0; count <= 2; ++count) {
+            BAMRegionQuery *query;
+            BAMAlignment const *rec;
+            uint32_t region;
+
+            REQUIRE_RC(BAMFileMakeRegionQuery(bam, &query, regions, count, threads));
+            REQUIRE_EQ(GetRCState(BAMRegionQueryRead(query, &region, &rec)), rcNotFound);
+            REQUIRE_EQ(GetRCState(BAMRegionQueryRead(query, &region, &rec)), rcNotFound);
+            REQUIRE_RC(BAMRegionQueryRelease(query));
+        }
+    }
+    BAMFileRelease(bam);
+}
+
+//////////////////////////////////////////// Main
+
+extern "C"
+{
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary (const char * prog_name)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args)
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-bam";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=BAMFileTestSuite(argc, argv);
+    return rc;
+}
+
+}
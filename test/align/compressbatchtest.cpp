@@ -0,0 +1,450 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for batched reference compression
+*/
+#include <ktst/unit_test.hpp>
+
+#include <klib/rc.h>
+#include <kfs/directory.h>
+#include <kfs/file.h>
+#include <kapp/main.h>
+#include <kfg/config.h>
+#include <vdb/manager.h>
+#include <vdb/schema.h>
+#include <vdb/database.h>
+#include <insdc/insdc.h>
+#include <align/writer-reference.h>
+#include <align/writer-alignment.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TEST_SUITE(CompressBatchTestSuite);
+
+static char const Database[] = "compressbatch.db";
+static char const Fasta[] = "compressbatch.fasta";
+static char const RefName[] = "chr1";
+static int32_t const RefLength = 100000;
+
+/* one alignment: a read, its CIGAR and where it starts on the reference */
+struct Alignment {
+    INSDC_coord_zero offset;
+    string seq;
+    string cigar;
+};
+
+/* one alignment record, with room for every read of it */
+class Record
+{
+public:
+    Record(size_t const bases)
+    : m_readStart(4), m_readLen(4)
+    , m_refOffset(bases), m_refOffsetType(bases)
+    , m_hasRefOffset(bases), m_hasMismatch(bases), m_mismatch(bases)
+    , m_refId(0), m_refStart(0), m_globalRefStart(0)
+    {
+        memset(&data, 0, sizeof(data));
+        Bind();
+    }
+    /* a copy has buffers of its own */
+    Record(Record const &rhs)
+    : data(rhs.data)
+    , m_readStart(rhs.m_readStart), m_readLen(rhs.m_readLen)
+    , m_refOffset(rhs.m_refOffset), m_refOffsetType(rhs.m_refOffsetType)
+    , m_hasRefOffset(rhs.m_hasRefOffset), m_hasMismatch(rhs.m_hasMismatch), m_mismatch(rhs.m_mismatch)
+    , m_refId(rhs.m_refId), m_refStart(rhs.m_refStart), m_globalRefStart(rhs.m_globalRefStart)
+    {
+        Bind();
+    }
+
+    bool operator == (Record const &rhs) const
+    {
+        TableWriterAlgnData const &a = data;
+        TableWriterAlgnData const &b = rhs.data;
+
+        return a.ploidy == b.ploidy
+            && a.ref_len == b.ref_len
+            && a.effective_offset == b.effective_offset
+            && a.ref_1st_row_id == b.ref_1st_row_id
+            && m_refId == rhs.m_refId
+            && m_refStart == rhs.m_refStart
+            && m_globalRefStart == rhs.m_globalRefStart
+            && Same<INSDC_coord_zero>(a.read_start, b.read_start)
+            && Same<INSDC_coord_len>(a.read_len, b.read_len)
+            && Same<int32_t>(a.ref_offset, b.ref_offset)
+            && Same<uint8_t>(a.ref_offset_type, b.ref_offset_type)
+            && Same<uint8_t>(a.has_ref_offset, b.has_ref_offset)
+            && Same<uint8_t>(a.has_mismatch, b.has_mismatch)
+            && Same<char>(a.mismatch, b.mismatch);
+    }
+
+    TableWriterAlgnData data;
+
+private:
+    Record &operator = (Record const &);
+
+    void Bind()
+    {
+        data.read_start.buffer = &m_readStart[0];
+        data.read_len.buffer = &m_readLen[0];
+        data.ref_offset.buffer = &m_refOffset[0];
+        data.ref_offset_type.buffer = &m_refOffsetType[0];
+        data.has_ref_offset.buffer = &m_hasRefOffset[0];
+        data.has_mismatch.buffer = &m_hasMismatch[0];
+        data.mismatch.buffer = &m_mismatch[0];
+        data.ref_id.buffer = &m_refId;
+        data.ref_start.buffer = &m_refStart;
+        data.global_ref_start.buffer = &m_globalRefStart;
+    }
+
+    template<typename T>
+    static bool Same(TableWriterData const &a, TableWriterData const &b)
+    {
+        return a.elements == b.elements
+            && memcmp(a.buffer, b.buffer, a.elements * sizeof(T)) == 0;
+    }
+
+    vector<INSDC_coord_zero> m_readStart;
+    vector<INSDC_coord_len> m_readLen;
+    vector<int32_t> m_refOffset;
+    vector<uint8_t> m_refOffsetType;
+    vector<uint8_t> m_hasRefOffset;
+    vector<uint8_t> m_hasMismatch;
+    vector<char> m_mismatch;
+    int64_t m_refId;
+    INSDC_coord_zero m_refStart;
+    uint64_t m_globalRefStart;
+};
+
+class CompressBatchFixture
+{
+public:
+    CompressBatchFixture()
+    : m_dir(0), m_vmgr(0), m_db(0), m_mgr(0), m_seq(0), m_batchRC(0), m_rnd(88172645463325252ull)
+    {
+        if (KDirectoryNativeDir(&m_dir) != 0)
+            throw logic_error("KDirectoryNativeDir failed");
+        Remove();
+        MakeFasta();
+        if (VDBManagerMakeUpdate(&m_vmgr, m_dir) != 0)
+            throw logic_error("VDBManagerMakeUpdate failed");
+        if (VDBManagerAddSchemaIncludePath(m_vmgr, "../../interfaces") != 0)
+            throw logic_error("VDBManagerAddSchemaIncludePath failed");
+
+        VSchema *schema;
+        if (VDBManagerMakeSchema(m_vmgr, &schema) != 0)
+            throw logic_error("VDBManagerMakeSchema failed");
+        rc_t rc = VSchemaParseFile(schema, "../../interfaces/align/align.vschema");
+        if (rc == 0)
+            rc = VDBManagerCreateDB(m_vmgr, &m_db, schema, "NCBI:align:db:alignment_sorted", kcmInit | kcmMD5, "%s", Database);
+        VSchemaRelease(schema);
+        if (rc != 0)
+            throw logic_error("VDBManagerCreateDB failed");
+        if (ReferenceMgr_Make(&m_mgr, m_db, m_vmgr, 0, NULL, ".", 0, 0, 0) != 0)
+            throw logic_error("ReferenceMgr_Make failed");
+        if (ReferenceMgr_FastaPath(m_mgr, Fasta) != 0)
+            throw logic_error("ReferenceMgr_FastaPath failed");
+
+        bool shouldUnmap = false;
+        bool wasRenamed = false;
+        if (ReferenceMgr_GetSeq(m_mgr, &m_seq, RefName, &shouldUnmap, false, &wasRenamed) != 0)
+            throw logic_error("ReferenceMgr_GetSeq failed");
+    }
+    ~CompressBatchFixture()
+    {
+        ReferenceSeq_Release(m_seq);
+        ReferenceMgr_Release(m_mgr, false, NULL, false, NULL);
+        VDatabaseRelease(m_db);
+        VDBManagerRelease(m_vmgr);
+        Remove();
+        KDirectoryRelease(m_dir);
+    }
+
+    void Remove()
+    {
+        KDirectoryRemove(m_dir, true, "%s", Database);
+        KDirectoryRemove(m_dir, true, "%s", Fasta);
+    }
+
+    uint64_t Random()
+    {
+        m_rnd ^= m_rnd << 13;
+        m_rnd ^= m_rnd >> 7;
+        m_rnd ^= m_rnd << 17;
+        return m_rnd;
+    }
+
+    void MakeFasta()
+    {
+        m_ref.resize(RefLength);
+        for (int32_t i = 0; i < RefLength; ++i)
+            m_ref[i] = "ACGT"[Random() % 4];
+
+        string text = string(">") + RefName + "\n";
+        for (int32_t i = 0; i < RefLength; i += 70)
+            text += m_ref.substr(i, 70) + "\n";
+
+        KFile *file;
+        size_t written = 0;
+        if (KDirectoryCreateFile(m_dir, &file, false, 0644, kcmInit, "%s", Fasta) != 0)
+            throw logic_error("KDirectoryCreateFile failed");
+        rc_t const rc = KFileWriteAll(file, 0, text.data(), text.size(), &written);
+        KFileRelease(file);
+        if (rc != 0 || written != text.size())
+            throw logic_error("KFileWriteAll failed");
+    }
+
+    /* a read of the reference at offset, through cigar, with some bases changed */
+    Alignment Align(INSDC_coord_zero const offset, string const &cigar)
+    {
+        Alignment result = { offset, string(), cigar };
+        int32_t pos = offset;
+        unsigned count = 0;
+
+        for (size_t i = 0; i < cigar.size(); ++i) {
+            char const op = cigar[i];
+
+            if (isdigit(op)) {
+                count = count * 10 + (op - '0');
+                continue;
+            }
+            for (unsigned j = 0; j < count; ++j) {
+                switch (op) {
+                case 'M':
+                    result.seq += pos < RefLength ? m_ref[pos] : 'A';
+                    ++pos;
+                    break;
+                case 'I':
+                case 'S':
+                    result.seq += "ACGT"[Random() % 4];
+                    break;
+                case 'D':
+                case 'N':
+                    ++pos;
+                    break;
+                }
+            }
+            count = 0;
+        }
+        for (size_t i = 0; i < result.seq.size(); ++i) {
+            if (Random() % 20 == 0)
+                result.seq[i] = "ACGTN"[Random() % 5];
+        }
+        return result;
+    }
+
+    Alignment RandomAlignment()
+    {
+        static char const *const cigars[] = {
+            "100M", "50M", "10S80M10S", "30M5I65M", "40M7D60M", "20M300N80M", "5S40M2I20M3D33M",
+        };
+        INSDC_coord_zero const offset = (INSDC_coord_zero)(Random() % (RefLength - 1000));
+
+        return Align(offset, cigars[Random() % (sizeof(cigars) / sizeof(cigars[0]))]);
+    }
+
+    /* records of one read each, or of several for ploidy > 1 */
+    void AddRecord(vector<Alignment> const &reads)
+    {
+        m_records.push_back(reads);
+    }
+
+    /* compresses every record a read at a time, then all of them as one batch, and compares */
+    bool SameAsBatch(uint32_t const threads)
+    {
+        size_t bases = 0;
+
+        for (size_t i = 0; i < m_records.size(); ++i) {
+            for (size_t j = 0; j < m_records[i].size(); ++j)
+                bases = max(bases, m_records[i][j].seq.size() * m_records[i].size());
+        }
+
+        vector<Record> expected(m_records.size(), Record(bases));
+        vector<Record> actual(m_records.size(), Record(bases));
+        vector<rc_t> expectedRC;
+
+        vector<ReferenceSeqCompressItem> items;
+        for (size_t i = 0; i < m_records.size(); ++i) {
+            for (size_t j = 0; j < m_records[i].size(); ++j) {
+                Alignment const &read = m_records[i][j];
+                ReferenceSeqCompressItem item;
+
+                expectedRC.push_back(ReferenceSeq_Compress(m_seq, 0, read.offset,
+                                                           read.seq.data(), read.seq.size(),
+                                                           read.cigar.data(), read.cigar.size(),
+                                                           0, NULL, 0, 0, NULL, 0, 0,
+                                                           &expected[i].data));
+                memset(&item, 0, sizeof(item));
+                item.offset = read.offset;
+                item.seq = read.seq.data();
+                item.seq_len = read.seq.size();
+                item.cigar = read.cigar.data();
+                item.cigar_len = read.cigar.size();
+                item.data = &actual[i].data;
+                items.push_back(item);
+            }
+        }
+
+        rc_t const rc = ReferenceMgr_CompressBatch(m_mgr, 0, RefName, items.size(), &items[0], threads);
+        rc_t firstRC = 0;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (items[i].rc != expectedRC[i])
+                return false;
+            if (firstRC == 0)
+                firstRC = expectedRC[i];
+        }
+        m_batchRC = rc;
+        if (rc != firstRC)
+            return false;
+
+        /* the records are compared whole, including those that failed part way */
+        for (size_t i = 0; i < m_records.size(); ++i) {
+            if (!(actual[i] == expected[i]))
+                return false;
+        }
+        return true;
+    }
+
+    KDirectory *m_dir;
+    VDBManager *m_vmgr;
+    VDatabase *m_db;
+    ReferenceMgr const *m_mgr;
+    ReferenceSeq const *m_seq;
+    string m_ref;
+    vector< vector<Alignment> > m_records;
+    rc_t m_batchRC;
+    uint64_t m_rnd;
+};
+
+static uint32_t const Threads[] = { 0, 1, 2, 4, 8 };
+static unsigned const ThreadCases = sizeof(Threads) / sizeof(Threads[0]);
+
+FIXTURE_TEST_CASE(CompressBatch_Empty, CompressBatchFixture)
+{
+    for (unsigned t = 0; t < ThreadCases; ++t)
+        REQUIRE_RC(ReferenceMgr_CompressBatch(m_mgr, 0, RefName, 0, NULL, Threads[t]));
+}
+
+FIXTURE_TEST_CASE(CompressBatch_Reads, CompressBatchFixture)
+{
+    for (unsigned i = 0; i < 500; ++i)
+        AddRecord(vector<Alignment>(1, RandomAlignment()));
+    for (unsigned t = 0; t < ThreadCases; ++t) {
+        REQUIRE(SameAsBatch(Threads[t]));
+        REQUIRE_RC(m_batchRC);
+    }
+}
+
+FIXTURE_TEST_CASE(CompressBatch_FewerReadsThanThreads, CompressBatchFixture)
+{
+    AddRecord(vector<Alignment>(1, RandomAlignment()));
+    AddRecord(vector<Alignment>(1, RandomAlignment()));
+    REQUIRE(SameAsBatch(8));
+    REQUIRE_RC(m_batchRC);
+}
+
+FIXTURE_TEST_CASE(CompressBatch_Ploidy, CompressBatchFixture)
+{
+    /* the reads of a record share its data and follow each other in it */
+    for (unsigned i = 0; i < 200; ++i) {
+        INSDC_coord_zero const offset = (INSDC_coord_zero)(Random() % (RefLength - 1000));
+        vector<Alignment> reads;
+
+        for (unsigned j = 0; j < 1 + i % 3; ++j)
+            reads.push_back(Align(offset, "60M"));
+        AddRecord(reads);
+    }
+    for (unsigned t = 0; t < ThreadCases; ++t) {
+        REQUIRE(SameAsBatch(Threads[t]));
+        REQUIRE_RC(m_batchRC);
+    }
+}
+
+FIXTURE_TEST_CASE(CompressBatch_OutsideWindow, CompressBatchFixture)
+{
+    /* the reference read ahead for the batch ends well short of the end of the last read's gap */
+    for (unsigned i = 0; i < 50; ++i)
+        AddRecord(vector<Alignment>(1, Align(1000 + i * 100, "100M")));
+    AddRecord(vector<Alignment>(1, Align(20000, "30M40000N30M")));
+    AddRecord(vector<Alignment>(1, Align(20000, "30M40000D30M")));
+    for (unsigned t = 0; t < ThreadCases; ++t) {
+        REQUIRE(SameAsBatch(Threads[t]));
+        REQUIRE_RC(m_batchRC);
+    }
+}
+
+FIXTURE_TEST_CASE(CompressBatch_FailsInTheMiddle, CompressBatchFixture)
+{
+    /* a read past the end of the reference fails alone, the rest are done anyway */
+    for (unsigned i = 0; i < 20; ++i)
+        AddRecord(vector<Alignment>(1, RandomAlignment()));
+    AddRecord(vector<Alignment>(1, Align(RefLength + 500, "50M")));
+    for (unsigned i = 0; i < 20; ++i)
+        AddRecord(vector<Alignment>(1, RandomAlignment()));
+    AddRecord(vector<Alignment>(1, Align(RefLength + 900, "70M")));
+
+    for (unsigned t = 0; t < ThreadCases; ++t) {
+        REQUIRE(SameAsBatch(Threads[t]));
+        REQUIRE_NE(m_batchRC, (rc_t)0);
+    }
+}
+
+//////////////////////////////////////////// Main
+
+extern "C"
+{
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary (const char * prog_name)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args)
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-compress-batch";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=CompressBatchTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -0,0 +1,518 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for the reference chunk cache
+*/
+#include <ktst/unit_test.hpp>
+
+#include <klib/rc.h>
+#include <kfs/directory.h>
+#include <kapp/main.h>
+#include <kfg/config.h>
+#include <vdb/manager.h>
+#include <vdb/schema.h>
+#include <vdb/database.h>
+#include <vdb/table.h>
+#include <vdb/cursor.h>
+#include <insdc/insdc.h>
+#include <align/writer-refseq.h>
+#include <align/refseq-mgr.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TEST_SUITE(RefSeqCacheTestSuite);
+
+/* bases per cached chunk, as in refseq-mgr.c */
+static int32_t const Chunk = 5000;
+
+static char const Linear[] = "refseqcache.linear";
+static char const Circular[] = "refseqcache.circular";
+
+/* WGS contigs are <prefix><row>, the prefix is the database;
+   as local paths, so that they are not taken for remote accessions */
+static char const WGSPrefix[] = "./RSCW01";
+static unsigned const WGSContigs = 4;
+
+class RefSeqCacheFixture
+{
+public:
+    RefSeqCacheFixture()
+    : m_dir(0), m_vmgr(0), m_plain(0), m_rnd(88172645463325252ull)
+    {
+        if (KDirectoryNativeDir(&m_dir) != 0)
+            throw logic_error("KDirectoryNativeDir failed");
+        if (VDBManagerMakeUpdate(&m_vmgr, m_dir) != 0)
+            throw logic_error("VDBManagerMakeUpdate failed");
+        if (VDBManagerAddSchemaIncludePath(m_vmgr, "../../interfaces") != 0)
+            throw logic_error("VDBManagerAddSchemaIncludePath failed");
+        Remove();
+        MakeRefSeq(Linear, 23456, false);
+        MakeRefSeq(Circular, 12345, true);
+        MakeWGS();
+        m_plain = MakeMgr(0, 0);
+    }
+    ~RefSeqCacheFixture()
+    {
+        RefSeqMgr_Release(m_plain);
+        VDBManagerRelease(m_vmgr);
+        Remove();
+        KDirectoryRelease(m_dir);
+    }
+
+    void Remove()
+    {
+        KDirectoryRemove(m_dir, true, "%s", Linear);
+        KDirectoryRemove(m_dir, true, "%s", Circular);
+        KDirectoryRemove(m_dir, true, "%s", WGSPrefix);
+        for (unsigned i = 1; i <= WGSContigs; ++i)
+            KDirectoryRemove(m_dir, true, "%s", Contig(i).c_str());
+    }
+
+    uint64_t Random()
+    {
+        m_rnd ^= m_rnd << 13;
+        m_rnd ^= m_rnd >> 7;
+        m_rnd ^= m_rnd << 17;
+        return m_rnd;
+    }
+
+    string Bases(size_t const length)
+    {
+        string bases(length, 'N');
+
+        for (size_t i = 0; i < length; ++i)
+            bases[i] = "ACGT"[Random() % 4];
+        return bases;
+    }
+
+    void MakeRefSeq(char const *const path, size_t const length, bool circular)
+    {
+        TableWriterRefSeq const *writer;
+        TableWriterData data;
+
+        if (TableWriterRefSeq_Make(&writer, m_vmgr, "../../interfaces/align/refseq.vschema", path, 0) != 0)
+            throw logic_error("TableWriterRefSeq_Make failed");
+
+        data.buffer = &circular;
+        data.elements = 1;
+        TableWriterRefSeq_WriteDefault(writer, ewrefseq_cn_CIRCULAR, &data);
+        data.buffer = path;
+        data.elements = strlen(path);
+        TableWriterRefSeq_WriteDefault(writer, ewrefseq_cn_SEQ_ID, &data);
+        TableWriterRefSeq_WriteDefault(writer, ewrefseq_cn_DEF_LINE, &data);
+
+        /* rows of the table's default length, which is also the cache's chunk size */
+        string const bases = Bases(length);
+        for (size_t i = 0; i < length; i += Chunk) {
+            TableWriterRefSeqData row;
+
+            memset(&row, 0, sizeof(row));
+            row.read.buffer = bases.data() + i;
+            row.read.elements = min(length - i, (size_t)Chunk);
+            if (TableWriterRefSeq_Write(writer, &row, NULL) != 0)
+                throw logic_error("TableWriterRefSeq_Write failed");
+        }
+        if (TableWriterRefSeq_Whack(writer, true, NULL, "test", 0x1000000, "Jan  1 2020", "test", 0x1000000) != 0)
+            throw logic_error("TableWriterRefSeq_Whack failed");
+    }
+
+    static string Contig(unsigned const row)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "%s%06u", WGSPrefix, row);
+        return name;
+    }
+
+    void MakeWGS()
+    {
+        VSchema *schema;
+        VDatabase *db;
+        VTable *tbl;
+        VCursor *curs;
+        uint32_t col;
+        rc_t rc;
+
+        if (VDBManagerMakeSchema(m_vmgr, &schema) != 0)
+            throw logic_error("VDBManagerMakeSchema failed");
+        rc = VSchemaParseFile(schema, "../../interfaces/ncbi/wgs-contig.vschema");
+        if (rc == 0)
+            rc = VDBManagerCreateDB(m_vmgr, &db, schema, "NCBI:WGS:db:contig", kcmInit | kcmMD5, "%s", WGSPrefix);
+        VSchemaRelease(schema);
+        if (rc != 0)
+            throw logic_error("VDBManagerCreateDB failed");
+        rc = VDatabaseCreateTable(db, &tbl, "SEQUENCE", kcmInit | kcmMD5, "SEQUENCE");
+        VDatabaseRelease(db);
+        if (rc != 0)
+            throw logic_error("VDatabaseCreateTable failed");
+        rc = VTableCreateCursorWrite(tbl, &curs, kcmInsert);
+        if (rc == 0)
+            rc = VCursorAddColumn(curs, &col, "(INSDC:dna:text)READ");
+        if (rc == 0)
+            rc = VCursorOpen(curs);
+
+        /* one contig shorter than a chunk, the others crossing chunk boundaries */
+        size_t const lengths[WGSContigs] = { 7321, 1234, 12000, 10001 };
+        for (unsigned i = 0; rc == 0 && i < WGSContigs; ++i) {
+            string const bases = Bases(lengths[i]);
+
+            rc = VCursorOpenRow(curs);
+            if (rc == 0)
+                rc = VCursorWrite(curs, col, 8, bases.data(), 0, bases.size());
+            if (rc == 0)
+                rc = VCursorCommitRow(curs);
+            if (rc == 0)
+                rc = VCursorCloseRow(curs);
+        }
+        if (rc == 0)
+            rc = VCursorCommit(curs);
+        VCursorRelease(curs);
+        if (rc == 0)
+            rc = VTableReindex(tbl);
+        VTableRelease(tbl);
+        if (rc != 0)
+            throw logic_error("writing WGS contigs failed");
+
+        /* a resolver would map every contig to the prefix's database */
+        for (unsigned i = 1; i <= WGSContigs; ++i) {
+            if (KDirectoryCreateAlias(m_dir, 0777, kcmInit, WGSPrefix, Contig(i).c_str()) != 0)
+                throw logic_error("KDirectoryCreateAlias failed");
+        }
+    }
+
+    /* each on its own VDB manager: opening a contig by its alias where the
+       prefix is already open under its own name would find it busy */
+    RefSeqMgr const *MakeMgr(RefSeqChunkCache *const cache, uint32_t const readahead, uint32_t const options = 0)
+    {
+        VDBManager *vmgr;
+        RefSeqMgr const *mgr;
+
+        if (VDBManagerMakeUpdate(&vmgr, m_dir) != 0)
+            throw logic_error("VDBManagerMakeUpdate failed");
+        rc_t const rc = RefSeqMgr_Make(&mgr, vmgr, options, 0, 0);
+        VDBManagerRelease(vmgr);
+        if (rc != 0)
+            throw logic_error("RefSeqMgr_Make failed");
+        if (cache && RefSeqMgr_SetChunkCache(mgr, cache, readahead) != 0)
+            throw logic_error("RefSeqMgr_SetChunkCache failed");
+        return mgr;
+    }
+
+    static RefSeqChunkCache *MakeCache(size_t const memory)
+    {
+        RefSeqChunkCache *cache;
+
+        if (RefSeqChunkCache_Make(&cache, memory) != 0)
+            throw logic_error("RefSeqChunkCache_Make failed");
+        return cache;
+    }
+
+    static RefSeqChunkCacheStats Stats(RefSeqChunkCache const *const cache)
+    {
+        RefSeqChunkCacheStats stats;
+
+        RefSeqChunkCache_GetStats(cache, &stats);
+        return stats;
+    }
+
+    /* a read through mgr returns the same as one through the plain manager */
+    static bool SameRead(RefSeqMgr const *const mgr, RefSeqMgr const *const plain,
+                         string const &name, int32_t const offset, uint32_t const length)
+    {
+        vector<uint8_t> expected(length + 1, 0xFF);
+        vector<uint8_t> actual(length + 1, 0xFF);
+        INSDC_coord_len expectedWritten = 0;
+        INSDC_coord_len actualWritten = 0;
+        rc_t const expectedRC = RefSeqMgr_Read(plain, name.data(), name.size(), offset, length,
+                                               &expected[0], &expectedWritten);
+        rc_t const actualRC = RefSeqMgr_Read(mgr, name.data(), name.size(), offset, length,
+                                             &actual[0], &actualWritten);
+
+        if (actualRC != expectedRC) {
+            cerr << name << " @" << offset << "+" << length << ": rc " << actualRC << " != " << expectedRC << endl;
+            return false;
+        }
+        if (actualRC != 0)
+            return true;
+        if (actualWritten != expectedWritten || memcmp(&actual[0], &expected[0], actualWritten) != 0) {
+            cerr << name << " @" << offset << "+" << length << ": " << actualWritten << " bases != " << expectedWritten << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool SameReads(RefSeqMgr const *const mgr, RefSeqMgr const *const plain, string const &name, int32_t const length)
+    {
+        struct { int32_t offset; uint32_t length; } const reads[] = {
+            { 0, 1 },
+            { 0, Chunk },
+            { Chunk - 10, 20 },                 /* across a chunk boundary */
+            { Chunk - 1, 2 },
+            { Chunk, Chunk },                   /* exactly one chunk */
+            { Chunk / 2, 2 * Chunk },           /* across two boundaries */
+            { 0, (uint32_t)length },            /* all of it */
+            { length - 6, 6 },                  /* up to the end */
+            { length - 6, 100 },                /* past the end: short or wrapped */
+            { length - 1, 2 * Chunk },
+            { length, 10 },                     /* at the end */
+            { length + 17, 10 },                /* after the end */
+            { -10, 30 },                        /* before the start */
+            { 100, 0 },
+        };
+        for (unsigned i = 0; i < sizeof(reads) / sizeof(reads[0]); ++i) {
+            /* twice, the second time from the cache */
+            for (unsigned j = 0; j < 2; ++j) {
+                if (!SameRead(mgr, plain, name, reads[i].offset, reads[i].length))
+                    return false;
+            }
+        }
+        for (unsigned i = 0; i < 500; ++i) {
+            int32_t const offset = (int32_t)(Random() % (length + 2 * Chunk)) - Chunk / 2;
+            uint32_t const len = i % 4 == 0 ? Random() % (3 * Chunk) : Random() % 100;
+
+            if (!SameRead(mgr, plain, name, offset, len))
+                return false;
+        }
+        return true;
+    }
+
+    /* a sequence read before is read from the cache alone, a chunk at a time */
+    bool Cached(RefSeqMgr const *const mgr, RefSeqChunkCache const *const cache, string const &name, int32_t const length)
+    {
+        RefSeqChunkCacheStats const before = Stats(cache);
+
+        if (!SameRead(mgr, m_plain, name, 0, length))
+            return false;
+
+        RefSeqChunkCacheStats const after = Stats(cache);
+        return after.misses == before.misses && after.hits - before.hits == (uint64_t)((length + Chunk - 1) / Chunk);
+    }
+
+    KDirectory *m_dir;
+    VDBManager *m_vmgr;
+    RefSeqMgr const *m_plain;
+    uint64_t m_rnd;
+};
+
+FIXTURE_TEST_CASE(RefSeqCache_Linear, RefSeqCacheFixture)
+{
+    RefSeqChunkCache *const cache = MakeCache(64 * 1024 * 1024);
+    RefSeqMgr const *const mgr = MakeMgr(cache, 0);
+
+    REQUIRE(SameReads(mgr, m_plain, Linear, 23456));
+    REQUIRE(Cached(mgr, cache, Linear, 23456));
+
+    RefSeqChunkCacheStats const stats = Stats(cache);
+    REQUIRE_EQ(stats.evicted, (uint64_t)0);
+    REQUIRE_EQ(stats.readahead, (uint64_t)0);
+
+    RefSeqMgr_Release(mgr);
+    RefSeqChunkCache_Release(cache);
+}
+
+FIXTURE_TEST_CASE(RefSeqCache_Circular, RefSeqCacheFixture)
+{
+    RefSeqChunkCache *const cache = MakeCache(64 * 1024 * 1024);
+    RefSeqMgr const *const mgr = MakeMgr(cache, 0);
+
+    /* reads past the end wrap around to the start */
+    REQUIRE(SameReads(mgr, m_plain, Circular, 12345));
+    REQUIRE(SameRead(mgr, m_plain, Circular, 12345 - Chunk / 2, 3 * Chunk));
+    REQUIRE(Cached(mgr, cache, Circular, 12345));
+
+    RefSeqMgr_Release(mgr);
+    RefSeqChunkCache_Release(cache);
+}
+
+FIXTURE_TEST_CASE(RefSeqCache_ReaderOptions, RefSeqCacheFixture)
+{
+    /* 4na and text bases of the same chunk are cached apart */
+    RefSeqChunkCache *const cache = MakeCache(64 * 1024 * 1024);
+    RefSeqMgr const *const text = MakeMgr(cache, 0);
+    RefSeqMgr const *const bin = MakeMgr(cache, 0, 1);
+    RefSeqMgr const *const plainBin = MakeMgr(0, 0, 1);
+
+    REQUIRE(SameReads(text, m_plain, Linear, 23456));
+    REQUIRE(Cached(text, cache, Linear, 23456));
+
+    uint64_t const misses = Stats(cache).misses;
+    REQUIRE(SameRead(bin, plainBin, Linear, 0, 10));
+    REQUIRE_EQ(Stats(cache).misses, misses + 1);
+    REQUIRE(SameReads(bin, plainBin, Linear, 23456));
+
+    RefSeqMgr_Release(plainBin);
+    RefSeqMgr_Release(bin);
+    RefSeqMgr_Release(text);
+    RefSeqChunkCache_Release(cache);
+}
+
+FIXTURE_TEST_CASE(RefSeqCache_WGS, RefSeqCacheFixture)
+{
+    RefSeqChunkCache *const cache = MakeCache(64 * 1024 * 1024);
+    RefSeqMgr const *const mgr = MakeMgr(cache, 4);
+    size_t const lengths[WGSContigs] = { 7321, 1234, 12000, 10001 };
+
+    /* every contig is a row of the same database, and is cached as its own */
+    for (unsigned pass = 0; pass < 2; ++pass) {
+        for (unsigned i = WGSContigs; i > 0; --i)
+            REQUIRE(SameReads(mgr, m_plain, Contig(i), lengths[i - 1]));
+    }
+
+    for (unsigned i = 1; i <= WGSContigs; ++i)
+        REQUIRE(Cached(mgr, cache, Contig(i), lengths[i - 1]));
+    REQUIRE_EQ(Stats(cache).readahead, (uint64_t)0);
+
+    RefSeqMgr_Release(mgr);
+    RefSeqChunkCache_Release(cache);
+}
+
+FIXTURE_TEST_CASE(RefSeqCache_Eviction, RefSeqCacheFixture)
+{
+    /* room for about two chunks */
+    size_t const memory = 2 * Chunk + 2000;
+    RefSeqChunkCache *const cache = MakeCache(memory);
+    RefSeqMgr const *const mgr = MakeMgr(cache, 0);
+
+    REQUIRE(SameReads(mgr, m_plain, Linear, 23456));
+    REQUIRE(SameReads(mgr, m_plain, Circular, 12345));
+
+    RefSeqChunkCacheStats const stats = Stats(cache);
+    REQUIRE_GT(stats.evicted, (uint64_t)0);
+    REQUIRE_LE(stats.used, memory);
+
+    RefSeqMgr_Release(mgr);
+    RefSeqChunkCache_Release(cache);
+}
+
+FIXTURE_TEST_CASE(RefSeqCache_Readahead, RefSeqCacheFixture)
+{
+    RefSeqChunkCache *const cache = MakeCache(64 * 1024 * 1024);
+    RefSeqMgr const *const mgr = MakeMgr(cache, 2);
+
+    REQUIRE(SameReads(mgr, m_plain, Linear, 23456));
+    REQUIRE(SameReads(mgr, m_plain, Circular, 12345));
+    REQUIRE_GT(Stats(cache).readahead, (uint64_t)0);
+
+    RefSeqMgr_Release(mgr);
+    RefSeqChunkCache_Release(cache);
+}
+
+FIXTURE_TEST_CASE(RefSeqCache_ReadaheadFailure, RefSeqCacheFixture)
+{
+    RefSeqChunkCache *const cache = MakeCache(64 * 1024 * 1024);
+    RefSeqMgr const *const mgr = MakeMgr(0, 0);
+    string const moved = string(Linear) + ".moved";
+
+    /* the readers have the reference open, the readahead thread has to open it by name */
+    REQUIRE(SameRead(mgr, m_plain, Linear, 0, 10));
+    REQUIRE_RC(KDirectoryRename(m_dir, false, Linear, moved.c_str()));
+    REQUIRE_RC(RefSeqMgr_SetChunkCache(mgr, cache, 2));
+
+    REQUIRE(SameReads(mgr, m_plain, Linear, 23456));
+    REQUIRE_RC(RefSeqMgr_SetChunkCache(mgr, NULL, 0));
+
+    RefSeqChunkCacheStats const stats = Stats(cache);
+    REQUIRE_GT(stats.readahead, (uint64_t)0);
+    REQUIRE_GT(stats.failed, (uint64_t)0);
+    REQUIRE_LE(stats.failed, stats.readahead);
+    REQUIRE_NE(stats.failure, (rc_t)0);
+
+    REQUIRE_RC(KDirectoryRename(m_dir, false, moved.c_str(), Linear));
+    RefSeqMgr_Release(mgr);
+    RefSeqChunkCache_Release(cache);
+}
+
+FIXTURE_TEST_CASE(RefSeqCache_StopWhileQueued, RefSeqCacheFixture)
+{
+    RefSeqChunkCache *const cache = MakeCache(64 * 1024 * 1024);
+    RefSeqMgr const *mgr = MakeMgr(cache, 4);
+
+    /* queues the rest of the reference, then detaches before it has been read */
+    REQUIRE(SameRead(mgr, m_plain, Linear, 0, 10));
+    REQUIRE_RC(RefSeqMgr_SetChunkCache(mgr, NULL, 0));
+    REQUIRE(SameRead(mgr, m_plain, Linear, Chunk - 10, 3 * Chunk));
+
+    /* the same, then released */
+    REQUIRE_RC(RefSeqMgr_SetChunkCache(mgr, cache, 4));
+    REQUIRE(SameRead(mgr, m_plain, Circular, 0, 10));
+    RefSeqMgr_Release(mgr);
+
+    /* chunks dropped from the queue are not left behind half made, for others to wait on */
+    mgr = MakeMgr(cache, 0);
+    REQUIRE(SameReads(mgr, m_plain, Linear, 23456));
+    REQUIRE(SameReads(mgr, m_plain, Circular, 12345));
+    REQUIRE_GT(Stats(cache).readahead, (uint64_t)0);
+
+    /* and over and over, stopping at whatever point the queue has reached */
+    for (unsigned i = 0; i < 20; ++i) {
+        RefSeqChunkCache *const fresh = MakeCache(64 * 1024 * 1024);
+        RefSeqMgr const *const quick = MakeMgr(fresh, 1 + i % 4);
+
+        REQUIRE(SameRead(quick, m_plain, i % 2 ? Linear : Circular, (int32_t)(i * 211), 10));
+        RefSeqMgr_Release(quick);
+        RefSeqChunkCache_Release(fresh);
+    }
+
+    RefSeqMgr_Release(mgr);
+    RefSeqChunkCache_Release(cache);
+}
+
+//////////////////////////////////////////// Main
+
+extern "C"
+{
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary (const char * prog_name)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args)
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-refseq-cache";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=RefSeqCacheTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -0,0 +1,751 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for sharded placement walks
+*/
+#include <ktst/unit_test.hpp>
+
+#include <klib/rc.h>
+#include <kfs/directory.h>
+#include <kfs/file.h>
+#include <kapp/main.h>
+#include <kfg/config.h>
+#include <vdb/manager.h>
+#include <vdb/database.h>
+#include <insdc/insdc.h>
+
+#if !READ_ONLY
+#include <vdb/schema.h>
+#include <align/writer-reference.h>
+#include <align/writer-alignment.h>
+#else
+#include <kproc/lock.h>
+#include <align/manager.h>
+#include <align/reference.h>
+#include <align/iterator.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * We will compile this test file first in read/write mode and create a
+ * cSRA database using libncbi-wvdb; then compile it again, with -DREAD_ONLY,
+ * link it against the read-only libncbi-vdb and walk the database.
+ *
+ * NB: rw mode test creates DB, rd mode deletes it.
+ */
+
+TEST_SUITE(WalkShardsTestSuite);
+
+static char const Database[] = "walkshards.db";
+
+struct Reference {
+    char const *name;
+    int32_t length;
+    unsigned reads;
+};
+
+static Reference const References[] = {
+    { "chr1", 60000, 2000 },
+    { "chr2", 23000, 800 },
+};
+static unsigned const ReferenceCount = sizeof(References) / sizeof(References[0]);
+
+#if !READ_ONLY
+
+static char const Fasta[] = "walkshards.fasta";
+
+/* one primary alignment, where it starts and how it lies on the reference */
+struct Alignment {
+    unsigned ref;
+    INSDC_coord_zero offset;
+    string cigar;
+
+    bool operator < (Alignment const &rhs) const
+    {
+        return ref < rhs.ref || (ref == rhs.ref && offset < rhs.offset);
+    }
+};
+
+/* a record for the PRIMARY_ALIGNMENT table, with room for the longest read */
+class Record
+{
+public:
+    Record(size_t const bases)
+    : m_readStart(0), m_readLen(0), m_readId(1), m_tmpKeyId(0)
+    , m_refOffset(bases), m_refOffsetType(bases)
+    , m_hasRefOffset(bases), m_hasMismatch(bases), m_mismatch(bases)
+    , m_refId(0), m_refStart(0), m_globalRefStart(0)
+    , m_refOrientation(false), m_mapq(0)
+    {
+        memset(&data, 0, sizeof(data));
+        data.read_start.buffer = &m_readStart;
+        data.read_len.buffer = &m_readLen;
+        data.seq_read_id.buffer = &m_readId;
+        data.seq_read_id.elements = 1;
+        data.tmp_key_id.buffer = &m_tmpKeyId;
+        data.tmp_key_id.elements = 1;
+        data.ref_offset.buffer = &m_refOffset[0];
+        data.ref_offset_type.buffer = &m_refOffsetType[0];
+        data.has_ref_offset.buffer = &m_hasRefOffset[0];
+        data.has_mismatch.buffer = &m_hasMismatch[0];
+        data.mismatch.buffer = &m_mismatch[0];
+        data.ref_id.buffer = &m_refId;
+        data.ref_start.buffer = &m_refStart;
+        data.global_ref_start.buffer = &m_globalRefStart;
+        data.ref_orientation.buffer = &m_refOrientation;
+        data.ref_orientation.elements = 1;
+        data.mapq.buffer = &m_mapq;
+        data.mapq.elements = 1;
+    }
+
+    void Reset(uint64_t const key, int32_t const mapq)
+    {
+        data.ploidy = 0;
+        m_tmpKeyId = key;
+        m_mapq = mapq;
+    }
+
+    TableWriterAlgnData data;
+
+private:
+    Record(Record const &);
+    Record &operator = (Record const &);
+
+    INSDC_coord_zero m_readStart;
+    INSDC_coord_len m_readLen;
+    INSDC_coord_one m_readId;
+    uint64_t m_tmpKeyId;
+    vector<int32_t> m_refOffset;
+    vector<uint8_t> m_refOffsetType;
+    vector<uint8_t> m_hasRefOffset;
+    vector<uint8_t> m_hasMismatch;
+    vector<char> m_mismatch;
+    int64_t m_refId;
+    INSDC_coord_zero m_refStart;
+    uint64_t m_globalRefStart;
+    bool m_refOrientation;
+    int32_t m_mapq;
+};
+
+/* the coverage pass asks after every row */
+static rc_t NotQuitting(void)
+{
+    return 0;
+}
+
+class WriteFixture
+{
+public:
+    WriteFixture()
+    : m_dir(0), m_rnd(88172645463325252ull)
+    {
+        if (KDirectoryNativeDir(&m_dir) != 0)
+            throw logic_error("KDirectoryNativeDir failed");
+        KDirectoryRemove(m_dir, true, "%s", Database);
+    }
+    ~WriteFixture()
+    {
+        KDirectoryRemove(m_dir, true, "%s", Fasta);
+        KDirectoryRelease(m_dir);
+    }
+
+    uint64_t Random()
+    {
+        m_rnd ^= m_rnd << 13;
+        m_rnd ^= m_rnd >> 7;
+        m_rnd ^= m_rnd << 17;
+        return m_rnd;
+    }
+
+    rc_t MakeFasta()
+    {
+        string text;
+
+        for (unsigned r = 0; r < ReferenceCount; ++r) {
+            string bases;
+
+            for (int32_t i = 0; i < References[r].length; ++i)
+                bases += "ACGT"[Random() % 4];
+            m_ref.push_back(bases);
+
+            text += string(">") + References[r].name + "\n";
+            for (int32_t i = 0; i < References[r].length; i += 70)
+                text += bases.substr(i, 70) + "\n";
+        }
+
+        KFile *file;
+        size_t written = 0;
+        rc_t rc = KDirectoryCreateFile(m_dir, &file, false, 0644, kcmInit, "%s", Fasta);
+        if (rc == 0) {
+            rc = KFileWriteAll(file, 0, text.data(), text.size(), &written);
+            KFileRelease(file);
+        }
+        return rc;
+    }
+
+    void Add(unsigned const ref, INSDC_coord_zero const offset, string const &cigar)
+    {
+        Alignment const a = { ref, offset, cigar };
+        m_alignments.push_back(a);
+    }
+
+    /* the bases of the reference the cigar covers */
+    string Read(Alignment const &a)
+    {
+        string seq;
+        int32_t pos = a.offset;
+        unsigned count = 0;
+
+        for (size_t i = 0; i < a.cigar.size(); ++i) {
+            char const op = a.cigar[i];
+
+            if (isdigit(op)) {
+                count = count * 10 + (op - '0');
+                continue;
+            }
+            for (unsigned j = 0; j < count; ++j) {
+                switch (op) {
+                case 'M':
+                    seq += m_ref[a.ref][pos++];
+                    break;
+                case 'I':
+                case 'S':
+                    seq += "ACGT"[Random() % 4];
+                    break;
+                case 'D':
+                case 'N':
+                    ++pos;
+                    break;
+                }
+            }
+            count = 0;
+        }
+        return seq;
+    }
+
+    /* writes the alignments in reference order, then the REFERENCE table with its alignment ids */
+    rc_t Write()
+    {
+        VDBManager *vmgr = 0;
+        VSchema *schema = 0;
+        VDatabase *db = 0;
+        ReferenceMgr const *refs = 0;
+        TableWriterAlgn const *algn = 0;
+        Record rec(512);
+
+        stable_sort(m_alignments.begin(), m_alignments.end());
+
+        rc_t rc = VDBManagerMakeUpdate(&vmgr, m_dir);
+        if (rc == 0)
+            rc = VDBManagerAddSchemaIncludePath(vmgr, "../../interfaces");
+        if (rc == 0)
+            rc = VDBManagerMakeSchema(vmgr, &schema);
+        if (rc == 0)
+            rc = VSchemaParseFile(schema, "../../interfaces/align/align.vschema");
+        if (rc == 0)
+            rc = VDBManagerCreateDB(vmgr, &db, schema, "NCBI:align:db:alignment_sorted", kcmInit | kcmMD5, "%s", Database);
+        if (rc == 0)
+            rc = ReferenceMgr_Make(&refs, db, vmgr, 0, NULL, ".", 0, 0, 0);
+        if (rc == 0)
+            rc = ReferenceMgr_FastaPath(refs, Fasta);
+        if (rc == 0)
+            rc = TableWriterAlgn_Make(&algn, db, ewalgn_tabletype_PrimaryAlignment, ewalgn_co_TMP_KEY_ID);
+
+        for (size_t i = 0; rc == 0 && i < m_alignments.size(); ++i) {
+            Alignment const &a = m_alignments[i];
+            string const seq = Read(a);
+            int64_t rowid;
+
+            rec.Reset(i + 1, (int32_t)(Random() % 60));
+            rc = ReferenceMgr_Compress(refs, 0, References[a.ref].name, a.offset,
+                                       seq.data(), seq.size(), a.cigar.data(), a.cigar.size(),
+                                       0, NULL, 0, 0, NULL, 0, 0, &rec.data);
+            if (rc == 0)
+                rc = TableWriterAlgn_Write(algn, &rec.data, &rowid);
+        }
+
+        rc_t rc2 = TableWriterAlgn_Whack(algn, rc == 0, NULL);
+        if (rc == 0)
+            rc = rc2;
+        /* PRIMARY_ALIGNMENT_IDS and OVERLAP_* come from the coverage pass */
+        rc2 = ReferenceMgr_Release(refs, rc == 0, NULL, rc == 0, NotQuitting);
+        if (rc == 0)
+            rc = rc2;
+        VDatabaseRelease(db);
+        VSchemaRelease(schema);
+        VDBManagerRelease(vmgr);
+        return rc;
+    }
+
+    KDirectory *m_dir;
+    vector<string> m_ref;
+    vector<Alignment> m_alignments;
+    uint64_t m_rnd;
+};
+
+FIXTURE_TEST_CASE(WalkShards_MakeDatabase, WriteFixture)
+{
+    static char const *const cigars[] = {
+        "100M", "50M", "10S80M10S", "30M5I65M", "40M7D60M", "20M3000N20M",
+    };
+
+    REQUIRE_RC(MakeFasta());
+    for (unsigned r = 0; r < ReferenceCount; ++r) {
+        int32_t const length = References[r].length;
+
+        for (unsigned i = 0; i < References[r].reads; ++i)
+            Add(r, (INSDC_coord_zero)(Random() % (length - 3100)), cigars[Random() % (sizeof(cigars) / sizeof(cigars[0]))]);
+
+        /* piles on both sides of a boundary every shard length used shares */
+        for (unsigned i = 0; i < 20; ++i) {
+            Add(r, 9999, "50M");
+            Add(r, 10000, "50M");
+        }
+        /* the first and the last base */
+        Add(r, 0, "60M");
+        Add(r, length - 60, "60M");
+    }
+    /* across many shards and several REFERENCE rows */
+    Add(0, 1000, "20M25000N20M");
+    Add(0, 1001, "20M47000D20M");
+    Add(1, 4990, "20M12000N20M");
+
+    REQUIRE_RC(Write());
+}
+
+#else
+
+/* a placement, as the caller sees it */
+struct Placement {
+    string ref;
+    int64_t id;
+    INSDC_coord_zero pos;
+    INSDC_coord_len len;
+
+    bool operator < (Placement const &rhs) const
+    {
+        if (ref != rhs.ref)
+            return ref < rhs.ref;
+        if (pos != rhs.pos)
+            return pos < rhs.pos;
+        if (id != rhs.id)
+            return id < rhs.id;
+        return len < rhs.len;
+    }
+    bool operator == (Placement const &rhs) const
+    {
+        return ref == rhs.ref && id == rhs.id && pos == rhs.pos && len == rhs.len;
+    }
+};
+
+typedef vector<Placement> Placements;
+
+static rc_t ToPlacement(PlacementRecord const *rec, Placement &p)
+{
+    char const *name = 0;
+    rc_t const rc = ReferenceObj_SeqId(rec->ref, &name);
+
+    if (rc == 0) {
+        p.ref = name;
+        p.id = rec->id;
+        p.pos = rec->pos;
+        p.len = rec->len;
+    }
+    return rc;
+}
+
+/* a reference window to add an iterator for */
+struct Window {
+    char const *ref;
+    INSDC_coord_zero first;
+    INSDC_coord_len len;
+};
+
+/* the state shared with the make and visit callbacks */
+struct Walk {
+    Walk()
+    : lock(0), made(0), badWorker(0), failAfter(0)
+    {
+    }
+
+    vector<ReferenceList const *> lists;    /* one per worker */
+    KLock *lock;
+    Placements found;
+    vector<uint64_t> perWorker;
+    uint64_t made;
+    uint64_t badWorker;
+    uint64_t failAfter;                     /* visit fails with the one after that many, 0 for never */
+};
+
+static rc_t const VisitFailed = SILENT_RC(rcAlign, rcIterator, rcAccessing, rcData, rcCanceled);
+
+/* an iterator like origin, over the shard, from the cursors of the worker */
+static rc_t CC MakeShard(PlacementIterator **pi, PlacementIterator const *origin,
+                         INSDC_coord_zero first_pos, INSDC_coord_len len, uint32_t worker, void *data)
+{
+    Walk *const walk = (Walk *)data;
+    ReferenceObj const *ref = 0;
+    ReferenceObj const *own = 0;
+    char const *name = 0;
+
+    if (worker >= walk->lists.size())
+        return RC(rcAlign, rcIterator, rcConstructing, rcId, rcOutofrange);
+
+    rc_t rc = PlacementIteratorRefObj(origin, &ref);
+    if (rc == 0)
+        rc = ReferenceObj_SeqId(ref, &name);
+    if (rc == 0)
+        rc = ReferenceList_Find(walk->lists[worker], &own, name, strlen(name));
+    if (rc == 0) {
+        rc = ReferenceObj_MakePlacementIterator(own, pi, first_pos, len, 0,
+                                                NULL, NULL, primary_align_ids, NULL, NULL, NULL, NULL);
+        ReferenceObj_Release(own);
+    }
+    if (rc == 0) {
+        KLockAcquire(walk->lock);
+        ++walk->made;
+        KLockUnlock(walk->lock);
+    }
+    return rc;
+}
+
+static rc_t CC VisitShard(PlacementRecord const *rec, uint32_t worker, void *data)
+{
+    Walk *const walk = (Walk *)data;
+    Placement p;
+    rc_t rc = ToPlacement(rec, p);
+
+    PlacementRecordWhack(rec);
+    KLockAcquire(walk->lock);
+    if (rc == 0 && walk->failAfter != 0 && walk->found.size() == walk->failAfter)
+        rc = VisitFailed;
+    if (rc == 0) {
+        walk->found.push_back(p);
+        if (worker < walk->perWorker.size())
+            ++walk->perWorker[worker];
+        else
+            ++walk->badWorker;
+    }
+    KLockUnlock(walk->lock);
+    return rc;
+}
+
+class WalkShardsFixture
+{
+public:
+    WalkShardsFixture()
+    : m_vmgr(0), m_db(0), m_amgr(0), m_list(0)
+    {
+        if (VDBManagerMakeRead(&m_vmgr, NULL) != 0)
+            throw logic_error("VDBManagerMakeRead failed");
+        if (VDBManagerOpenDBRead(m_vmgr, &m_db, NULL, "%s", Database) != 0)
+            throw logic_error("VDBManagerOpenDBRead failed");
+        if (AlignMgrMakeRead(&m_amgr) != 0)
+            throw logic_error("AlignMgrMakeRead failed");
+        if (ReferenceList_MakeDatabase(&m_list, m_db, ereferencelist_usePrimaryIds, 0, NULL, 0) != 0)
+            throw logic_error("ReferenceList_MakeDatabase failed");
+
+        /* whole references, windows overlapping each other and one added twice */
+        static Window const windows[] = {
+            { "chr1", 0, 20000 },
+            { "chr1", 15000, 10000 },
+            { "chr1", 20000, 17000 },
+            { "chr1", 40000, 20000 },
+            { "chr1", 40000, 20000 },
+            { "chr2", 0, 23000 },
+        };
+        m_windows.assign(windows, windows + sizeof(windows) / sizeof(windows[0]));
+    }
+    ~WalkShardsFixture()
+    {
+        ReferenceList_Release(m_list);
+        AlignMgrRelease(m_amgr);
+        VDatabaseRelease(m_db);
+        VDBManagerRelease(m_vmgr);
+    }
+
+    rc_t MakeSet(PlacementSetIterator **set)
+    {
+        rc_t rc = AlignMgrMakePlacementSetIterator(m_amgr, set);
+
+        for (size_t i = 0; rc == 0 && i < m_windows.size(); ++i) {
+            Window const &w = m_windows[i];
+            ReferenceObj const *ref = 0;
+            PlacementIterator *pi = 0;
+
+            rc = ReferenceList_Find(m_list, &ref, w.ref, strlen(w.ref));
+            if (rc == 0) {
+                rc = ReferenceObj_MakePlacementIterator(ref, &pi, w.first, w.len, 0,
+                                                        NULL, NULL, primary_align_ids, NULL, NULL, NULL, NULL);
+                ReferenceObj_Release(ref);
+            }
+            if (rc == 0) {
+                rc = PlacementSetIteratorAddPlacementIterator(*set, pi);
+                if (rc != 0)
+                    PlacementIteratorRelease(pi);
+                if (GetRCState(rc) == rcDone)
+                    rc = 0;
+            }
+        }
+        if (rc != 0) {
+            PlacementSetIteratorRelease(*set);
+            *set = 0;
+        }
+        return rc;
+    }
+
+    /* NextReference / NextWindow / NextAvailPos / NextRecordAt */
+    rc_t Unsharded(Placements &found)
+    {
+        PlacementSetIterator *set = 0;
+        rc_t rc = MakeSet(&set);
+
+        while (rc == 0 && (rc = PlacementSetIteratorNextReference(set, NULL, NULL, NULL)) == 0) {
+            while (rc == 0 && (rc = PlacementSetIteratorNextWindow(set, NULL, NULL)) == 0) {
+                INSDC_coord_zero pos;
+
+                while (rc == 0 && (rc = PlacementSetIteratorNextAvailPos(set, &pos, NULL)) == 0) {
+                    PlacementRecord const *rec;
+
+                    while (rc == 0 && (rc = PlacementSetIteratorNextRecordAt(set, pos, &rec)) == 0) {
+                        Placement p;
+
+                        rc = ToPlacement(rec, p);
+                        PlacementRecordWhack(rec);
+                        found.push_back(p);
+                    }
+                    if (GetRCState(rc) == rcDone)
+                        rc = 0;
+                }
+                if (GetRCState(rc) == rcDone)
+                    rc = 0;
+            }
+            if (GetRCState(rc) == rcDone)
+                rc = 0;
+        }
+        if (GetRCState(rc) == rcDone)
+            rc = 0;
+        PlacementSetIteratorRelease(set);
+        return rc;
+    }
+
+    rc_t Sharded(INSDC_coord_len const shard_len, uint32_t const threads, bool const ordered, Walk &walk)
+    {
+        PlacementSetIterator *set = 0;
+        rc_t rc = KLockMake(&walk.lock);
+
+        walk.perWorker.assign(threads, 0);
+        walk.made = 0;
+        walk.badWorker = 0;
+        for (uint32_t i = 0; rc == 0 && i < threads; ++i) {
+            ReferenceList const *list = 0;
+
+            rc = ReferenceList_MakeDatabase(&list, m_db, ereferencelist_usePrimaryIds, 0, NULL, 0);
+            if (rc == 0)
+                walk.lists.push_back(list);
+        }
+        if (rc == 0)
+            rc = MakeSet(&set);
+        if (rc == 0) {
+            rc = PlacementSetIteratorWalkShards(set, shard_len, threads, ordered, MakeShard, VisitShard, &walk);
+
+            /* the set is consumed */
+            rc_t const rc2 = PlacementSetIteratorNextReference(set, NULL, NULL, NULL);
+            if (rc == 0 && GetRCState(rc2) != rcDone)
+                rc = RC(rcAlign, rcIterator, rcAccessing, rcData, rcUnexpected);
+        }
+        PlacementSetIteratorRelease(set);
+        for (size_t i = 0; i < walk.lists.size(); ++i)
+            ReferenceList_Release(walk.lists[i]);
+        walk.lists.clear();
+        KLockRelease(walk.lock);
+        walk.lock = 0;
+        return rc;
+    }
+
+    bool SameAsUnsharded(INSDC_coord_len const shard_len, uint32_t const threads, bool const ordered)
+    {
+        Placements expected;
+        Walk walk;
+
+        if (Unsharded(expected) != 0 || expected.empty())
+            return false;
+        if (Sharded(shard_len, threads, ordered, walk) != 0 || walk.badWorker != 0)
+            return false;
+        if (!ordered) {
+            sort(expected.begin(), expected.end());
+            sort(walk.found.begin(), walk.found.end());
+        }
+        return walk.found == expected;
+    }
+
+    /* placements the shards cut through, which only the shard with their position may report */
+    size_t Spanning(INSDC_coord_len const shard_len)
+    {
+        Placements all;
+        size_t count = 0;
+
+        if (Unsharded(all) != 0)
+            return 0;
+        for (size_t i = 0; i < all.size(); ++i) {
+            Placement const &p = all[i];
+
+            if (p.pos / shard_len != (p.pos + (INSDC_coord_zero)p.len - 1) / shard_len)
+                ++count;
+        }
+        return count;
+    }
+
+    VDBManager const *m_vmgr;
+    VDatabase const *m_db;
+    AlignMgr const *m_amgr;
+    ReferenceList const *m_list;
+    vector<Window> m_windows;
+};
+
+static INSDC_coord_len const ShardLengths[] = { 0, 997, 5000, 100000 };
+static unsigned const ShardLengthCases = sizeof(ShardLengths) / sizeof(ShardLengths[0]);
+static uint32_t const Threads[] = { 1, 4 };
+static unsigned const ThreadCases = sizeof(Threads) / sizeof(Threads[0]);
+
+FIXTURE_TEST_CASE(WalkShards_Ordered, WalkShardsFixture)
+{
+    for (unsigned s = 0; s < ShardLengthCases; ++s) {
+        for (unsigned t = 0; t < ThreadCases; ++t)
+            REQUIRE(SameAsUnsharded(ShardLengths[s], Threads[t], true));
+    }
+}
+
+FIXTURE_TEST_CASE(WalkShards_Unordered, WalkShardsFixture)
+{
+    for (unsigned s = 0; s < ShardLengthCases; ++s) {
+        for (unsigned t = 0; t < ThreadCases; ++t)
+            REQUIRE(SameAsUnsharded(ShardLengths[s], Threads[t], false));
+    }
+}
+
+FIXTURE_TEST_CASE(WalkShards_Spanning, WalkShardsFixture)
+{
+    /* the data has placements across shard boundaries, and they come out once */
+    REQUIRE_GT(Spanning(997), (size_t)100);
+    REQUIRE_GT(Spanning(5000), (size_t)10);
+
+    Walk walk;
+    REQUIRE_RC(Sharded(997, 4, false, walk));
+
+    Placements expected;
+    REQUIRE_RC(Unsharded(expected));
+    REQUIRE_EQ(walk.found.size(), expected.size());
+
+    /* an iterator per shard and per iterator in its window */
+    REQUIRE_GT(walk.made, (uint64_t)(60000 / 997));
+}
+
+FIXTURE_TEST_CASE(WalkShards_MoreThreadsThanShards, WalkShardsFixture)
+{
+    m_windows.resize(1);
+    REQUIRE(SameAsUnsharded(0, 8, true));
+    REQUIRE(SameAsUnsharded(0, 8, false));
+}
+
+FIXTURE_TEST_CASE(WalkShards_Empty, WalkShardsFixture)
+{
+    m_windows.clear();
+
+    Walk walk;
+    REQUIRE_RC(Sharded(997, 4, true, walk));
+    REQUIRE(walk.found.empty());
+    REQUIRE_EQ(walk.made, (uint64_t)0);
+}
+
+FIXTURE_TEST_CASE(WalkShards_VisitFails, WalkShardsFixture)
+{
+    Placements expected;
+    REQUIRE_RC(Unsharded(expected));
+
+    for (unsigned t = 0; t < ThreadCases; ++t) {
+        /* ordered: everything before the failure, in order, and not one more */
+        Walk walk;
+        walk.failAfter = 1000;
+        REQUIRE_EQ(Sharded(997, Threads[t], true, walk), VisitFailed);
+        REQUIRE_EQ(walk.found.size(), (size_t)1000);
+        REQUIRE(equal(walk.found.begin(), walk.found.end(), expected.begin()));
+
+        /* unordered: every visit after it fails too, and the workers stop */
+        Walk unordered;
+        unordered.failAfter = 1000;
+        REQUIRE_EQ(Sharded(997, Threads[t], false, unordered), VisitFailed);
+        REQUIRE_EQ(unordered.found.size(), (size_t)1000);
+    }
+}
+
+#endif
+
+//////////////////////////////////////////// Main
+
+extern "C"
+{
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary (const char * prog_name)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args)
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-walk-shards";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=WalkShardsTestSuite(argc, argv);
+#if READ_ONLY
+    KDirectory *wd;
+    if (KDirectoryNativeDir(&wd) == 0) {
+        KDirectoryRemove(wd, true, "%s", Database);
+        KDirectoryRelease(wd);
+    }
+#endif
+    return rc;
+}
+
+}
@@ -38,6 +38,9 @@
 #include <kdb/table.h>
 #include <kdb/column.h>
 #include <kdb/meta.h>
+#include <kdb/btree.h>
+#include <kfs/file.h>
+#include <klib/printf.h>
 
 using namespace std;
 
@@ -228,6 +231,54 @@ FIXTURE_TEST_CASE ( ColumnBlobRead_insufficient_buffer, ColumnBlobReadFixture )
     REQUIRE_EQ ( (size_t)0, m_remaining );
 }
 
+// a clustered load through a small cache: splits hint the pager to read
+// the split child's neighbors ahead while evicted pages are written back
+TEST_CASE ( KBTree_WriteBack )
+{
+    KDirectory * wd;
+    REQUIRE_RC ( KDirectoryNativeDir ( & wd ) );
+    const char * fileName = "btree.writeback";
+    const uint32_t count = 800 * 64;
+
+    KFile * file;
+    REQUIRE_RC ( KDirectoryCreateFile ( wd, & file, true, 0664, kcmInit, "%s", fileName ) );
+    KBTree * bt;
+    REQUIRE_RC ( KBTreeMakeUpdate ( & bt, file, 16 * 32 * 1024, false, kbtOpaqueKey, 1, 255, sizeof ( uint32_t ), NULL ) );
+    REQUIRE_RC ( KBTreeSetWriteBack ( bt, 4 * 32 * 1024 ) );
+
+    for ( int pass = 0; pass < 2; ++ pass )
+    {
+        for ( uint32_t i = 0; i < count; ++ i )
+        {
+            /* runs of neighboring keys, the runs in no order */
+            uint32_t const k = ( i / 64 * 7919 ) % ( count / 64 ) * 64 + i % 64;
+            char key [ 32 ];
+            size_t key_size;
+            REQUIRE_RC ( string_printf ( key, sizeof key, & key_size, "key-%08u", k ) );
+
+            uint64_t id = k + 1;
+            bool was_inserted;
+            REQUIRE_RC ( KBTreeEntry ( bt, & id, & was_inserted, key, key_size ) );
+            REQUIRE_EQ ( pass == 0, was_inserted );
+            REQUIRE_EQ ( ( uint64_t ) k + 1, id );
+        }
+    }
+    for ( uint32_t k = 0; k < count; ++ k )
+    {
+        char key [ 32 ];
+        size_t key_size;
+        REQUIRE_RC ( string_printf ( key, sizeof key, & key_size, "key-%08u", k ) );
+        uint64_t id = 0;
+        REQUIRE_RC ( KBTreeFind ( bt, & id, key, key_size ) );
+        REQUIRE_EQ ( ( uint64_t ) k + 1, id );
+    }
+
+    REQUIRE_RC ( KBTreeRelease ( bt ) );
+    REQUIRE_RC ( KFileRelease ( file ) );
+    REQUIRE_RC ( KDirectoryRemove ( wd, false, "%s", fileName ) );
+    REQUIRE_RC ( KDirectoryRelease ( wd ) );
+}
+
 //////////////////////////////////////////// Main
 extern "C"
 {
@@ -29,12 +29,21 @@
 */
 
 #include <cstring>
+#include <vector>
+#include <stdexcept>
 
 #include <ktst/unit_test.hpp>
 #include <kfs/mmap.h>
 #include <kfs/directory.h>
 #include <kfs/impl.h>
 #include <kfs/tar.h>
+#include <kfs/sra.h>
+#include <kfs/toc.h>
+#include <kfs/arc.h>
+#include <kfs/ramfile.h>
+#include <kfs/readahead.h>
+#include <kfs/pagefile.h>
+#include <kproc/thread.h>
 
 #include <kfs/ffext.h>
 #include <kfs/ffmagic.h>
@@ -43,7 +52,9 @@
 #include <kfs/fileformat.h>
 #undef class
 
+extern "C" {
 #include "../../libs/kfs/toc-priv.h"
+}
 
 using namespace std;
 
@@ -84,6 +95,43 @@ TEST_CASE(KMMapMakeRead_and_KMMapRelease)
     REQUIRE_RC(KDirectoryRelease ( wd ));
 }
 
+TEST_CASE(KMMapAdvise_KeepsContents)
+{   // hints must not change what is in the region or the size of the file
+    KDirectory *wd;
+    REQUIRE_RC(KDirectoryNativeDir ( & wd ));
+
+    const char* fileName="test.advise";
+    size_t const rgnSize = 1024 * 1024;
+    KFile* file;
+    REQUIRE_RC(KDirectoryCreateFile(wd, &file, true, 0664, kcmInit, fileName));
+
+    KMMap * mm;
+    REQUIRE_RC(KMMapMakeRgnUpdate(&mm, file, 4096, rgnSize));
+    void *addr;
+    REQUIRE_RC(KMMapAddrUpdate(mm, &addr));
+    memset(addr, 'x', 100);
+    REQUIRE_RC(KMMapAdvise(mm, kmmapAdviseReserve | kmmapAdviseHugePages | kmmapAdvisePrefault));
+    REQUIRE_EQ(memcmp(addr, std::string(100, 'x').data(), 100), 0);
+    REQUIRE_EQ(((char const *)addr)[rgnSize - 1], '\0');
+    REQUIRE_RC(KMMapRelease(mm));
+
+    uint64_t eof;
+    REQUIRE_RC(KFileSize(file, &eof));
+    REQUIRE_EQ(eof, (uint64_t)(4096 + rgnSize));
+    REQUIRE_RC(KFileRelease(file));
+
+    const KFile* rfile;
+    REQUIRE_RC(KDirectoryOpenFileRead(wd, &rfile, fileName));
+    const KMMap * rm;
+    REQUIRE_RC(KMMapMakeRead(&rm, rfile));
+    REQUIRE_RC(KMMapAdvise(rm, kmmapAdvisePrefault));
+    REQUIRE_RC(KMMapRelease(rm));
+    REQUIRE_RC(KFileRelease(rfile));
+
+    REQUIRE_RC(KDirectoryRemove(wd, false, fileName));
+    REQUIRE_RC(KDirectoryRelease ( wd ));
+}
+
 #ifdef HAVE_KFF
 
 TEST_CASE(ExtFileFormat)
@@ -163,7 +211,472 @@ TEST_CASE(Tar_Parse)
     REQUIRE_RC(KNamelistRelease(list));
     REQUIRE_RC(KDirectoryRelease(tarDir));
     REQUIRE_RC(KDirectoryRelease(dir));
-}                                 
+}
+
+TEST_CASE(Tar_MemberMap)
+{
+    KDirectory *dir;
+    REQUIRE_RC(KDirectoryNativeDir(&dir));
+
+    const KDirectory *tarDir;
+    REQUIRE_RC(KDirectoryOpenTarArchiveRead(dir, &tarDir, false, "test.tar"));
+
+    const KFile *member;
+    REQUIRE_RC(KDirectoryOpenFileRead(tarDir, &member, "kfstest.cpp"));
+
+    uint64_t eof;
+    REQUIRE_RC(KFileSize(member, &eof));
+    REQUIRE_EQ(eof, (uint64_t)5573);
+
+    std::vector<char> buf((size_t)eof);
+    size_t num_read;
+    REQUIRE_RC(KFileReadAll(member, 0, &buf[0], buf.size(), &num_read));
+    REQUIRE_EQ(num_read, buf.size());
+
+    /* whole member */
+    const KMMap *mm;
+    const void *addr;
+    size_t size;
+    REQUIRE_RC(KMMapMakeRead(&mm, member));
+    REQUIRE_RC(KMMapSize(mm, &size));
+    REQUIRE_EQ(size, buf.size());
+    REQUIRE_RC(KMMapAddrRead(mm, &addr));
+    REQUIRE_EQ(memcmp(addr, &buf[0], size), 0);
+
+    /* region running past the end is cropped to the member */
+    const KMMap *rgn;
+    uint64_t pos;
+    REQUIRE_RC(KMMapMakeRgnRead(&rgn, member, 1000, 100000));
+    REQUIRE_RC(KMMapSize(rgn, &size));
+    REQUIRE_EQ(size, buf.size() - 1000);
+    REQUIRE_RC(KMMapPosition(rgn, &pos));
+    REQUIRE_EQ(pos, (uint64_t)1000);
+    REQUIRE_RC(KMMapAddrRead(rgn, &addr));
+    REQUIRE_EQ(memcmp(addr, &buf[1000], size), 0);
+
+    REQUIRE_RC(KMMapReposition(rgn, 5000, &size));
+    REQUIRE_EQ(size, buf.size() - 5000);
+    REQUIRE_RC(KMMapAddrRead(rgn, &addr));
+    REQUIRE_EQ(memcmp(addr, &buf[5000], size), 0);
+
+    /* maps outlive the directory and file they came from */
+    REQUIRE_RC(KFileRelease(member));
+    REQUIRE_RC(KDirectoryRelease(tarDir));
+    REQUIRE_RC(KMMapAddrRead(mm, &addr));
+    REQUIRE_EQ(memcmp(addr, &buf[0], buf.size()), 0);
+
+    REQUIRE_RC(KMMapRelease(rgn));
+    REQUIRE_RC(KMMapRelease(mm));
+    REQUIRE_RC(KDirectoryRelease(dir));
+}
+
+//////////////////////////////////////////// SRA archive path index
+
+class SraPathIndexFixture
+{
+public:
+    SraPathIndexFixture()
+    : wd ( 0 ), root ( "sra-path-index.dir" )
+    {
+        if ( KDirectoryNativeDir ( & wd ) != 0 )
+            throw logic_error ( "SraPathIndexFixture: KDirectoryNativeDir failed" );
+        KDirectoryRemove ( wd, true, "%s", root );
+
+        for ( int t = 0; t < 3; ++ t )
+        {
+            for ( int c = 0; c < 20; ++ c )
+            {
+                char path [ 256 ];
+                sprintf ( path, "%s/tbl/T%d/col/C%02d/data", root, t, c );
+                WriteFile ( path, ( t * 100 + c ) * 3 + 1 );
+            }
+        }
+        WriteFile ( "sra-path-index.dir/md/cur", 17 );
+    }
+    ~SraPathIndexFixture()
+    {
+        KDirectoryRemove ( wd, true, "%s", root );
+        KDirectoryRelease ( wd );
+    }
+
+    void WriteFile ( const char * path, size_t size )
+    {
+        KFile * f;
+        if ( KDirectoryCreateFile ( wd, & f, false, 0664, kcmInit | kcmParents, "%s", path ) != 0 )
+            throw logic_error ( "SraPathIndexFixture: KDirectoryCreateFile failed" );
+        std::vector < char > buf ( size, ( char ) size );
+        size_t num_writ;
+        KFileWrite ( f, 0, & buf [ 0 ], size, & num_writ );
+        KFileRelease ( f );
+    }
+
+    bool CheckArchive ( const KDirectory * arc, bool indexed )
+    {
+        const KToc * toc;
+        if ( ! KDirectoryIsKArcDir ( arc ) ||
+             KArcDirGetTOC ( ( const KArcDir * ) arc, & toc ) != 0 )
+            return false;
+        if ( ( toc -> pix . by_ordinal != NULL ) != indexed )
+            return false;
+
+        for ( int t = 0; t < 3; ++ t )
+        {
+            for ( int c = 0; c < 20; ++ c )
+            {
+                char path [ 256 ];
+                sprintf ( path, "tbl/T%d/col/C%02d/data", t, c );
+                size_t size = ( t * 100 + c ) * 3 + 1;
+
+                if ( KDirectoryPathType ( arc, "%s", path ) != kptFile )
+                    return false;
+
+                const KFile * f;
+                if ( KDirectoryOpenFileRead ( arc, & f, "%s", path ) != 0 )
+                    return false;
+                std::vector < char > buf ( size + 10 );
+                size_t num_read;
+                rc_t rc = KFileReadAll ( f, 0, & buf [ 0 ], buf . size (), & num_read );
+                KFileRelease ( f );
+                if ( rc != 0 || num_read != size || buf [ 0 ] != ( char ) size || buf [ size - 1 ] != ( char ) size )
+                    return false;
+            }
+        }
+        return KDirectoryPathType ( arc, "tbl/T1/col/" ) == kptDir &&
+               KDirectoryPathType ( arc, "md/cur" ) == kptFile &&
+               KDirectoryPathType ( arc, "md/cur/" ) == kptNotFound &&
+               KDirectoryPathType ( arc, "tbl/T3" ) == kptNotFound;
+    }
+
+    KDirectory * wd;
+    const char * root;
+};
+
+FIXTURE_TEST_CASE(Sra_PathIndex, SraPathIndexFixture)
+{
+    const KDirectory * src;
+    REQUIRE_RC ( KDirectoryOpenDirRead ( wd, & src, false, "%s", root ) );
+
+    const KFile * sra;
+    REQUIRE_RC ( KDirectoryOpenTocFileRead ( src, & sra, sraAlign4Byte, NULL, NULL, NULL ) );
+
+    uint64_t eof;
+    REQUIRE_RC ( KFileSize ( sra, & eof ) );
+    std::vector < char > image ( ( size_t ) eof );
+    size_t num_read;
+    REQUIRE_RC ( KFileReadAll ( sra, 0, & image [ 0 ], image . size (), & num_read ) );
+    REQUIRE_EQ ( ( uint64_t ) num_read, eof );
+    REQUIRE_RC ( KFileRelease ( sra ) );
+    REQUIRE_RC ( KDirectoryRelease ( src ) );
+
+    /* archive written with the index */
+    const KFile * f;
+    const KDirectory * arc;
+    REQUIRE_RC ( KRamFileMakeRead ( & f, & image [ 0 ], image . size () ) );
+    REQUIRE_RC ( KDirectoryOpenSraArchiveReadUnbounded_silent_preopened ( wd, & arc, false, f, "/x.sra" ) );
+    REQUIRE ( CheckArchive ( arc, true ) );
+    REQUIRE_RC ( KDirectoryRelease ( arc ) );
+    REQUIRE_RC ( KFileRelease ( f ) );
+
+    /* same archive without a recognizable index falls back to the tree */
+    uint64_t toc_end = SraHeaderGetFileOffset ( ( const KSraHeader * ) & image [ 0 ] );
+    image [ ( size_t ) toc_end - 1 ] ^= 0x55;
+    REQUIRE_RC ( KRamFileMakeRead ( & f, & image [ 0 ], image . size () ) );
+    REQUIRE_RC ( KDirectoryOpenSraArchiveReadUnbounded_silent_preopened ( wd, & arc, false, f, "/x.sra" ) );
+    REQUIRE ( CheckArchive ( arc, false ) );
+    REQUIRE_RC ( KDirectoryRelease ( arc ) );
+    REQUIRE_RC ( KFileRelease ( f ) );
+}
+
+//////////////////////////////////////////// KReadAheadFile
+
+class ReadAheadFixture
+{
+public:
+    ReadAheadFixture()
+    : data ( 1024 * 1024 ), orig ( 0 ), ra ( 0 )
+    {
+        for ( size_t i = 0; i < data . size (); ++ i )
+            data [ i ] = ( char ) ( i * 7 + ( i >> 11 ) );
+        if ( KRamFileMakeRead ( & orig, & data [ 0 ], data . size () ) != 0 )
+            throw logic_error ( "ReadAheadFixture: KRamFileMakeRead failed" );
+    }
+    ~ReadAheadFixture()
+    {
+        KFileRelease ( ra );
+        KFileRelease ( orig );
+    }
+
+    bool Check ( uint64_t pos, size_t bsize )
+    {
+        std::vector < char > buf ( bsize );
+        size_t num_read;
+        if ( KFileReadAll ( ra, pos, & buf [ 0 ], bsize, & num_read ) != 0 )
+            return false;
+        size_t expected = pos >= data . size () ? 0 : min ( bsize, ( size_t ) ( data . size () - pos ) );
+        return num_read == expected && memcmp ( & buf [ 0 ], & data [ pos ], num_read ) == 0;
+    }
+
+    std::vector < char > data;
+    const KFile * orig;
+    const KFile * ra;
+};
+
+FIXTURE_TEST_CASE(ReadAhead_Sequential, ReadAheadFixture)
+{
+    REQUIRE_RC ( KFileMakeAdaptiveReadAhead ( & ra, orig, 4096, 65536, 4 ) );
+    for ( uint64_t pos = 0; pos < data . size (); pos += 1000 )
+        REQUIRE ( Check ( pos, 1000 ) );
+
+    KReadAheadStats stats;
+    REQUIRE_RC ( KFileGetReadAheadStats ( ra, & stats ) );
+    REQUIRE_EQ ( ( uint32_t ) kraSequential, stats . pattern );
+    REQUIRE_GT ( stats . window, ( size_t ) 4096 );
+    REQUIRE_LT ( stats . misses, stats . reads / 10 );
+}
+
+FIXTURE_TEST_CASE(ReadAhead_Strided, ReadAheadFixture)
+{
+    REQUIRE_RC ( KFileMakeAdaptiveReadAhead ( & ra, orig, 256, 65536, 2 ) );
+    for ( uint64_t pos = 0; pos + 512 < data . size (); pos += 10000 )
+        REQUIRE ( Check ( pos, 512 ) );
+
+    KReadAheadStats stats;
+    REQUIRE_RC ( KFileGetReadAheadStats ( ra, & stats ) );
+    REQUIRE_EQ ( ( uint32_t ) kraStrided, stats . pattern );
+}
+
+FIXTURE_TEST_CASE(ReadAhead_Random, ReadAheadFixture)
+{
+    REQUIRE_RC ( KFileMakeAdaptiveReadAhead ( & ra, orig, 4096, 65536, 2 ) );
+    uint64_t pos = 12345;
+    for ( int i = 0; i < 200; ++ i )
+    {
+        pos = ( pos * 1103515245 + 12345 ) % data . size ();
+        REQUIRE ( Check ( pos, 300 ) );
+    }
+
+    KReadAheadStats stats;
+    REQUIRE_RC ( KFileGetReadAheadStats ( ra, & stats ) );
+    REQUIRE_EQ ( ( uint32_t ) kraRandom, stats . pattern );
+    REQUIRE_EQ ( ( size_t ) 4096, stats . window );
+}
+
+FIXTURE_TEST_CASE(ReadAhead_Synchronous, ReadAheadFixture)
+{
+    REQUIRE_RC ( KFileMakeAdaptiveReadAhead ( & ra, orig, 0, 0, 0 ) );
+    for ( uint64_t pos = 0; pos < data . size () + 100; pos += 777 )
+        REQUIRE ( Check ( pos, 777 ) );
+
+    KReadAheadStats stats;
+    REQUIRE_RC ( KFileGetReadAheadStats ( ra, & stats ) );
+    REQUIRE_EQ ( ( uint64_t ) 0, stats . bytes_prefetched );
+    REQUIRE_EQ ( ( uint64_t ) 0, stats . stalls );
+}
+
+/* readers sharing the pages, each waiting on prefetches the others may recycle */
+struct ReadAheadReader
+{
+    ReadAheadFixture * fixture;
+    uint64_t start;
+    size_t bsize;
+    bool ok;
+};
+
+static rc_t CC ReadAheadReaderMain ( const KThread * th, void * data )
+{
+    ReadAheadReader * r = ( ReadAheadReader * ) data;
+    for ( int pass = 0; pass < 4 && r -> ok; ++ pass )
+    {
+        for ( uint64_t pos = r -> start; pos < r -> fixture -> data . size () && r -> ok; pos += r -> bsize )
+            r -> ok = r -> fixture -> Check ( pos, r -> bsize );
+    }
+    return 0;
+}
+
+FIXTURE_TEST_CASE(ReadAhead_Concurrent, ReadAheadFixture)
+{
+    REQUIRE_RC ( KFileMakeAdaptiveReadAhead ( & ra, orig, 1024, 8192, 4 ) );
+
+    const int count = 4;
+    ReadAheadReader reader [ count ];
+    KThread * th [ count ];
+    for ( int i = 0; i < count; ++ i )
+    {
+        reader [ i ] . fixture = this;
+        reader [ i ] . start = i * 333;
+        reader [ i ] . bsize = 500 + i * 111;
+        reader [ i ] . ok = true;
+        REQUIRE_RC ( KThreadMake ( & th [ i ], ReadAheadReaderMain, & reader [ i ] ) );
+    }
+    for ( int i = 0; i < count; ++ i )
+    {
+        REQUIRE_RC ( KThreadWait ( th [ i ], NULL ) );
+        REQUIRE_RC ( KThreadRelease ( th [ i ] ) );
+        REQUIRE ( reader [ i ] . ok );
+    }
+}
+
+TEST_CASE(ReadAhead_StatsOnWrongType)
+{
+    char buf [ 16 ];
+    const KFile * f;
+    REQUIRE_RC ( KRamFileMakeRead ( & f, buf, sizeof buf ) );
+    KReadAheadStats stats;
+    REQUIRE_RC_FAIL ( KFileGetReadAheadStats ( f, & stats ) );
+    REQUIRE_RC ( KFileRelease ( f ) );
+}
+
+//////////////////////////////////////////// KPageFile
+
+TEST_CASE(PageFile_WriteBack)
+{
+    KDirectory *wd;
+    REQUIRE_RC(KDirectoryNativeDir(&wd));
+
+    const char* fileName = "pagefile.test";
+    const uint32_t count = 200;
+
+    {
+        KFile *file;
+        REQUIRE_RC(KDirectoryCreateFile(wd, &file, true, 0664, kcmInit, fileName));
+        KPageFile *pf;
+        REQUIRE_RC(KPageFileMakeUpdate(&pf, file, 8 * KPageConstSize(), false));
+        REQUIRE_RC(KPageFileSetWriteBack(pf, 4 * KPageConstSize()));
+
+        for (uint32_t i = 1; i <= count; ++i)
+        {
+            KPage *page;
+            uint32_t id;
+            void *mem;
+            REQUIRE_RC(KPageFileAlloc(pf, &page, &id));
+            REQUIRE_EQ(i, id);
+            REQUIRE_RC(KPageAccessUpdate(page, &mem, NULL));
+            memset(mem, (int)(i & 0xFF), KPageConstSize());
+            REQUIRE_RC(KPageRelease(page));
+
+            /* revisit pages that are likely parked or already written */
+            if (i > 20 && i % 7 == 0)
+            {
+                REQUIRE_RC(KPageFilePrefetch(pf, i - 17));
+                REQUIRE_RC(KPageFileGet(pf, &page, i - 10));
+                REQUIRE_RC(KPageAccessUpdate(page, &mem, NULL));
+                REQUIRE_EQ((int)((i - 10) & 0xFF), (int)*(uint8_t*)mem);
+                ((uint8_t*)mem)[1] = 0xA5;
+                REQUIRE_RC(KPageRelease(page));
+            }
+        }
+        REQUIRE_RC(KPageFileRelease(pf));
+        REQUIRE_RC(KFileRelease(file));
+    }
+    {
+        const KFile *file;
+        REQUIRE_RC(KDirectoryOpenFileRead(wd, &file, fileName));
+        const KPageFile *pf;
+        REQUIRE_RC(KPageFileMakeRead(&pf, file, 8 * KPageConstSize()));
+        for (uint32_t i = 1; i <= count; ++i)
+        {
+            KPage *page;
+            const void *mem;
+            REQUIRE_RC(KPageFileGet((KPageFile*)pf, &page, i));
+            REQUIRE_RC(KPageAccessRead(page, &mem, NULL));
+            const uint8_t *b = (const uint8_t*)mem;
+            REQUIRE_EQ((int)(i & 0xFF), (int)b[0]);
+            bool touched = i + 10 <= count && i > 10 && (i + 10) % 7 == 0;
+            REQUIRE_EQ(touched ? 0xA5 : (int)(i & 0xFF), (int)b[1]);
+            REQUIRE_EQ((int)(i & 0xFF), (int)b[KPageConstSize() - 1]);
+            REQUIRE_RC(KPageRelease(page));
+        }
+        REQUIRE_RC(KPageFileRelease(pf));
+        REQUIRE_RC(KFileRelease(file));
+    }
+
+    REQUIRE_RC(KDirectoryRemove(wd, false, fileName));
+    REQUIRE_RC(KDirectoryRelease(wd));
+}
+
+TEST_CASE(PageFile_Prefetch)
+{
+    KDirectory *wd;
+    REQUIRE_RC(KDirectoryNativeDir(&wd));
+
+    const char* fileName = "pagefile.prefetch";
+    const uint32_t count = 120;
+    std::vector<uint8_t> mark(count + 1, 0);
+
+    {
+        KFile *file;
+        REQUIRE_RC(KDirectoryCreateFile(wd, &file, true, 0664, kcmInit, fileName));
+        KPageFile *pf;
+        REQUIRE_RC(KPageFileMakeUpdate(&pf, file, 8 * KPageConstSize(), false));
+        for (uint32_t i = 1; i <= count; ++i)
+        {
+            KPage *page;
+            uint32_t id;
+            void *mem;
+            REQUIRE_RC(KPageFileAlloc(pf, &page, &id));
+            REQUIRE_RC(KPageAccessUpdate(page, &mem, NULL));
+            memset(mem, (int)(i & 0xFF), KPageConstSize());
+            mark[i] = (uint8_t)(i & 0xFF);
+            REQUIRE_RC(KPageRelease(page));
+        }
+        REQUIRE_RC(KPageFileRelease(pf));
+        REQUIRE_RC(KFileRelease(file));
+    }
+    {
+        KFile *file;
+        REQUIRE_RC(KDirectoryOpenFileWrite(wd, &file, true, fileName));
+        KPageFile *pf;
+        REQUIRE_RC(KPageFileMakeUpdate(&pf, file, 8 * KPageConstSize(), false));
+        REQUIRE_RC(KPageFileSetWriteBack(pf, 4 * KPageConstSize()));
+
+        /* forward with read-ahead, changing every third page; then back,
+           so that pages read ahead must not be older than their parked
+           or written copies */
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (uint32_t k = 1; k <= count; ++k)
+            {
+                uint32_t const i = pass == 0 ? k : count + 1 - k;
+                uint32_t const ahead = pass == 0 ? i + 3 : i - 3;
+                if (ahead >= 1 && ahead <= count)
+                    REQUIRE_RC(KPageFilePrefetch(pf, ahead));
+
+                KPage *page;
+                void *mem;
+                REQUIRE_RC(KPageFileGet(pf, &page, i));
+                REQUIRE_RC(KPageAccessUpdate(page, &mem, NULL));
+                uint8_t *b = (uint8_t*)mem;
+                REQUIRE_EQ((int)(i & 0xFF), (int)b[0]);
+                REQUIRE_EQ((int)mark[i], (int)b[1]);
+                if (i % 3 == pass)
+                    b[1] = mark[i] = (uint8_t)(mark[i] + 0x51);
+                REQUIRE_RC(KPageRelease(page));
+            }
+        }
+        REQUIRE_RC(KPageFileRelease(pf));
+        REQUIRE_RC(KFileRelease(file));
+    }
+    {
+        const KFile *file;
+        REQUIRE_RC(KDirectoryOpenFileRead(wd, &file, fileName));
+        const KPageFile *pf;
+        REQUIRE_RC(KPageFileMakeRead(&pf, file, 8 * KPageConstSize()));
+        for (uint32_t i = 1; i <= count; ++i)
+        {
+            KPage *page;
+            const void *mem;
+            REQUIRE_RC(KPageFileGet((KPageFile*)pf, &page, i));
+            REQUIRE_RC(KPageAccessRead(page, &mem, NULL));
+            REQUIRE_EQ((int)mark[i], (int)((const uint8_t*)mem)[1]);
+            REQUIRE_RC(KPageRelease(page));
+        }
+        REQUIRE_RC(KPageFileRelease(pf));
+        REQUIRE_RC(KFileRelease(file));
+    }
+
+    REQUIRE_RC(KDirectoryRemove(wd, false, fileName));
+    REQUIRE_RC(KDirectoryRelease(wd));
+}
 
 //////////////////////////////////////////// Main
 extern "C"
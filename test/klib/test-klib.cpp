@@ -35,12 +35,14 @@
 #include <klib/data-buffer.h>
 #include <klib/log.h>
 #include <klib/num-gen.h>
+#include <klib/pack.h>
 #include <klib/text.h>
 #include <klib/misc.h> /* is_user_admin() */
 
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
+#include <vector>
 #include <stdint.h>
 
 using namespace std;
@@ -731,6 +733,56 @@ TEST_CASE(KDataBuffer_Cast_W32Assert)
     KDataBufferWhack ( & src );
 }
 
+//////////////////////////////////////////// Pack / Unpack
+TEST_CASE(Pack_BitOrder)
+{   /* elements are packed MSB first */
+    const uint8_t src [ 8 ] = { 0, 1, 2, 3, 3, 2, 1, 0 };
+    uint8_t dst [ 2 ];
+    bitsz_t psize;
+    REQUIRE_RC ( Pack ( 8, 2, src, sizeof src, NULL, dst, 0, sizeof dst * 8, & psize ) );
+    REQUIRE_EQ ( psize, ( bitsz_t ) 16 );
+    REQUIRE_EQ ( ( int ) dst [ 0 ], 0x1B );
+    REQUIRE_EQ ( ( int ) dst [ 1 ], 0xE4 );
+}
+
+TEST_CASE(Pack_Unpack_RoundTrip)
+{   /* counts straddle every vector width, so that vector and scalar paths meet */
+    static const uint32_t widths [][ 2 ] = { { 8, 1 }, { 8, 2 }, { 8, 3 }, { 8, 4 }, { 16, 8 }, { 16, 12 }, { 32, 8 }, { 64, 8 } };
+    static const uint32_t counts [] = { 1, 15, 16, 17, 63, 64, 65, 255, 256, 257, 1000, 4099 };
+
+    uint64_t seed = 1;
+    for ( size_t w = 0; w < sizeof widths / sizeof widths [ 0 ]; ++ w )
+    {
+        uint32_t unpacked = widths [ w ] [ 0 ], packed = widths [ w ] [ 1 ];
+        size_t ebytes = unpacked / 8;
+        for ( size_t c = 0; c < sizeof counts / sizeof counts [ 0 ]; ++ c )
+        {
+            uint32_t count = counts [ c ];
+            std::vector < uint8_t > src ( count * ebytes ), packbuf ( count * ebytes ), dst ( count * ebytes + 1 );
+            for ( uint32_t i = 0; i < count; ++ i )
+            {
+                seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+                uint64_t v = ( seed >> 33 ) & ( ( ( uint64_t ) 1 << packed ) - 1 );
+                memmove ( & src [ i * ebytes ], & v, ebytes );
+            }
+
+            bitsz_t psize;
+            REQUIRE_RC ( Pack ( unpacked, packed, & src [ 0 ], src . size (), NULL, & packbuf [ 0 ], 0, packbuf . size () * 8, & psize ) );
+            REQUIRE_EQ ( psize, ( bitsz_t ) count * packed );
+
+            size_t usize;
+            REQUIRE_RC ( Unpack ( packed, unpacked, & packbuf [ 0 ], 0, psize, NULL, & dst [ 0 ], dst . size (), & usize ) );
+            REQUIRE_EQ ( usize, src . size () );
+            REQUIRE ( memcmp ( & src [ 0 ], & dst [ 0 ], usize ) == 0 );
+
+            /* unpacking in place */
+            memmove ( & dst [ 0 ], & packbuf [ 0 ], ( psize + 7 ) / 8 );
+            REQUIRE_RC ( Unpack ( packed, unpacked, & dst [ 0 ], 0, psize, NULL, & dst [ 0 ], dst . size (), & usize ) );
+            REQUIRE ( memcmp ( & src [ 0 ], & dst [ 0 ], usize ) == 0 );
+        }
+    }
+}
+
 //////////////////////////////////////////// Log
 TEST_CASE(KLog_Formatting)
 {
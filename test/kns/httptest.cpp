@@ -39,6 +39,9 @@
 #include <kns/manager.h>
 #include <kns/kns-mgr-priv.h>
 #include <kns/http.h>
+#include <kns/endpoint.h>
+#include <kns/socket.h>
+#include <kns/stream.h>
 
 #include <../libs/kns/mgr-priv.h>
 #include <../libs/kns/http-priv.h>
@@ -48,10 +51,13 @@
 #include <kfs/defs.h>
 
 #include <kproc/thread.h>
+#include <kproc/timeout.h>
 
 #include <sysalloc.h>
 #include <stdexcept>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
 #include <list>
 #include <sstream>
 
@@ -291,6 +297,256 @@ FIXTURE_TEST_CASE(Http_Read, HttpFixture)
     REQUIRE_EQ( string ( "content" ), string ( buf, num_read ) );
 }
 
+FIXTURE_TEST_CASE(Http_Download, HttpFixture)
+{
+    KDirectory * wd;
+    REQUIRE_RC ( KDirectoryNativeDir ( & wd ) );
+    KFile * dst;
+    REQUIRE_RC ( KDirectoryCreateFile ( wd, & dst, true, 0664, kcmInit, "%s", GetName() ) );
+
+    TestStream::AddResponse("HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: 7\r\n"); // response to HEAD
+    TestStream::AddResponse(    // response to GET
+        "HTTP/1.1 206 Partial Content\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Content-Range: bytes 0-6/7\r\n"
+        "\r\n"
+        "7\r\n"
+        "content",
+        true
+    );
+    uint64_t size = 0;
+    REQUIRE_RC ( KNSManagerDownloadHttpFile ( m_mgr, dst, & size, & m_stream, 0x01010000, 4, 0, MakeURL(GetName()).c_str() ) );
+    REQUIRE_EQ ( ( uint64_t ) 7, size );
+
+    char buf[16];
+    size_t num_read;
+    REQUIRE_RC ( KFileReadAll ( dst, 0, buf, sizeof buf, & num_read ) );
+    REQUIRE_EQ( string ( "content" ), string ( buf, num_read ) );
+
+    REQUIRE_RC ( KFileRelease ( dst ) );
+    REQUIRE_RC ( KDirectoryRemove ( wd, true, "%s", GetName() ) );
+    REQUIRE_RC ( KDirectoryRelease ( wd ) );
+}
+
+// A minimal HTTP/1.1 server on the loopback interface serving one object by byte ranges.
+// Unlike TestStream it accepts any number of connections, so the download really opens its extra streams.
+class RangeServer
+{
+public:
+    RangeServer ( const KNSManager * mgr, const string & content )
+    : m_mgr ( mgr ), m_content ( content ), m_listener ( 0 ), m_server ( 0 ), m_done ( false ), m_port ( 0 ), m_workers ()
+    {
+        // any free port will do
+        for ( uint16_t port = 40000 + atoi ( TestEnv::GetPidString () . c_str () ) % 10000; m_listener == 0 && port < 60000; port += 7 )
+        {
+            if ( KNSManagerInitIPv4Endpoint ( m_mgr, & m_ep, 0x7F000001, port ) == 0 &&
+                 KNSManagerMakeListener ( m_mgr, & m_listener, & m_ep ) == 0 )
+            {
+                m_port = port;
+            }
+        }
+        if ( m_listener == 0 )
+            throw logic_error ( "RangeServer: KNSManagerMakeListener failed" );
+        if ( KThreadMake ( & m_server, Serve, this ) != 0 )
+            throw logic_error ( "RangeServer: KThreadMake failed" );
+    }
+
+    ~RangeServer ()
+    {
+        Stop ();
+        KListenerRelease ( m_listener );
+    }
+
+    string URL ( const char * name ) const
+    {
+        ostringstream s;
+        s << "http://127.0.0.1:" << m_port << "/" << name;
+        return s . str ();
+    }
+
+    // stops accepting, waits for every connection to close; returns the number of connections served
+    size_t Stop ()
+    {
+        if ( m_server != 0 )
+        {
+            m_done = true;
+            // wake up the accepting thread
+            KSocket * wake;
+            if ( KNSManagerMakeConnection ( m_mgr, & wake, NULL, & m_ep ) == 0 )
+                KSocketRelease ( wake );
+            KThreadWait ( m_server, NULL );
+            KThreadRelease ( m_server );
+            m_server = 0;
+
+            for ( list < Worker > :: iterator i = m_workers . begin (); i != m_workers . end (); ++ i )
+            {
+                KThreadWait ( i -> thread, NULL );
+                KThreadRelease ( i -> thread );
+            }
+        }
+        return m_workers . size ();
+    }
+
+    // number of ranged GETs answered, valid after Stop()
+    size_t Ranges () const
+    {
+        size_t ret = 0;
+        for ( list < Worker > :: const_iterator i = m_workers . begin (); i != m_workers . end (); ++ i )
+            ret += i -> ranges;
+        return ret;
+    }
+
+private:
+    struct Worker
+    {
+        RangeServer * server;
+        KStream * stream;
+        KThread * thread;
+        size_t ranges;
+    };
+
+    static rc_t CC Serve ( const KThread *self, void *data )
+    {
+        RangeServer * me = ( RangeServer * ) data;
+        while ( true )
+        {
+            KSocket * socket;
+            rc_t rc = KListenerAccept ( me -> m_listener, & socket );
+            if ( rc != 0 )
+                return rc;
+            if ( me -> m_done )
+            {
+                KSocketRelease ( socket );
+                return 0;
+            }
+
+            Worker w = { me, 0, 0, 0 };
+            me -> m_workers . push_back ( w );
+            Worker & worker = me -> m_workers . back ();
+            rc = KSocketGetStream ( socket, & worker . stream );
+            KSocketRelease ( socket );
+            if ( rc == 0 )
+                rc = KThreadMake ( & worker . thread, Respond, & worker );
+            if ( rc != 0 )
+            {
+                KStreamRelease ( worker . stream );
+                me -> m_workers . pop_back ();
+                return rc;
+            }
+        }
+    }
+
+    // answers requests on one connection until the client closes it
+    static rc_t CC Respond ( const KThread *self, void *data )
+    {
+        Worker * w = ( Worker * ) data;
+        const string & content = w -> server -> m_content;
+        string request;
+        rc_t rc = 0;
+        while ( rc == 0 )
+        {
+            size_t end = request . find ( "\r\n\r\n" );
+            if ( end == string :: npos )
+            {
+                char buf [ 1024 ];
+                size_t num_read;
+                timeout_t tm;
+                TimeoutInit ( & tm, 10000 );
+                rc = KStreamTimedRead ( w -> stream, buf, sizeof buf, & num_read, & tm );
+                if ( rc == 0 && num_read == 0 )
+                    break;
+                request . append ( buf, num_read );
+                continue;
+            }
+
+            string headers = request . substr ( 0, end );
+            request . erase ( 0, end + 4 );
+
+            ostringstream response;
+            string body;
+            if ( headers . compare ( 0, 5, "HEAD " ) == 0 )
+            {
+                response << "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: " << content . size () << "\r\n\r\n";
+            }
+            else
+            {
+                unsigned long first = 0, last = content . size () - 1;
+                size_t range = headers . find ( "Range: bytes=" );
+                if ( range == string :: npos ||
+                     sscanf ( headers . c_str () + range, "Range: bytes=%lu-%lu", & first, & last ) != 2 ||
+                     first >= content . size () )
+                {
+                    response << "HTTP/1.1 416 Requested Range Not Satisfiable\r\nContent-Length: 0\r\n\r\n";
+                }
+                else
+                {
+                    if ( last >= content . size () )
+                        last = content . size () - 1;
+                    body = content . substr ( first, last - first + 1 );
+                    response << "HTTP/1.1 206 Partial Content\r\nAccept-Ranges: bytes\r\n"
+                             << "Content-Range: bytes " << first << "-" << last << "/" << content . size () << "\r\n"
+                             << "Content-Length: " << body . size () << "\r\n\r\n";
+                    ++ w -> ranges;
+                }
+            }
+
+            string out = response . str () + body;
+            size_t num_writ;
+            rc = KStreamWriteAll ( w -> stream, out . data (), out . size (), & num_writ );
+        }
+        KStreamRelease ( w -> stream );
+        return rc;
+    }
+
+    const KNSManager * m_mgr;
+    string m_content;
+    KEndPoint m_ep;
+    KListener * m_listener;
+    KThread * m_server;
+    volatile bool m_done;
+    uint16_t m_port;
+    list < Worker > m_workers;
+};
+
+FIXTURE_TEST_CASE(Http_Download_Parallel, HttpFixture)
+{
+    // an object several ranges long, so every stream gets a share
+    const size_t range_size = 4096;
+    string content;
+    for ( size_t i = 0; content . size () < 16 * range_size + 123; ++ i )
+    {
+        ostringstream s;
+        s << i << ",";
+        content += s . str ();
+    }
+    RangeServer server ( m_mgr, content );
+
+    KDirectory * wd;
+    REQUIRE_RC ( KDirectoryNativeDir ( & wd ) );
+    KFile * dst;
+    REQUIRE_RC ( KDirectoryCreateFile ( wd, & dst, true, 0664, kcmInit, "%s", GetName() ) );
+
+    uint64_t size = 0;
+    REQUIRE_RC ( KNSManagerDownloadHttpFile ( m_mgr, dst, & size, NULL, 0x01010000, 4, range_size, "%s", server . URL ( GetName() ) . c_str () ) );
+    REQUIRE_EQ ( ( uint64_t ) content . size (), size );
+
+    // every stream has closed its connection by now
+    size_t connections = server . Stop ();
+    REQUIRE_EQ ( ( size_t ) 4, connections );
+    REQUIRE_GE ( server . Ranges (), ( size_t ) 17 );
+
+    string buf ( content . size () + 1, '\0' );
+    size_t num_read;
+    REQUIRE_RC ( KFileReadAll ( dst, 0, & buf [ 0 ], buf . size (), & num_read ) );
+    REQUIRE_EQ ( content . size (), num_read );
+    REQUIRE ( content == buf . substr ( 0, num_read ) );
+
+    REQUIRE_RC ( KFileRelease ( dst ) );
+    REQUIRE_RC ( KDirectoryRemove ( wd, true, "%s", GetName() ) );
+    REQUIRE_RC ( KDirectoryRelease ( wd ) );
+}
+
 struct ReadThreadData
 {
     int tid;
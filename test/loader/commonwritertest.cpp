@@ -0,0 +1,574 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for CommonWriter
+*/
+#include <ktst/unit_test.hpp>
+
+#include <klib/log.h>
+#include <klib/printf.h>
+#include <klib/rc.h>
+#include <kdb/btree.h>
+#include <kfs/directory.h>
+#include <kapp/main.h>
+#include <kfg/config.h>
+#include <vdb/manager.h>
+#include <vdb/database.h>
+#include <vdb/schema.h>
+#include <vdb/table.h>
+#include <vdb/cursor.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <loader/common-writer.h>
+#include <loader/common-reader-priv.h>
+#include <loader/extsort.h>
+
+/* not in common-writer.h, the loaders reach the spot names through CommonWriter */
+rc_t SetupContext(const CommonWriterSettings* settings, SpotAssembler *ctx);
+rc_t GetKeyID(CommonWriterSettings *settings, SpotAssembler *ctx,
+              uint64_t *rslt, bool *wasInserted,
+              char const key[], char const name[], size_t namelen);
+void ContextReleaseKeyIds(SpotAssembler *ctx);
+void ContextRelease(SpotAssembler *ctx);
+}
+
+using namespace std;
+
+TEST_SUITE(CommonWriterTestSuite);
+
+/* MARK: spot names */
+
+class SpotNameFixture
+{
+public:
+    SpotNameFixture()
+    {
+        memset(&m_settings, 0, sizeof(m_settings));
+        memset(&m_ctx, 0, sizeof(m_ctx));
+        m_settings.tmpfs = ".";
+        m_settings.pid = 1;
+        m_settings.cache_size = 16 * 1024 * 1024;
+        m_settings.mode = mode_Analysis;
+    }
+    ~SpotNameFixture()
+    {
+        ContextReleaseKeyIds(&m_ctx);
+        ContextRelease(&m_ctx);
+    }
+
+    void Setup(size_t const nameHashMemory, size_t const key2id_max)
+    {
+        ContextReleaseKeyIds(&m_ctx);
+        ContextRelease(&m_ctx);
+        m_settings.nameHashMemory = nameHashMemory;
+        if (SetupContext(&m_settings, &m_ctx) != 0)
+            throw logic_error("SetupContext failed");
+        m_ctx.key2id_max = key2id_max;
+    }
+
+    /* spot group "key" is "" when there is one B-tree */
+    uint64_t KeyId(string const &key, string const &name, bool &wasInserted)
+    {
+        uint64_t id = 0;
+
+        if (GetKeyID(&m_settings, &m_ctx, &id, &wasInserted, key.c_str(), name.c_str(), name.size()) != 0)
+            throw logic_error("GetKeyID failed");
+        return id;
+    }
+
+    static string Name(unsigned const i)
+    {
+        char name[64];
+        /* not in name order, so that the spill has to sort */
+        string_printf(name, sizeof(name), NULL, "SRR000001.%u.%u", (i * 7919u) % 100003u, i);
+        return name;
+    }
+
+    CommonWriterSettings m_settings;
+    SpotAssembler m_ctx;
+};
+
+FIXTURE_TEST_CASE(SpotNameHash_Hits, SpotNameFixture)
+{
+    unsigned const count = 20000;
+
+    Setup(16 * 1024 * 1024, 1);
+    for (unsigned i = 0; i < count; ++i) {
+        bool wasInserted = false;
+
+        REQUIRE_EQ(KeyId("", Name(i), wasInserted), (uint64_t)i);
+        REQUIRE(wasInserted);
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        bool wasInserted = true;
+
+        REQUIRE_EQ(KeyId("", Name(i), wasInserted), (uint64_t)i);
+        REQUIRE(!wasInserted);
+    }
+    REQUIRE_EQ(m_ctx.idCount[0], count);
+
+    /* the table held them all, the B-tree has none */
+    uint64_t id;
+    string const name = Name(0);
+    REQUIRE_RC_FAIL(KBTreeFind(m_ctx.key2id[0], &id, name.data(), name.size()));
+}
+
+FIXTURE_TEST_CASE(SpotNameHash_Spill, SpotNameFixture)
+{
+    unsigned const count = 20000;
+
+    Setup(NAME_HASH_MIN_MEMORY, 1);
+    for (unsigned i = 0; i < count; ++i) {
+        bool wasInserted = false;
+
+        REQUIRE_EQ(KeyId("", Name(i), wasInserted), (uint64_t)i);
+        REQUIRE(wasInserted);
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        bool wasInserted = true;
+
+        REQUIRE_EQ(KeyId("", Name(i), wasInserted), (uint64_t)i);
+        REQUIRE(!wasInserted);
+    }
+
+    /* the budget ran out, so every name is in the B-tree with its id */
+    for (unsigned i = 0; i < count; ++i) {
+        string const name = Name(i);
+        uint64_t id = ~(uint64_t)0;
+
+        REQUIRE_RC(KBTreeFind(m_ctx.key2id[0], &id, name.data(), name.size()));
+        REQUIRE_EQ(id, (uint64_t)i);
+    }
+}
+
+FIXTURE_TEST_CASE(SpotNameHash_MatchesBTree, SpotNameFixture)
+{
+    size_t const memory[] = { 0, NAME_HASH_MIN_MEMORY, 16 * 1024 * 1024 };
+    size_t const trees[] = { 1, NUM_ID_SPACES };
+
+    for (unsigned t = 0; t < sizeof(trees) / sizeof(trees[0]); ++t) {
+        vector<uint64_t> expected;
+        vector<bool> expectedInserted;
+
+        for (unsigned m = 0; m < sizeof(memory) / sizeof(memory[0]); ++m) {
+            vector<uint64_t> ids;
+            vector<bool> inserted;
+
+            Setup(memory[m], trees[t]);
+            srand(5);
+            for (unsigned i = 0; i < 30000; ++i) {
+                /* spot groups and names that repeat, as mates do */
+                string const key = string("grp") + char('0' + rand() % 5);
+                bool wasInserted;
+
+                ids.push_back(KeyId(key, Name(rand() % 12000), wasInserted));
+                inserted.push_back(wasInserted);
+            }
+            if (m == 0) {
+                expected = ids;
+                expectedInserted = inserted;
+            }
+            else {
+                REQUIRE(ids == expected);
+                REQUIRE(inserted == expectedInserted);
+            }
+        }
+    }
+}
+
+FIXTURE_TEST_CASE(SpotNameHash_SmallBudget, SpotNameFixture)
+{
+    m_settings.nameHashMemory = NAME_HASH_MIN_MEMORY - 1;
+    rc_t const rc = SetupContext(&m_settings, &m_ctx);
+    REQUIRE_EQ(GetRCState(rc), rcInsufficient);
+
+    Setup(NAME_HASH_MIN_MEMORY, 1);
+    bool wasInserted;
+    REQUIRE_EQ(KeyId("", Name(1), wasInserted), (uint64_t)0);
+    REQUIRE(wasInserted);
+}
+
+/* MARK: mate pairing */
+
+/* a ReaderFile that hands out unaligned reads from a list */
+struct FakeRead
+{
+    string name;
+    string spotGroup;
+    string read;
+    string qual;
+    unsigned readNo;    /* 0: not paired */
+    bool duplicate;
+    bool lowQuality;
+    bool reverse;
+};
+
+static vector<FakeRead> const *FakeReads;
+static size_t FakeNext;
+
+#define FAKE_CUR ((*FakeReads)[FakeNext - 1])
+
+static rc_t CC FakeRecordAddRef(Record const *) { return 0; }
+static rc_t CC FakeRecordRelease(Record const *) { return 0; }
+static rc_t CC FakeRecordGetSequence(Record const *, Sequence const **rslt);
+static rc_t CC FakeRecordGetAlignment(Record const *, Alignment const **rslt) { *rslt = NULL; return 0; }
+static rc_t CC FakeRecordGetRejected(Record const *, Rejected const **rslt) { *rslt = NULL; return 0; }
+
+static Record_vt_v1 FakeRecord_vt = {
+    1, 0,
+    FakeRecordAddRef, FakeRecordRelease,
+    FakeRecordGetSequence, FakeRecordGetAlignment, FakeRecordGetRejected
+};
+
+static rc_t CC FakeSeqAddRef(Sequence const *) { return 0; }
+static rc_t CC FakeSeqRelease(Sequence const *) { return 0; }
+static rc_t CC FakeSeqGetReadLength(Sequence const *, uint32_t *length) { *length = (uint32_t)FAKE_CUR.read.size(); return 0; }
+static rc_t CC FakeSeqGetRead(Sequence const *, char *sequence) { memcpy(sequence, FAKE_CUR.read.data(), FAKE_CUR.read.size()); return 0; }
+static rc_t CC FakeSeqGetQuality(Sequence const *, int8_t const **quality, uint8_t *offset, int *qualType)
+{
+    *quality = (int8_t const *)FAKE_CUR.qual.data();
+    *offset = 0;
+    *qualType = QT_Phred;
+    return 0;
+}
+static rc_t CC FakeSeqGetSpotGroup(Sequence const *, char const **name, size_t *length)
+{
+    *name = FAKE_CUR.spotGroup.empty() ? NULL : FAKE_CUR.spotGroup.c_str();
+    *length = FAKE_CUR.spotGroup.size();
+    return 0;
+}
+static rc_t CC FakeSeqGetSpotName(Sequence const *, char const **name, size_t *length)
+{
+    *name = FAKE_CUR.name.c_str();
+    *length = FAKE_CUR.name.size();
+    return 0;
+}
+static bool CC FakeSeqFalse(Sequence const *) { return false; }
+static bool CC FakeSeqWasPaired(Sequence const *) { return FAKE_CUR.readNo != 0; }
+static int CC FakeSeqOrientation(Sequence const *) { return FAKE_CUR.reverse ? ReadOrientationReverse : ReadOrientationForward; }
+static bool CC FakeSeqIsFirst(Sequence const *) { return FAKE_CUR.readNo == 1; }
+static bool CC FakeSeqIsSecond(Sequence const *) { return FAKE_CUR.readNo == 2; }
+static bool CC FakeSeqIsDuplicate(Sequence const *) { return FAKE_CUR.duplicate; }
+static bool CC FakeSeqIsLowQuality(Sequence const *) { return FAKE_CUR.lowQuality; }
+static rc_t CC FakeSeqGetTI(Sequence const *, uint64_t *ti) { *ti = 0; return 0; }
+
+static Sequence_vt_v1 FakeSequence_vt = {
+    1, 0,
+    FakeSeqAddRef, FakeSeqRelease,
+    FakeSeqGetReadLength, FakeSeqGetRead, NULL, FakeSeqGetQuality,
+    FakeSeqGetSpotGroup, FakeSeqGetSpotName,
+    FakeSeqFalse, NULL, NULL, NULL, NULL,
+    FakeSeqWasPaired, FakeSeqOrientation, FakeSeqOrientation,
+    FakeSeqIsFirst, FakeSeqIsSecond, FakeSeqIsDuplicate, FakeSeqIsLowQuality,
+    FakeSeqGetTI
+};
+
+static Record FakeRecord = { { &FakeRecord_vt } };
+static Sequence FakeSequence = { { &FakeSequence_vt } };
+
+static rc_t CC FakeRecordGetSequence(Record const *, Sequence const **rslt) { *rslt = &FakeSequence; return 0; }
+
+static rc_t CC FakeFileDestroy(ReaderFile *) { return 0; }
+static rc_t CC FakeFileGetRecord(ReaderFile const *, Record const **rslt)
+{
+    *rslt = FakeNext < FakeReads->size() ? (++FakeNext, &FakeRecord) : NULL;
+    return 0;
+}
+static float CC FakeFileGetPosition(ReaderFile const *) { return FakeReads->empty() ? 1 : (float)FakeNext / FakeReads->size(); }
+static rc_t CC FakeFileGetReferenceInfo(ReaderFile const *, ReferenceInfo const **rslt) { *rslt = NULL; return 0; }
+
+static ReaderFile_vt_v1 FakeFile_vt = {
+    1, 0,
+    FakeFileDestroy, FakeFileGetRecord, FakeFileGetPosition, FakeFileGetReferenceInfo
+};
+
+class MatePairingFixture
+{
+public:
+    MatePairingFixture()
+    : m_runs(0), m_rnd(88172645463325252ull), m_logLevel(KLogLevelGet())
+    {
+        /* the reads have flag conflicts on purpose */
+        KLogLevelSet(klogErr);
+    }
+    ~MatePairingFixture()
+    {
+        KDirectory *dir;
+
+        KLogLevelSet(m_logLevel);
+
+        if (KDirectoryNativeDir(&dir) == 0) {
+            for (unsigned i = 0; i < m_databases.size(); ++i)
+                KDirectoryRemove(dir, true, "%s", m_databases[i].c_str());
+            KDirectoryRelease(dir);
+        }
+    }
+
+    uint64_t Random()
+    {
+        m_rnd ^= m_rnd << 13;
+        m_rnd ^= m_rnd >> 7;
+        m_rnd ^= m_rnd << 17;
+        return m_rnd;
+    }
+
+    FakeRead MakeRead(unsigned const spot, unsigned const readNo, bool const duplicate)
+    {
+        FakeRead read;
+        char name[64];
+
+        string_printf(name, sizeof(name), NULL, "SPOT.%u", spot);
+        read.name = name;
+        read.spotGroup = spot % 3 == 0 ? "" : spot % 3 == 1 ? "GRP1" : "GRP2";
+        read.readNo = readNo;
+        read.duplicate = duplicate;
+        read.lowQuality = Random() % 5 == 0;
+        read.reverse = (Random() & 1) != 0;
+        for (unsigned i = 20 + Random() % 120; i > 0; --i) {
+            read.read += "ACGT"[Random() & 3];
+            read.qual += (char)(2 + Random() % 39);
+        }
+        return read;
+    }
+
+    /* loads the reads into a new database and returns the SEQUENCE rows */
+    vector<string> Load(string const &name, size_t const mateSortMemory)
+    {
+        VDBManager *mgr;
+        VSchema *schema;
+        VDatabase *db;
+        CommonWriterSettings settings;
+        CommonWriter cw;
+        ReaderFile reader;
+
+        m_databases.push_back(name);
+        THROW_ON_RC(VDBManagerMakeUpdate(&mgr, NULL));
+        THROW_ON_RC(VDBManagerAddSchemaIncludePath(mgr, "%s", "../../interfaces"));
+        THROW_ON_RC(VDBManagerMakeSchema(mgr, &schema));
+        THROW_ON_RC(VSchemaParseFile(schema, "%s", "../../interfaces/align/align.vschema"));
+        THROW_ON_RC(VDBManagerCreateDB(mgr, &db, schema, "NCBI:align:db:alignment_sorted",
+                                       kcmInit + kcmMD5, "%s", name.c_str()));
+        VSchemaRelease(schema);
+
+        memset(&settings, 0, sizeof(settings));
+        settings.numfiles = 1;
+        settings.tmpfs = ".";
+        settings.pid = 1;
+        settings.cache_size = 64 * 1024 * 1024;
+        settings.mode = mode_Archive;
+        settings.QualQuantizer = "0";
+        settings.maxErrCount = 1000000;
+        settings.maxErrPct = 100;
+        settings.noColorSpace = true;
+        settings.mateSortMemory = mateSortMemory;
+
+        memset(&reader, 0, sizeof(reader));
+        reader.vt.v1 = &FakeFile_vt;
+        FakeReads = &m_reads;
+        FakeNext = 0;
+
+        THROW_ON_RC(CommonWriterInit(&cw, mgr, db, &settings));
+        rc_t rc = CommonWriterArchive(&cw, &reader);
+        if (rc == 0 && (mateSortMemory == 0) != (cw.ctx.mates == NULL))
+            rc = RC(rcExe, rcData, rcValidating, rcMode, rcUnexpected);
+        m_runs = 0;
+        if (cw.ctx.mates != NULL) {
+            ExtSortStats stats;
+
+            ExtSortGetStats(cw.ctx.mates, &stats);
+            m_runs = stats.runs;
+        }
+        if (rc == 0)
+            rc = CommonWriterComplete(&cw, false, 0);
+        rc_t const rc2 = CommonWriterWhack(&cw);
+        VDatabaseRelease(db);
+        VDBManagerRelease(mgr);
+        THROW_ON_RC(rc);
+        THROW_ON_RC(rc2);
+        return ReadRows(name);
+    }
+
+    /* each row's bases, qualities, read lengths, filters and spot group */
+    static vector<string> ReadRows(string const &name)
+    {
+        char const *const columns[] = {
+            "(INSDC:dna:text)CMP_READ", /* all of READ, nothing is aligned */
+            "(INSDC:quality:phred)QUALITY",
+            "(INSDC:coord:len)READ_LEN",
+            "(INSDC:SRA:read_filter)READ_FILTER",
+            "(ascii)SPOT_GROUP",
+        };
+        unsigned const ncol = sizeof(columns) / sizeof(columns[0]);
+        VDBManager *mgr;
+        VDatabase const *db;
+        VTable const *tbl;
+        VCursor const *curs;
+        uint32_t idx[ncol];
+        int64_t first;
+        uint64_t count;
+        vector<string> rows;
+
+        THROW_ON_RC(VDBManagerMakeUpdate(&mgr, NULL));
+        THROW_ON_RC(VDBManagerOpenDBRead(mgr, &db, NULL, "%s", name.c_str()));
+        THROW_ON_RC(VDatabaseOpenTableRead(db, &tbl, "SEQUENCE"));
+        THROW_ON_RC(VTableCreateCursorRead(tbl, &curs));
+        for (unsigned i = 0; i < ncol; ++i)
+            THROW_ON_RC(VCursorAddColumn(curs, &idx[i], "%s", columns[i]));
+        THROW_ON_RC(VCursorOpen(curs));
+        THROW_ON_RC(VCursorIdRange(curs, idx[0], &first, &count));
+        for (uint64_t r = 0; r < count; ++r) {
+            string row;
+
+            for (unsigned i = 0; i < ncol; ++i) {
+                void const *base;
+                uint32_t elem_bits;
+                uint32_t boff;
+                uint32_t len;
+
+                THROW_ON_RC(VCursorCellDataDirect(curs, first + r, idx[i], &elem_bits, &base, &boff, &len));
+                row.append((char const *)base, (size_t)elem_bits / 8 * len);
+                row += '|';
+            }
+            rows.push_back(row);
+        }
+        VCursorRelease(curs);
+        VTableRelease(tbl);
+        VDatabaseRelease(db);
+        VDBManagerRelease(mgr);
+        return rows;
+    }
+
+    vector<FakeRead> m_reads;
+    vector<string> m_databases;
+    uint64_t m_runs;    /* the mate sort spilled while loading, in the last Load */
+    uint64_t m_rnd;
+    KLogLevel m_logLevel;
+};
+
+FIXTURE_TEST_CASE(SortedMates_SameSpotIds, MatePairingFixture)
+{
+    /* mates complete in the order the spots were first seen, so the
+       online pairing numbers the spots in key order, as the sort does */
+    unsigned const spots = 12000;
+    unsigned const window = 50;
+
+    for (unsigned base = 0; base < spots; base += window) {
+        vector<FakeRead> second;
+
+        for (unsigned spot = base; spot < base + window; ++spot) {
+            bool const duplicate = Random() % 11 == 0;
+            unsigned const firstNo = Random() % 4 == 0 ? 2 : 1;
+
+            m_reads.push_back(MakeRead(spot, firstNo, duplicate));
+            second.push_back(MakeRead(spot, 3 - firstNo, duplicate));
+        }
+        m_reads.insert(m_reads.end(), second.begin(), second.end());
+    }
+
+    vector<string> const online = Load(GetName() + string(".online"), 0);
+    REQUIRE_EQ(online.size(), (size_t)spots);
+    /* in memory, then spilled to several runs */
+    REQUIRE(Load(GetName() + string(".sorted"), 64 * 1024 * 1024) == online);
+    REQUIRE_EQ(m_runs, (uint64_t)0);
+    REQUIRE(Load(GetName() + string(".spilled"), 1) == online);
+    REQUIRE_GT(m_runs, (uint64_t)0);
+}
+
+FIXTURE_TEST_CASE(SortedMates_SameSpots, MatePairingFixture)
+{
+    /* a shuffled mix of pairs, lone mates and unpaired reads; the spots
+       are numbered differently but must hold the same reads */
+    unsigned const spots = 12000;
+
+    for (unsigned spot = 0; spot < spots; ++spot) {
+        bool const duplicate = Random() % 11 == 0;
+
+        switch (Random() % 8) {
+        case 0:
+            m_reads.push_back(MakeRead(spot, 0, duplicate));
+            break;
+        case 1:
+            m_reads.push_back(MakeRead(spot, 1 + Random() % 2, duplicate));
+            break;
+        default:
+            m_reads.push_back(MakeRead(spot, 1, duplicate));
+            m_reads.push_back(MakeRead(spot, 2, duplicate));
+            break;
+        }
+    }
+    for (size_t i = m_reads.size(); i > 1; --i)
+        swap(m_reads[i - 1], m_reads[Random() % i]);
+
+    vector<string> online = Load(GetName() + string(".online"), 0);
+    vector<string> sorted = Load(GetName() + string(".sorted"), 64 * 1024 * 1024);
+    vector<string> spilled = Load(GetName() + string(".spilled"), 1);
+    REQUIRE_GT(m_runs, (uint64_t)0);
+
+    REQUIRE_EQ(online.size(), (size_t)spots);
+    std::sort(online.begin(), online.end());
+    std::sort(sorted.begin(), sorted.end());
+    std::sort(spilled.begin(), spilled.end());
+    REQUIRE(sorted == online);
+    REQUIRE(spilled == online);
+}
+
+//////////////////////////////////////////// Main
+
+extern "C"
+{
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary (const char * prog_name)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args)
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-common-writer";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=CommonWriterTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -0,0 +1,278 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for ExtSort
+*/
+#include <ktst/unit_test.hpp>
+
+#include <klib/rc.h>
+#include <kfs/directory.h>
+#include <kfs/file.h>
+#include <kapp/main.h>
+#include <kfg/config.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+extern "C" {
+#include <loader/extsort.h>
+}
+
+using namespace std;
+
+TEST_SUITE(ExtSortTestSuite);
+
+class ExtSortFixture
+{
+public:
+    struct Rec {
+        uint64_t key;
+        uint32_t seq;   /* order of arrival */
+        size_t size;
+
+        bool operator < (Rec const &rhs) const { return key < rhs.key; }
+    };
+
+    ExtSortFixture()
+    : m_sort(0), m_rnd(88172645463325252ull)
+    {
+    }
+    ~ExtSortFixture()
+    {
+        ExtSortWhack(m_sort);
+    }
+
+    void Make(size_t const memory)
+    {
+        KDirectory *dir;
+        KFile *file;
+        char const *const name = "extsort.tmp";
+
+        if (KDirectoryNativeDir(&dir) != 0)
+            throw logic_error("KDirectoryNativeDir failed");
+        rc_t rc = KDirectoryCreateFile(dir, &file, true, 0600, kcmInit, "%s", name);
+        KDirectoryRemove(dir, false, "%s", name);
+        KDirectoryRelease(dir);
+        if (rc == 0) {
+            rc = ExtSortMake(&m_sort, file, memory);
+            KFileRelease(file);
+        }
+        if (rc != 0)
+            throw logic_error("ExtSortMake failed");
+    }
+
+    uint64_t Random()
+    {
+        m_rnd ^= m_rnd << 13;
+        m_rnd ^= m_rnd >> 7;
+        m_rnd ^= m_rnd << 17;
+        return m_rnd;
+    }
+
+    /* the data is the arrival number, then that number's low byte repeated */
+    rc_t Add(uint64_t const key, size_t const size)
+    {
+        Rec const rec = { key, (uint32_t)m_added.size(), size };
+        vector<uint8_t> data(size, (uint8_t)rec.seq);
+
+        memcpy(&data[0], &rec.seq, min(size, sizeof(rec.seq)));
+        rc_t const rc = ExtSortAdd(m_sort, key, &data[0], size);
+        if (rc == 0)
+            m_added.push_back(rec);
+        return rc;
+    }
+
+    /* reads everything back and checks it against a stable sort of what went in */
+    bool Verify()
+    {
+        vector<Rec> expected(m_added);
+
+        stable_sort(expected.begin(), expected.end());
+        for (size_t i = 0; ; ++i) {
+            uint64_t key = 0;
+            void const *data = 0;
+            size_t size = 0;
+
+            if (ExtSortNext(m_sort, &key, &data, &size) != 0)
+                return false;
+            if (data == 0)
+                return i == expected.size();
+            if (i == expected.size() || key != expected[i].key || size != expected[i].size)
+                return false;
+
+            uint8_t const *const bytes = (uint8_t const *)data;
+            size_t const prefix = min(size, sizeof(uint32_t));
+            uint32_t seq = 0;
+
+            memcpy(&seq, bytes, prefix);
+            if (prefix == sizeof(seq) && seq != expected[i].seq)
+                return false;
+            for (size_t j = prefix; j < size; ++j) {
+                if (bytes[j] != (uint8_t)expected[i].seq)
+                    return false;
+            }
+        }
+    }
+
+    ExtSortStats Stats() const
+    {
+        ExtSortStats stats;
+
+        ExtSortGetStats(m_sort, &stats);
+        return stats;
+    }
+
+    struct ExtSort *m_sort;
+    vector<Rec> m_added;
+    uint64_t m_rnd;
+};
+
+FIXTURE_TEST_CASE(ExtSort_Empty, ExtSortFixture)
+{
+    Make(0);
+    REQUIRE(Verify());
+    REQUIRE_EQ(Stats().records, (uint64_t)0);
+    REQUIRE_EQ(Stats().runs, (uint64_t)0);
+}
+
+FIXTURE_TEST_CASE(ExtSort_InMemory, ExtSortFixture)
+{
+    Make(4 * 1024 * 1024);
+    for (unsigned i = 0; i < 20000; ++i)
+        REQUIRE_RC(Add(Random() % 100000, Random() % 40));
+    REQUIRE(Verify());
+
+    ExtSortStats const stats = Stats();
+    REQUIRE_EQ(stats.records, (uint64_t)20000);
+    REQUIRE_EQ(stats.runs, (uint64_t)0);
+    REQUIRE_EQ(stats.spilled, (uint64_t)0);
+}
+
+FIXTURE_TEST_CASE(ExtSort_Runs, ExtSortFixture)
+{
+    /* the least memory it takes, about 10MB of records */
+    Make(0);
+    for (unsigned i = 0; i < 100000; ++i)
+        REQUIRE_RC(Add(Random(), Random() % 200));
+    REQUIRE(Verify());
+
+    ExtSortStats const stats = Stats();
+    REQUIRE_EQ(stats.records, (uint64_t)100000);
+    REQUIRE_GT(stats.runs, (uint64_t)2);
+    REQUIRE_GT(stats.spilled, (uint64_t)0);
+}
+
+FIXTURE_TEST_CASE(ExtSort_TiesInMemory, ExtSortFixture)
+{
+    Make(0);
+    for (unsigned i = 0; i < 5000; ++i)
+        REQUIRE_RC(Add(Random() % 7, 8));
+    REQUIRE(Verify());
+    REQUIRE_EQ(Stats().runs, (uint64_t)0);
+}
+
+FIXTURE_TEST_CASE(ExtSort_TiesAcrossRuns, ExtSortFixture)
+{
+    /* every key is in every run, so ties are settled by the merge */
+    Make(0);
+    for (unsigned i = 0; i < 100000; ++i)
+        REQUIRE_RC(Add(Random() % 7, 64));
+    REQUIRE(Verify());
+    REQUIRE_GT(Stats().runs, (uint64_t)2);
+}
+
+FIXTURE_TEST_CASE(ExtSort_LargeRecords, ExtSortFixture)
+{
+    /* larger than the write buffer and than a run's share of the read buffer */
+    Make(6 * 1024 * 1024);
+    for (unsigned i = 0; i < 40; ++i)
+        REQUIRE_RC(Add(Random() % 10, i % 4 == 0 ? 1536 * 1024 + i : Random() % 4096));
+    REQUIRE(Verify());
+    REQUIRE_GT(Stats().runs, (uint64_t)1);
+}
+
+FIXTURE_TEST_CASE(ExtSort_TooLarge, ExtSortFixture)
+{
+    Make(0);
+    REQUIRE_RC(Add(1, 16));
+
+    vector<uint8_t> const data(3 * 1024 * 1024);
+    rc_t const rc = ExtSortAdd(m_sort, 0, &data[0], data.size());
+    REQUIRE_EQ(GetRCState(rc), rcExcessive);
+
+    /* the sort is still good */
+    REQUIRE_RC(Add(0, 16));
+    REQUIRE(Verify());
+}
+
+FIXTURE_TEST_CASE(ExtSort_AddWhileMerging, ExtSortFixture)
+{
+    Make(0);
+    REQUIRE_RC(Add(1, 16));
+
+    uint64_t key;
+    void const *data;
+    size_t size;
+    REQUIRE_RC(ExtSortNext(m_sort, &key, &data, &size));
+    REQUIRE_EQ(key, (uint64_t)1);
+
+    rc_t const rc = ExtSortAdd(m_sort, 0, "x", 1);
+    REQUIRE_EQ(GetRCState(rc), rcBusy);
+}
+
+//////////////////////////////////////////// Main
+
+extern "C"
+{
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary (const char * prog_name)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args)
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-extsort";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=ExtSortTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -0,0 +1,276 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/**
+* Unit tests for MMArray
+*/
+#include <ktst/unit_test.hpp>
+
+#include <klib/rc.h>
+#include <kfs/directory.h>
+#include <kfs/file.h>
+#include <kapp/main.h>
+#include <kfg/config.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+extern "C" {
+#include <loader/mmarray.h>
+}
+
+using namespace std;
+
+TEST_SUITE(MMArrayTestSuite);
+
+/* elements per subchunk, as in mmarray.c */
+static uint64_t const Subchunk = 1u << 24;
+
+class MMArrayFixture
+{
+public:
+    MMArrayFixture()
+    : m_array(0)
+    {
+    }
+    ~MMArrayFixture()
+    {
+        if (m_array)
+            MMArrayWhack(m_array);
+    }
+
+    void Make(uint32_t const options)
+    {
+        KDirectory *dir;
+        KFile *file;
+        char const *const name = "mmarray.tmp";
+
+        if (KDirectoryNativeDir(&dir) != 0)
+            throw logic_error("KDirectoryNativeDir failed");
+        rc_t rc = KDirectoryCreateFile(dir, &file, true, 0600, kcmInit, "%s", name);
+        KDirectoryRemove(dir, false, "%s", name);
+        KDirectoryRelease(dir);
+        if (rc == 0) {
+            rc = MMArrayMakeWithOptions(&m_array, file, sizeof(Elem), options);
+            KFileRelease(file);
+        }
+        if (rc != 0)
+            throw logic_error("MMArrayMakeWithOptions failed");
+    }
+
+    void Whack()
+    {
+        MMArrayWhack(m_array);
+        m_array = 0;
+    }
+
+    /* small elements keep the subchunks small */
+    typedef uint32_t Elem;
+
+    /* never zero, and different in every id space */
+    static Elem Value(uint64_t const id)
+    {
+        return ((uint32_t)(id * 2654435761u) ^ (uint32_t)(id >> 32)) | 1;
+    }
+
+    /* ids on both sides of the first subchunk boundary, in three id spaces */
+    static vector<uint64_t> Ids()
+    {
+        uint64_t const spaces[] = { 0, 1, NUM_ID_SPACES - 1 };
+        uint64_t const offsets[] = { 0, 1, 4095, 4096, Subchunk - 2, Subchunk - 1, Subchunk, Subchunk + 1 };
+        vector<uint64_t> ids;
+
+        for (unsigned o = 0; o < sizeof(offsets) / sizeof(offsets[0]); ++o) {
+            for (unsigned s = 0; s < sizeof(spaces) / sizeof(spaces[0]); ++s)
+                ids.push_back((spaces[s] << 32) | offsets[o]);
+        }
+        return ids;
+    }
+
+    /* writes every id, then reads them all back */
+    bool WriteAndVerify(vector<uint64_t> const &ids)
+    {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            Elem *elem = 0;
+
+            if (MMArrayGet(m_array, (void **)&elem, ids[i]) != 0)
+                return false;
+            *elem = Value(ids[i]);
+        }
+        for (size_t i = ids.size(); i > 0; --i) {
+            Elem *elem = 0;
+
+            if (MMArrayGet(m_array, (void **)&elem, ids[i - 1]) != 0)
+                return false;
+            if (*elem != Value(ids[i - 1]))
+                return false;
+        }
+        return true;
+    }
+
+    /* an untouched element reads as zero */
+    bool IsZero(uint64_t const id)
+    {
+        Elem *elem = 0;
+
+        return MMArrayGet(m_array, (void **)&elem, id) == 0 && *elem == 0;
+    }
+
+    MMArrayStats Stats() const
+    {
+        MMArrayStats stats;
+
+        MMArrayGetStats(m_array, &stats);
+        return stats;
+    }
+
+    struct MMArray *m_array;
+};
+
+/* three id spaces with two subchunks each */
+static uint64_t const SubchunksUsed = 6;
+
+FIXTURE_TEST_CASE(MMArray_Plain, MMArrayFixture)
+{
+    Make(0);
+    REQUIRE(WriteAndVerify(Ids()));
+    REQUIRE(IsZero(Subchunk + 2));
+
+    MMArrayStats const stats = Stats();
+    REQUIRE_EQ(stats.maps, SubchunksUsed);
+    REQUIRE_EQ(stats.prefetched, (uint64_t)0);
+    REQUIRE_EQ(stats.prefaulted, (uint64_t)0);
+    REQUIRE_EQ(stats.reserved, (uint64_t)0);
+}
+
+FIXTURE_TEST_CASE(MMArray_Reserve, MMArrayFixture)
+{
+    Make(mma_Reserve);
+    REQUIRE(WriteAndVerify(Ids()));
+    REQUIRE(IsZero(Subchunk + 2));
+
+    MMArrayStats const stats = Stats();
+    REQUIRE_EQ(stats.maps, SubchunksUsed);
+    REQUIRE_EQ(stats.prefetched, (uint64_t)0);
+    REQUIRE_EQ(stats.prefaulted, (uint64_t)0);
+    /* grown ahead of use, in steps of several subchunks */
+    REQUIRE_GT(stats.reserved, SubchunksUsed * Subchunk * sizeof(Elem));
+}
+
+FIXTURE_TEST_CASE(MMArray_HugePages, MMArrayFixture)
+{
+    Make(mma_HugePages);
+    REQUIRE(WriteAndVerify(Ids()));
+    REQUIRE(IsZero(Subchunk + 2));
+
+    MMArrayStats const stats = Stats();
+    REQUIRE_EQ(stats.maps, SubchunksUsed);
+    REQUIRE_EQ(stats.prefetched, (uint64_t)0);
+    REQUIRE_GT(stats.reserved, (uint64_t)0);
+}
+
+FIXTURE_TEST_CASE(MMArray_Prefetch, MMArrayFixture)
+{
+    Make(mma_Prefetch);
+
+    /* the first subchunk asks for the next, which is then taken from the prefetcher */
+    vector<uint64_t> ids;
+    for (uint64_t id = 0; id < 2 * Subchunk; id += 4093)
+        ids.push_back(id);
+    REQUIRE(WriteAndVerify(ids));
+
+    MMArrayStats const stats = Stats();
+    REQUIRE_EQ(stats.maps, (uint64_t)2);
+    REQUIRE_GE(stats.prefetched, (uint64_t)1);
+    REQUIRE_LE(stats.waits, (uint64_t)1);
+    REQUIRE_GE(stats.prefaulted, stats.maps * Subchunk * sizeof(Elem));
+
+    /* the third subchunk is still pending, and is released with the array */
+    Whack();
+}
+
+FIXTURE_TEST_CASE(MMArray_PrefetchSpaces, MMArrayFixture)
+{
+    Make(mma_Reserve | mma_HugePages | mma_Prefetch);
+    REQUIRE(WriteAndVerify(Ids()));
+    REQUIRE(IsZero(Subchunk + 2));
+    REQUIRE_EQ(Stats().maps, SubchunksUsed);
+}
+
+FIXTURE_TEST_CASE(MMArray_PrefetchIdle, MMArrayFixture)
+{
+    /* the prefetch thread stops whether it has done anything or not */
+    for (unsigned i = 0; i < 20; ++i) {
+        Make(mma_Prefetch);
+        if (i % 2 != 0) {
+            void *value;
+
+            REQUIRE_RC(MMArrayGet(m_array, &value, 0));
+        }
+        Whack();
+    }
+}
+
+FIXTURE_TEST_CASE(MMArray_BadIdSpace, MMArrayFixture)
+{
+    Make(0);
+
+    void *value;
+    rc_t const rc = MMArrayGet(m_array, &value, (uint64_t)NUM_ID_SPACES << 32);
+    REQUIRE_EQ(GetRCState(rc), rcExcessive);
+}
+
+//////////////////////////////////////////// Main
+
+extern "C"
+{
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary (const char * prog_name)
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args)
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "test-mmarray";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    KConfigDisableUserSettings();
+    rc_t rc=MMArrayTestSuite(argc, argv);
+    return rc;
+}
+
+}
@@ -486,6 +486,108 @@ FIXTURE_TEST_CASE(CSRA1_PileupIteratorSlice_PileupGetPileupDepth_WithFiltering,
     
     EXIT;
 }
+
+// bulk counts
+
+static
+uint32_t CountsBin ( char base )
+{
+    switch ( base )
+    {
+    case 'A': return NGS_PileupCountsBase_A;
+    case 'C': return NGS_PileupCountsBase_C;
+    case 'G': return NGS_PileupCountsBase_G;
+    case 'T': return NGS_PileupCountsBase_T;
+    }
+    return NGS_PileupCountsBase_N;
+}
+
+FIXTURE_TEST_CASE(CSRA1_PileupIteratorSlice_GetCounts_Depth, CSRA1_Fixture)
+{   // same slice and depths as CSRA1_PileupIteratorSlice_PileupGetPileupDepth_WithFiltering
+    ENTRY_GET_PILEUP_SLICE( CSRA1_PrimaryOnly, "supercont2.1", 5505, 4 );
+
+    NGS_PileupCounts counts;
+    NGS_PileupGetCounts ( m_pileup, ctx, & counts );
+    REQUIRE ( ! FAILED () );
+
+    REQUIRE_EQ ( (int64_t)5505, counts . first );
+    REQUIRE_EQ ( (uint64_t)4, counts . length );
+    REQUIRE_EQ ( (uint32_t)2, counts . depth [ 0 ] );
+    REQUIRE_EQ ( (uint32_t)2, counts . depth [ 1 ] );
+    REQUIRE_EQ ( (uint32_t)3, counts . depth [ 2 ] );
+    REQUIRE_EQ ( (uint32_t)3, counts . depth [ 3 ] );
+
+    // the pileup is used up
+    REQUIRE ( ! NGS_PileupIteratorNext ( m_pileup, ctx ) );
+
+    NGS_PileupCountsWhack ( & counts );
+
+    EXIT;
+}
+
+FIXTURE_TEST_CASE(CSRA1_PileupIteratorSlice_GetCounts_NoAccessAfterNext, CSRA1_Fixture)
+{
+    ENTRY_GET_PILEUP_SLICE_NEXT( CSRA1_PrimaryOnly, "supercont2.1", 5505, 4 );
+
+    NGS_PileupCounts counts;
+    NGS_PileupGetCounts ( m_pileup, ctx, & counts );
+    REQUIRE_FAILED ();
+
+    EXIT;
+}
+
+FIXTURE_TEST_CASE(CSRA1_PileupIteratorSlice_GetCounts_MatchEvents, CSRA1_Fixture)
+{   // tallies agree with walking every event of an identical pileup
+    const uint64_t start = 5000, size = 2000;
+    ENTRY_GET_PILEUP_SLICE( CSRA1_PrimaryOnly, "supercont2.1", start, size );
+
+    NGS_PileupCounts counts;
+    NGS_PileupGetCounts ( m_pileup, ctx, & counts );
+    REQUIRE ( ! FAILED () );
+    REQUIRE_EQ ( size, counts . length );
+
+    NGS_PileupRelease ( m_pileup, ctx );
+    m_pileup = NGS_ReferenceGetPileupSlice( m_ref, ctx, start, size, true, false);
+    REQUIRE ( ! FAILED () && m_pileup );
+
+    uint64_t i = 0;
+    while ( NGS_PileupIteratorNext ( m_pileup, ctx ) )
+    {
+        uint32_t base [ NGS_PileupCountsBase_count ] = { 0 };
+        uint32_t deletion = 0, insertion = 0, quality = 0;
+
+        NGS_PileupEvent * ev = NGS_PileupToPileupEvent ( m_pileup );
+        while ( NGS_PileupEventIteratorNext ( ev, ctx ) )
+        {
+            int type = NGS_PileupEventGetEventType ( ev, ctx );
+            if ( ( type & 7 ) == NGS_PileupEventType_deletion )
+                ++ deletion;
+            else
+            {
+                ++ base [ CountsBin ( NGS_PileupEventGetAlignmentBase ( ev, ctx ) ) ];
+                quality += NGS_PileupEventGetAlignmentQuality ( ev, ctx ) - 33;
+            }
+            if ( ( type & NGS_PileupEventType_insertion ) != 0 )
+                ++ insertion;
+        }
+        REQUIRE ( ! FAILED () );
+
+        REQUIRE_LT ( i, counts . length );
+        REQUIRE_EQ ( ( uint32_t ) NGS_PileupGetPileupDepth ( m_pileup, ctx ), counts . depth [ i ] );
+        for ( uint32_t b = 0; b < NGS_PileupCountsBase_count; ++ b )
+            REQUIRE_EQ ( base [ b ], counts . base [ b ] [ i ] );
+        REQUIRE_EQ ( deletion, counts . deletion [ i ] );
+        REQUIRE_EQ ( insertion, counts . insertion [ i ] );
+        REQUIRE_EQ ( quality, counts . quality [ i ] );
+        ++ i;
+    }
+    REQUIRE_EQ ( size, i );
+
+    NGS_PileupCountsWhack ( & counts );
+
+    EXIT;
+}
+
 //TODO: alignment filtering-related schema variations
 // no RD_FILTER physically exists in either PRIMARY_ALIGNMENT or SEQUENCE (no filtering) 
 //      (use VTableListPhysColumns) (NB. READ_FILTER may be present but virtual!)
@@ -0,0 +1,123 @@
+#include <klib/rc.h>
+
+#include <ktst/unit_test.hpp> /* TEST_SUITE */
+#include <kapp/main.h> /* KAppVersion */
+
+#include <stdlib.h>
+#include <string.h> /* memset */
+#include <vector>
+
+#include "../../libs/sraxf/qual_rans_codec.h"
+
+ver_t CC KAppVersion ( void ) { return 0; }
+rc_t CC Usage ( const Args * args ) { return 0; }
+const char UsageDefaultName[] = "";
+rc_t UsageSummary (const char * progname) { return 0; }
+
+TEST_SUITE(QualRansTestSuite);
+
+/* binned scores with runs and a drift towards the ends of reads */
+static std::vector<uint8_t> make_quals(size_t count, unsigned seed) {
+    static const uint8_t bins[] = { 2, 12, 23, 37 };
+    std::vector<uint8_t> q(count);
+    unsigned b = 3;
+    srand(seed);
+    for (size_t i = 0; i < count; ++i) {
+        int r = rand() % 16;
+        if (r == 0 && b > 0)
+            --b;
+        else if (r == 1 && b < 3)
+            ++b;
+        q[i] = bins[b];
+    }
+    return q;
+}
+
+static rc_t round_trip(const std::vector<uint8_t> &src, uint32_t order, size_t *used) {
+    std::vector<uint8_t> enc(src.size() * 2 + 1024);
+    std::vector<uint8_t> dec(src.size() + 1);
+    rc_t rc = qual_rans_encode(&enc[0], enc.size(), used, src.empty() ? NULL : &src[0], src.size(), order);
+    if (rc == 0) {
+        rc = qual_rans_decode(&dec[0], src.size(), &enc[0], *used);
+        if (rc == 0 && memcmp(&dec[0], src.empty() ? "" : (const void *)&src[0], src.size()) != 0)
+            rc = RC(rcXF, rcFunction, rcExecuting, rcData, rcCorrupt);
+    }
+    return rc;
+}
+
+TEST_CASE(empty) {
+    std::vector<uint8_t> q;
+    size_t used;
+    REQUIRE_RC(round_trip(q, qual_rans_order_auto, &used));
+}
+
+TEST_CASE(short_blobs) {
+    /* fewer scores than coders, and every tail length */
+    for (size_t n = 1; n <= 9; ++n) {
+        std::vector<uint8_t> q = make_quals(n, (unsigned)n);
+        size_t used;
+        REQUIRE_RC(round_trip(q, qual_rans_order_1, &used));
+        REQUIRE_RC(round_trip(q, qual_rans_order_2, &used));
+    }
+}
+
+TEST_CASE(single_score) {
+    std::vector<uint8_t> q(10000, 30);
+    size_t used;
+    REQUIRE_RC(round_trip(q, qual_rans_order_auto, &used));
+    REQUIRE_LT(used, (size_t)64);
+}
+
+TEST_CASE(binned_compresses) {
+    std::vector<uint8_t> q = make_quals(100000, 1);
+    size_t used1, used2, used_auto;
+    REQUIRE_RC(round_trip(q, qual_rans_order_1, &used1));
+    REQUIRE_RC(round_trip(q, qual_rans_order_2, &used2));
+    REQUIRE_RC(round_trip(q, qual_rans_order_auto, &used_auto));
+    /* well under the 2 bits an unmodelled 4 symbol alphabet needs */
+    REQUIRE_LT(used1, q.size() / 5);
+    REQUIRE_LE(used_auto, used1 > used2 ? used1 : used2);
+}
+
+TEST_CASE(full_alphabet) {
+    /* more scores than order 2 models; falls back to order 1 */
+    std::vector<uint8_t> q(50001);
+    srand(7);
+    for (size_t i = 0; i < q.size(); ++i)
+        q[i] = (uint8_t)(i % 3 == 0 ? rand() : i);
+    size_t used;
+    REQUIRE_RC(round_trip(q, qual_rans_order_2, &used));
+}
+
+TEST_CASE(insufficient_buffer) {
+    std::vector<uint8_t> q = make_quals(1000, 3);
+    std::vector<uint8_t> enc(q.size());
+    size_t used;
+    REQUIRE_RC(qual_rans_encode(&enc[0], enc.size(), &used, &q[0], q.size(), qual_rans_order_1));
+    rc_t rc = qual_rans_encode(&enc[0], used - 1, &used, &q[0], q.size(), qual_rans_order_1);
+    REQUIRE_EQ(GetRCState(rc), rcInsufficient);
+}
+
+TEST_CASE(rejects_corruption) {
+    std::vector<uint8_t> q = make_quals(4000, 5);
+    std::vector<uint8_t> enc(q.size() * 2);
+    std::vector<uint8_t> dec(q.size());
+    size_t used;
+    REQUIRE_RC(qual_rans_encode(&enc[0], enc.size(), &used, &q[0], q.size(), qual_rans_order_2));
+
+    /* wrong length */
+    REQUIRE_RC_FAIL(qual_rans_decode(&dec[0], q.size() - 1, &enc[0], used));
+    /* truncated */
+    for (size_t n = 0; n < used; n += 7)
+        REQUIRE_RC_FAIL(qual_rans_decode(&dec[0], q.size(), &enc[0], n));
+    /* bit flips either fail or at worst decode garbage, never overrun */
+    srand(11);
+    for (int i = 0; i < 2000; ++i) {
+        std::vector<uint8_t> bad(enc.begin(), enc.begin() + used);
+        bad[rand() % used] ^= (uint8_t)(1u << (rand() % 8));
+        qual_rans_decode(&dec[0], q.size(), &bad[0], used);
+    }
+}
+
+rc_t CC KMain ( int argc, char *argv [] )
+{ return QualRansTestSuite(argc, argv); }
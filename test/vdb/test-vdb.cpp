@@ -35,14 +35,18 @@
 extern "C" {
     #include <../libs/vdb/blob-priv.h>
     #include <../libs/vdb/page-map.h>
+    #include <../libs/vdb/spot-name-codec.h>
 }
 
 #include <ktst/unit_test.hpp> // TEST_CASE
 #include <kfg/config.h>
+#include <klib/rc.h>
 
 #include <sysalloc.h>
 #include <cstdlib>
 #include <stdexcept>
+#include <string>
+#include <cstring>
 
 using namespace std;
 
@@ -592,6 +596,64 @@ FIXTURE_TEST_CASE ( VCursor_FindNextRowIdDirect, VdbFixture )
     REQUIRE_EQ ( (int64_t)2, next ) ; // VDB-3075: next == 1
 }
 
+// SpotName codec
+
+static
+void SpotNameSplit ( const char *names [], uint32_t count, string & data, SpotNameRec *recs )
+{
+    for ( uint32_t i = 0; i < count; ++ i )
+    {
+        recs [ i ] . off = ( uint32_t ) data . size ();
+        recs [ i ] . len = ( uint32_t ) strlen ( names [ i ] );
+        data += names [ i ];
+    }
+}
+
+TEST_CASE ( SpotNameCodec_RoundTrip )
+{
+    const char *names [] =
+    {
+        "HWI-ST1234:8:1101:1208:2176#0/1",
+        "HWI-ST1234:8:1101:1208:2184#0/1",
+        "HWI-ST1234:8:1101:1301:2093#0/1",
+        "",
+        "HWI-ST1234:8:1102:007:1#0/1",
+        "read_12345678901234567890",
+        "read_12345678901234567891",
+        "HWI-ST1234:8:1101:1208:2176#0/1"
+    };
+    const uint32_t count = sizeof names / sizeof names [ 0 ];
+    SpotNameRec recs [ count ];
+    string data;
+    SpotNameSplit ( names, count, data, recs );
+
+    char enc [ 1024 ];
+    size_t used;
+    REQUIRE_RC ( SpotNameEncode ( enc, sizeof enc, & used, data . data (), recs, count ) );
+
+    string dec ( data . size (), '\0' );
+    REQUIRE_RC ( SpotNameDecode ( & dec [ 0 ], dec . size (), recs, count, enc, used ) );
+    REQUIRE_EQ ( data, dec );
+
+    // damaged or short input is refused, never overrun
+    REQUIRE_RC_FAIL ( SpotNameDecode ( & dec [ 0 ], dec . size (), recs, count, enc, used / 2 ) );
+    REQUIRE_RC_FAIL ( SpotNameDecode ( & dec [ 0 ], dec . size () - 1, recs, count, enc, used ) );
+}
+
+TEST_CASE ( SpotNameCodec_Insufficient )
+{
+    const char *names [] = { "a1b", "c2d", "e3f" };
+    const uint32_t count = sizeof names / sizeof names [ 0 ];
+    SpotNameRec recs [ count ];
+    string data;
+    SpotNameSplit ( names, count, data, recs );
+
+    char enc [ 64 ];
+    size_t used;
+    rc_t rc = SpotNameEncode ( enc, 4, & used, data . data (), recs, count );
+    REQUIRE_EQ ( GetRCState ( rc ), rcInsufficient );
+}
+
 //////////////////////////////////////////// Main
 extern "C"
 {
@@ -30,17 +30,25 @@
 #include <vdb/cursor.h>
 #include <vdb/schema.h> /* VSchemaRelease */
 #include <vdb/vdb-priv.h>
+#include <vdb/blob.h>
+
+#include <../libs/vdb/blob-priv.h> // BlobBufferBits
+#undef VBlobAddRef  // the in-library macros do not take a const blob
+#undef VBlobRelease
 
 #include <sra/sraschema.h> // VDBManagerMakeSRASchema
 
 #include <kdb/meta.h>
 #include <kdb/table.h>
 
+#include <kfg/config.h>
+
 #include <ktst/unit_test.hpp> // TEST_CASE
 
 #include <sysalloc.h>
 
 #include <sstream>
+#include <vector>
 #include <cstdlib>
 
 using namespace std;
@@ -492,6 +500,631 @@ FIXTURE_TEST_CASE ( VCursor_FindNextRowIdDirect, WVDB_Fixture )
 }
 
 
+FIXTURE_TEST_CASE ( ZstdEncoding_RoundTrip, WVDB_Fixture )
+{
+    m_databaseName = ScratchDir + GetName();
+    RemoveDatabase();
+
+    string schemaText = "include 'vdb/vdb.vschema';"
+                        "table table1 #1.0.0"
+                        "{"
+                        "    column < ascii > zstd_encoding PLAIN;"
+                        "    column < ascii > zstd_encoding < 19 > BEST;"
+                        "    column < ascii > zstd_encoding < 0, 'zstd/dict' > DICT;"
+                        "};"
+                        "database root_database #1 { table table1 #1 TABLE1; } ;";
+
+    const char* TableName = "TABLE1";
+    const char* Columns [] = { "PLAIN", "BEST", "DICT" };
+    const size_t NumColumns = sizeof Columns / sizeof Columns [ 0 ];
+    const int NumRows = 2000;
+
+    VDatabase* db;
+    {
+        VSchema* schema;
+        REQUIRE_RC ( VDBManagerMakeSchema ( m_mgr, & schema ) );
+        REQUIRE_RC ( VSchemaAddIncludePath ( schema, "../../interfaces" ) );
+        REQUIRE_RC ( VSchemaParseText ( schema, NULL, schemaText . c_str (), schemaText . size () ) );
+
+        REQUIRE_RC ( VDBManagerCreateDB ( m_mgr,
+                                          & db,
+                                          schema,
+                                          "root_database",
+                                          kcmInit + kcmMD5,
+                                          "%s",
+                                          m_databaseName . c_str () ) );
+
+        VTable* table;
+        REQUIRE_RC ( VDatabaseCreateTable ( db , & table, TableName, kcmInit + kcmMD5, TableName ) );
+
+        // any content serves as a raw dictionary; it has to be in place before the cursor opens
+        {
+            KMetadata *meta;
+            REQUIRE_RC ( VTableOpenMetadataUpdate ( table, & meta ) );
+            KMDataNode* node;
+            REQUIRE_RC ( KMetadataOpenNodeUpdate ( meta, & node, "zstd/dict" ) );
+            const char* Dict = "row=ACGTACGTNNACGT;row=ACGTACGTNNACGT;";
+            REQUIRE_RC ( KMDataNodeWrite ( node, Dict, string_size ( Dict ) ) );
+            REQUIRE_RC ( KMDataNodeRelease ( node ) );
+            REQUIRE_RC ( KMetadataRelease ( meta ) );
+        }
+
+        VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorWrite ( table, & cursor, kcmInsert ) );
+        uint32_t column_idx [ NumColumns ];
+        for ( size_t c = 0; c < NumColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx [ c ], Columns [ c ] ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            ostringstream out;
+            out << "row=ACGTACGTNNACGT" << i;
+            REQUIRE_RC ( VCursorOpenRow ( cursor ) );
+            for ( size_t c = 0; c < NumColumns; ++ c )
+                REQUIRE_RC ( VCursorWrite ( cursor, column_idx [ c ], 8, out.str().c_str(), 0, out.str().size() ) );
+            REQUIRE_RC ( VCursorCommitRow ( cursor ) );
+            REQUIRE_RC ( VCursorCloseRow ( cursor ) );
+        }
+
+        REQUIRE_RC ( VCursorCommit ( cursor ) );
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+        REQUIRE_RC ( VSchemaRelease ( schema ) );
+    }
+    {
+        const VTable* table;
+        REQUIRE_RC ( VDatabaseOpenTableRead ( db , & table, TableName ) );
+        const VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorRead ( table, & cursor ) );
+        uint32_t column_idx [ NumColumns ];
+        for ( size_t c = 0; c < NumColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx [ c ], Columns [ c ] ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            ostringstream out;
+            out << "row=ACGTACGTNNACGT" << i;
+            for ( size_t c = 0; c < NumColumns; ++ c )
+            {
+                char buf [ 64 ];
+                uint32_t row_len;
+                REQUIRE_RC ( VCursorReadDirect ( cursor, i + 1, column_idx [ c ], 8, buf, sizeof buf, & row_len ) );
+                REQUIRE_EQ ( out . str (), string ( buf, row_len ) );
+            }
+        }
+
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+    }
+    REQUIRE_RC ( VDatabaseRelease ( db ) );
+}
+
+FIXTURE_TEST_CASE ( ZstdEncoding_Bits, WVDB_Fixture )
+{
+    m_databaseName = ScratchDir + GetName();
+    RemoveDatabase();
+
+    string schemaText = "include 'vdb/vdb.vschema';"
+                        "table table1 #1.0.0"
+                        "{"
+                        "    column < B1 > zstd_encoding BITS;"
+                        "};"
+                        "database root_database #1 { table table1 #1 TABLE1; } ;";
+
+    const char* TableName = "TABLE1";
+    const int NumRows = 1001;
+
+    // rows of 3 bits each, so that the blob ends off a byte boundary
+    const uint8_t Bits [] = { 0xA0, 0x60, 0xE0, 0x20 };
+
+    VDatabase* db;
+    {
+        VSchema* schema;
+        REQUIRE_RC ( VDBManagerMakeSchema ( m_mgr, & schema ) );
+        REQUIRE_RC ( VSchemaAddIncludePath ( schema, "../../interfaces" ) );
+        REQUIRE_RC ( VSchemaParseText ( schema, NULL, schemaText . c_str (), schemaText . size () ) );
+
+        REQUIRE_RC ( VDBManagerCreateDB ( m_mgr,
+                                          & db,
+                                          schema,
+                                          "root_database",
+                                          kcmInit + kcmMD5,
+                                          "%s",
+                                          m_databaseName . c_str () ) );
+
+        VTable* table;
+        REQUIRE_RC ( VDatabaseCreateTable ( db , & table, TableName, kcmInit + kcmMD5, TableName ) );
+
+        VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorWrite ( table, & cursor, kcmInsert ) );
+        uint32_t column_idx;
+        REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx, "BITS" ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            REQUIRE_RC ( VCursorOpenRow ( cursor ) );
+            REQUIRE_RC ( VCursorWrite ( cursor, column_idx, 1, & Bits [ i % 4 ], 0, 3 ) );
+            REQUIRE_RC ( VCursorCommitRow ( cursor ) );
+            REQUIRE_RC ( VCursorCloseRow ( cursor ) );
+        }
+
+        REQUIRE_RC ( VCursorCommit ( cursor ) );
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+        REQUIRE_RC ( VSchemaRelease ( schema ) );
+    }
+    {
+        const VTable* table;
+        REQUIRE_RC ( VDatabaseOpenTableRead ( db , & table, TableName ) );
+        const VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorRead ( table, & cursor ) );
+        uint32_t column_idx;
+        REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx, "BITS" ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            uint8_t bits = 0;
+            uint32_t row_len, remaining;
+            REQUIRE_RC ( VCursorReadBitsDirect ( cursor, i + 1, column_idx, 1, 0, & bits, 0, 3, & row_len, & remaining ) );
+            REQUIRE_EQ ( 3u, row_len );
+            REQUIRE_EQ ( ( int ) Bits [ i % 4 ], ( int ) ( bits & 0xE0 ) );
+        }
+
+        // the decoded blob holds exactly its rows' bits, not the rounded-up bytes
+        const VBlob* blob;
+        REQUIRE_RC ( VCursorGetBlobDirect ( cursor, & blob, 1, column_idx ) );
+        uint64_t count;
+        REQUIRE_RC ( VBlobIdRange ( blob, NULL, & count ) );
+        REQUIRE_NE ( ( uint64_t ) 0, ( count * 3 ) % 8 );
+        REQUIRE_EQ ( count * 3, BlobBufferBits ( blob ) );
+        REQUIRE_RC ( VBlobRelease ( blob ) );
+
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+    }
+    REQUIRE_RC ( VDatabaseRelease ( db ) );
+}
+
+FIXTURE_TEST_CASE ( AzipEncoding_RoundTrip, WVDB_Fixture )
+{
+    m_databaseName = ScratchDir + GetName();
+    RemoveDatabase();
+
+    string schemaText = "include 'vdb/vdb.vschema';"
+                        "table table1 #1.0.0"
+                        "{"
+                        "    column < ascii > azip_encoding TEXT;"
+                        "    column < ascii > azip_encoding < AZIP_ALL, 10 > FAST;"
+                        "    column < ascii > azip_encoding < AZIP_ALL, 0, 1024 > SAMPLED;"
+                        "    column < ascii > azip_encoding < AZIP_DEFLATE > DEFLATE;"
+                        "    column < U8 > azip_encoding NOISE;"
+                        "    column < B1 > azip_encoding BITS;"
+                        "    column < B1 > zstd_encoding ZBITS;"
+                        "};"
+                        "database root_database #1 { table table1 #1 TABLE1; } ;";
+
+    const char* TableName = "TABLE1";
+    const char* TextColumns [] = { "TEXT", "FAST", "SAMPLED", "DEFLATE" };
+    const size_t NumTextColumns = sizeof TextColumns / sizeof TextColumns [ 0 ];
+    const char* BitColumns [] = { "BITS", "ZBITS" };
+    const size_t NumBitColumns = sizeof BitColumns / sizeof BitColumns [ 0 ];
+    const int NumRows = 2001;
+    const int NoiseLen = 16;
+
+    // rows of 3 bits each, so that blobs end off a byte boundary
+    const uint8_t Bits [] = { 0xA0, 0x60, 0xE0, 0x20 };
+
+    VDatabase* db;
+    {
+        VSchema* schema;
+        REQUIRE_RC ( VDBManagerMakeSchema ( m_mgr, & schema ) );
+        REQUIRE_RC ( VSchemaAddIncludePath ( schema, "../../interfaces" ) );
+        REQUIRE_RC ( VSchemaParseText ( schema, NULL, schemaText . c_str (), schemaText . size () ) );
+
+        REQUIRE_RC ( VDBManagerCreateDB ( m_mgr,
+                                          & db,
+                                          schema,
+                                          "root_database",
+                                          kcmInit + kcmMD5,
+                                          "%s",
+                                          m_databaseName . c_str () ) );
+
+        VTable* table;
+        REQUIRE_RC ( VDatabaseCreateTable ( db , & table, TableName, kcmInit + kcmMD5, TableName ) );
+
+        VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorWrite ( table, & cursor, kcmInsert ) );
+        uint32_t text_idx [ NumTextColumns ];
+        for ( size_t c = 0; c < NumTextColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & text_idx [ c ], TextColumns [ c ] ) );
+        uint32_t bit_idx [ NumBitColumns ];
+        for ( size_t c = 0; c < NumBitColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & bit_idx [ c ], BitColumns [ c ] ) );
+        uint32_t noise_idx;
+        REQUIRE_RC ( VCursorAddColumn ( cursor, & noise_idx, "NOISE" ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        uint32_t seed = 1;
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            ostringstream out;
+            out << "row=ACGTACGTNNACGT" << i;
+            uint8_t noise [ NoiseLen ];
+            for ( int k = 0; k < NoiseLen; ++ k )
+            {
+                seed = seed * 1103515245 + 12345;
+                noise [ k ] = ( uint8_t ) ( seed >> 16 );
+            }
+            REQUIRE_RC ( VCursorOpenRow ( cursor ) );
+            for ( size_t c = 0; c < NumTextColumns; ++ c )
+                REQUIRE_RC ( VCursorWrite ( cursor, text_idx [ c ], 8, out.str().c_str(), 0, out.str().size() ) );
+            for ( size_t c = 0; c < NumBitColumns; ++ c )
+                REQUIRE_RC ( VCursorWrite ( cursor, bit_idx [ c ], 1, & Bits [ i % 4 ], 0, 3 ) );
+            REQUIRE_RC ( VCursorWrite ( cursor, noise_idx, 8, noise, 0, NoiseLen ) );
+            REQUIRE_RC ( VCursorCommitRow ( cursor ) );
+            REQUIRE_RC ( VCursorCloseRow ( cursor ) );
+        }
+
+        REQUIRE_RC ( VCursorCommit ( cursor ) );
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+        REQUIRE_RC ( VSchemaRelease ( schema ) );
+    }
+    {
+        const VTable* table;
+        REQUIRE_RC ( VDatabaseOpenTableRead ( db , & table, TableName ) );
+        const VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorRead ( table, & cursor ) );
+        uint32_t text_idx [ NumTextColumns ];
+        for ( size_t c = 0; c < NumTextColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & text_idx [ c ], TextColumns [ c ] ) );
+        uint32_t bit_idx [ NumBitColumns ];
+        for ( size_t c = 0; c < NumBitColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & bit_idx [ c ], BitColumns [ c ] ) );
+        uint32_t noise_idx;
+        REQUIRE_RC ( VCursorAddColumn ( cursor, & noise_idx, "NOISE" ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        uint32_t seed = 1;
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            ostringstream out;
+            out << "row=ACGTACGTNNACGT" << i;
+            uint8_t noise [ NoiseLen ];
+            for ( int k = 0; k < NoiseLen; ++ k )
+            {
+                seed = seed * 1103515245 + 12345;
+                noise [ k ] = ( uint8_t ) ( seed >> 16 );
+            }
+
+            char buf [ 64 ];
+            uint32_t row_len;
+            for ( size_t c = 0; c < NumTextColumns; ++ c )
+            {
+                REQUIRE_RC ( VCursorReadDirect ( cursor, i + 1, text_idx [ c ], 8, buf, sizeof buf, & row_len ) );
+                REQUIRE_EQ ( out . str (), string ( buf, row_len ) );
+            }
+            for ( size_t c = 0; c < NumBitColumns; ++ c )
+            {
+                uint8_t bits = 0;
+                uint32_t remaining;
+                REQUIRE_RC ( VCursorReadBitsDirect ( cursor, i + 1, bit_idx [ c ], 1, 0, & bits, 0, 3, & row_len, & remaining ) );
+                REQUIRE_EQ ( 3u, row_len );
+                REQUIRE_EQ ( ( int ) Bits [ i % 4 ], ( int ) ( bits & 0xE0 ) );
+            }
+            REQUIRE_RC ( VCursorReadDirect ( cursor, i + 1, noise_idx, 8, buf, sizeof buf, & row_len ) );
+            REQUIRE_EQ ( ( uint32_t ) NoiseLen, row_len );
+            REQUIRE_EQ ( 0, memcmp ( noise, buf, NoiseLen ) );
+        }
+
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+    }
+    REQUIRE_RC ( VDatabaseRelease ( db ) );
+}
+
+FIXTURE_TEST_CASE ( ZipEncoding_Chunked, WVDB_Fixture )
+{
+    m_databaseName = ScratchDir + GetName();
+    RemoveDatabase();
+
+    // blobs past the 1MB chunk size are split and deflated on several threads
+    string schemaText = "include 'vdb/vdb.vschema';"
+                        "table table1 #1.0.0"
+                        "{"
+                        "    column < U8 > zip_encoding PLAIN;"
+                        "    column < U8 > zip_encoding < Z_DEFAULT_STRATEGY, Z_BEST_SPEED, 4 > CHUNKED;"
+                        "};"
+                        "database root_database #1 { table table1 #1 TABLE1; } ;";
+
+    const char* TableName = "TABLE1";
+    const char* Columns [] = { "PLAIN", "CHUNKED" };
+    const size_t NumColumns = sizeof Columns / sizeof Columns [ 0 ];
+    const int NumRows = 1500;
+    const size_t RowLen = 4001;
+
+    VDatabase* db;
+    {
+        VSchema* schema;
+        REQUIRE_RC ( VDBManagerMakeSchema ( m_mgr, & schema ) );
+        REQUIRE_RC ( VSchemaAddIncludePath ( schema, "../../interfaces" ) );
+        REQUIRE_RC ( VSchemaParseText ( schema, NULL, schemaText . c_str (), schemaText . size () ) );
+
+        REQUIRE_RC ( VDBManagerCreateDB ( m_mgr,
+                                          & db,
+                                          schema,
+                                          "root_database",
+                                          kcmInit + kcmMD5,
+                                          "%s",
+                                          m_databaseName . c_str () ) );
+
+        VTable* table;
+        REQUIRE_RC ( VDatabaseCreateTable ( db , & table, TableName, kcmInit + kcmMD5, TableName ) );
+
+        VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorWrite ( table, & cursor, kcmInsert ) );
+        uint32_t column_idx [ NumColumns ];
+        for ( size_t c = 0; c < NumColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx [ c ], Columns [ c ] ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        uint32_t seed = 1;
+        vector < uint8_t > row ( RowLen );
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            for ( size_t j = 0; j < RowLen; ++ j )
+            {
+                seed = seed * 1103515245 + 12345;
+                row [ j ] = "ACGTN" [ ( seed >> 16 ) % 5 ];
+            }
+            REQUIRE_RC ( VCursorOpenRow ( cursor ) );
+            for ( size_t c = 0; c < NumColumns; ++ c )
+                REQUIRE_RC ( VCursorWrite ( cursor, column_idx [ c ], 8, & row [ 0 ], 0, RowLen ) );
+            REQUIRE_RC ( VCursorCommitRow ( cursor ) );
+            REQUIRE_RC ( VCursorCloseRow ( cursor ) );
+        }
+
+        REQUIRE_RC ( VCursorCommit ( cursor ) );
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+        REQUIRE_RC ( VSchemaRelease ( schema ) );
+    }
+    // readers inflate on one thread unless configured otherwise
+    KConfig* kfg;
+    REQUIRE_RC ( KConfigMake ( & kfg, NULL ) );
+    const char* Threads [] = { "1", "4" };
+    for ( size_t t = 0; t < sizeof Threads / sizeof Threads [ 0 ]; ++ t )
+    {
+        REQUIRE_RC ( KConfigWriteString ( kfg, "/vdb/unzip/threads", Threads [ t ] ) );
+
+        const VTable* table;
+        REQUIRE_RC ( VDatabaseOpenTableRead ( db , & table, TableName ) );
+        const VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorRead ( table, & cursor ) );
+        uint32_t column_idx [ NumColumns ];
+        for ( size_t c = 0; c < NumColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx [ c ], Columns [ c ] ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        vector < uint8_t > plain ( RowLen ), chunked ( RowLen );
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            uint32_t plain_len, chunked_len;
+            REQUIRE_RC ( VCursorReadDirect ( cursor, i + 1, column_idx [ 0 ], 8, & plain [ 0 ], RowLen, & plain_len ) );
+            REQUIRE_RC ( VCursorReadDirect ( cursor, i + 1, column_idx [ 1 ], 8, & chunked [ 0 ], RowLen, & chunked_len ) );
+            REQUIRE_EQ ( RowLen, ( size_t ) plain_len );
+            REQUIRE_EQ ( RowLen, ( size_t ) chunked_len );
+            REQUIRE ( plain == chunked );
+        }
+
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+    }
+    REQUIRE_RC ( KConfigWriteString ( kfg, "/vdb/unzip/threads", "1" ) );
+    REQUIRE_RC ( KConfigRelease ( kfg ) );
+    REQUIRE_RC ( VDatabaseRelease ( db ) );
+}
+
+FIXTURE_TEST_CASE ( QualRansEncoding_RoundTrip, WVDB_Fixture )
+{
+    m_databaseName = ScratchDir + GetName();
+    RemoveDatabase();
+
+    string schemaText = "include 'insdc/sra.vschema';"
+                        "table table1 #1.0.0"
+                        "{"
+                        "    column INSDC:SRA:qual_rans_encoding AUTO;"
+                        "    column INSDC:SRA:qual_rans_encoding < 1 > ORDER1;"
+                        "    column INSDC:SRA:qual_rans_encoding < 2 > ORDER2;"
+                        "};"
+                        "database root_database #1 { table table1 #1 TABLE1; } ;";
+
+    const char* TableName = "TABLE1";
+    const char* Columns [] = { "AUTO", "ORDER1", "ORDER2" };
+    const size_t NumColumns = sizeof Columns / sizeof Columns [ 0 ];
+    const int NumRows = 2000;
+    const int RowLen = 150;
+
+    // binned scores falling off towards the end of each read
+    vector < uint8_t > quals ( NumRows * RowLen );
+    for ( size_t i = 0; i < quals . size (); ++ i )
+        quals [ i ] = i % RowLen < RowLen - 30 ? ( i * 7 % 13 == 0 ? 23 : 37 ) : ( i * 3 % 7 == 0 ? 2 : 12 );
+
+    VDatabase* db;
+    {
+        VSchema* schema;
+        REQUIRE_RC ( VDBManagerMakeSchema ( m_mgr, & schema ) );
+        REQUIRE_RC ( VSchemaAddIncludePath ( schema, "../../interfaces" ) );
+        REQUIRE_RC ( VSchemaParseText ( schema, NULL, schemaText . c_str (), schemaText . size () ) );
+
+        REQUIRE_RC ( VDBManagerCreateDB ( m_mgr,
+                                          & db,
+                                          schema,
+                                          "root_database",
+                                          kcmInit + kcmMD5,
+                                          "%s",
+                                          m_databaseName . c_str () ) );
+
+        VTable* table;
+        REQUIRE_RC ( VDatabaseCreateTable ( db , & table, TableName, kcmInit + kcmMD5, TableName ) );
+
+        VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorWrite ( table, & cursor, kcmInsert ) );
+        uint32_t column_idx [ NumColumns ];
+        for ( size_t c = 0; c < NumColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx [ c ], Columns [ c ] ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            REQUIRE_RC ( VCursorOpenRow ( cursor ) );
+            for ( size_t c = 0; c < NumColumns; ++ c )
+                REQUIRE_RC ( VCursorWrite ( cursor, column_idx [ c ], 8, & quals [ i * RowLen ], 0, RowLen ) );
+            REQUIRE_RC ( VCursorCommitRow ( cursor ) );
+            REQUIRE_RC ( VCursorCloseRow ( cursor ) );
+        }
+
+        REQUIRE_RC ( VCursorCommit ( cursor ) );
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+        REQUIRE_RC ( VSchemaRelease ( schema ) );
+    }
+    {
+        const VTable* table;
+        REQUIRE_RC ( VDatabaseOpenTableRead ( db , & table, TableName ) );
+        const VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorRead ( table, & cursor ) );
+        uint32_t column_idx [ NumColumns ];
+        for ( size_t c = 0; c < NumColumns; ++ c )
+            REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx [ c ], Columns [ c ] ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        for ( int i = 0; i < NumRows; ++ i )
+        {
+            for ( size_t c = 0; c < NumColumns; ++ c )
+            {
+                uint8_t buf [ RowLen ];
+                uint32_t row_len;
+                REQUIRE_RC ( VCursorReadDirect ( cursor, i + 1, column_idx [ c ], 8, buf, sizeof buf, & row_len ) );
+                REQUIRE_EQ ( ( uint32_t ) RowLen, row_len );
+                REQUIRE_EQ ( 0, memcmp ( buf, & quals [ i * RowLen ], RowLen ) );
+            }
+        }
+
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+    }
+    REQUIRE_RC ( VDatabaseRelease ( db ) );
+}
+
+FIXTURE_TEST_CASE ( SpotNameEncoding_RoundTrip, WVDB_Fixture )
+{
+    m_databaseName = ScratchDir + GetName();
+    RemoveDatabase();
+
+    string schemaText = "include 'insdc/sra.vschema';"
+                        "table table1 #1.0.0"
+                        "{"
+                        "    column INSDC:SRA:spot_name_encoding NAME;"
+                        "};"
+                        "database root_database #1 { table table1 #1 TABLE1; } ;";
+
+    const char* TableName = "TABLE1";
+    const int NumRows = 5000;
+
+    // Illumina-style names, with repeats, empty names, leading zeros,
+    // long digit runs and too many tokens mixed in
+    vector < string > names;
+    for ( int i = 0; i < NumRows; ++ i )
+    {
+        ostringstream out;
+        switch ( i % 97 )
+        {
+        case 10:
+            break;
+        case 20:
+            out << "SRR000" << i << ".1 x" << 12345678901234567890ULL % ( i + 1 ) << "12345678901234567890";
+            break;
+        case 30:
+            for ( int k = 0; k < 40; ++ k )
+                out << k << '_';
+            break;
+        default:
+            out << "M01234:45:000000000-A" << char ( 'A' + i / 1000 ) << "CDE:1:" << 1101 + i / 2000
+                << ':' << ( i * 7919 ) % 29000 << ':' << i * 3;
+        }
+        names . push_back ( out . str () );
+        if ( i % 13 == 0 && i + 1 < NumRows )
+        {
+            names . push_back ( names . back () );
+            ++ i;
+        }
+    }
+
+    VDatabase* db;
+    {
+        VSchema* schema;
+        REQUIRE_RC ( VDBManagerMakeSchema ( m_mgr, & schema ) );
+        REQUIRE_RC ( VSchemaAddIncludePath ( schema, "../../interfaces" ) );
+        REQUIRE_RC ( VSchemaParseText ( schema, NULL, schemaText . c_str (), schemaText . size () ) );
+
+        REQUIRE_RC ( VDBManagerCreateDB ( m_mgr,
+                                          & db,
+                                          schema,
+                                          "root_database",
+                                          kcmInit + kcmMD5,
+                                          "%s",
+                                          m_databaseName . c_str () ) );
+
+        VTable* table;
+        REQUIRE_RC ( VDatabaseCreateTable ( db , & table, TableName, kcmInit + kcmMD5, TableName ) );
+
+        VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorWrite ( table, & cursor, kcmInsert ) );
+        uint32_t column_idx;
+        REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx, "NAME" ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        for ( size_t i = 0; i < names . size (); ++ i )
+        {
+            REQUIRE_RC ( VCursorOpenRow ( cursor ) );
+            REQUIRE_RC ( VCursorWrite ( cursor, column_idx, 8, names [ i ] . c_str (), 0, names [ i ] . size () ) );
+            REQUIRE_RC ( VCursorCommitRow ( cursor ) );
+            REQUIRE_RC ( VCursorCloseRow ( cursor ) );
+        }
+
+        REQUIRE_RC ( VCursorCommit ( cursor ) );
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+        REQUIRE_RC ( VSchemaRelease ( schema ) );
+    }
+    {
+        const VTable* table;
+        REQUIRE_RC ( VDatabaseOpenTableRead ( db , & table, TableName ) );
+        const VCursor* cursor;
+        REQUIRE_RC ( VTableCreateCursorRead ( table, & cursor ) );
+        uint32_t column_idx;
+        REQUIRE_RC ( VCursorAddColumn ( cursor, & column_idx, "NAME" ) );
+        REQUIRE_RC ( VCursorOpen ( cursor ) );
+
+        for ( size_t i = 0; i < names . size (); ++ i )
+        {
+            char buf [ 256 ];
+            uint32_t row_len;
+            REQUIRE_RC ( VCursorReadDirect ( cursor, i + 1, column_idx, 8, buf, sizeof buf, & row_len ) );
+            REQUIRE_EQ ( names [ i ], string ( buf, row_len ) );
+        }
+
+        REQUIRE_RC ( VCursorRelease ( cursor ) );
+        REQUIRE_RC ( VTableRelease ( table ) );
+    }
+    REQUIRE_RC ( VDatabaseRelease ( db ) );
+}
+
 //////////////////////////////////////////// Main
 extern "C"
 {
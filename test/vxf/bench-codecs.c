@@ -0,0 +1,654 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/*
+ * benchmark: every encode/decode pair of vxf and sraxf, run through its
+ * physical encoding on a scratch table, over synthetic corpora and over
+ * any captured blobs named on the command line ( read as bytes )
+ *
+ *  make bench-codecs && $(TEST_BINDIR)/bench-codecs [ blob-file ... ]
+ *
+ * prints one tab-separated line per codec and corpus:
+ *  codec corpus elems raw_bytes stored_bytes ratio
+ *  enc_MBps dec_MBps enc_cyc_elem dec_cyc_elem check
+ *
+ * the "none" lines store the corpus as-is, and give the cost of the
+ * table and cursor machinery that every other line carries as well
+ */
+
+#include <kapp/main.h>
+#include <kapp/args.h>
+#include <klib/rc.h>
+#include <kfs/directory.h>
+#include <kdb/manager.h>
+#include <vdb/manager.h>
+#include <vdb/schema.h>
+#include <vdb/table.h>
+#include <vdb/cursor.h>
+#include <vdb/blob.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined __x86_64__ || defined __i386__
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define CORPUS_BYTES ( 8 * 1024 * 1024 )
+#define MIN_DECODE_SECS 0.25
+#define MAX_DECODE_ROUNDS 20
+#define SCRATCH "bench-codecs.tbl"
+
+static double now ( void )
+{
+    struct timespec ts;
+    clock_gettime ( CLOCK_MONOTONIC, & ts );
+    return ts . tv_sec + ts . tv_nsec * 1e-9;
+}
+
+static uint64_t cycles ( void )
+{
+#if HAVE_TSC
+    return __rdtsc ();
+#else
+    return 0;
+#endif
+}
+
+/*--------------------------------------------------------------------------
+ * corpora
+ */
+typedef struct Corpus Corpus;
+struct Corpus
+{
+    const char *name;
+    uint8_t *data;
+    uint32_t *row_len;
+    uint64_t bytes;
+    uint32_t rows;
+    uint32_t elem_bits;
+};
+
+/* xorshift: all of its bits are usable */
+static uint32_t seed = 12345;
+
+static uint32_t rnd ( void )
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static bool CorpusAlloc ( Corpus *c, const char *name, uint32_t elem_bits, uint32_t max_rows )
+{
+    c -> name = name;
+    c -> elem_bits = elem_bits;
+    c -> bytes = 0;
+    c -> rows = 0;
+    c -> data = malloc ( CORPUS_BYTES + 4096 );
+    c -> row_len = malloc ( sizeof c -> row_len [ 0 ] * max_rows );
+    return c -> data != NULL && c -> row_len != NULL;
+}
+
+/* rows of "len" elements that the caller filled at the end of the data */
+static void CorpusAddRow ( Corpus *c, uint32_t len )
+{
+    c -> row_len [ c -> rows ++ ] = len;
+    c -> bytes += ( uint64_t ) len * c -> elem_bits / 8;
+}
+
+static bool CorpusFull ( const Corpus *c, uint32_t next_bytes )
+{
+    return c -> bytes + next_bytes > CORPUS_BYTES;
+}
+
+/* Illumina style spot names */
+static bool MakeNames ( Corpus *c )
+{
+    uint32_t tile = 1101, x = 1000;
+    if ( ! CorpusAlloc ( c, "names", 8, CORPUS_BYTES / 16 ) )
+        return false;
+    while ( ! CorpusFull ( c, 64 ) )
+    {
+        char *p = ( char* ) c -> data + c -> bytes;
+        if ( c -> rows % 4000 == 0 )
+        {
+            ++ tile;
+            x = 1000;
+        }
+        x += rnd () % 3;
+        CorpusAddRow ( c, sprintf ( p, "HWI-ST1234:8:%u:%u:%u#0/1", tile, x, 1000 + rnd () % 20000 ) );
+    }
+    return true;
+}
+
+/* binned phred scores that fall off towards the end of each read */
+static bool MakePhred ( Corpus *c )
+{
+    static const uint8_t bins [] = { 37, 37, 37, 33, 27, 22, 12, 2 };
+    if ( ! CorpusAlloc ( c, "phred", 8, CORPUS_BYTES / 150 ) )
+        return false;
+    while ( ! CorpusFull ( c, 150 ) )
+    {
+        uint8_t *p = c -> data + c -> bytes;
+        uint32_t i;
+        for ( i = 0; i < 150; ++ i )
+        {
+            uint32_t b = rnd () % 4 + ( i > 100 ? ( i - 100 ) / 12 : 0 );
+            p [ i ] = bins [ b < 8 ? b : 7 ];
+        }
+        CorpusAddRow ( c, 150 );
+    }
+    return true;
+}
+
+/* bases as 2na values */
+static bool MakeBases ( Corpus *c )
+{
+    if ( ! CorpusAlloc ( c, "bases", 8, CORPUS_BYTES / 150 ) )
+        return false;
+    while ( ! CorpusFull ( c, 150 ) )
+    {
+        uint8_t *p = c -> data + c -> bytes;
+        uint32_t i;
+        for ( i = 0; i < 150; ++ i )
+            p [ i ] = ( uint8_t ) ( rnd () & 3 );
+        CorpusAddRow ( c, 150 );
+    }
+    return true;
+}
+
+/* long runs of a few byte values */
+static bool MakeRuns ( Corpus *c )
+{
+    uint8_t v = 0;
+    if ( ! CorpusAlloc ( c, "runs", 8, CORPUS_BYTES / 64 ) )
+        return false;
+    while ( ! CorpusFull ( c, 64 ) )
+    {
+        uint8_t *p = c -> data + c -> bytes;
+        uint32_t i;
+        for ( i = 0; i < 64; ++ i )
+        {
+            if ( rnd () % 50 == 0 )
+                v = ( uint8_t ) ( rnd () & 1 );
+            p [ i ] = v;
+        }
+        CorpusAddRow ( c, 64 );
+    }
+    return true;
+}
+
+/* ascending alignment positions */
+static bool MakePositions ( Corpus *c )
+{
+    uint32_t pos = 10000;
+    if ( ! CorpusAlloc ( c, "positions", 32, CORPUS_BYTES / 256 ) )
+        return false;
+    while ( ! CorpusFull ( c, 256 ) )
+    {
+        uint32_t *p = ( uint32_t* ) ( c -> data + c -> bytes );
+        uint32_t i;
+        for ( i = 0; i < 64; ++ i )
+            p [ i ] = pos += rnd () % 300;
+        CorpusAddRow ( c, 64 );
+    }
+    return true;
+}
+
+/* small counts */
+static bool MakeCounts ( Corpus *c )
+{
+    if ( ! CorpusAlloc ( c, "counts", 32, CORPUS_BYTES / 256 ) )
+        return false;
+    while ( ! CorpusFull ( c, 256 ) )
+    {
+        uint32_t *p = ( uint32_t* ) ( c -> data + c -> bytes );
+        uint32_t i;
+        for ( i = 0; i < 64; ++ i )
+            p [ i ] = rnd () % 1000;
+        CorpusAddRow ( c, 64 );
+    }
+    return true;
+}
+
+/* smooth signal intensities */
+static bool MakeSignal ( Corpus *c )
+{
+    float v = 100;
+    if ( ! CorpusAlloc ( c, "signal", 32, CORPUS_BYTES / 256 ) )
+        return false;
+    while ( ! CorpusFull ( c, 256 ) )
+    {
+        float *p = ( float* ) ( c -> data + c -> bytes );
+        uint32_t i;
+        for ( i = 0; i < 64; ++ i )
+        {
+            v += ( float ) ( ( int ) ( rnd () % 2001 ) - 1000 ) / 100;
+            p [ i ] = v;
+        }
+        CorpusAddRow ( c, 64 );
+    }
+    return true;
+}
+
+/* 4-channel log-odds, the called base high and the others low */
+static bool MakeQual4 ( Corpus *c )
+{
+    if ( ! CorpusAlloc ( c, "qual4", 32, CORPUS_BYTES / 144 ) )
+        return false;
+    while ( ! CorpusFull ( c, 144 ) )
+    {
+        int8_t *p = ( int8_t* ) ( c -> data + c -> bytes );
+        uint32_t i;
+        for ( i = 0; i < 36; ++ i )
+        {
+            p [ i * 4 ] = ( int8_t ) ( 10 + rnd () % 30 );
+            p [ i * 4 + 1 ] = p [ i * 4 + 2 ] = p [ i * 4 + 3 ] = ( int8_t ) ( -5 - ( int ) ( rnd () % 3 ) );
+        }
+        CorpusAddRow ( c, 36 );
+    }
+    return true;
+}
+
+/* a captured blob, as bytes in rows of 256 */
+static bool ReadCaptured ( Corpus *c, const char *path )
+{
+    size_t n;
+    FILE *f = fopen ( path, "rb" );
+    if ( f == NULL )
+        return false;
+    if ( ! CorpusAlloc ( c, path, 8, CORPUS_BYTES / 256 + 1 ) )
+    {
+        fclose ( f );
+        return false;
+    }
+    n = fread ( c -> data, 1, CORPUS_BYTES, f );
+    fclose ( f );
+    while ( c -> bytes < n )
+        CorpusAddRow ( c, n - c -> bytes < 256 ? ( uint32_t ) ( n - c -> bytes ) : 256 );
+    return n != 0;
+}
+
+static void CorpusWhack ( Corpus *c )
+{
+    free ( c -> data );
+    free ( c -> row_len );
+}
+
+/*--------------------------------------------------------------------------
+ * codecs
+ *  "column" is the column declaration; "corpora" names the corpora it
+ *  suits, where "bytes" stands for the captured blobs as well
+ */
+typedef struct Codec Codec;
+struct Codec
+{
+    const char *name;
+    const char *column;
+    const char *corpora;
+};
+
+static const Codec codecs [] =
+{
+    { "none", "column U8 DATA", "names phred bases runs bytes" },
+    { "none", "column U32 DATA", "positions counts" },
+    { "none", "column F32 DATA", "signal" },
+    { "zip", "column < U8 > zip_encoding DATA", "names phred bases runs bytes" },
+    { "zip", "column < U32 > zip_encoding DATA", "positions counts" },
+    { "zip", "column < F32 > zip_encoding DATA", "signal" },
+    { "zip-best", "column < U8 > zip_encoding < Z_DEFAULT_STRATEGY, Z_BEST_COMPRESSION > DATA", "names phred bytes" },
+    { "bzip", "column < U8 > bzip_encoding DATA", "names phred bytes" },
+    { "zstd", "column < U8 > zstd_encoding DATA", "names phred bases runs bytes" },
+    { "zstd", "column < U32 > zstd_encoding DATA", "positions counts" },
+    { "zstd-19", "column < U8 > zstd_encoding < 19 > DATA", "names phred bytes" },
+    { "azip", "column < U8 > azip_encoding DATA", "names phred bases runs bytes" },
+    { "azip", "column < U32 > azip_encoding DATA", "positions counts" },
+    { "izip", "column < U32 > izip_encoding DATA", "positions counts" },
+    { "delta-izip", "column < I32 > delta_izip_encoding DATA", "positions" },
+    { "delta-zip", "column < I32 > delta_zip_encoding DATA", "positions" },
+    { "fzip", "column < F32 > fzip_encoding < 24 > DATA", "signal" },
+    { "rle", "column < U8 > bench_rle_encoding DATA", "runs" },
+    { "pack", "column bench_pack2_encoding DATA", "bases" },
+    { "bool", "column bool_encoding DATA", "runs" },
+    { "qual4", "column NCBI:SRA:qual4_encoding DATA", "qual4" },
+    { "qual_rans", "column INSDC:SRA:qual_rans_encoding DATA", "phred" },
+    { "spot_name", "column INSDC:SRA:spot_name_encoding DATA", "names" }
+};
+
+static const char schema_head [] =
+    "include 'vdb/vdb.vschema';"
+    "include 'insdc/sra.vschema';"
+    "include 'sra/illumina.vschema';"
+    /* rlencode and pack have no encoding of their own */
+    "physical < type T > T bench_rle_encoding #1"
+    "{"
+    "    decode { return rldecode ( @ ); }"
+    "    encode { return rlencode ( @ ); }"
+    "};"
+    "physical U8 bench_pack2_encoding #1"
+    "{"
+    "    decode { B1 [ 2 ] p = @; return ( U8 ) unpack ( p ); }"
+    "    encode { B1 [ 2 ] p = pack ( @ ); return p; }"
+    "};";
+
+static bool suits ( const Codec *codec, const Corpus *c, bool captured )
+{
+    const char *name = captured ? "bytes" : c -> name;
+    size_t len = strlen ( name );
+    const char *p = codec -> corpora;
+    while ( ( p = strstr ( p, name ) ) != NULL )
+    {
+        if ( ( p == codec -> corpora || p [ -1 ] == ' ' ) && ( p [ len ] == 0 || p [ len ] == ' ' ) )
+            return true;
+        p += len;
+    }
+    return false;
+}
+
+/*--------------------------------------------------------------------------
+ * runs
+ */
+typedef struct Result Result;
+struct Result
+{
+    double enc_secs, dec_secs;
+    uint64_t enc_cycles, dec_cycles;
+    uint64_t stored;
+    bool verified;
+};
+
+static rc_t encode ( VDBManager *mgr, const VSchema *schema, const Corpus *c, Result *r )
+{
+    VTable *tbl;
+    double t0 = now ();
+    uint64_t c0 = cycles ();
+    rc_t rc = VDBManagerCreateTable ( mgr, & tbl, schema, "bench_tbl", kcmInit + kcmParents, SCRATCH );
+    if ( rc == 0 )
+    {
+        VCursor *curs;
+        rc = VTableCreateCursorWrite ( tbl, & curs, kcmInsert );
+        if ( rc == 0 )
+        {
+            uint32_t idx;
+            rc = VCursorAddColumn ( curs, & idx, "DATA" );
+            if ( rc == 0 )
+                rc = VCursorOpen ( curs );
+            if ( rc == 0 )
+            {
+                uint64_t off = 0;
+                uint32_t i;
+                for ( i = 0; rc == 0 && i < c -> rows; ++ i )
+                {
+                    rc = VCursorOpenRow ( curs );
+                    if ( rc == 0 )
+                        rc = VCursorWrite ( curs, idx, c -> elem_bits, c -> data + off, 0, c -> row_len [ i ] );
+                    if ( rc == 0 )
+                        rc = VCursorCommitRow ( curs );
+                    if ( rc == 0 )
+                        rc = VCursorCloseRow ( curs );
+                    off += ( uint64_t ) c -> row_len [ i ] * c -> elem_bits / 8;
+                }
+                if ( rc == 0 )
+                    rc = VCursorCommit ( curs );
+            }
+            VCursorRelease ( curs );
+        }
+        VTableRelease ( tbl );
+    }
+    r -> enc_cycles = cycles () - c0;
+    r -> enc_secs = now () - t0;
+    return rc;
+}
+
+/* decode every blob of the column, as a reader that wants all of it */
+static rc_t decode_round ( const VDBManager *mgr, const Corpus *c )
+{
+    const VTable *tbl;
+    rc_t rc = VDBManagerOpenTableRead ( mgr, & tbl, NULL, SCRATCH );
+    if ( rc == 0 )
+    {
+        const VCursor *curs;
+        rc = VTableCreateCursorRead ( tbl, & curs );
+        if ( rc == 0 )
+        {
+            uint32_t idx;
+            rc = VCursorAddColumn ( curs, & idx, "DATA" );
+            if ( rc == 0 )
+                rc = VCursorOpen ( curs );
+            if ( rc == 0 )
+            {
+                int64_t row = 1;
+                while ( rc == 0 && row <= ( int64_t ) c -> rows )
+                {
+                    const VBlob *blob;
+                    rc = VCursorGetBlobDirect ( curs, & blob, row, idx );
+                    if ( rc == 0 )
+                    {
+                        int64_t first;
+                        uint64_t count;
+                        rc = VBlobIdRange ( blob, & first, & count );
+                        if ( rc == 0 )
+                            row = first + ( int64_t ) count;
+                        VBlobRelease ( blob );
+                    }
+                }
+            }
+            VCursorRelease ( curs );
+        }
+        VTableRelease ( tbl );
+    }
+    return rc;
+}
+
+static rc_t verify ( const VDBManager *mgr, const Corpus *c, bool *ok )
+{
+    const VTable *tbl;
+    rc_t rc = VDBManagerOpenTableRead ( mgr, & tbl, NULL, SCRATCH );
+    * ok = false;
+    if ( rc == 0 )
+    {
+        const VCursor *curs;
+        rc = VTableCreateCursorRead ( tbl, & curs );
+        if ( rc == 0 )
+        {
+            uint32_t idx;
+            rc = VCursorAddColumn ( curs, & idx, "DATA" );
+            if ( rc == 0 )
+                rc = VCursorOpen ( curs );
+            if ( rc == 0 )
+            {
+                uint64_t off = 0;
+                uint32_t i;
+                * ok = true;
+                for ( i = 0; rc == 0 && * ok && i < c -> rows; ++ i )
+                {
+                    uint32_t elem_bits, boff, row_len;
+                    const void *base;
+                    size_t const bytes = ( size_t ) c -> row_len [ i ] * c -> elem_bits / 8;
+                    rc = VCursorCellDataDirect ( curs, i + 1, idx, & elem_bits, & base, & boff, & row_len );
+                    if ( rc == 0 )
+                    {
+                        * ok = boff == 0 && ( uint64_t ) elem_bits * row_len == ( uint64_t ) bytes * 8 &&
+                            memcmp ( base, c -> data + off, bytes ) == 0;
+                    }
+                    off += bytes;
+                }
+            }
+            VCursorRelease ( curs );
+        }
+        VTableRelease ( tbl );
+    }
+    return rc;
+}
+
+static rc_t run ( VDBManager *mgr, KDirectory *wd, const Codec *codec, const Corpus *c, Result *r )
+{
+    VSchema *schema;
+    rc_t rc = VDBManagerMakeSchema ( mgr, & schema );
+    if ( rc == 0 )
+    {
+        char text [ 4096 ];
+        int len = snprintf ( text, sizeof text, "%stable bench_tbl #1 { %s; };", schema_head, codec -> column );
+
+        rc = VSchemaAddIncludePath ( schema, "../../interfaces" );
+        if ( rc == 0 )
+            rc = VSchemaParseText ( schema, NULL, text, len );
+        if ( rc == 0 )
+            rc = encode ( mgr, schema, c, r );
+        VSchemaRelease ( schema );
+    }
+
+    if ( rc == 0 )
+        rc = KDirectoryFileSize ( wd, & r -> stored, "%s/col/DATA/data", SCRATCH );
+
+    if ( rc == 0 )
+    {
+        /* best of a few rounds */
+        double total = 0;
+        int rounds = 0;
+        r -> dec_secs = 1e30;
+        while ( rc == 0 && rounds < MAX_DECODE_ROUNDS && ( rounds < 3 || total < MIN_DECODE_SECS ) )
+        {
+            double t0 = now (), t;
+            uint64_t c0 = cycles ();
+            rc = decode_round ( mgr, c );
+            t = now () - t0;
+            if ( t < r -> dec_secs )
+            {
+                r -> dec_secs = t;
+                r -> dec_cycles = cycles () - c0;
+            }
+            total += t;
+            ++ rounds;
+        }
+    }
+
+    if ( rc == 0 )
+        rc = verify ( mgr, c, & r -> verified );
+
+    KDirectoryRemove ( wd, true, SCRATCH );
+    return rc;
+}
+
+static void report ( const Codec *codec, const Corpus *c, const Result *r )
+{
+    uint64_t const elems = c -> bytes * 8 / c -> elem_bits;
+    printf ( "%s\t%s\t%lu\t%lu\t%lu\t%.4f\t%.1f\t%.1f\t",
+        codec -> name, c -> name, elems, c -> bytes, r -> stored,
+        ( double ) r -> stored / c -> bytes,
+        c -> bytes / r -> enc_secs / 1e6, c -> bytes / r -> dec_secs / 1e6 );
+#if HAVE_TSC
+    printf ( "%.2f\t%.2f\t", ( double ) r -> enc_cycles / elems, ( double ) r -> dec_cycles / elems );
+#else
+    printf ( "NA\tNA\t" );
+#endif
+    printf ( "%s\n", r -> verified ? "ok" : "MISMATCH" );
+    fflush ( stdout );
+}
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary ( const char * progname )
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "bench-codecs";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    static bool ( * const makers [] ) ( Corpus* ) =
+    {
+        MakeNames, MakePhred, MakeBases, MakeRuns,
+        MakePositions, MakeCounts, MakeSignal, MakeQual4
+    };
+    size_t const nmakers = sizeof makers / sizeof makers [ 0 ];
+    size_t const ncodecs = sizeof codecs / sizeof codecs [ 0 ];
+
+    KDirectory *wd;
+    VDBManager *mgr;
+    size_t i, k;
+    int failed = 0;
+
+    rc_t rc = KDirectoryNativeDir ( & wd );
+    if ( rc == 0 )
+        rc = VDBManagerMakeUpdate ( & mgr, wd );
+    if ( rc != 0 )
+        return rc;
+
+    printf ( "codec\tcorpus\telems\traw_bytes\tstored_bytes\tratio\t"
+             "enc_MBps\tdec_MBps\tenc_cyc_elem\tdec_cyc_elem\tcheck\n" );
+
+    for ( i = 0; i < nmakers + ( size_t ) ( argc - 1 ); ++ i )
+    {
+        Corpus c;
+        bool const captured = i >= nmakers;
+        bool made = captured ? ReadCaptured ( & c, argv [ i - nmakers + 1 ] ) : makers [ i ] ( & c );
+        if ( ! made )
+        {
+            fprintf ( stderr, "corpus %zu: cannot be made\n", i );
+            ++ failed;
+            continue;
+        }
+
+        for ( k = 0; k < ncodecs; ++ k )
+        {
+            Result r;
+            if ( ! suits ( & codecs [ k ], & c, captured ) )
+                continue;
+            memset ( & r, 0, sizeof r );
+            rc = run ( mgr, wd, & codecs [ k ], & c, & r );
+            if ( rc != 0 )
+            {
+                fprintf ( stderr, "%s %s: rc %u\n", codecs [ k ] . name, c . name, rc );
+                ++ failed;
+            }
+            else
+            {
+                report ( & codecs [ k ], & c, & r );
+                failed += ! r . verified;
+            }
+        }
+        CorpusWhack ( & c );
+    }
+
+    VDBManagerRelease ( mgr );
+    KDirectoryRelease ( wd );
+    return failed == 0 ? 0 : RC ( rcExe, rcData, rcValidating, rcData, rcCorrupt );
+}
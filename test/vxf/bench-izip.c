@@ -0,0 +1,226 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/*
+ * microbenchmark: the izip/irzip decoding kernels against the scalar
+ * loops they replace, then whole irzip decodes of representative blobs
+ *
+ *  make bench-izip && $(TEST_BINDIR)/bench-izip
+ */
+
+#include <kapp/main.h>
+#include <kapp/args.h>
+#include <klib/rc.h>
+
+#include "../../libs/vxf/izip-vec.h"
+#include "../../libs/vxf/prefix-sum.h"
+#include "wb-irzip-impl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOB_ELEMS 16384
+#define ROUNDS 5000
+
+static double now ( void )
+{
+    struct timespec ts;
+    clock_gettime ( CLOCK_MONOTONIC, & ts );
+    return ts . tv_sec + ts . tv_nsec * 1e-9;
+}
+
+/* keep the compiler from discarding or merging repeated calls */
+#define CLOBBER( p ) __asm__ volatile ( "" : : "r" ( p ) : "memory" )
+
+#define TIME( elapsed, stmt )                                           \
+{                                                                       \
+    double t0 = now ();                                                 \
+    int r;                                                              \
+    for ( r = 0; r < ROUNDS; ++ r )                                     \
+    {                                                                   \
+        stmt;                                                           \
+    }                                                                   \
+    elapsed = now () - t0;                                              \
+}
+
+static void report ( const char *what, double scalar, double vector )
+{
+    printf ( "%-22s %8.3f %8.3f %7.2fx\n", what,
+        scalar * 1e9 / ROUNDS / BLOB_ELEMS,
+        vector * 1e9 / ROUNDS / BLOB_ELEMS,
+        scalar / vector );
+}
+
+/* the loops as they were in iunzip.c and irzip.impl.h */
+static void scalar_widen_u16 ( int64_t *raw, unsigned count, int64_t min )
+{
+    const uint16_t *u16 = ( const uint16_t* ) raw;
+    unsigned i;
+    for ( i = count; i; -- i )
+        raw [ i - 1 ] = u16 [ i - 1 ] + min;
+    CLOBBER ( raw );
+}
+
+static void scalar_merge_u32 ( uint32_t *Y, const uint8_t *planes, unsigned N )
+{
+    unsigned i, k;
+    for ( i = 0; i != N; ++ i )
+        Y [ i ] = planes [ i ];
+    for ( k = 1; k != 4; ++ k )
+    {
+        CLOBBER ( Y );
+        for ( i = 0; i != N; ++ i )
+            Y [ i ] |= ( ( uint32_t ) planes [ k * N + i ] ) << ( 8 * k );
+    }
+}
+
+static void scalar_delta_both_i32 ( int32_t *Y, unsigned N )
+{
+    unsigned i;
+    for ( i = 1; i != N; ++ i )
+    {
+        uint32_t val = ( uint32_t ) Y [ i ];
+        val >>= 1;
+        if ( Y [ i ] & 1 ) Y [ i ] = Y [ i - 1 ] - val;
+        else               Y [ i ] = Y [ i - 1 ] + val;
+    }
+}
+
+static void vector_delta_both_i32 ( int32_t *Y, unsigned N )
+{
+    unsigned i;
+    for ( i = 1; i != N; ++ i )
+    {
+        uint32_t const neg = 0 - ( ( uint32_t ) Y [ i ] & 1 );
+        uint32_t const val = ( uint32_t ) Y [ i ] >> 1;
+        Y [ i ] = ( int32_t ) ( ( val ^ neg ) - neg );
+    }
+    vxf_prefix_sum_i32 ( Y, Y, N, false );
+}
+
+static void bench_kernels ( void )
+{
+    static int64_t raw [ BLOB_ELEMS ];
+    static uint8_t planes [ 4 * BLOB_ELEMS ];
+    static int32_t y32 [ BLOB_ELEMS ], deltas [ BLOB_ELEMS ];
+    double s, v;
+    unsigned i;
+
+    for ( i = 0; i < 4 * BLOB_ELEMS; ++ i )
+        planes [ i ] = ( uint8_t ) rand ();
+    for ( i = 0; i < BLOB_ELEMS; ++ i )
+        deltas [ i ] = rand () % 64;
+
+    TIME ( s, memcpy ( raw, planes, 2 * BLOB_ELEMS ); scalar_widen_u16 ( raw, BLOB_ELEMS, -3 ) );
+    TIME ( v, memcpy ( raw, planes, 2 * BLOB_ELEMS ); vxf_izip_widen_u16 ( raw, BLOB_ELEMS, -3 ); CLOBBER ( raw ) );
+    report ( "iunzip widen u16", s, v );
+
+    TIME ( s, scalar_merge_u32 ( ( uint32_t* ) y32, planes, BLOB_ELEMS ); CLOBBER ( y32 ) );
+    TIME ( v, vxf_izip_merge_planes ( y32, 4, planes, BLOB_ELEMS ); CLOBBER ( y32 ) );
+    report ( "irzip merge 4 planes", s, v );
+
+    TIME ( s, memcpy ( y32, deltas, sizeof y32 ); scalar_delta_both_i32 ( y32, BLOB_ELEMS ); CLOBBER ( y32 ) );
+    TIME ( v, memcpy ( y32, deltas, sizeof y32 ); vector_delta_both_i32 ( y32, BLOB_ELEMS ); CLOBBER ( y32 ) );
+    report ( "irzip delta both i32", s, v );
+}
+
+/* whole decodes; run the same binary built before and after a change
+   to compare them */
+static void bench_decode ( const char *what, bool wide )
+{
+    static uint32_t y32 [ BLOB_ELEMS ], x32 [ BLOB_ELEMS ];
+    static int64_t y64 [ BLOB_ELEMS ], x64 [ BLOB_ELEMS ];
+    static uint8_t enc [ 16 * BLOB_ELEMS ];
+    size_t used = 0;
+    int64_t min [ 2 ], slope [ 2 ], m [ 2 ];
+    uint8_t series = 1, planes = 0;
+    rc_t rc;
+    double t;
+    unsigned i;
+
+    if ( wide )
+    {
+        /* ids: a slope with jitter, too wide for 32 bits */
+        for ( i = 0; i < BLOB_ELEMS; ++ i )
+            y64 [ i ] = ( INT64_C ( 1 ) << 40 ) + i * 1000 + rand () % 500;
+        rc = doEncode_i64 ( enc, sizeof enc, & used, min, slope, & series, & planes, y64, BLOB_ELEMS );
+    }
+    else
+    {
+        /* positions: ascending with small gaps */
+        for ( y32 [ 0 ] = 1000, i = 1; i < BLOB_ELEMS; ++ i )
+            y32 [ i ] = y32 [ i - 1 ] + rand () % 300;
+        rc = doEncode_u32 ( enc, sizeof enc, & used, min, slope, & series, & planes, y32, BLOB_ELEMS );
+    }
+    if ( rc != 0 )
+    {
+        printf ( "%-22s encode failed\n", what );
+        return;
+    }
+
+    /* decoding advances min for sloped blobs, so each round gets a copy */
+    if ( wide )
+        TIME ( t, memcpy ( m, min, sizeof m );
+                  doDecode_i64 ( x64, BLOB_ELEMS, m, slope, series, planes, enc, used );
+                  CLOBBER ( x64 ) )
+    else
+        TIME ( t, memcpy ( m, min, sizeof m );
+                  doDecode_u32 ( x32, BLOB_ELEMS, m, slope, series, planes, enc, used );
+                  CLOBBER ( x32 ) )
+
+    printf ( "%-22s %8.3f ns/elem, %zu bytes, planes %02x\n", what,
+        t * 1e9 / ROUNDS / BLOB_ELEMS, used, planes );
+}
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary ( const char * progname )
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "bench-izip";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    printf ( "%d element blobs, ns per element\n", BLOB_ELEMS );
+    printf ( "%-22s %8s %8s %8s\n", "stage", "scalar", "vector", "speedup" );
+    bench_kernels ();
+    printf ( "\n" );
+    bench_decode ( "irzip decode u32 pos", false );
+    bench_decode ( "irzip decode i64 ids", true );
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================
+*
+*/
+
+/*
+ * microbenchmark: vectorized prefix sums against the scalar loops
+ * undelta and integral used before, on 4096 element blobs
+ *
+ *  make bench-prefix-sum && $(TEST_BINDIR)/bench-prefix-sum
+ */
+
+#include <kapp/main.h>
+#include <kapp/args.h>
+#include <klib/rc.h>
+
+#include "../../libs/vxf/prefix-sum.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOB_ELEMS 4096
+#define ROUNDS 20000
+
+static double now ( void )
+{
+    struct timespec ts;
+    clock_gettime ( CLOCK_MONOTONIC, & ts );
+    return ts . tv_sec + ts . tv_nsec * 1e-9;
+}
+
+/* keep the compiler from discarding or merging repeated calls */
+#define CLOBBER( p ) __asm__ volatile ( "" : : "r" ( p ) : "memory" )
+
+#define SCALAR( T )                                                     \
+static void scalar_ ## T ( T *dst, const T *src, uint64_t count, bool exclusive ) \
+{                                                                       \
+    uint64_t i;                                                         \
+    T prior = 0;                                                        \
+    for ( i = 0; i < count; ++ i )                                      \
+    {                                                                   \
+        if ( exclusive )                                                \
+        {                                                               \
+            dst [ i ] = prior;                                          \
+            prior += src [ i ];                                         \
+        }                                                               \
+        else                                                            \
+        {                                                               \
+            prior += src [ i ];                                         \
+            dst [ i ] = prior;                                          \
+        }                                                               \
+    }                                                                   \
+}
+
+SCALAR ( int8_t )
+SCALAR ( int16_t )
+SCALAR ( int32_t )
+SCALAR ( int64_t )
+
+#define BENCH( T, VEC )                                                 \
+{                                                                       \
+    static T src [ BLOB_ELEMS ], dst [ BLOB_ELEMS ];                    \
+    double t0, t1, t2;                                                  \
+    int r, i, exclusive;                                                \
+    for ( i = 0; i < BLOB_ELEMS; ++ i )                                 \
+        src [ i ] = ( T ) ( rand () % 64 );                             \
+    for ( exclusive = 0; exclusive < 2; ++ exclusive )                  \
+    {                                                                   \
+        t0 = now ();                                                    \
+        for ( r = 0; r < ROUNDS; ++ r )                                 \
+        {                                                               \
+            scalar_ ## T ( dst, src, BLOB_ELEMS, exclusive );           \
+            CLOBBER ( dst );                                            \
+        }                                                               \
+        t1 = now ();                                                    \
+        for ( r = 0; r < ROUNDS; ++ r )                                 \
+        {                                                               \
+            VEC ( dst, src, BLOB_ELEMS, exclusive );                    \
+            CLOBBER ( dst );                                            \
+        }                                                               \
+        t2 = now ();                                                    \
+        printf ( "%-8s %-10s %8.3f %8.3f %7.2fx\n", #T,                 \
+            exclusive ? "integral_0" : "undelta",                       \
+            ( t1 - t0 ) * 1e9 / ROUNDS / BLOB_ELEMS,                    \
+            ( t2 - t1 ) * 1e9 / ROUNDS / BLOB_ELEMS,                    \
+            ( t1 - t0 ) / ( t2 - t1 ) );                                \
+    }                                                                   \
+}
+
+ver_t CC KAppVersion ( void )
+{
+    return 0x1000000;
+}
+
+rc_t CC UsageSummary ( const char * progname )
+{
+    return 0;
+}
+
+rc_t CC Usage ( const Args * args )
+{
+    return 0;
+}
+
+const char UsageDefaultName[] = "bench-prefix-sum";
+
+rc_t CC KMain ( int argc, char *argv [] )
+{
+    printf ( "%d element blobs, ns per element\n", BLOB_ELEMS );
+    printf ( "%-8s %-10s %8s %8s %8s\n", "type", "transform", "scalar", "vector", "speedup" );
+    BENCH ( int8_t, vxf_prefix_sum_i8 )
+    BENCH ( int16_t, vxf_prefix_sum_i16 )
+    BENCH ( int32_t, vxf_prefix_sum_i32 )
+    BENCH ( int64_t, vxf_prefix_sum_i64 )
+    return 0;
+}
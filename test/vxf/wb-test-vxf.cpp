@@ -29,6 +29,14 @@
 TEST_SUITE(VxfTestSuite);
 
 #include "wb-irzip-impl.h"
+#include "../../libs/vxf/raw-inflate.h"
+#include "../../libs/vxf/prefix-sum.h"
+#include "../../libs/vxf/izip-vec.h"
+
+#include <zlib.h>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
 
 ////////////////////////////////////////// IZIP encoding tests
 
@@ -235,6 +243,196 @@ FIXTURE_TEST_CASE(IRZIP_i32_assert1, EncoderFixture)
     REQUIRE_EQ_ARR(y, decoded, ARR_SIZE(y));
 }
 
+////////////////////////////////////////// raw inflate tests
+
+class RawInflateFixture
+{
+public:
+    // compress with zlib as the zip transform does
+    std::vector<uint8_t> Deflate(const std::vector<uint8_t> &src, int level, int strategy)
+    {
+        std::vector<uint8_t> dst(compressBound(src.size()) + 64);
+        z_stream s;
+        memset(&s, 0, sizeof s);
+        if (deflateInit2(&s, level, Z_DEFLATED, -15, 9, strategy) != Z_OK)
+            throw std::logic_error("deflateInit2 failed");
+        s.next_in = (Bytef *)&src[0];
+        s.avail_in = (uInt)src.size();
+        s.next_out = &dst[0];
+        s.avail_out = (uInt)dst.size();
+        int zr = deflate(&s, Z_FINISH);
+        deflateEnd(&s);
+        if (zr != Z_STREAM_END)
+            throw std::logic_error("deflate failed");
+        dst.resize(s.total_out);
+        return dst;
+    }
+
+    // repetitive text with some noise, to exercise long matches and literals
+    std::vector<uint8_t> Sample(size_t size, unsigned seed)
+    {
+        static const char words[] = "ACGTNACGGTTAACCGGTTNNNNACGTACGTAAAAAAAAAAAAAAAAAAAA";
+        std::vector<uint8_t> v(size);
+        for (size_t i = 0; i < size; ++i) {
+            seed = seed * 1103515245 + 12345;
+            v[i] = (seed >> 24) < 16 ? (uint8_t)(seed >> 16) : (uint8_t)words[(i + (seed >> 28)) % (sizeof words - 1)];
+        }
+        return v;
+    }
+
+    void RoundTrip(const std::vector<uint8_t> &src, int level, int strategy)
+    {
+        std::vector<uint8_t> z = Deflate(src, level, strategy);
+        std::vector<uint8_t> out(src.size() + 1);
+        size_t dused = 0, sused = 0;
+        if (!vxf_raw_inflate(&out[0], out.size(), &dused, &z[0], z.size(), &sused))
+            throw std::logic_error("vxf_raw_inflate failed");
+        if (dused != src.size() || sused != z.size() || memcmp(&out[0], &src[0], dused) != 0)
+            throw std::logic_error("vxf_raw_inflate mismatch");
+    }
+};
+
+FIXTURE_TEST_CASE(RawInflate_MatchesZlib, RawInflateFixture)
+{
+    static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_FIXED, Z_HUFFMAN_ONLY, Z_RLE };
+    static const size_t sizes[] = { 1, 7, 100, 4096, 70000, 1000000 };
+    for (size_t i = 0; i < ARR_SIZE(sizes); ++i) {
+        std::vector<uint8_t> src = Sample(sizes[i], (unsigned)i);
+        RoundTrip(src, 0, Z_DEFAULT_STRATEGY);
+        for (size_t j = 0; j < ARR_SIZE(strategies); ++j) {
+            RoundTrip(src, 1, strategies[j]);
+            RoundTrip(src, 9, strategies[j]);
+        }
+    }
+}
+
+FIXTURE_TEST_CASE(RawInflate_LeavesFailuresToZlib, RawInflateFixture)
+{
+    std::vector<uint8_t> src = Sample(10000, 42);
+    std::vector<uint8_t> z = Deflate(src, 6, Z_DEFAULT_STRATEGY);
+    std::vector<uint8_t> out(src.size());
+    size_t dused, sused;
+
+    // output buffer one byte short
+    REQUIRE(!vxf_raw_inflate(&out[0], src.size() - 1, &dused, &z[0], z.size(), &sused));
+    // truncated input
+    REQUIRE(!vxf_raw_inflate(&out[0], out.size(), &dused, &z[0], z.size() / 2, &sused));
+    // reserved block type
+    uint8_t bad[16] = { 0x07 };
+    REQUIRE(!vxf_raw_inflate(&out[0], out.size(), &dused, bad, sizeof bad, &sused));
+}
+
+////////////////////////////////////////// prefix sums
+
+// the loops undelta and integral used before vectorizing
+template < typename T >
+static void ScalarPrefixSum(T *dst, const T *src, uint64_t count, bool exclusive)
+{
+    T prior = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        T cur = src[i];
+        if (exclusive) {
+            dst[i] = prior;
+            prior += cur;
+        }
+        else {
+            prior += cur;
+            dst[i] = prior;
+        }
+    }
+}
+
+template < typename T >
+static bool CheckPrefixSum(void (*sum)(T *, const T *, uint64_t, bool))
+{
+    std::vector<T> src(1000), expected(1000), actual(1000);
+    uint64_t seed = 17;
+    for (size_t i = 0; i < src.size(); ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        src[i] = (T)(seed >> 17); // large values, so the sums wrap
+    }
+    // every length up to a few vectors, then one long run
+    std::vector<uint64_t> counts;
+    for (uint64_t count = 0; count <= 70; ++count)
+        counts.push_back(count);
+    counts.push_back(src.size());
+
+    for (size_t c = 0; c < counts.size(); ++c) {
+        uint64_t count = counts[c];
+        for (int exclusive = 0; exclusive < 2; ++exclusive) {
+            ScalarPrefixSum(&expected[0], &src[0], count, exclusive != 0);
+            sum(&actual[0], &src[0], count, exclusive != 0);
+            if (memcmp(&expected[0], &actual[0], count * sizeof(T)) != 0)
+                return false;
+            // in place
+            actual = src;
+            sum(&actual[0], &actual[0], count, exclusive != 0);
+            if (memcmp(&expected[0], &actual[0], count * sizeof(T)) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE(PrefixSum_MatchesScalar)
+{
+    REQUIRE(CheckPrefixSum<int8_t>(vxf_prefix_sum_i8));
+    REQUIRE(CheckPrefixSum<int16_t>(vxf_prefix_sum_i16));
+    REQUIRE(CheckPrefixSum<int32_t>(vxf_prefix_sum_i32));
+    REQUIRE(CheckPrefixSum<int64_t>(vxf_prefix_sum_i64));
+}
+
+//////////////////////////////////////////// izip decoding kernels
+
+TEST_CASE(IzipVec_Widen)
+{
+    // in place, over lengths around the vector widths
+    for (unsigned count = 0; count <= 40; ++count) {
+        std::vector<int64_t> buf(count + 1);
+        uint8_t *u8 = (uint8_t *)&buf[0];
+        uint16_t *u16 = (uint16_t *)&buf[0];
+        uint32_t *u32 = (uint32_t *)&buf[0];
+
+        for (unsigned i = 0; i < count; ++i) u8[i] = (uint8_t)(0xF0 + i);
+        vxf_izip_widen_u8(&buf[0], count, -100);
+        for (unsigned i = 0; i < count; ++i) REQUIRE_EQ(buf[i], (int64_t)(uint8_t)(0xF0 + i) - 100);
+
+        for (unsigned i = 0; i < count; ++i) u16[i] = (uint16_t)(0xFFF0 + i);
+        vxf_izip_widen_u16(&buf[0], count, 7);
+        for (unsigned i = 0; i < count; ++i) REQUIRE_EQ(buf[i], (int64_t)(uint16_t)(0xFFF0 + i) + 7);
+
+        for (unsigned i = 0; i < count; ++i) u32[i] = 0xFFFFFFF0u + i;
+        vxf_izip_widen_u32(&buf[0], count, INT64_C(1) << 40);
+        for (unsigned i = 0; i < count; ++i) REQUIRE_EQ(buf[i], (int64_t)(uint32_t)(0xFFFFFFF0u + i) + (INT64_C(1) << 40));
+    }
+}
+
+TEST_CASE(IzipVec_MergePlanes)
+{
+    const unsigned count = 37;
+    std::vector<uint8_t> planes(8 * count);
+    for (size_t i = 0; i < planes.size(); ++i)
+        planes[i] = (uint8_t)(i * 151 + 3);
+
+    for (unsigned width = 1; width <= 8; width <<= 1) {
+        std::vector<uint64_t> merged(count);
+        vxf_izip_merge_planes(&merged[0], width, &planes[0], count);
+        for (unsigned i = 0; i < count; ++i) {
+            uint64_t expected = 0;
+            uint64_t actual = 0;
+            for (unsigned p = 0; p < width; ++p)
+                expected |= (uint64_t)planes[p * count + i] << (8 * p);
+            switch (width) {
+            case 1: actual = ((uint8_t *)&merged[0])[i]; break;
+            case 2: actual = ((uint16_t *)&merged[0])[i]; break;
+            case 4: actual = ((uint32_t *)&merged[0])[i]; break;
+            case 8: actual = merged[i]; break;
+            }
+            REQUIRE_EQ(actual, expected);
+        }
+    }
+}
+
 //////////////////////////////////////////// Main
 extern "C"
 {